@@ -33,8 +33,10 @@
 #include <QCommandLineParser>
 #include <QCommandLineOption>
 #include <QDaemonLog>
+#include <QDaemonApplication>
 
 const quint16 TcpServer::defaultPort = 5890;
+const QString TcpServer::listenerName = QStringLiteral("listener");
 
 TcpServer::TcpServer(QObject * parent)
     : QTcpServer(parent)
@@ -60,8 +62,12 @@ void TcpServer::start(const QStringList & arguments)
             port = portOptionValue;
     }
 
-    // Start the TCP server
-    if (!listen(QHostAddress::Any, port))  {
+    // Start the TCP server, reusing the listening socket of the previous instance when upgrading,
+    // or the one passed by systemd when installed with --socket listener=<port>
+    qintptr descriptor = QDaemonApplication::inheritedDescriptor(listenerName);
+    if (descriptor < 0 && QDaemonApplication::workerIndex() >= 0)
+        descriptor = QDaemonApplication::createReusePortListener(port);     // The workers share the port
+    if (descriptor >= 0 ? !setSocketDescriptor(descriptor) : !listen(QHostAddress::Any, port))  {
         // We couldn't start the server ...
         // Log the error
         qDaemonLog(QStringLiteral("Couldn't start the server. QTcpServer::listen() failed"), QDaemonLog::ErrorEntry);
@@ -69,6 +75,9 @@ void TcpServer::start(const QStringList & arguments)
         qApp->quit();
         return;
     }
+
+    // Make the listening socket available to an upgraded instance
+    QDaemonApplication::registerDescriptor(listenerName, socketDescriptor());
 }
 
 void TcpServer::stop()
@@ -76,6 +85,7 @@ void TcpServer::stop()
     if (!isListening())
         return;
 
+    QDaemonApplication::unregisterDescriptor(listenerName);
     close();
 
     emit stopped();
@@ -59,6 +59,7 @@ private:
     QSemaphore threadWaitSemaphore;
 
     static const quint16 defaultPort;
+    static const QString listenerName;
 };
 
 Q_DECLARE_METATYPE(qintptr)
@@ -9,18 +9,39 @@ unix:!macx  {
 SOURCES += \
     $$PWD/qdaemonapplication.cpp \
     $$PWD/qdaemonlog.cpp \
+    $$PWD/qdaemonmetrics.cpp \
+    $$PWD/qdaemonexecutor.cpp \
+    $$PWD/qdaemontimerwheel.cpp \
+    $$PWD/qdaemonsettings.cpp \
+    $$PWD/qdaemonstats.cpp \
     $$PWD/private/qdaemonlog_p.cpp \
+    $$PWD/private/qdaemonmetrics_p.cpp \
+    $$PWD/private/qdaemonexecutor_p.cpp \
+    $$PWD/private/qdaemontimerwheel_p.cpp \
+    $$PWD/private/qdaemonsettings_p.cpp \
+    $$PWD/private/qdaemonstartupprofiler_p.cpp \
     $$PWD/private/qdaemonapplication_p.cpp \
     $$PWD/private/qabstractdaemonbackend.cpp
 
 PUBLIC_HEADERS += \
     $$PWD/qdaemon-global.h \
     $$PWD/qdaemonapplication.h \
-    $$PWD/qdaemonlog.h
+    $$PWD/qdaemonlog.h \
+    $$PWD/qdaemonmetrics.h \
+    $$PWD/qdaemonexecutor.h \
+    $$PWD/qdaemontimerwheel.h \
+    $$PWD/qdaemonsettings.h \
+    $$PWD/qdaemonstats.h
 
 PRIVATE_HEADERS += \
     $$PWD/private/qdaemonapplication_p.h \
     $$PWD/private/qdaemonlog_p.h \
+    $$PWD/private/qdaemonmetrics_p.h \
+    $$PWD/private/qdaemonexecutor_p.h \
+    $$PWD/private/qdaemontimerwheel_p.h \
+    $$PWD/private/qdaemonsettings_p.h \
+    $$PWD/private/qdaemonstats_p.h \
+    $$PWD/private/qdaemonstartupprofiler_p.h \
     $$PWD/private/qabstractdaemonbackend.h
 
 unix:RESOURCES += qdaemon.qrc
@@ -36,11 +57,45 @@ macx {
 } else: unix {
     SOURCES += \
         $$PWD/private/controllerbackend_linux.cpp \
-        $$PWD/private/daemonbackend_linux.cpp
+        $$PWD/private/daemonbackend_linux.cpp \
+        $$PWD/private/qdaemonmetricsserver_p.cpp \
+        $$PWD/private/qdaemonwatchdog_p.cpp \
+        $$PWD/private/qdaemonhandoff_p.cpp \
+        $$PWD/private/qdaemonsupervisor_p.cpp \
+        $$PWD/private/qdaemoneventdispatcher_p.cpp \
+        $$PWD/private/qdaemonioring_p.cpp \
+        $$PWD/private/qdaemonlogwriter_p.cpp \
+        $$PWD/private/qdaemonprocesstuning_p.cpp \
+        $$PWD/private/qdaemoncontrolgroup_p.cpp \
+        $$PWD/private/qdaemonbusregistration_p.cpp \
+        $$PWD/private/qdaemonspawner_p.cpp \
+        $$PWD/private/qdaemonstatspublisher_p.cpp \
+        $$PWD/private/qdaemonstatsmonitor_p.cpp \
+        $$PWD/private/qdaemoncontrol_p.cpp \
+        $$PWD/qdaemonioring.cpp
 
     PRIVATE_HEADERS += \
         $$PWD/private/controllerbackend_linux.h \
-        $$PWD/private/daemonbackend_linux.h
+        $$PWD/private/daemonbackend_linux.h \
+        $$PWD/private/qdaemonmetricsserver_p.h \
+        $$PWD/private/qdaemonwatchdog_p.h \
+        $$PWD/private/qdaemonhandoff_p.h \
+        $$PWD/private/qdaemonsupervisor_p.h \
+        $$PWD/private/qdaemoneventdispatcher_p.h \
+        $$PWD/private/qdaemonioring_p.h \
+        $$PWD/private/qdaemonlogwriter_p.h \
+        $$PWD/private/qdaemonprocesstuning_p.h \
+        $$PWD/private/qdaemoncontrolgroup_p.h \
+        $$PWD/private/qdaemonbusregistration_p.h \
+        $$PWD/private/qdaemonspawner_p.h \
+        $$PWD/private/qdaemonstatspublisher_p.h \
+        $$PWD/private/qdaemonstatsmonitor_p.h \
+        $$PWD/private/qdaemoncontrol_p.h
+
+    PUBLIC_HEADERS += \
+        $$PWD/qdaemonioring.h
+
+    LIBS += -lrt
 
 
     target.path = /usr/lib
@@ -48,7 +103,9 @@ macx {
 
     DISTFILES += \
         resources/init \
-        resources/dbus
+        resources/dbus \
+        resources/systemd-service \
+        resources/systemd-socket
 } else: win32 {
     SOURCES += \
         $$PWD/private/controllerbackend_win.cpp \
@@ -29,7 +29,11 @@
 #include "controllerbackend_linux.h"
 #include "daemonbackend_linux.h"
 #include "qdaemonapplication.h"
+#include "qdaemonapplication_p.h"
 #include "qdaemonlog.h"
+#include "qdaemonspawner_p.h"
+#include "qdaemonstatsmonitor_p.h"
+#include "qdaemonstats.h"
 
 #include <QtCore/qmetaobject.h>
 #include <QtCore/qcommandlineparser.h>
@@ -41,11 +45,19 @@
 #include <QtCore/qfile.h>
 #include <QtCore/qfileinfo.h>
 #include <QtCore/qelapsedtimer.h>
+#include <QtCore/qmap.h>
 
 #include <QtDBus/qdbusconnection.h>
 #include <QtDBus/qdbuserror.h>
 #include <QtDBus/qdbusinterface.h>
 #include <QtDBus/qdbusreply.h>
+#include <QtDBus/qdbusconnectioninterface.h>
+#include <QtDBus/qdbusmessage.h>
+#include <QtDBus/qdbuspendingcall.h>
+#include <QtDBus/qdbuspendingreply.h>
+
+#include <errno.h>
+#include <cstring>
 
 QT_BEGIN_NAMESPACE
 
@@ -53,19 +65,59 @@ using namespace QtDaemon;
 
 static qint32 dbusServiceTimeout = 30000;		// Up to 30 seconds
 static qint32 dbusPollTime = 1000;				// Poll each second on start
+static qint32 statsPollTime = 10;				// The statistics are in shared memory, so they're cheap to poll
+static qint32 watchInterval = 1000;				// Refresh each second when watching
 
 const QString ControllerBackendLinux::initdPrefix = QStringLiteral("initd-prefix");
 const QString ControllerBackendLinux::dbusPrefix = QStringLiteral("dbus-prefix");
+const QString ControllerBackendLinux::systemdPrefix = QStringLiteral("systemd-prefix");
 const QString ControllerBackendLinux::defaultInitPath = QStringLiteral("/etc/init.d");
 const QString ControllerBackendLinux::defaultDBusPath = QStringLiteral("/etc/dbus-1/system.d");
+const QString ControllerBackendLinux::defaultSystemdPath = QStringLiteral("/etc/systemd/system");
 
 ControllerBackendLinux::ControllerBackendLinux(QCommandLineParser & parser, bool autoQuit)
     : QAbstractControllerBackend(parser, autoQuit),
       dbusPrefixOption(dbusPrefix, QCoreApplication::translate("main", "Sets the path for the installed dbus configuration file"), QStringLiteral("path"), defaultDBusPath),
-      initdPrefixOption(initdPrefix, QCoreApplication::translate("main", "Sets the path for the installed init.d script"), QStringLiteral("path"), defaultInitPath)
+      initdPrefixOption(initdPrefix, QCoreApplication::translate("main", "Sets the path for the installed init.d script"), QStringLiteral("path"), defaultInitPath),
+      systemdPrefixOption(systemdPrefix, QCoreApplication::translate("main", "Sets the path for the installed systemd units"), QStringLiteral("path"), defaultSystemdPath),
+      socketOption(QStringLiteral("socket"), QCoreApplication::translate("main", "Installs a systemd socket unit listening on address for the socket activated daemon (can be repeated)"), QStringLiteral("name=address")),
+      superviseOption(DaemonBackendLinux::superviseName, QCoreApplication::translate("main", "Runs the daemon under a supervisor process that restarts it when it fails")),
+      restartDelayOption(DaemonBackendLinux::restartDelayName, QCoreApplication::translate("main", "Sets the initial and the maximal delay (in milliseconds) before the supervisor restarts the daemon"), QStringLiteral("min[:max]")),
+      crashLimitOption(DaemonBackendLinux::crashLimitName, QCoreApplication::translate("main", "Sets how many times the daemon may fail in the given time before the supervisor gives up"), QStringLiteral("count[/seconds]")),
+      standbyOption(DaemonBackendLinux::standbyName, QCoreApplication::translate("main", "Starts a warmed up standby instance that takes over when the running daemon quits")),
+      timeoutOption(QStringLiteral("timeout"), QCoreApplication::translate("main", "Sets the time (in milliseconds) the whole operation may take"), QStringLiteral("milliseconds"), QString::number(dbusServiceTimeout)),
+      intervalOption(QStringLiteral("interval"), QCoreApplication::translate("main", "Sets the refresh interval (in milliseconds) when watching the daemon"), QStringLiteral("milliseconds"), QString::number(watchInterval)),
+      cpusOption(DaemonBackendLinux::cpusName, QCoreApplication::translate("main", "Runs the daemon on the given CPUs only, e.g. 0-3,8"), QStringLiteral("list")),
+      numaNodeOption(DaemonBackendLinux::numaNodeName, QCoreApplication::translate("main", "Runs the daemon on the CPUs of the given NUMA node and allocates its memory there"), QStringLiteral("node")),
+      niceOption(DaemonBackendLinux::niceName, QCoreApplication::translate("main", "Sets the nice value of the daemon (from -20 to 19)"), QStringLiteral("value")),
+      ioPriorityOption(DaemonBackendLinux::ioPriorityName, QCoreApplication::translate("main", "Sets the I/O scheduling class and level of the daemon"), QStringLiteral("class[:level]")),
+      maxFilesOption(DaemonBackendLinux::maxFilesName, QCoreApplication::translate("main", "Sets the maximal number of files the daemon may open (the hard limit by default)"), QStringLiteral("count")),
+      lockMemoryOption(DaemonBackendLinux::lockMemoryName, QCoreApplication::translate("main", "Locks the daemon's memory so it's never paged out")),
+      heapReserveOption(DaemonBackendLinux::heapReserveName, QCoreApplication::translate("main", "Faults in the given amount of heap memory on startup, e.g. 64M"), QStringLiteral("size")),
+      deferRegistrationOption(DaemonBackendLinux::deferRegistrationName, QCoreApplication::translate("main", "Registers the daemon's D-Bus service in the background, without delaying the start of the daemon")),
+      environmentOption(QStringLiteral("env"), QCoreApplication::translate("main", "Sets (or with no value unsets) an environment variable of the started daemon (can be repeated)"), QStringLiteral("name[=value]")),
+      workingDirectoryOption(QStringLiteral("workdir"), QCoreApplication::translate("main", "Sets the working directory of the started daemon"), QStringLiteral("path"))
 {
     parser.addOption(dbusPrefixOption);
     parser.addOption(initdPrefixOption);
+    parser.addOption(systemdPrefixOption);
+    parser.addOption(socketOption);
+    parser.addOption(superviseOption);
+    parser.addOption(restartDelayOption);
+    parser.addOption(crashLimitOption);
+    parser.addOption(standbyOption);
+    parser.addOption(timeoutOption);
+    parser.addOption(intervalOption);
+    parser.addOption(cpusOption);
+    parser.addOption(numaNodeOption);
+    parser.addOption(niceOption);
+    parser.addOption(ioPriorityOption);
+    parser.addOption(maxFilesOption);
+    parser.addOption(lockMemoryOption);
+    parser.addOption(heapReserveOption);
+    parser.addOption(deferRegistrationOption);
+    parser.addOption(environmentOption);
+    parser.addOption(workingDirectoryOption);
 }
 
 bool ControllerBackendLinux::start()
@@ -77,55 +129,140 @@ bool ControllerBackendLinux::start()
         return false;
     }
 
-    // Get the service name
-    QString service = DaemonBackendLinux::serviceName();
-
-    // First check if the daemon is already running
-    QScopedPointer<QDBusAbstractInterface> interface(new QDBusInterface(service, QStringLiteral("/"), QStringLiteral(Q_DAEMON_DBUS_CONTROL_INTERFACE), dbus));
-    if (interface->isValid())  {
-        QDBusReply<bool> reply = interface->call(QStringLiteral("isRunning"));
-        if (reply.isValid() && reply.value())
-            qDaemonLog(QStringLiteral("The daemon is already running."), QDaemonLog::NoticeEntry);
-        else
-            qDaemonLog(QStringLiteral("The daemon is not responding."), QDaemonLog::ErrorEntry);
-
+    QStringList instances = selectedInstances(dbus, false);
+    if (instances.isEmpty())
         return false;
-    }
 
-    // The daemon is (most probably) not running, so start it with the proper arguments
-    QStringList arguments = parser.positionalArguments();
-    if (arguments.size() > 0)
-        arguments.prepend(QStringLiteral("--"));
-    arguments.prepend(QStringLiteral("-d"));
-
-    if (!QProcess::startDetached(QDaemonApplication::applicationFilePath(), arguments, QDaemonApplication::applicationDirPath()))  {
-        qDaemonLog(QStringLiteral("The daemon failed to start."), QDaemonLog::ErrorEntry);
-        return false;
+    // A standby instance is started beside the running one and waits for it to go away
+    if (parser.isSet(standbyOption))
+        return startStandby(instances);
+
+    QElapsedTimer operationTimer;
+    operationTimer.start();
+    qint32 timeout = operationTimeout();
+
+    // Check all the instances at once and start the ones that aren't running yet
+    bool ok = true;
+    QMap<QString, QString> results;
+    QMap<QString, qint64> pids;
+    QStringList pending;
+
+    QList<QDBusPendingCall> calls = callInstances(dbus, instances, QStringLiteral("isRunning"), timeout);
+    for (qint32 i = 0, size = instances.size(); i < size; i++)  {
+        const QString & instance = instances.at(i);
+
+        QDBusPendingReply<bool> reply = calls.at(i);
+        if (!reply.isError() || !isServiceUnknown(reply.error()))  {
+            results.insert(instance, !reply.isError() && reply.value() ? QStringLiteral("is already running") : QStringLiteral("is not responding"));
+            ok = false;
+            continue;
+        }
+
+        // The daemon is not running, so start it with the proper arguments
+        QStringList arguments = daemonArguments(instance);
+        arguments.prepend(QStringLiteral("-d"));
+
+        qint64 pid = spawnDaemon(arguments);
+        if (pid < 0)  {
+            int error = errno;
+            results.insert(instance, QStringLiteral("failed to start (%1)").arg(QString::fromLocal8Bit(std::strerror(error))));
+            ok = false;
+            continue;
+        }
+
+        pending.append(instance);
+        pids.insert(instance, pid);
     }
 
-    // Repeat the call to make sure the communication is ok
-    QElapsedTimer dbusTimeoutTimer;
-    dbusTimeoutTimer.start();
-
-    // Give the daemon some seconds to start its DBus service
-    while (!dbusTimeoutTimer.hasExpired(dbusServiceTimeout))  {
-        interface.reset(new QDBusInterface(service, QStringLiteral("/"), QStringLiteral(Q_DAEMON_DBUS_CONTROL_INTERFACE), dbus));
-        if (interface->isValid())
-            break;
-
-        QThread::msleep(dbusPollTime);	// Wait some time before retrying
+    // Wait for the daemons to report they're running in their statistics segments, which doesn't depend on the D-Bus
+    // registration (it may be deferred). The bus is polled only for the daemons that don't publish their statistics.
+    QMap<QString, QDaemonStatsReader *> readers;
+    qint64 lastBusPoll = 0;
+    while (!pending.isEmpty() && !operationTimer.hasExpired(timeout))  {
+        QThread::msleep(qBound<qint64>(0, timeout - operationTimer.elapsed(), statsPollTime));	// Wait some time before retrying
+
+        QStringList unpublished;
+        for (qint32 i = pending.size() - 1; i >= 0; i--)  {
+            const QString instance = pending.at(i);
+            qint64 pid = pids.value(instance);
+
+            QDaemonStatsReader *& reader = readers[instance];
+            if (!reader)
+                reader = new QDaemonStatsReader;
+
+            // The segment may be left over from a previous daemon, so it's reopened until the new daemon replaces it
+            QDaemonStatsBlock block;
+            bool published = (reader->isOpen() || reader->open(instance)) && reader->read(block) && block.pid == pid;
+            if (!published)
+                reader->close();
+
+            if (published && block.state == QDaemonStatsBlock::RunningState)
+                results.insert(instance, QStringLiteral("started (process %1)").arg(pid));
+            else if (!QDaemonSpawner::isAlive(pid))  {
+                // No need to wait out the timeout for a daemon that's gone
+                results.insert(instance, QStringLiteral("exited while starting (process %1)").arg(pid));
+                ok = false;
+            }
+            else  {
+                if (!published)
+                    unpublished.append(instance);
+                continue;       // Not up yet
+            }
+
+            pending.removeAt(i);
+        }
+
+        if (unpublished.isEmpty() || operationTimer.elapsed() - lastBusPoll < dbusPollTime / 10)
+            continue;
+
+        lastBusPoll = operationTimer.elapsed();
+        calls = callInstances(dbus, unpublished, QStringLiteral("isRunning"), qMax<qint64>(1, timeout - operationTimer.elapsed()));
+        for (qint32 i = 0, size = unpublished.size(); i < size; i++)  {
+            const QString & instance = unpublished.at(i);
+
+            QDBusPendingReply<bool> reply = calls.at(i);
+            if (reply.isError() && isServiceUnknown(reply.error()))
+                continue;       // Not up yet
+            else if (reply.isError() || !reply.value())  {
+                results.insert(instance, QStringLiteral("replied erroneously (%1)").arg(reply.error().message()));
+                ok = false;
+            }
+            else
+                results.insert(instance, QStringLiteral("started (process %1)").arg(pids.value(instance)));
+
+            pending.removeOne(instance);
+        }
     }
+    qDeleteAll(readers);
 
-    // Check the DBus status
-    if (!interface)  {
-        qDaemonLog(QStringLiteral("Connection with the daemon couldn't be established. (%1)").arg(dbus.lastError().message()), QDaemonLog::ErrorEntry);
-        return false;
+    foreach (const QString & instance, pending)  {
+        results.insert(instance, QStringLiteral("didn't start in time"));
+        ok = false;
     }
 
-    QDBusReply<bool> reply = interface->call(QStringLiteral("isRunning"));
-    if (!reply.isValid() || !reply.value())  {
-        qDaemonLog(QStringLiteral("The acquired DBus interface replied erroneously. (%1)").arg(dbus.lastError().message()), QDaemonLog::ErrorEntry);
+    reportResults(results, !ok);
+    if (!ok)
         return false;
+
+    QMetaObject::invokeMethod(qApp, "started", Qt::QueuedConnection);
+    return true;
+}
+
+bool ControllerBackendLinux::startStandby(const QStringList & instances)
+{
+    foreach (const QString & instance, instances)  {
+        QStringList arguments = daemonArguments(instance);
+        arguments.prepend(QStringLiteral("-d"));
+
+        // The standby instance doesn't own the service, so there's nothing to wait for over D-Bus
+        qint64 pid = spawnDaemon(arguments);
+        if (pid < 0)  {
+            int error = errno;
+            qDaemonLog(QStringLiteral("The standby daemon failed to start (%1).").arg(QString::fromLocal8Bit(std::strerror(error))), QDaemonLog::ErrorEntry);
+            return false;
+        }
+
+        qDaemonLog(QStringLiteral("%1 is on standby (process %2).").arg(instanceLabel(instance)).arg(pid), QDaemonLog::NoticeEntry);
     }
 
     QMetaObject::invokeMethod(qApp, "started", Qt::QueuedConnection);
@@ -141,30 +278,42 @@ bool ControllerBackendLinux::stop()
         return false;
     }
 
-    // Get the service name
-    QString service = DaemonBackendLinux::serviceName();
-
-    // Acquire the DBus interface
-    QScopedPointer<QDBusAbstractInterface> interface(new QDBusInterface(service, QStringLiteral("/"), QStringLiteral(Q_DAEMON_DBUS_CONTROL_INTERFACE), dbus));
-    if (!interface->isValid())  {
-        qDaemonLog(QStringLiteral("Couldn't acquire the DBus interface. Is the daemon running? (%1)").arg(dbus.lastError().message()), QDaemonLog::ErrorEntry);
+    QStringList instances = selectedInstances(dbus, true);
+    if (instances.isEmpty())  {
+        qDaemonLog(QStringLiteral("There are no running instances of the daemon."), QDaemonLog::ErrorEntry);
         return false;
     }
 
-    QDBusReply<bool> reply = interface->call(QStringLiteral("stop"));
-    if (!reply.isValid() || !reply.value())  {
-        qDaemonLog(QStringLiteral("The acquired DBus interface replied erroneously. (%1)").arg(dbus.lastError().message()), QDaemonLog::ErrorEntry);
-        return false;
+    // Ask all the instances to stop at once
+    bool ok = true;
+    QMap<QString, QString> results;
+
+    QList<QDBusPendingCall> calls = callInstances(dbus, instances, QStringLiteral("stop"), operationTimeout());
+    for (qint32 i = 0, size = instances.size(); i < size; i++)  {
+        QDBusPendingReply<bool> reply = calls.at(i);
+        if (!reply.isError() && reply.value())  {
+            results.insert(instances.at(i), QStringLiteral("stopped"));
+            continue;
+        }
+
+        results.insert(instances.at(i), reply.isError() && isServiceUnknown(reply.error()) ? QStringLiteral("is not running") : QStringLiteral("replied erroneously (%1)").arg(reply.error().message()));
+        ok = false;
     }
 
+    reportResults(results, !ok);
+    if (!ok)
+        return false;
+
     QMetaObject::invokeMethod(qApp, "stopped", Qt::QueuedConnection);
     return true;
 }
 
 bool ControllerBackendLinux::install()
 {
-    QFileInfo applicationInfo(QDaemonApplication::applicationFilePath());
-    QString path = applicationInfo.absoluteFilePath(), executable = applicationInfo.fileName(), service = DaemonBackendLinux::serviceName();
+    if (!isSingleInstance())
+        return false;
+
+    QString path = QFileInfo(QDaemonApplication::applicationFilePath()).absoluteFilePath(), executable = artifactName(), service = DaemonBackendLinux::serviceName();
 
     QString dbusPath = parser.isSet(dbusPrefixOption) ? parser.value(dbusPrefixOption) : defaultDBusPath;
     QString initdPath = parser.isSet(initdPrefixOption) ? parser.value(initdPrefixOption) : defaultInitPath;
@@ -232,9 +381,7 @@ bool ControllerBackendLinux::install()
     fout.setDevice(&initdFile);
 
     // Read the init.d script, do the substitution and write to disk
-    QStringList arguments = parser.positionalArguments();
-    if (arguments.size() > 0)
-        arguments.prepend(QStringLiteral("--"));
+    QStringList arguments = daemonArguments(QDaemonApplication::instanceId());
 
     data = fin.readAll();
     data.replace(QStringLiteral("%%DAEMON%%"), path)
@@ -243,6 +390,8 @@ bool ControllerBackendLinux::install()
         .replace(QStringLiteral("%%DESCRIPTION%%"), QDaemonApplication::applicationDescription())
         .replace(QStringLiteral("%%INITD_PREFIX%%"), initdPath)
         .replace(QStringLiteral("%%DBUS_PREFIX%%"), dbusPath)
+        .replace(QStringLiteral("%%SYSTEMD_PREFIX%%"), QDir(parser.value(systemdPrefixOption)).absolutePath())
+        .replace(QStringLiteral("%%INSTANCE%%"), QDaemonApplication::instanceId().isEmpty() ? QString() : QStringLiteral("--instance=%1").arg(QDaemonApplication::instanceId()))
         .replace(QStringLiteral("%%ARGUMENTS%%"), arguments.join(' '));
     fout << data;
 
@@ -253,14 +402,23 @@ bool ControllerBackendLinux::install()
     if (!initdFile.setPermissions(QFile::WriteOwner | QFile::ExeOwner | QFile::ReadOwner | QFile::ReadGroup | QFile::ExeGroup | QFile::ReadOther | QFile::ExeOther))
         qDaemonLog(QStringLiteral("An error occured while setting the permissions for the init.d script. Installation may be broken."), QDaemonLog::WarningEntry);
 
+    // Emit the units for socket activation if sockets were requested
+    if (parser.isSet(socketOption) && !installSystemdUnits(path, arguments))  {
+        dbusConf.remove();
+        initdFile.remove();
+        return false;
+    }
+
     QMetaObject::invokeMethod(qApp, "installed", Qt::QueuedConnection);
     return true;
 }
 
 bool ControllerBackendLinux::uninstall()
 {
-    QFileInfo applicationInfo(QDaemonApplication::applicationFilePath());
-    QString executable = applicationInfo.fileName(), service = DaemonBackendLinux::serviceName();
+    if (!isSingleInstance())
+        return false;
+
+    QString executable = artifactName(), service = DaemonBackendLinux::serviceName();
 
     QString dbusPath = parser.isSet(dbusPrefixOption) ? parser.value(dbusPrefixOption) : defaultDBusPath;
     QString initdPath = parser.isSet(initdPrefixOption) ? parser.value(initdPrefixOption) : defaultInitPath;
@@ -280,11 +438,124 @@ bool ControllerBackendLinux::uninstall()
         qDaemonLog(QStringLiteral("Couldn't remove the init.d script for this service (%1).").arg(initdFilePath), QDaemonLog::ErrorEntry);
         return false;
     }
+    if (!uninstallSystemdUnits(executable))
+        return false;
 
     QMetaObject::invokeMethod(qApp, "uninstalled", Qt::QueuedConnection);
     return true;
 }
 
+bool ControllerBackendLinux::installSystemdUnits(const QString & path, const QStringList & arguments)
+{
+    QString executable = artifactName();
+    QDir systemdDir(QDir(parser.value(systemdPrefixOption)).absolutePath());
+
+    // Parse the requested sockets first, so nothing is written for a malformed command line
+    QList< QPair<QString, QString> > sockets;
+    QStringList socketUnits;
+    foreach (const QString & socket, parser.values(socketOption))  {
+        qint32 separator = socket.indexOf(QLatin1Char('='));
+        QString name = socket.left(separator), address = socket.mid(separator + 1);
+        if (separator <= 0 || address.isEmpty() || name.contains(QLatin1Char(':')) || name.contains(QLatin1Char('/')))  {
+            qDaemonLog(QStringLiteral("The socket must be given as name=address (%1).").arg(socket), QDaemonLog::ErrorEntry);
+            return false;
+        }
+
+        sockets.append(qMakePair(name, address));
+        socketUnits.append(QStringLiteral("%1-%2.socket").arg(executable, name));
+    }
+
+    QFile serviceTemplate(QStringLiteral(":/resources/systemd-service")), socketTemplate(QStringLiteral(":/resources/systemd-socket"));
+    if (!serviceTemplate.open(QFile::ReadOnly | QFile::Text) || !socketTemplate.open(QFile::ReadOnly | QFile::Text))  {
+        qDaemonLog(QStringLiteral("Couldn't read the daemon's resources!"), QDaemonLog::ErrorEntry);
+        return false;
+    }
+
+    QString serviceData = QTextStream(&serviceTemplate).readAll(), socketData = QTextStream(&socketTemplate).readAll();
+
+    // Write the service unit
+    QString serviceFilePath = systemdDir.filePath(executable + QStringLiteral(".service"));
+    QFile serviceUnit(serviceFilePath);
+    if (serviceUnit.exists())  {
+        qDaemonLog(QStringLiteral("The provided systemd directory already contains a unit for this service. Uninstall first"), QDaemonLog::ErrorEntry);
+        return false;
+    }
+    if (!serviceUnit.open(QFile::WriteOnly | QFile::Text))  {
+        qDaemonLog(QStringLiteral("Couldn't open the systemd service unit for writing (%1).").arg(serviceFilePath), QDaemonLog::ErrorEntry);
+        return false;
+    }
+
+    QTextStream fout(&serviceUnit);
+    fout << serviceData.replace(QStringLiteral("%%DAEMON%%"), path)
+                       .replace(QStringLiteral("%%DESCRIPTION%%"), QDaemonApplication::applicationDescription())
+                       .replace(QStringLiteral("%%SOCKETS%%"), socketUnits.join(' '))
+                       .replace(QStringLiteral("%%ARGUMENTS%%"), arguments.join(' '));
+
+    if (fout.status() != QTextStream::Ok)
+        qDaemonLog(QStringLiteral("An error occured while writing the systemd service unit. Installation may be broken."), QDaemonLog::WarningEntry);
+
+    // Write a socket unit for each of the sockets, the name is passed to the daemon in LISTEN_FDNAMES
+    for (qint32 i = 0, size = sockets.size(); i < size; i++)  {
+        QString socketFilePath = systemdDir.filePath(socketUnits.at(i));
+        QFile socketUnit(socketFilePath);
+        if (!socketUnit.open(QFile::WriteOnly | QFile::Text))  {
+            qDaemonLog(QStringLiteral("Couldn't open the systemd socket unit for writing (%1).").arg(socketFilePath), QDaemonLog::ErrorEntry);
+            uninstallSystemdUnits(executable);
+            return false;
+        }
+
+        QString data = socketData;
+        fout.setDevice(&socketUnit);
+        fout << data.replace(QStringLiteral("%%NAME%%"), QDaemonApplication::applicationName())
+                    .replace(QStringLiteral("%%EXECUTABLE%%"), executable)
+                    .replace(QStringLiteral("%%SOCKET_NAME%%"), sockets.at(i).first)
+                    .replace(QStringLiteral("%%ADDRESS%%"), sockets.at(i).second);
+
+        if (fout.status() != QTextStream::Ok)  {
+            qDaemonLog(QStringLiteral("An error occured while writing the systemd socket unit. Installation may be broken."), QDaemonLog::WarningEntry);
+            fout.resetStatus();
+        }
+    }
+
+    return true;
+}
+
+bool ControllerBackendLinux::uninstallSystemdUnits(const QString & executable)
+{
+    QDir systemdDir(QDir(parser.value(systemdPrefixOption)).absolutePath());
+
+    // Only the socket units this installation wrote, as listed in the service unit. Other programs' units may share the prefix
+    QString serviceFileName = executable + QStringLiteral(".service"), prefix = executable + QLatin1Char('-');
+
+    QStringList units;
+    QFile serviceUnit(systemdDir.filePath(serviceFileName));
+    if (serviceUnit.open(QFile::ReadOnly | QFile::Text))  {
+        QTextStream input(&serviceUnit);
+        while (!input.atEnd())  {
+            QString line = input.readLine().trimmed();
+            if (!line.startsWith(QLatin1String("Requires=")))
+                continue;
+
+            foreach (const QString & unit, line.mid(9).split(QLatin1Char(' '), QString::SkipEmptyParts))  {
+                if (unit.startsWith(prefix) && unit.endsWith(QLatin1String(".socket")) && !unit.contains(QLatin1Char('/')))
+                    units.append(unit);
+            }
+        }
+        serviceUnit.close();
+    }
+    units.append(serviceFileName);
+
+    foreach (const QString & unit, units)  {
+        QFile unitFile(systemdDir.filePath(unit));
+        if (unitFile.exists() && !unitFile.remove())  {
+            qDaemonLog(QStringLiteral("Couldn't remove the systemd unit for this service (%1).").arg(unitFile.fileName()), QDaemonLog::ErrorEntry);
+            return false;
+        }
+    }
+
+    return true;
+}
+
 QAbstractControllerBackend::DaemonStatus ControllerBackendLinux::status()
 {
     // Connect to the DBus infrastructure
@@ -294,16 +565,366 @@ QAbstractControllerBackend::DaemonStatus ControllerBackendLinux::status()
         return NotRunningStatus;
     }
 
-    // Get the service name
+    QStringList instances = selectedInstances(dbus, true);
+    if (instances.isEmpty())
+        return NotRunningStatus;
+
+    // Query all the instances at once
+    runningInstances.clear();
+    QList<QDBusPendingCall> calls = callInstances(dbus, instances, QStringLiteral("isRunning"), operationTimeout());
+    for (qint32 i = 0, size = instances.size(); i < size; i++)  {
+        QDBusPendingReply<bool> reply = calls.at(i);
+        runningInstances.insert(instances.at(i), !reply.isError() && reply.value());
+    }
+
+    // Running only if all the selected instances are
+    return runningInstances.values().contains(false) ? NotRunningStatus : RunningStatus;
+}
+
+QString ControllerBackendLinux::statusDetails()
+{
+    if (runningInstances.isEmpty())
+        return QString();
+
+    QDBusConnection dbus = QDBusConnection::systemBus();
+
+    QStringList running;
+    for (QMap<QString, bool>::ConstIterator i = runningInstances.constBegin(), end = runningInstances.constEnd(); i != end; ++i)  {
+        if (i.value())
+            running.append(i.key());
+    }
+
+    QList<QDBusPendingCall> calls = callInstances(dbus, running, QStringLiteral("statusDetails"), operationTimeout());
+
+    // A single instance reports only its details, several are listed in a table with their state
+    if (runningInstances.size() == 1)  {
+        QDBusPendingReply<QString> reply = calls.value(0, QDBusPendingCall::fromError(QDBusError()));
+        return !reply.isError() ? reply.value() : QString();
+    }
+
+    QMap<QString, QString> results;
+    for (QMap<QString, bool>::ConstIterator i = runningInstances.constBegin(), end = runningInstances.constEnd(); i != end; ++i)  {
+        QString result = i.value() ? QStringLiteral("is running") : QStringLiteral("is not running");
+
+        qint32 index = running.indexOf(i.key());
+        if (index >= 0)  {
+            QDBusPendingReply<QString> reply = calls.at(index);
+            if (!reply.isError() && !reply.value().isEmpty())
+                result += QLatin1Char('\n') + reply.value();
+        }
+
+        results.insert(i.key(), result);
+    }
+
+    return formatResults(results);
+}
+
+bool ControllerBackendLinux::statistics()
+{
+    if (!isSingleInstance())
+        return false;
+
+    QScopedPointer<QDBusAbstractInterface> interface(getDBusInterface());
+    if (!interface)
+        return false;
+
+    QDBusReply<QString> reply = interface->call(QStringLiteral("statistics"));
+    if (!reply.isValid())  {
+        qDaemonLog(QStringLiteral("The acquired DBus interface replied erroneously. (%1)").arg(reply.error().message()), QDaemonLog::ErrorEntry);
+        return false;
+    }
+
+    QString statistics = reply.value();
+    qDaemonLog() << (statistics.isEmpty() ? QStringLiteral("The daemon has no registered metrics.") : statistics);
+    return true;
+}
+
+bool ControllerBackendLinux::watch()
+{
+    // Only the statistics the daemons publish in shared memory and the kernel's are read, the daemons aren't contacted at all
+    QStringList instances = parser.values(QStringLiteral("instance"));
+    if (instances.isEmpty())
+        instances.append(QString());       // The default, unqualified, instance
+    instances.removeDuplicates();
+
+    bool ok;
+    qint32 interval = parser.value(intervalOption).toInt(&ok);
+    if (!ok || interval <= 0)
+        interval = watchInterval;
+
+    // Refreshed until interrupted
+    autoQuit = false;
+
+    QDaemonStatsMonitor * monitor = new QDaemonStatsMonitor(instances, interval, qApp);
+    monitor->start();
+
+    return true;
+}
+
+bool ControllerBackendLinux::reload()
+{
+    if (!isSingleInstance())
+        return false;
+
+    QScopedPointer<QDBusAbstractInterface> interface(getDBusInterface());
+    if (!interface)
+        return false;
+
+    QDBusReply<bool> reply = interface->call(QStringLiteral("reload"));
+    if (!reply.isValid() || !reply.value())  {
+        qDaemonLog(QStringLiteral("The acquired DBus interface replied erroneously. (%1)").arg(reply.error().message()), QDaemonLog::ErrorEntry);
+        return false;
+    }
+
+    qDaemonLog() << QStringLiteral("The daemon was asked to reload its configuration.");
+    return true;
+}
+
+bool ControllerBackendLinux::upgrade()
+{
+    if (!isSingleInstance())
+        return false;
+
+    QScopedPointer<QDBusAbstractInterface> interface(getDBusInterface());
+    if (!interface)
+        return false;
+
+    // Ask the running daemon to prepare for handing over its descriptors
+    QDBusReply<QString> reply = interface->call(QStringLiteral("prepareUpgrade"));
+    if (!reply.isValid() || reply.value().isEmpty())  {
+        qDaemonLog(QStringLiteral("The running daemon couldn't prepare for the upgrade. (%1)").arg(reply.error().message()), QDaemonLog::ErrorEntry);
+        return false;
+    }
+
+    // Start the upgraded instance with the same arguments, pointing it to the running one
+    QStringList arguments = daemonArguments(QDaemonApplication::instanceId());
+    arguments.prepend(reply.value());
+    arguments.prepend(QStringLiteral("--handoff"));
+    arguments.prepend(QStringLiteral("-d"));
+
+    qint64 pid = spawnDaemon(arguments);
+    if (pid < 0)  {
+        int error = errno;
+        qDaemonLog(QStringLiteral("The upgraded daemon failed to start (%1).").arg(QString::fromLocal8Bit(std::strerror(error))), QDaemonLog::ErrorEntry);
+        return false;
+    }
+
+    // Wait for the upgraded instance to take over the service
+    QDBusConnection dbus = interface->connection();
     QString service = DaemonBackendLinux::serviceName();
 
+    QElapsedTimer dbusTimeoutTimer;
+    dbusTimeoutTimer.start();
+    while (!dbusTimeoutTimer.hasExpired(dbusServiceTimeout))  {
+        QDBusReply<uint> owner = dbus.interface()->servicePid(service);
+        if (owner.isValid() && qint64(owner.value()) == pid)  {
+            qDaemonLog(QStringLiteral("The daemon was upgraded (process %1).").arg(pid), QDaemonLog::NoticeEntry);
+            return true;
+        }
+
+        if (!QDaemonSpawner::isAlive(pid))  {
+            qDaemonLog(QStringLiteral("The upgraded daemon exited while starting (process %1).").arg(pid), QDaemonLog::ErrorEntry);
+            return false;
+        }
+
+        QThread::msleep(dbusPollTime / 10);
+    }
+
+    qDaemonLog(QStringLiteral("The upgraded daemon didn't take over the service in time."), QDaemonLog::ErrorEntry);
+    return false;
+}
+
+qint64 ControllerBackendLinux::spawnDaemon(const QStringList & arguments) const
+{
+    // The daemon gets the controller's environment with the requested changes
+    QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+    foreach (const QString & variable, parser.values(environmentOption))  {
+        qint32 separator = variable.indexOf(QLatin1Char('='));
+        if (separator < 0)
+            environment.remove(variable);
+        else
+            environment.insert(variable.left(separator), variable.mid(separator + 1));
+    }
+
+    QString workingDirectory = parser.isSet(workingDirectoryOption) ? QDir(parser.value(workingDirectoryOption)).absolutePath() : QDaemonApplication::applicationDirPath();
+    return QDaemonSpawner::spawn(QDaemonApplication::applicationFilePath(), arguments, workingDirectory, environment.toStringList());
+}
+
+QList<QDBusPendingCall> ControllerBackendLinux::callInstances(QDBusConnection & dbus, const QStringList & instances, const QString & method, qint32 timeout)
+{
+    // Send all the calls first, then collect the replies, so it takes as long as the slowest instance
+    QList<QDBusPendingCall> calls;
+    foreach (const QString & instance, instances)  {
+        QDBusMessage message = QDBusMessage::createMethodCall(DaemonBackendLinux::serviceName(instance), QStringLiteral("/"), QStringLiteral(Q_DAEMON_DBUS_CONTROL_INTERFACE), method);
+        calls.append(dbus.asyncCall(message, timeout));
+    }
+
+    for (qint32 i = 0, size = calls.size(); i < size; i++)
+        calls[i].waitForFinished();
+
+    return calls;
+}
+
+bool ControllerBackendLinux::isServiceUnknown(const QDBusError & error)
+{
+    // No one owns the service name, i.e. the instance isn't running
+    return error.type() == QDBusError::ServiceUnknown || error.name() == QStringLiteral("org.freedesktop.DBus.Error.NameHasNoOwner");
+}
+
+qint32 ControllerBackendLinux::operationTimeout() const
+{
+    bool ok;
+    qint32 timeout = parser.value(timeoutOption).toInt(&ok);
+    return ok && timeout > 0 ? timeout : dbusServiceTimeout;
+}
+
+void ControllerBackendLinux::reportResults(const QMap<QString, QString> & results, bool failed)
+{
+    if (results.size() == 1)  {
+        // A single instance is reported in a sentence, and only when something went wrong
+        if (failed)
+            qDaemonLog(QStringLiteral("%1 %2.").arg(instanceLabel(results.firstKey()), results.first()), QDaemonLog::ErrorEntry);
+        return;
+    }
+
+    qDaemonLog() << formatResults(results);
+}
+
+QString ControllerBackendLinux::formatResults(const QMap<QString, QString> & results)
+{
+    static const QString defaultInstance = QStringLiteral("(default)");
+
+    qint32 width = defaultInstance.size();
+    foreach (const QString & instance, results.keys())
+        width = qMax(width, instance.size());
+
+    QStringList lines;
+    lines.append(QStringLiteral("Instance").leftJustified(width + 2) + QStringLiteral("Result"));
+    for (QMap<QString, QString>::ConstIterator i = results.constBegin(), end = results.constEnd(); i != end; ++i)  {
+        QString indent(width + 2, QLatin1Char(' '));
+        QString result = i.value();
+        result.replace(QLatin1Char('\n'), QLatin1Char('\n') + indent);
+
+        lines.append((i.key().isEmpty() ? defaultInstance : i.key()).leftJustified(width + 2) + result);
+    }
+
+    return lines.join(QLatin1Char('\n'));
+}
+
+QStringList ControllerBackendLinux::selectedInstances(QDBusConnection & dbus, bool allowAll)
+{
+    QStringList instances = parser.values(QStringLiteral("instance"));
+    if (instances.isEmpty())
+        return QStringList() << QString();      // The default, unqualified, instance
+
+    if (!instances.contains(QDaemonApplicationPrivate::allInstances))  {
+        instances.removeDuplicates();
+        return instances;
+    }
+
+    if (!allowAll)  {
+        qDaemonLog(QStringLiteral("'%1' selects the running instances only, the instances have to be listed explicitly.").arg(QDaemonApplicationPrivate::allInstances), QDaemonLog::ErrorEntry);
+        return QStringList();
+    }
+
+    // Find the running instances by their service names
+    QDBusReply<QStringList> names = dbus.interface()->registeredServiceNames();
+    if (!names.isValid())  {
+        qDaemonLog(QStringLiteral("Couldn't list the D-Bus services (%1)").arg(names.error().message()), QDaemonLog::ErrorEntry);
+        return QStringList();
+    }
+
+    QString service = DaemonBackendLinux::serviceName(QString()), prefix = service + QLatin1Char('_');
+
+    instances.clear();
+    foreach (const QString & name, names.value())  {
+        if (name == service)
+            instances.append(QString());
+        else if (name.startsWith(prefix))
+            instances.append(name.mid(prefix.size()));
+    }
+
+    instances.sort();
+    return instances;
+}
+
+bool ControllerBackendLinux::isSingleInstance()
+{
+    QStringList instances = parser.values(QStringLiteral("instance"));
+    if (instances.size() <= 1 && !instances.contains(QDaemonApplicationPrivate::allInstances))
+        return true;
+
+    qDaemonLog(QStringLiteral("The operation can be done on a single instance only."), QDaemonLog::ErrorEntry);
+    return false;
+}
+
+QString ControllerBackendLinux::instanceLabel(const QString & instance)
+{
+    return instance.isEmpty() ? QStringLiteral("The daemon") : QStringLiteral("The daemon instance %1").arg(instance);
+}
+
+QString ControllerBackendLinux::artifactName()
+{
+    // The installed files are named after the executable, qualified with the instance if there's one
+    QString executable = QFileInfo(QDaemonApplication::applicationFilePath()).fileName(), instance = QDaemonApplication::instanceId();
+    return instance.isEmpty() ? executable : executable + QLatin1Char('_') + instance;
+}
+
+QStringList ControllerBackendLinux::daemonArguments(const QString & instance) const
+{
+    // The switches for the daemon process go first, then the application's own arguments
+    QStringList arguments;
+    if (!instance.isEmpty())
+        arguments.append(QStringLiteral("--instance=%1").arg(instance));
+    if (parser.isSet(superviseOption))
+        arguments.append(QStringLiteral("--%1").arg(DaemonBackendLinux::superviseName));
+    if (parser.isSet(restartDelayOption))
+        arguments.append(QStringLiteral("--%1=%2").arg(DaemonBackendLinux::restartDelayName, parser.value(restartDelayOption)));
+    if (parser.isSet(crashLimitOption))
+        arguments.append(QStringLiteral("--%1=%2").arg(DaemonBackendLinux::crashLimitName, parser.value(crashLimitOption)));
+    if (parser.isSet(standbyOption))
+        arguments.append(QStringLiteral("--%1").arg(DaemonBackendLinux::standbyName));
+    if (parser.isSet(cpusOption))
+        arguments.append(QStringLiteral("--%1=%2").arg(DaemonBackendLinux::cpusName, parser.value(cpusOption)));
+    if (parser.isSet(numaNodeOption))
+        arguments.append(QStringLiteral("--%1=%2").arg(DaemonBackendLinux::numaNodeName, parser.value(numaNodeOption)));
+    if (parser.isSet(niceOption))
+        arguments.append(QStringLiteral("--%1=%2").arg(DaemonBackendLinux::niceName, parser.value(niceOption)));
+    if (parser.isSet(ioPriorityOption))
+        arguments.append(QStringLiteral("--%1=%2").arg(DaemonBackendLinux::ioPriorityName, parser.value(ioPriorityOption)));
+    if (parser.isSet(maxFilesOption))
+        arguments.append(QStringLiteral("--%1=%2").arg(DaemonBackendLinux::maxFilesName, parser.value(maxFilesOption)));
+    if (parser.isSet(lockMemoryOption))
+        arguments.append(QStringLiteral("--%1").arg(DaemonBackendLinux::lockMemoryName));
+    if (parser.isSet(heapReserveOption))
+        arguments.append(QStringLiteral("--%1=%2").arg(DaemonBackendLinux::heapReserveName, parser.value(heapReserveOption)));
+    if (parser.isSet(deferRegistrationOption))
+        arguments.append(QStringLiteral("--%1").arg(DaemonBackendLinux::deferRegistrationName));
+
+    QStringList positional = parser.positionalArguments();
+    if (positional.size() > 0)
+        arguments << QStringLiteral("--") << positional;
+
+    return arguments;
+}
+
+QDBusAbstractInterface * ControllerBackendLinux::getDBusInterface()
+{
+    // Connect to the DBus infrastructure
+    QDBusConnection dbus = QDBusConnection::systemBus();
+    if (!dbus.isConnected())  {
+        qDaemonLog(QStringLiteral("Can't connect to the DBus system bus (%1)").arg(dbus.lastError().message()), QDaemonLog::ErrorEntry);
+        return Q_NULLPTR;
+    }
+
     // Acquire the DBus interface
-    QScopedPointer<QDBusAbstractInterface> interface(new QDBusInterface(service, QStringLiteral("/"), QStringLiteral(Q_DAEMON_DBUS_CONTROL_INTERFACE), dbus));
-    if (!interface->isValid())
-        return NotRunningStatus;
+    QScopedPointer<QDBusAbstractInterface> interface(new QDBusInterface(DaemonBackendLinux::serviceName(), QStringLiteral("/"), QStringLiteral(Q_DAEMON_DBUS_CONTROL_INTERFACE), dbus));
+    if (!interface->isValid())  {
+        qDaemonLog(QStringLiteral("Couldn't acquire the DBus interface. Is the daemon running? (%1)").arg(dbus.lastError().message()), QDaemonLog::ErrorEntry);
+        return Q_NULLPTR;
+    }
 
-    QDBusReply<bool> reply = interface->call(QStringLiteral("isRunning"));
-    return reply.isValid() && reply.value() ? RunningStatus : NotRunningStatus;
+    return interface.take();
 }
 
 QT_END_NAMESPACE
@@ -42,9 +42,14 @@
 
 #include "QtDaemon/qabstractdaemonbackend.h"
 
+#include <QtCore/qmap.h>
+
 QT_BEGIN_NAMESPACE
 
 class QDBusAbstractInterface;
+class QDBusConnection;
+class QDBusError;
+class QDBusPendingCall;
 
 namespace QtDaemon
 {
@@ -60,17 +65,59 @@ namespace QtDaemon
         bool install() Q_DECL_OVERRIDE;
         bool uninstall() Q_DECL_OVERRIDE;
         DaemonStatus status() Q_DECL_OVERRIDE;
+        QString statusDetails() Q_DECL_OVERRIDE;
+        bool statistics() Q_DECL_OVERRIDE;
+        bool watch() Q_DECL_OVERRIDE;
+        bool reload() Q_DECL_OVERRIDE;
+        bool upgrade() Q_DECL_OVERRIDE;
 
     private:
         QDBusAbstractInterface * getDBusInterface();
+        QStringList daemonArguments(const QString &) const;
+        QStringList selectedInstances(QDBusConnection &, bool);
+        bool isSingleInstance();
+        QList<QDBusPendingCall> callInstances(QDBusConnection &, const QStringList &, const QString &, qint32);
+        qint32 operationTimeout() const;
+        void reportResults(const QMap<QString, QString> &, bool);
+        bool startStandby(const QStringList &);
+        qint64 spawnDaemon(const QStringList &) const;
+
+        static QString instanceLabel(const QString &);
+        static QString artifactName();
+        static bool isServiceUnknown(const QDBusError &);
+        static QString formatResults(const QMap<QString, QString> &);
+        bool installSystemdUnits(const QString &, const QStringList &);
+        bool uninstallSystemdUnits(const QString &);
 
         const QCommandLineOption dbusPrefixOption;
         const QCommandLineOption initdPrefixOption;
+        const QCommandLineOption systemdPrefixOption;
+        const QCommandLineOption socketOption;
+        const QCommandLineOption superviseOption;
+        const QCommandLineOption restartDelayOption;
+        const QCommandLineOption crashLimitOption;
+        const QCommandLineOption standbyOption;
+        const QCommandLineOption timeoutOption;
+        const QCommandLineOption intervalOption;
+        const QCommandLineOption cpusOption;
+        const QCommandLineOption numaNodeOption;
+        const QCommandLineOption niceOption;
+        const QCommandLineOption ioPriorityOption;
+        const QCommandLineOption maxFilesOption;
+        const QCommandLineOption lockMemoryOption;
+        const QCommandLineOption heapReserveOption;
+        const QCommandLineOption deferRegistrationOption;
+        const QCommandLineOption environmentOption;
+        const QCommandLineOption workingDirectoryOption;
+
+        QMap<QString, bool> runningInstances;
 
         static const QString initdPrefix;
         static const QString dbusPrefix;
+        static const QString systemdPrefix;
         static const QString defaultInitPath;
         static const QString defaultDBusPath;
+        static const QString defaultSystemdPath;
     };
 }
 
@@ -27,85 +27,672 @@
 ****************************************************************************/
 
 #include "daemonbackend_linux.h"
+#include "qdaemonmetricsserver_p.h"
+#include "qdaemonwatchdog_p.h"
+#include "qdaemonhandoff_p.h"
+#include "qdaemonsupervisor_p.h"
+#include "qdaemonprocesstuning_p.h"
+#include "qdaemonstartupprofiler_p.h"
+#include "qdaemonbusregistration_p.h"
+#include "qdaemonstatspublisher_p.h"
+#include "qdaemonapplication_p.h"
 #include "qdaemonapplication.h"
 #include "qdaemonlog.h"
+#include "qdaemonmetrics.h"
+#include "qdaemonstats.h"
 
 #include <QtCore/qstring.h>
 #include <QtCore/qfileinfo.h>
 #include <QtCore/qcommandlineparser.h>
+#include <QtCore/qscopedpointer.h>
+#include <QtCore/qtimer.h>
 
 #include <QtDBus/qdbusconnection.h>
 #include <QtDBus/qdbuserror.h>
+#include <QtDBus/qdbusreply.h>
+#include <QtDBus/qdbusconnectioninterface.h>
+#include <QtDBus/qdbusmessage.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <errno.h>
+#include <cstdlib>
+#include <cstring>
 
 QT_BEGIN_NAMESPACE
 
 using namespace QtDaemon;
 
+const QString DaemonBackendLinux::superviseName = QStringLiteral("supervise");
+const QString DaemonBackendLinux::restartDelayName = QStringLiteral("restart-delay");
+const QString DaemonBackendLinux::crashLimitName = QStringLiteral("crash-limit");
+const QString DaemonBackendLinux::standbyName = QStringLiteral("standby");
+const QString DaemonBackendLinux::cpusName = QStringLiteral("cpus");
+const QString DaemonBackendLinux::numaNodeName = QStringLiteral("numa-node");
+const QString DaemonBackendLinux::niceName = QStringLiteral("nice");
+const QString DaemonBackendLinux::ioPriorityName = QStringLiteral("ioprio");
+const QString DaemonBackendLinux::maxFilesName = QStringLiteral("max-files");
+const QString DaemonBackendLinux::lockMemoryName = QStringLiteral("lock-memory");
+const QString DaemonBackendLinux::heapReserveName = QStringLiteral("heap-reserve");
+const QString DaemonBackendLinux::deferRegistrationName = QStringLiteral("defer-dbus");
+const QString DaemonBackendLinux::controlConnectionName = QStringLiteral("qtdaemon_control");
+
 DaemonBackendLinux::DaemonBackendLinux(QCommandLineParser & arguments)
-    : QAbstractDaemonBackend(arguments)
+    : QAbstractDaemonBackend(arguments), handoffOption(QStringLiteral("handoff"), QString(), QStringLiteral("name")),
+      workerOption(QStringLiteral("worker"), QString(), QStringLiteral("index")), supervisedOption(QStringLiteral("supervised")),
+      superviseOption(superviseName), restartDelayOption(restartDelayName, QString(), QStringLiteral("min[:max]")),
+      crashLimitOption(crashLimitName, QString(), QStringLiteral("count[/seconds]")),
+      standbyOption(standbyName), cpusOption(cpusName, QString(), QStringLiteral("list")), numaNodeOption(numaNodeName, QString(), QStringLiteral("node")),
+      niceOption(niceName, QString(), QStringLiteral("value")), ioPriorityOption(ioPriorityName, QString(), QStringLiteral("class[:level]")),
+      maxFilesOption(maxFilesName, QString(), QStringLiteral("count")), lockMemoryOption(lockMemoryName), heapReserveOption(heapReserveName, QString(), QStringLiteral("size")),
+      deferRegistrationOption(deferRegistrationName), handoff(new QDaemonHandoff(this)), supervisor(new QDaemonSupervisor(this)), metricsServer(new QDaemonMetricsServer(this)),
+      statsPublisher(new QDaemonStatsPublisher(this)), registration(Q_NULLPTR), control(new QDaemonControl(supervisor)),
+      registrationLatency(qDaemonMetrics().gauge(QStringLiteral("qtdaemon_dbus_registration_milliseconds"), QStringLiteral("Time it took to register the D-Bus service."))), busConnectionName(controlConnectionName),
+      serviceRegistered(false)
 {
+    handoffOption.setHidden(true);
+    workerOption.setHidden(true);
+    supervisedOption.setHidden(true);
+    parser.addOption(handoffOption);
+    parser.addOption(workerOption);
+    parser.addOption(supervisedOption);
+    parser.addOption(superviseOption);
+    parser.addOption(restartDelayOption);
+    parser.addOption(crashLimitOption);
+    parser.addOption(standbyOption);
+    parser.addOption(cpusOption);
+    parser.addOption(numaNodeOption);
+    parser.addOption(niceOption);
+    parser.addOption(ioPriorityOption);
+    parser.addOption(maxFilesOption);
+    parser.addOption(lockMemoryOption);
+    parser.addOption(heapReserveOption);
+    parser.addOption(deferRegistrationOption);
+
+    QObject::connect(handoff, &QDaemonHandoff::ready, this, &DaemonBackendLinux::handOver);
+
+    // The control calls are served in a thread of their own, so a busy main event loop doesn't delay (or time out) them
+    controlThread.setObjectName(QStringLiteral("QDaemon control"));
+    control->moveToThread(&controlThread);
+    QObject::connect(control, &QDaemonControl::upgradeRequested, this, &DaemonBackendLinux::prepareUpgrade);
 }
 
 DaemonBackendLinux::~DaemonBackendLinux()
 {
+    controlThread.quit();
+    controlThread.wait();
+
+    delete control;
 }
 
 int DaemonBackendLinux::exec()
 {
-    QString service = serviceName();
+    // Pick up the sockets passed by the service manager (socket activation)
+    QDaemonApplicationPrivate::inheritActivatedDescriptors();
+
+    if (parser.isSet(workerOption) || parser.isSet(supervisedOption))
+        return execChild();
+
+    // The children inherit the placement and the priorities, so they're set up once, before anything else runs
+    if (!configureScheduling())
+        return BackendFailed;
+
+    bool supervising = QDaemonApplication::workerCount() > 0 || parser.isSet(superviseOption);
+    if (supervising && !configureSupervisor())
+        return BackendFailed;
+
+    // The limits and the locked memory belong to the process that runs the application code (the children are given the options)
+    if (!supervising)
+        configureResources();
+
+    controlThread.start();
+
+    bool upgrading = parser.isSet(handoffOption), standby = parser.isSet(standbyOption);
+    if (upgrading)  {
+        // Take over the descriptors of the running instance, the service is registered after it releases it
+        QHash<QString, int> descriptors;
+        if (!handoff->connectToInstance(parser.value(handoffOption), descriptors))
+            return BackendFailed;
+
+        QDaemonApplicationPrivate::inheritedDescriptors.unite(descriptors);
+        QObject::connect(handoff, &QDaemonHandoff::released, this, [this] () -> void  {
+            // Without the service the upgraded instance can't be controlled, so it doesn't keep running
+            if (!registerService())  {
+                qDaemonLog(QStringLiteral("The upgraded instance couldn't take the service over from the previous one."), QDaemonLog::ErrorEntry);
+                QCoreApplication::exit(BackendFailed);
+            }
+        });
+    }
+    else if (standby)  {
+        if (!queueService())
+            return BackendFailed;
+    }
+    else if (parser.isSet(deferRegistrationOption))
+        registerServiceInBackground();
+    else  {
+        QElapsedTimer timer;
+        timer.start();
+
+        if (!registerService())
+            return BackendFailed;
+
+        registrationLatency.set(timer.elapsed());
+    }
+
+    // Watch the main event loop for stalls
+    QScopedPointer<QDaemonWatchdog> watchdog;
+    int stallThreshold = QDaemonApplication::stallThreshold();
+    if (stallThreshold > 0)  {
+        watchdog.reset(new QDaemonWatchdog(stallThreshold));
+        watchdog->start();
+    }
+
+    if (!standby || serviceRegistered)
+        activate();
+    else  // Let the application warm up while waiting for the primary instance to go away
+        QMetaObject::invokeMethod(qApp, "standby", Qt::QueuedConnection);
+
+    if (upgrading)  // Report readiness after the application has initialized itself with the inherited descriptors
+        QMetaObject::invokeMethod(handoff, "notifyReady", Qt::QueuedConnection);
+
+    int status = QCoreApplication::exec();
+
+    statsPublisher->setState(QDaemonStatsBlock::StoppingState);
+
+    supervisor->stop();
+    if (watchdog)
+        watchdog->stop();
+    metricsServer->stop();
+
+    // The segment goes away before the service, so whoever takes the service over can publish its own
+    statsPublisher->close();
+    unregisterService();
+
+    return status;
+}
+
+void DaemonBackendLinux::activate()
+{
+    // Start serving the metrics (the failure isn't fatal, the daemon can run without the endpoint)
+    QString metricsEndpoint = QDaemonApplication::metricsEndpoint();
+    if (!metricsEndpoint.isEmpty())
+        metricsServer->listen(metricsEndpoint);
+
+    QStringList arguments = parser.positionalArguments();
+
+    int workers = QDaemonApplication::workerCount();
+    if (workers > 0 || parser.isSet(superviseOption))  {
+        // Supervise the children instead of running the application code in this process
+        if (arguments.size() > 0)
+            arguments.prepend(QStringLiteral("--"));
+
+        QString instance = QDaemonApplication::instanceId();
+        if (!instance.isEmpty())
+            arguments.prepend(QStringLiteral("--instance=%1").arg(instance));
+
+        // Memory locks aren't inherited across fork() and exec(), so the children set up their resources themselves
+        if (parser.isSet(maxFilesOption))
+            arguments.prepend(QStringLiteral("--%1=%2").arg(maxFilesName, parser.value(maxFilesOption)));
+        if (parser.isSet(lockMemoryOption))
+            arguments.prepend(QStringLiteral("--%1").arg(lockMemoryName));
+        if (parser.isSet(heapReserveOption))
+            arguments.prepend(QStringLiteral("--%1=%2").arg(heapReserveName, parser.value(heapReserveOption)));
+
+        QList<QStringList> childArguments;
+        if (workers > 0)  {
+            for (qint32 i = 0; i < workers; i++)
+                childArguments.append(QStringList() << QStringLiteral("-d") << QStringLiteral("--worker") << QString::number(i) << arguments);
+        }
+        else
+            childArguments.append(QStringList() << QStringLiteral("-d") << QStringLiteral("--supervised") << arguments);
+
+        supervisor->start(QDaemonApplication::applicationFilePath(), childArguments);
+    }
+    else  {
+        arguments.prepend(QDaemonApplication::applicationFilePath());
+        QMetaObject::invokeMethod(qApp, "daemonized", Qt::QueuedConnection, Q_ARG(QStringList, arguments));
+    }
+
+    // Queued after the application's initialization. The tools see it once the statistics are published, when the service is registered
+    QTimer::singleShot(0, statsPublisher, [this] () -> void  {
+        statsPublisher->setState(QDaemonStatsBlock::RunningState);
+    });
+}
+
+bool DaemonBackendLinux::configureSupervisor()
+{
+    QDaemonApplication * application = QDaemonApplication::instance();
 
+    // Workers are always restarted, a supervised daemon only when it fails
+    if (QDaemonApplication::workerCount() > 0)
+        supervisor->setRestartPolicy(QDaemonSupervisor::RestartAlways);
+    else
+        supervisor->setRestartPolicy(QDaemonSupervisor::RestartOnFailure);
+
+    if (parser.isSet(restartDelayOption))  {
+        QStringList values = parser.value(restartDelayOption).split(QLatin1Char(':'));
+
+        bool ok, maximumOk = true;
+        qint64 minimum = values.first().toLongLong(&ok), maximum = values.size() > 1 ? values.last().toLongLong(&maximumOk) : minimum * 300;
+        if (!ok || !maximumOk || values.size() > 2)  {
+            qDaemonLog(QStringLiteral("The restart delay must be given in milliseconds as min[:max] (%1).").arg(parser.value(restartDelayOption)), QDaemonLog::ErrorEntry);
+            return false;
+        }
+
+        supervisor->setBackoff(minimum, maximum);
+    }
+
+    if (parser.isSet(crashLimitOption))  {
+        QStringList values = parser.value(crashLimitOption).split(QLatin1Char('/'));
+
+        bool ok, windowOk = true;
+        qint32 count = values.first().toInt(&ok);
+        qint64 window = values.size() > 1 ? values.last().toLongLong(&windowOk) : 60;
+        if (!ok || !windowOk || values.size() > 2 || window <= 0)  {
+            qDaemonLog(QStringLiteral("The crash limit must be given as count[/seconds] (%1).").arg(parser.value(crashLimitOption)), QDaemonLog::ErrorEntry);
+            return false;
+        }
+
+        supervisor->setCrashLimit(count, window * 1000);
+    }
+
+    // Quit when the children are done, or with a failure when they can't keep running
+    QObject::connect(supervisor, &QDaemonSupervisor::finished, application, &QCoreApplication::quit);
+    QObject::connect(supervisor, &QDaemonSupervisor::crashLoop, application, [] () -> void  {
+        QCoreApplication::exit(EXIT_FAILURE);
+    });
+
+    // Pass the requests received by the supervisor on to the children
+    QObject::connect(application, &QDaemonApplication::reloadRequested, supervisor, [this] () -> void  {
+        supervisor->signal(SIGHUP);
+    });
+    QObject::connect(application, &QDaemonApplication::logReopenRequested, supervisor, [this] () -> void  {
+        supervisor->signal(SIGUSR1);
+    });
+    QObject::connect(application, &QDaemonApplication::dumpRequested, supervisor, [this] () -> void  {
+        supervisor->signal(SIGUSR2);
+    });
+
+    return true;
+}
+
+bool DaemonBackendLinux::configureScheduling()
+{
+    QStringList applied;
+
+    QList<int> cpus;
+    if (parser.isSet(cpusOption) && !QDaemonProcessTuning::parseCpuList(parser.value(cpusOption), cpus))  {
+        qDaemonLog(QStringLiteral("The CPUs must be given as a list of ranges, e.g. 0-3,8 (%1).").arg(parser.value(cpusOption)), QDaemonLog::ErrorEntry);
+        return false;
+    }
+
+    if (parser.isSet(numaNodeOption))  {
+        bool ok;
+        int node = parser.value(numaNodeOption).toInt(&ok);
+
+        QList<int> nodeCpus = ok ? QDaemonProcessTuning::numaNodeCpus(node) : QList<int>();
+        if (nodeCpus.isEmpty())  {
+            qDaemonLog(QStringLiteral("There's no NUMA node %1.").arg(parser.value(numaNodeOption)), QDaemonLog::ErrorEntry);
+            return false;
+        }
+
+        // Run on the node's CPUs, or on those of the given CPUs that belong to the node
+        if (!cpus.isEmpty())  {
+            QList<int> nodeSubset;
+            foreach (int cpu, cpus)  {
+                if (nodeCpus.contains(cpu))
+                    nodeSubset.append(cpu);
+            }
+            nodeCpus = nodeSubset;
+        }
+
+        if (nodeCpus.isEmpty())  {
+            qDaemonLog(QStringLiteral("None of the CPUs %1 belongs to the NUMA node %2.").arg(parser.value(cpusOption)).arg(node), QDaemonLog::ErrorEntry);
+            return false;
+        }
+
+        if (!QDaemonProcessTuning::bindMemory(node))  {
+            int error = errno;
+            qDaemonLog(QStringLiteral("Couldn't bind the memory to the NUMA node %1 (%2).").arg(node).arg(QString::fromLocal8Bit(std::strerror(error))), QDaemonLog::ErrorEntry);
+            return false;
+        }
+
+        cpus = nodeCpus;
+        applied.append(QStringLiteral("NUMA node %1").arg(node));
+    }
+
+    if (!cpus.isEmpty())  {
+        if (!QDaemonProcessTuning::setAffinity(cpus))  {
+            int error = errno;
+            qDaemonLog(QStringLiteral("Couldn't run the daemon on the CPUs %1 (%2).").arg(QDaemonProcessTuning::cpuListString(cpus)).arg(QString::fromLocal8Bit(std::strerror(error))), QDaemonLog::ErrorEntry);
+            return false;
+        }
+        applied.append(QStringLiteral("CPUs %1").arg(QDaemonProcessTuning::cpuListString(cpus)));
+    }
+
+    if (parser.isSet(niceOption))  {
+        bool ok;
+        int nice = parser.value(niceOption).toInt(&ok);
+        if (!ok || nice < -20 || nice > 19)  {
+            qDaemonLog(QStringLiteral("The nice value must be between -20 and 19 (%1).").arg(parser.value(niceOption)), QDaemonLog::ErrorEntry);
+            return false;
+        }
+
+        // Lowering the value requires CAP_SYS_NICE (or a matching RLIMIT_NICE)
+        if (!QDaemonProcessTuning::setNice(nice))  {
+            int error = errno;
+            qDaemonLog(QStringLiteral("Couldn't set the nice value to %1 (%2).").arg(nice).arg(QString::fromLocal8Bit(std::strerror(error))), QDaemonLog::ErrorEntry);
+            return false;
+        }
+        applied.append(QStringLiteral("nice %1").arg(nice));
+    }
+
+    if (parser.isSet(ioPriorityOption))  {
+        int priority;
+        if (!QDaemonProcessTuning::parseIoPriority(parser.value(ioPriorityOption), priority))  {
+            qDaemonLog(QStringLiteral("The I/O priority must be given as realtime[:level], best-effort[:level] or idle, with a level from 0 to 7 (%1).").arg(parser.value(ioPriorityOption)), QDaemonLog::ErrorEntry);
+            return false;
+        }
+
+        if (!QDaemonProcessTuning::setIoPriority(priority))  {
+            int error = errno;
+            qDaemonLog(QStringLiteral("Couldn't set the I/O priority to %1 (%2).").arg(parser.value(ioPriorityOption)).arg(QString::fromLocal8Bit(std::strerror(error))), QDaemonLog::ErrorEntry);
+            return false;
+        }
+        applied.append(QStringLiteral("I/O priority %1").arg(parser.value(ioPriorityOption)));
+    }
+
+    if (!applied.isEmpty())
+        qDaemonLog(QStringLiteral("Scheduling: %1.").arg(applied.join(QStringLiteral(", "))), QDaemonLog::NoticeEntry);
+
+    return true;
+}
+
+void DaemonBackendLinux::configureResources()
+{
+    // None of the failures is fatal, the daemon still runs, only with the limits it was started with
+    QStringList applied;
+
+    // The descriptor limit is always raised, up to the hard limit unless a count is given
+    qint64 maxFiles = -1, limit;
+    if (parser.isSet(maxFilesOption))  {
+        bool ok;
+        maxFiles = parser.value(maxFilesOption).toLongLong(&ok);
+        if (!ok || maxFiles <= 0)  {
+            qDaemonLog(QStringLiteral("The maximal number of open files must be a positive number (%1).").arg(parser.value(maxFilesOption)), QDaemonLog::WarningEntry);
+            maxFiles = -1;
+        }
+    }
+
+    if (QDaemonProcessTuning::raiseDescriptorLimit(maxFiles, limit))
+        applied.append(QStringLiteral("open files %1").arg(limit));
+    else  {
+        int error = errno;
+        qDaemonLog(QStringLiteral("Couldn't raise the limit of open files to %1, it remains %2 (%3).").arg(maxFiles < 0 ? QStringLiteral("the hard limit") : QString::number(maxFiles)).arg(limit).arg(QString::fromLocal8Bit(std::strerror(error))), QDaemonLog::WarningEntry);
+    }
+
+    if (parser.isSet(lockMemoryOption))  {
+        // Requires CAP_IPC_LOCK or a sufficient RLIMIT_MEMLOCK
+        if (QDaemonProcessTuning::lockMemory())
+            applied.append(QStringLiteral("memory locked"));
+        else  {
+            int error = errno;
+            qDaemonLog(QStringLiteral("Couldn't lock the daemon's memory (%1).").arg(QString::fromLocal8Bit(std::strerror(error))), QDaemonLog::WarningEntry);
+        }
+
+        // Fault in the stack the main thread is going to run on
+        QDaemonProcessTuning::prefaultStack(stackReserve);
+    }
+
+    if (parser.isSet(heapReserveOption))  {
+        qint64 size;
+        if (!QDaemonProcessTuning::parseSize(parser.value(heapReserveOption), size) || size == 0)
+            qDaemonLog(QStringLiteral("The heap reserve must be given in bytes with an optional K, M or G suffix (%1).").arg(parser.value(heapReserveOption)), QDaemonLog::WarningEntry);
+        else if (QDaemonProcessTuning::prefaultHeap(size))
+            applied.append(QStringLiteral("heap reserve %1 bytes").arg(size));
+        else  {
+            int error = errno;
+            qDaemonLog(QStringLiteral("Couldn't prefault a heap reserve of %1 bytes (%2).").arg(size).arg(QString::fromLocal8Bit(std::strerror(error))), QDaemonLog::WarningEntry);
+        }
+    }
+
+    if (!applied.isEmpty())
+        qDaemonLog(QStringLiteral("Resources: %1.").arg(applied.join(QStringLiteral(", "))), QDaemonLog::NoticeEntry);
+}
+
+int DaemonBackendLinux::execChild()
+{
+    if (parser.isSet(workerOption))  {
+        bool ok;
+        int index = parser.value(workerOption).toInt(&ok);
+        if (!ok || index < 0)  {
+            qDaemonLog(QStringLiteral("Invalid worker index (%1).").arg(parser.value(workerOption)), QDaemonLog::ErrorEntry);
+            return BackendFailed;
+        }
+
+        QDaemonApplicationPrivate::workerIndex = index;
+    }
+
+    // Don't outlive the supervisor, the signal goes through the regular handler so the child quits cleanly
+    ::prctl(PR_SET_PDEATHSIG, SIGTERM);
+
+    configureResources();
+
+    // The supervisor owns the D-Bus service and the metrics endpoint, the child only runs the application code
+    QScopedPointer<QDaemonWatchdog> watchdog;
+    int stallThreshold = QDaemonApplication::stallThreshold();
+    if (stallThreshold > 0)  {
+        watchdog.reset(new QDaemonWatchdog(stallThreshold));
+        watchdog->start();
+    }
+
+    // The statistics of the application code are in the child, so it publishes them next to the supervisor's (a supervised child is worker 0)
+    int worker = qMax(0, QDaemonApplication::workerIndex());
+    if (!statsPublisher->open(QDaemonStatsReader::segmentName(QDaemonApplication::instanceId(), worker)))  {
+        int error = errno;
+        qDaemonLog(QStringLiteral("Can't publish the statistics of worker %1 in shared memory (%2).").arg(worker).arg(QString::fromLocal8Bit(std::strerror(error))), QDaemonLog::WarningEntry);
+    }
+
+    QStringList arguments = parser.positionalArguments();
+    arguments.prepend(QDaemonApplication::applicationFilePath());
+
+    QMetaObject::invokeMethod(qApp, "daemonized", Qt::QueuedConnection, Q_ARG(QStringList, arguments));
+    QTimer::singleShot(0, statsPublisher, [this] () -> void  {
+        statsPublisher->setState(QDaemonStatsBlock::RunningState);
+    });
+
+    int status = QCoreApplication::exec();
+
+    statsPublisher->setState(QDaemonStatsBlock::StoppingState);
+    if (watchdog)
+        watchdog->stop();
+    statsPublisher->close();
+
+    return status;
+}
+
+QDBusConnection DaemonBackendLinux::bus() const
+{
+    // The control object is served on a connection of its own, not the application's (the one it was registered on in the background, if so)
+    return QDBusConnection::connectToBus(QDBusConnection::SystemBus, busConnectionName);
+}
+
+bool DaemonBackendLinux::registerService()
+{
     // Connect to the DBus infrastructure
-    QDBusConnection dbus = QDBusConnection::systemBus();
+    QDBusConnection dbus = bus();
     if (!dbus.isConnected())  {
         qDaemonLog(QStringLiteral("Can't connect to the D-Bus system bus: %1").arg(dbus.lastError().message()), QDaemonLog::ErrorEntry);
-        return BackendFailed;
+        return false;
     }
 
     // Register the service
-    if (!dbus.registerService(service))  {
+    if (!dbus.registerService(serviceName()))  {
         qDaemonLog(QStringLiteral("Couldn't register a service with the D-Bus system bus: %1").arg(dbus.lastError().message()), QDaemonLog::ErrorEntry);
-        return BackendFailed;
+        return false;
+    }
+
+    return registerObject();
+}
+
+void DaemonBackendLinux::registerServiceInBackground()
+{
+    // The daemon starts working right away, the control operations are available once the service is registered
+    registration = new QDaemonBusRegistration(serviceName(), control, this);
+
+    QObject::connect(registration, &QDaemonBusRegistration::registered, this, &DaemonBackendLinux::completeRegistration);
+    QObject::connect(registration, &QDaemonBusRegistration::retrying, this, [] (const QString & error) -> void  {
+        qDaemonLog(QStringLiteral("%1. Retrying in the background.").arg(error), QDaemonLog::WarningEntry);
+    });
+    QObject::connect(registration, &QDaemonBusRegistration::failed, this, [] (const QString & error) -> void  {
+        // Without the service the daemon can't be controlled, so it doesn't keep running
+        qDaemonLog(error, QDaemonLog::ErrorEntry);
+        QCoreApplication::exit(BackendFailed);
+    });
+
+    registration->start();
+}
+
+void DaemonBackendLinux::completeRegistration(const QString & connectionName, int attempts, qint64 latency)
+{
+    busConnectionName = connectionName;
+    serviceRegistered = true;
+
+    registrationLatency.set(latency);
+    QDaemonStartupProfiler::mark(QStringLiteral("service registered"));
+
+    qDaemonLog(QStringLiteral("The D-Bus service was registered in the background in %1 ms (%2 attempt(s)).").arg(latency).arg(attempts), QDaemonLog::NoticeEntry);
+
+    publishStatistics();
+}
+
+bool DaemonBackendLinux::queueService()
+{
+    // Connect to the DBus infrastructure
+    QDBusConnection dbus = bus();
+    if (!dbus.isConnected())  {
+        qDaemonLog(QStringLiteral("Can't connect to the D-Bus system bus: %1").arg(dbus.lastError().message()), QDaemonLog::ErrorEntry);
+        return false;
     }
 
+    // Wait in the bus' queue for the service name, the bus hands it over as soon as the primary instance releases it or dies
+    QDBusConnectionInterface * bus = dbus.interface();
+    QObject::connect(bus, &QDBusConnectionInterface::serviceRegistered, this, &DaemonBackendLinux::takeOver);
+
+    QDBusReply<QDBusConnectionInterface::RegisterServiceReply> reply = bus->registerService(serviceName(), QDBusConnectionInterface::QueueService, QDBusConnectionInterface::DontAllowReplacement);
+    if (!reply.isValid())  {
+        qDaemonLog(QStringLiteral("Couldn't queue for the service with the D-Bus system bus: %1").arg(reply.error().message()), QDaemonLog::ErrorEntry);
+        return false;
+    }
+
+    if (reply.value() == QDBusConnectionInterface::ServiceRegistered)  {
+        qDaemonLog(QStringLiteral("There's no primary instance running, starting the standby instance as primary."), QDaemonLog::NoticeEntry);
+        return registerObject();
+    }
+
+    qDaemonLog(QStringLiteral("The daemon is on standby."), QDaemonLog::NoticeEntry);
+    standbyTimer.start();
+    return true;
+}
+
+void DaemonBackendLinux::takeOver(const QString & name)
+{
+    if (serviceRegistered || name != serviceName())
+        return;
+
+    // The primary instance is gone and the bus gave the service to us
+    if (!registerObject())  {
+        QCoreApplication::exit(EXIT_FAILURE);
+        return;
+    }
+
+    qDaemonLog(QStringLiteral("The standby instance took over the service (on standby for %1 s).").arg(standbyTimer.elapsed() / 1000), QDaemonLog::NoticeEntry);
+    activate();
+}
+
+bool DaemonBackendLinux::registerObject()
+{
+    QDBusConnection dbus = bus();
+
     // Register the object
-    if (!dbus.registerObject(QStringLiteral("/"), this, QDBusConnection::ExportAllInvokables))  {
+    if (!dbus.registerObject(QStringLiteral("/"), control, QDBusConnection::ExportAllInvokables))  {
         qDaemonLog(QStringLiteral("Couldn't register an object with the D-Bus system bus. (%1)").arg(dbus.lastError().message()), QDaemonLog::ErrorEntry);
-        return BackendFailed;
+        dbus.unregisterService(serviceName());
+        return false;
     }
 
-    QStringList arguments = parser.positionalArguments();
-    arguments.prepend(QDaemonApplication::applicationFilePath());
+    serviceRegistered = true;
+    QDaemonStartupProfiler::mark(QStringLiteral("service registered"));
 
-    QMetaObject::invokeMethod(qApp, "daemonized", Qt::QueuedConnection, Q_ARG(QStringList, arguments));
+    publishStatistics();
+    return true;
+}
 
-    int status = QCoreApplication::exec();
+void DaemonBackendLinux::publishStatistics()
+{
+    // Published by the owner of the service only, the process the tools look for (not fatal, the daemon can run without it)
+    if (!statsPublisher->open(QDaemonStatsReader::segmentName(QDaemonApplication::instanceId())))  {
+        int error = errno;
+        qDaemonLog(QStringLiteral("Can't publish the statistics in shared memory (%1).").arg(QString::fromLocal8Bit(std::strerror(error))), QDaemonLog::WarningEntry);
+    }
+}
+
+void DaemonBackendLinux::unregisterService()
+{
+    // Don't let a registration still in progress outlive the daemon
+    if (registration)
+        registration->stop();
+
+    if (!serviceRegistered)
+        return;
+
+    serviceRegistered = false;
+    QDBusConnection dbus = bus();
 
     // Unregister the object
     dbus.unregisterObject(QStringLiteral("/"));
 
     // Unregister the service
-    if (!dbus.unregisterService(service))
+    if (!dbus.unregisterService(serviceName()))
         qDaemonLog(QStringLiteral("Can't unregister service from D-bus. (%1)").arg(dbus.lastError().message()), QDaemonLog::WarningEntry);
-
-    return status;
 }
 
-bool DaemonBackendLinux::isRunning()
+void DaemonBackendLinux::handOver()
 {
-    return true;	// This is just for notifying the controlling process. The function is invoked over D-Bus only.
+    // The upgraded instance is ready, release the service (and the statistics) for it and quit
+    statsPublisher->close();
+    unregisterService();
+    handoff->notifyReleased();
+
+    qDaemonLog(QStringLiteral("The daemon was upgraded. Draining the remaining work before quitting."), QDaemonLog::NoticeEntry);
+
+    emit QDaemonApplication::instance()->upgraded();
+    qApp->quit();
 }
 
-bool DaemonBackendLinux::stop()
+void DaemonBackendLinux::prepareUpgrade(const QDBusMessage & request)
 {
-    qApp->quit();	// This is just to respond to the controlling process. The function is invoked over D-Bus only.
-    return true;
+    // Requested over D-Bus. The name of the handoff socket is passed to the upgraded instance
+    QString name = handoff->listen(serviceName(), QDaemonApplicationPrivate::registeredDescriptors);
+    bus().send(request.createReply(name));
 }
 
 QString DaemonBackendLinux::serviceName()
+{
+    return serviceName(QDaemonApplication::instanceId());
+}
+
+QString DaemonBackendLinux::serviceName(const QString & instance)
 {
     QString executable = QFileInfo(QDaemonApplication::applicationFilePath()).completeBaseName();
     QString domain = QDaemonApplication::organizationDomain();
 
+    // Qualify the name when running one of several instances
+    if (!instance.isEmpty())
+        executable += QLatin1Char('_') + instance;
+
     // Get the service name
     if (domain.isEmpty())
         return QStringLiteral("io.qt.QtDaemon.%1").arg(executable);
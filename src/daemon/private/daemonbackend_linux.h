@@ -41,20 +41,28 @@
 #define DAEMONBACKEND_LINUX_H
 
 #include "QtDaemon/qabstractdaemonbackend.h"
+#include "qdaemoncontrol_p.h"
+#include "qdaemonmetrics.h"
 
 #include <QtCore/qobject.h>
-
-#define Q_DAEMON_DBUS_CONTROL_INTERFACE "io.qt.QtDaemon.Control"
+#include <QtCore/qthread.h>
+#include <QtCore/qelapsedtimer.h>
 
 QT_BEGIN_NAMESPACE
 
+class QDBusConnection;
+
 namespace QtDaemon
 {
+    class QDaemonBusRegistration;
+    class QDaemonHandoff;
+    class QDaemonSupervisor;
+    class QDaemonMetricsServer;
+    class QDaemonStatsPublisher;
     class Q_DAEMON_LOCAL DaemonBackendLinux : public QObject, public QAbstractDaemonBackend
     {
         Q_OBJECT
         Q_DISABLE_COPY(DaemonBackendLinux)
-        Q_CLASSINFO("D-Bus Interface", Q_DAEMON_DBUS_CONTROL_INTERFACE)
 
     public:
         DaemonBackendLinux(QCommandLineParser &);
@@ -62,10 +70,69 @@ namespace QtDaemon
 
         int exec() Q_DECL_OVERRIDE;
 
-        Q_INVOKABLE bool isRunning();
-        Q_INVOKABLE bool stop();
-
         static QString serviceName();
+        static QString serviceName(const QString &);
+
+        static const QString superviseName;
+        static const QString restartDelayName;
+        static const QString crashLimitName;
+        static const QString standbyName;
+        static const QString cpusName;
+        static const QString numaNodeName;
+        static const QString niceName;
+        static const QString ioPriorityName;
+        static const QString maxFilesName;
+        static const QString lockMemoryName;
+        static const QString heapReserveName;
+        static const QString deferRegistrationName;
+
+    private:
+        QDBusConnection bus() const;
+        bool registerService();
+        void registerServiceInBackground();
+        void completeRegistration(const QString &, int, qint64);
+        bool queueService();
+        bool registerObject();
+        void publishStatistics();
+        void takeOver(const QString &);
+        void activate();
+        void unregisterService();
+        void handOver();
+        void prepareUpgrade(const QDBusMessage &);
+        bool configureSupervisor();
+        bool configureScheduling();
+        void configureResources();
+        int execChild();
+
+        static const int stackReserve = 256 * 1024;     // How much of the main thread's stack is faulted in when locking the memory
+        static const QString controlConnectionName;
+
+        QCommandLineOption handoffOption;
+        QCommandLineOption workerOption;
+        QCommandLineOption supervisedOption;
+        QCommandLineOption superviseOption;
+        QCommandLineOption restartDelayOption;
+        QCommandLineOption crashLimitOption;
+        QCommandLineOption standbyOption;
+        QCommandLineOption cpusOption;
+        QCommandLineOption numaNodeOption;
+        QCommandLineOption niceOption;
+        QCommandLineOption ioPriorityOption;
+        QCommandLineOption maxFilesOption;
+        QCommandLineOption lockMemoryOption;
+        QCommandLineOption heapReserveOption;
+        QCommandLineOption deferRegistrationOption;
+        QDaemonHandoff * handoff;
+        QDaemonSupervisor * supervisor;
+        QDaemonMetricsServer * metricsServer;
+        QDaemonStatsPublisher * statsPublisher;
+        QDaemonBusRegistration * registration;
+        QDaemonControl * control;
+        QThread controlThread;
+        QDaemonGauge registrationLatency;
+        QString busConnectionName;
+        QElapsedTimer standbyTimer;
+        bool serviceRegistered;
     };
 }
 
@@ -54,6 +54,10 @@ QAbstractControllerBackend::QAbstractControllerBackend(QCommandLineParser & pars
       startOption(QStringList() << QStringLiteral("s") << QStringLiteral("start"), QCoreApplication::translate("main", "Start the daemon")),
       stopOption(QStringList() << QStringLiteral("t") << QStringLiteral("stop"), QCoreApplication::translate("main", "Stop the daemon")),
       statusOption(QStringList() << QStringLiteral("status"), QCoreApplication::translate("main", "Check the daemon status")),
+      statsOption(QStringList() << QStringLiteral("stats"), QCoreApplication::translate("main", "Print the daemon's runtime statistics")),
+      watchOption(QStringList() << QStringLiteral("watch"), QCoreApplication::translate("main", "Continuously display the daemon's resource usage and statistics")),
+      reloadOption(QStringList() << QStringLiteral("reload"), QCoreApplication::translate("main", "Ask the daemon to reload its configuration")),
+      upgradeOption(QStringList() << QStringLiteral("upgrade"), QCoreApplication::translate("main", "Replace the running daemon with this executable without downtime")),
       fakeOption(QStringLiteral("fake"), QCoreApplication::translate("main", "Run the daemon in fake mode (for debugging)."))
 {
     parser.addOption(installOption);
@@ -61,6 +65,10 @@ QAbstractControllerBackend::QAbstractControllerBackend(QCommandLineParser & pars
     parser.addOption(startOption);
     parser.addOption(stopOption);
     parser.addOption(statusOption);
+    parser.addOption(statsOption);
+    parser.addOption(watchOption);
+    parser.addOption(reloadOption);
+    parser.addOption(upgradeOption);
     parser.addOption(fakeOption);
     parser.addHelpOption();
 }
@@ -77,8 +85,21 @@ int QAbstractControllerBackend::exec()
     else if (parser.isSet(uninstallOption))
         result = uninstall();
     else if (parser.isSet(statusOption))  {
-        qDaemonLog() << (status() == RunningStatus ? QCoreApplication::translate("main", "Daemon is running.") : QCoreApplication::translate("main", "Daemon is not running or it's not responding."));
+        bool running = status() == RunningStatus;
+        qDaemonLog() << (running ? QCoreApplication::translate("main", "Daemon is running.") : QCoreApplication::translate("main", "Daemon is not running or it's not responding."));
+
+        QString details = statusDetails();
+        if (!details.isEmpty())
+            qDaemonLog() << details;
     }
+    else if (parser.isSet(statsOption))
+        result = statistics();
+    else if (parser.isSet(watchOption))
+        result = watch();
+    else if (parser.isSet(reloadOption))
+        result = reload();
+    else if (parser.isSet(upgradeOption))
+        result = upgrade();
     else if (parser.isSet(fakeOption))  {
         autoQuit = false;	// Enforce not quitting
 
@@ -101,4 +122,33 @@ int QAbstractControllerBackend::exec()
     return QCoreApplication::exec();
 }
 
+QString QAbstractControllerBackend::statusDetails()
+{
+    return QString();   // Nothing more than running or not by default
+}
+
+bool QAbstractControllerBackend::statistics()
+{
+    qDaemonLog(QCoreApplication::translate("main", "Runtime statistics are not supported on this platform."), QDaemonLog::WarningEntry);
+    return false;
+}
+
+bool QAbstractControllerBackend::watch()
+{
+    qDaemonLog(QCoreApplication::translate("main", "Watching the daemon is not supported on this platform."), QDaemonLog::WarningEntry);
+    return false;
+}
+
+bool QAbstractControllerBackend::reload()
+{
+    qDaemonLog(QCoreApplication::translate("main", "Reloading the configuration is not supported on this platform."), QDaemonLog::WarningEntry);
+    return false;
+}
+
+bool QAbstractControllerBackend::upgrade()
+{
+    qDaemonLog(QCoreApplication::translate("main", "Upgrading the daemon is not supported on this platform."), QDaemonLog::WarningEntry);
+    return false;
+}
+
 QT_END_NAMESPACE
@@ -88,6 +88,11 @@ namespace QtDaemon
         virtual bool install() = 0;
         virtual bool uninstall() = 0;
         virtual DaemonStatus status() = 0;
+        virtual QString statusDetails();
+        virtual bool statistics();
+        virtual bool watch();
+        virtual bool reload();
+        virtual bool upgrade();
 
     protected:
         bool autoQuit;
@@ -97,6 +102,10 @@ namespace QtDaemon
         const QCommandLineOption startOption;
         const QCommandLineOption stopOption;
         const QCommandLineOption statusOption;
+        const QCommandLineOption statsOption;
+        const QCommandLineOption watchOption;
+        const QCommandLineOption reloadOption;
+        const QCommandLineOption upgradeOption;
         const QCommandLineOption fakeOption;
     };
 }
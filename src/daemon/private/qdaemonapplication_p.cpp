@@ -29,15 +29,34 @@
 #include "qdaemonapplication_p.h"
 #include "qdaemonapplication.h"
 #include "qdaemonlog_p.h"
+#include "qdaemonmetrics_p.h"
+#include "qdaemonexecutor_p.h"
+#include "qdaemonstartupprofiler_p.h"
+
+#include <QtCore/qmath.h>
+#include <QtCore/qthread.h>
 
 #include <csignal>
 
+#ifdef Q_OS_UNIX
+#include <QtCore/qsocketnotifier.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
 #if defined(Q_OS_WIN)
 #include "daemonbackend_win.h"
 #include "controllerbackend_win.h"
 #elif defined(Q_OS_LINUX)
 #include "daemonbackend_linux.h"
 #include "controllerbackend_linux.h"
+#include "qdaemonprocesstuning_p.h"
+#include "qdaemoncontrolgroup_p.h"
 #elif defined(Q_OS_OSX)
 #include "daemonbackend_osx.h"
 #include "controllerbackend_osx.h"
@@ -61,25 +80,111 @@ typedef ControllerBackendOSX ControllerBackend;
 #endif
 
 QString QDaemonApplicationPrivate::description;
+QString QDaemonApplicationPrivate::metricsEndpoint;
+int QDaemonApplicationPrivate::stallThreshold = 0;
+int QDaemonApplicationPrivate::workerCount = 0;
+int QDaemonApplicationPrivate::executorThreadCount = 0;
+int QDaemonApplicationPrivate::workerIndex = -1;
+QString QDaemonApplicationPrivate::instanceId;
+const QString QDaemonApplicationPrivate::allInstances = QStringLiteral("all");
+QHash<QString, int> QDaemonApplicationPrivate::registeredDescriptors;
+QHash<QString, int> QDaemonApplicationPrivate::inheritedDescriptors;
+
+#ifdef Q_OS_UNIX
+int QDaemonApplicationPrivate::signalDescriptors[2] = { -1, -1 };
+
+static const int handledSignals[] = { SIGTERM, SIGINT, SIGHUP, SIGUSR1, SIGUSR2 };
+#endif
 
 QDaemonApplicationPrivate::QDaemonApplicationPrivate(QDaemonApplication * q)
-    : q_ptr(q), log(*new QDaemonLogPrivate), autoQuit(true)
+    : q_ptr(q), log(*new QDaemonLogPrivate), metrics(*new QDaemonMetricsPrivate), executor(*new QDaemonExecutorPrivate), autoQuit(true)
 {
+    // Connected first, so the executor is up before the application's own slots run
+    QObject::connect(q, &QDaemonApplication::daemonized, q, [this] () -> void  {
+        QDaemonStartupProfiler::mark(QStringLiteral("daemonized"));
+        executor.d_ptr->start(executorThreadCount);
+    });
+
+    // Queued, so the startup is complete once the application's slots have returned
+    QObject::connect(q, &QDaemonApplication::daemonized, q, [] () -> void  {
+        QDaemonStartupProfiler::finish();
+    }, Qt::QueuedConnection);
+
+    std::signal(SIGSEGV, QDaemonApplicationPrivate::processSignalHandler);
+
+#ifdef Q_OS_UNIX
+    // Signals are only queued in the handler and dispatched from the event loop (self-pipe)
+    if (Q_UNLIKELY(::socketpair(AF_UNIX, SOCK_STREAM, 0, signalDescriptors) != 0))  {
+        qWarning("Couldn't create the signal dispatching socket pair. Falling back to quitting on SIGTERM and SIGINT only.");
+        signalDescriptors[0] = signalDescriptors[1] = -1;
+        std::signal(SIGTERM, QDaemonApplicationPrivate::processSignalHandler);
+        std::signal(SIGINT, QDaemonApplicationPrivate::processSignalHandler);
+        return;
+    }
+
+    for (int i = 0; i < 2; i++)  {
+        ::fcntl(signalDescriptors[i], F_SETFL, ::fcntl(signalDescriptors[i], F_GETFL) | O_NONBLOCK);
+        ::fcntl(signalDescriptors[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    QSocketNotifier * notifier = new QSocketNotifier(signalDescriptors[0], QSocketNotifier::Read, q);
+    QObject::connect(notifier, &QSocketNotifier::activated, q, [this] () -> void  {
+        dispatchSignals();
+    });
+
+    struct sigaction action;
+    ::sigemptyset(&action.sa_mask);
+    action.sa_handler = QDaemonApplicationPrivate::processSignalHandler;
+    action.sa_flags = SA_RESTART;
+    for (int signalNumber : handledSignals)
+        ::sigaction(signalNumber, &action, Q_NULLPTR);
+#else
     std::signal(SIGTERM, QDaemonApplicationPrivate::processSignalHandler);
     std::signal(SIGINT, QDaemonApplicationPrivate::processSignalHandler);
-    std::signal(SIGSEGV, QDaemonApplicationPrivate::processSignalHandler);
+#endif
 }
 
 QDaemonApplicationPrivate::~QDaemonApplicationPrivate()
 {
+    // The asynchronous log writer publishes metrics, so it's stopped while the registry is still around
+    log.setAsynchronous(false);
+
+#ifdef Q_OS_UNIX
+    if (signalDescriptors[0] < 0)
+        return;
+
+    for (int signalNumber : handledSignals)
+        std::signal(signalNumber, SIG_DFL);
+
+    ::close(signalDescriptors[0]);
+    ::close(signalDescriptors[1]);
+    signalDescriptors[0] = signalDescriptors[1] = -1;
+#endif
 }
 
 void QDaemonApplicationPrivate::processSignalHandler(int signalNumber)
 {
+    if (signalNumber == SIGSEGV)  {
+        // Die from the signal so the parent (e.g. the supervisor) sees a crash instead of a regular exit
+        std::signal(SIGSEGV, SIG_DFL);
+        std::raise(SIGSEGV);
+        return;
+    }
+
+#ifdef Q_OS_UNIX
+    if (signalDescriptors[1] >= 0)  {
+        // Only queue the signal number here (async-signal-safe), it's handled from the event loop in dispatchSignals()
+        int error = errno;
+        char signalByte = char(signalNumber);
+        while (::write(signalDescriptors[1], &signalByte, 1) < 0 && errno == EINTR)
+            ;
+        errno = error;
+        return;
+    }
+#endif
+
     switch (signalNumber)
     {
-    case SIGSEGV:
-       ::exit(-1);
     case SIGTERM:
     case SIGINT:
         {
@@ -95,9 +200,143 @@ void QDaemonApplicationPrivate::processSignalHandler(int signalNumber)
     }
 }
 
+#ifdef Q_OS_UNIX
+void QDaemonApplicationPrivate::dispatchSignals()
+{
+    Q_Q(QDaemonApplication);
+
+    char signalBytes[64];
+    ssize_t count;
+    while ((count = ::read(signalDescriptors[0], signalBytes, sizeof(signalBytes))) > 0 || (count < 0 && errno == EINTR))  {
+        for (ssize_t i = 0; i < count; i++)  {
+            switch (signalBytes[i])
+            {
+            case SIGTERM:
+            case SIGINT:
+                q->quit();
+                break;
+            case SIGHUP:
+                emit q->reloadRequested();
+                break;
+            case SIGUSR1:
+                log.reopen();
+                emit q->logReopenRequested();
+                break;
+            case SIGUSR2:
+                log << QStringLiteral("Runtime statistics:\n%1").arg(metrics.toString());
+                emit q->dumpRequested();
+                break;
+            default:
+                break;
+            }
+        }
+    }
+}
+#endif
+
+bool QDaemonApplicationPrivate::isValidInstanceId(const QString & id)
+{
+    // The id goes into the D-Bus service name and file names, so keep it to the characters that are valid everywhere.
+    // The controller's selector for all the running instances isn't an id either.
+    if (id.isEmpty() || id == allInstances)
+        return false;
+
+    foreach (QChar c, id)  {
+        if (c.unicode() > 0x7F || (!c.isLetterOrNumber() && c != QLatin1Char('_')))
+            return false;
+    }
+
+    return true;
+}
+
+#ifdef Q_OS_LINUX
+void QDaemonApplicationPrivate::inheritActivatedDescriptors()
+{
+    // The variables are consumed once they're found to be meant for this process, so calling this again is harmless
+    static const int firstDescriptor = 3;   // The passed descriptors always start after stdin, stdout and stderr (SD_LISTEN_FDS_START)
+
+    bool ok;
+    qint64 pid = qgetenv("LISTEN_PID").toLongLong(&ok);
+    if (!ok || pid != ::getpid())
+        return;     // Not activated, or the variables were meant for another process
+
+    int count = qgetenv("LISTEN_FDS").toInt(&ok);
+    QList<QByteArray> names = qgetenv("LISTEN_FDNAMES").split(':');
+
+    // The variables are for this process only, don't leak them to the children
+    qunsetenv("LISTEN_PID");
+    qunsetenv("LISTEN_FDS");
+    qunsetenv("LISTEN_FDNAMES");
+
+    if (!ok || count <= 0)
+        return;
+
+    for (qint32 i = 0; i < count; i++)  {
+        int descriptor = firstDescriptor + i;
+        ::fcntl(descriptor, F_SETFD, FD_CLOEXEC);
+
+        // Unnamed sockets get the same name the service manager uses by default
+        QString name = QString::fromUtf8(names.value(i));
+        if (name.isEmpty())
+            name = QStringLiteral("unknown");
+
+        if (inheritedDescriptors.contains(name))  {
+            qDaemonLog(QStringLiteral("The socket %1 was passed more than once, only the first one will be used.").arg(name), QDaemonLog::WarningEntry);
+            continue;
+        }
+
+        inheritedDescriptors.insert(name, descriptor);
+    }
+
+    qDaemonLog(QStringLiteral("Inherited %1 socket(s) from the service manager.").arg(count), QDaemonLog::NoticeEntry);
+}
+#endif
+
+int QDaemonApplicationPrivate::detectCpuCount()
+{
+    int count = qMax(1, QThread::idealThreadCount());
+
+#if defined(Q_OS_LINUX)
+    // The affinity mask reflects taskset and the cpuset, the quota only shows up in the cgroup
+    int allowed = QDaemonProcessTuning::allowedCpus().size(), effective = QDaemonControlGroup::effectiveCpus().size();
+    if (allowed > 0)
+        count = allowed;
+    if (effective > 0)
+        count = qMin(count, effective);
+
+    double quota = QDaemonControlGroup::cpuQuota();
+    if (quota > 0)
+        count = qMin(count, qMax(1, qCeil(quota)));
+#endif
+
+    return count;
+}
+
+qint64 QDaemonApplicationPrivate::detectMemoryBudget()
+{
+    qint64 budget = -1;
+
+#ifdef Q_OS_UNIX
+    long pages = ::sysconf(_SC_PHYS_PAGES), pageSize = ::sysconf(_SC_PAGESIZE);
+    if (pages > 0 && pageSize > 0)
+        budget = qint64(pages) * pageSize;
+#endif
+
+#if defined(Q_OS_LINUX)
+    qint64 limit = QDaemonControlGroup::memoryLimit();
+    if (limit >= 0 && (budget < 0 || limit < budget))
+        budget = limit;
+#endif
+
+    return budget;
+}
+
 QAbstractDaemonBackend * QDaemonApplicationPrivate::createBackend(bool isDaemon)
 {
     if (isDaemon)  {
+        if (!instanceId.isEmpty())
+            log.d_ptr->setInstanceId(instanceId);
+
         log.setLogType(QDaemonLog::LogToFile);
         return new DaemonBackend(parser);
     }
@@ -105,4 +344,9 @@ QAbstractDaemonBackend * QDaemonApplicationPrivate::createBackend(bool isDaemon)
         return new ControllerBackend(parser, autoQuit);
 }
 
+void QDaemonApplicationPrivate::stopExecutor()
+{
+    executor.d_ptr->stop();
+}
+
 QT_END_NAMESPACE
@@ -42,9 +42,12 @@
 
 #include "qdaemon-global.h"
 #include "qdaemonlog.h"
+#include "qdaemonmetrics.h"
+#include "qdaemonexecutor.h"
 
 #include <QtCore/qcommandlineparser.h>
 #include <QtCore/qcommandlineoption.h>
+#include <QtCore/qhash.h>
 
 QT_BEGIN_NAMESPACE
 
@@ -61,21 +64,48 @@ public:
     QDaemonApplicationPrivate(QDaemonApplication *);
     ~QDaemonApplicationPrivate();
 
+    // Shared with the backends
+    static QHash<QString, int> registeredDescriptors;
+    static QHash<QString, int> inheritedDescriptors;
+    static int workerIndex;
+    static QString instanceId;
+    static const QString allInstances;
+
+    static bool isValidInstanceId(const QString &);
+#ifdef Q_OS_LINUX
+    static void inheritActivatedDescriptors();
+#endif
+
 private:
     int exec();
 
     static void processSignalHandler(int);
+    static int detectCpuCount();
+    static qint64 detectMemoryBudget();
+#ifdef Q_OS_UNIX
+    void dispatchSignals();
+#endif
 
 private:
     QtDaemon::QAbstractDaemonBackend * createBackend(bool);
+    void stopExecutor();
 
 private:
     QDaemonApplication * q_ptr;
     QDaemonLog log;
+    QDaemonMetrics metrics;
+    QDaemonExecutor executor;
     bool autoQuit;
     QCommandLineParser parser;
 
     static QString description;
+#ifdef Q_OS_UNIX
+    static int signalDescriptors[2];
+#endif
+    static QString metricsEndpoint;
+    static int stallThreshold;
+    static int workerCount;
+    static int executorThreadCount;
 };
 
 QT_END_NAMESPACE
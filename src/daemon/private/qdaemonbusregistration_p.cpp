@@ -0,0 +1,132 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include "qdaemonbusregistration_p.h"
+
+#include <QtCore/qelapsedtimer.h>
+
+#include <QtDBus/qdbusconnection.h>
+#include <QtDBus/qdbuserror.h>
+#include <QtDBus/qdbusreply.h>
+#include <QtDBus/qdbusconnectioninterface.h>
+
+QT_BEGIN_NAMESPACE
+
+using namespace QtDaemon;
+
+const int QDaemonBusRegistration::minimumRetryDelay = 100;      // In milliseconds, doubled after each failed attempt
+const int QDaemonBusRegistration::maximumRetryDelay = 5000;
+
+QDaemonBusRegistration::QDaemonBusRegistration(const QString & serviceName, QObject * exported, QObject * parent)
+    : QThread(parent), service(serviceName), object(exported), stopRequested(false)
+{
+}
+
+QDaemonBusRegistration::~QDaemonBusRegistration()
+{
+    stop();
+}
+
+void QDaemonBusRegistration::stop()
+{
+    QMutexLocker lock(&mutex);
+    stopRequested = true;
+    condition.wakeAll();
+    lock.unlock();
+
+    wait();
+}
+
+void QDaemonBusRegistration::run()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    int delay = minimumRetryDelay;
+    for (int attempts = 1; ; attempts++)  {
+        // Each attempt gets its own connection, a failed default connection (QDBusConnection::systemBus()) is never retried
+        QString connectionName = QStringLiteral("qtdaemon_registration_%1").arg(attempts), error;
+
+        AttemptResult result = attempt(connectionName, error);
+        if (result == Registered)  {
+            emit registered(connectionName, attempts, timer.elapsed());
+            return;
+        }
+
+        QDBusConnection::disconnectFromBus(connectionName);
+        if (result == Failed)  {
+            emit failed(error);
+            return;
+        }
+
+        if (attempts == 1)
+            emit retrying(error);
+
+        QMutexLocker lock(&mutex);
+        Q_UNUSED(lock);
+
+        if (!stopRequested)
+            condition.wait(&mutex, delay);
+        if (stopRequested)
+            return;
+
+        delay = qMin(delay * 2, maximumRetryDelay);
+    }
+}
+
+QDaemonBusRegistration::AttemptResult QDaemonBusRegistration::attempt(const QString & connectionName, QString & error)
+{
+    QDBusConnection dbus = QDBusConnection::connectToBus(QDBusConnection::SystemBus, connectionName);
+    if (!dbus.isConnected())  {
+        error = QStringLiteral("Can't connect to the D-Bus system bus: %1").arg(dbus.lastError().message());
+        return Retry;
+    }
+
+    // Export the object first, so the control calls are served as soon as the name is acquired
+    if (!dbus.registerObject(QStringLiteral("/"), object, QDBusConnection::ExportAllInvokables))  {
+        error = QStringLiteral("Couldn't register an object with the D-Bus system bus. (%1)").arg(dbus.lastError().message());
+        return Failed;
+    }
+
+    QDBusReply<QDBusConnectionInterface::RegisterServiceReply> reply = dbus.interface()->registerService(service, QDBusConnectionInterface::DontQueueService, QDBusConnectionInterface::DontAllowReplacement);
+    if (reply.isValid() && reply.value() == QDBusConnectionInterface::ServiceRegistered)
+        return Registered;
+
+    dbus.unregisterObject(QStringLiteral("/"));
+
+    // The bus answered, but the name belongs to another process
+    if (reply.isValid())  {
+        error = QStringLiteral("Couldn't register a service with the D-Bus system bus: %1 is owned by another process").arg(service);
+        return Failed;
+    }
+
+    error = QStringLiteral("Couldn't register a service with the D-Bus system bus: %1").arg(reply.error().message());
+    return Retry;
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,91 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtDaemon API. It exists only
+// as an implementation detail. This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#ifndef QDAEMONBUSREGISTRATION_P_H
+#define QDAEMONBUSREGISTRATION_P_H
+
+#include "QtDaemon/qdaemon-global.h"
+
+#include <QtCore/qthread.h>
+#include <QtCore/qmutex.h>
+#include <QtCore/qwaitcondition.h>
+#include <QtCore/qstring.h>
+
+QT_BEGIN_NAMESPACE
+
+namespace QtDaemon
+{
+    class Q_DAEMON_LOCAL QDaemonBusRegistration : public QThread
+    {
+        Q_OBJECT
+        Q_DISABLE_COPY(QDaemonBusRegistration)
+
+    public:
+        QDaemonBusRegistration(const QString &, QObject *, QObject * = Q_NULLPTR);
+        ~QDaemonBusRegistration() Q_DECL_OVERRIDE;
+
+        void stop();
+
+    Q_SIGNALS:
+        void registered(const QString &, int, qint64);
+        void retrying(const QString &);
+        void failed(const QString &);
+
+    protected:
+        void run() Q_DECL_OVERRIDE;
+
+    private:
+        enum AttemptResult  { Registered, Retry, Failed };
+        AttemptResult attempt(const QString &, QString &);
+
+        const QString service;
+        QObject * const object;
+
+        QMutex mutex;
+        QWaitCondition condition;
+        bool stopRequested;
+
+        static const int minimumRetryDelay;
+        static const int maximumRetryDelay;
+    };
+}
+
+QT_END_NAMESPACE
+
+#endif // QDAEMONBUSREGISTRATION_P_H
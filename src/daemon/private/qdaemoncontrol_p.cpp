@@ -0,0 +1,88 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include "qdaemoncontrol_p.h"
+#include "qdaemonsupervisor_p.h"
+#include "qdaemonstartupprofiler_p.h"
+#include "qdaemonmetrics.h"
+
+#include <QtCore/qcoreapplication.h>
+#include <QtCore/qmetatype.h>
+
+QT_BEGIN_NAMESPACE
+
+using namespace QtDaemon;
+
+QDaemonControl::QDaemonControl(QDaemonSupervisor * daemonSupervisor)
+    : supervisor(daemonSupervisor)
+{
+    qRegisterMetaType<QDBusMessage>();
+}
+
+bool QDaemonControl::isRunning()
+{
+    return true;	// This is just for notifying the controlling process, however busy the main event loop is.
+}
+
+QString QDaemonControl::statistics()
+{
+    return qDaemonMetrics().toString();     // The registry is thread-safe.
+}
+
+QString QDaemonControl::statusDetails()
+{
+    // Both the supervisor's status and the startup report can be read from any thread
+    QString children = supervisor->status();
+    if (children.isEmpty())
+        return QDaemonStartupProfiler::report();
+
+    return children + QLatin1Char('\n') + QDaemonStartupProfiler::report();
+}
+
+bool QDaemonControl::stop()
+{
+    // This is just to respond to the controlling process, the daemon quits once the main event loop gets to it
+    return QMetaObject::invokeMethod(qApp, "quit", Qt::QueuedConnection);
+}
+
+bool QDaemonControl::reload()
+{
+    // This is just to respond to the controlling process
+    return QMetaObject::invokeMethod(qApp, "reloadRequested", Qt::QueuedConnection);
+}
+
+QString QDaemonControl::prepareUpgrade()
+{
+    // The handoff belongs to the main thread, which sends the reply (the name of the handoff socket) when it's done
+    setDelayedReply(true);
+    emit upgradeRequested(message());
+
+    return QString();
+}
+
+QT_END_NAMESPACE
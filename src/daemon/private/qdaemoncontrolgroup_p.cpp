@@ -0,0 +1,179 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include "qdaemoncontrolgroup_p.h"
+#include "qdaemonprocesstuning_p.h"
+
+#include <QtCore/qdir.h>
+#include <QtCore/qfile.h>
+#include <QtCore/qstringlist.h>
+
+QT_BEGIN_NAMESPACE
+
+using namespace QtDaemon;
+
+static const QString controlGroupRoot = QStringLiteral("/sys/fs/cgroup");
+
+QString QDaemonControlGroup::path()
+{
+    QFile file(QStringLiteral("/proc/self/cgroup"));
+    if (!file.open(QFile::ReadOnly | QFile::Text))
+        return QString();
+
+    return path(controlGroupRoot, file.readAll());
+}
+
+QString QDaemonControlGroup::path(const QString & root, const QByteArray & membership)
+{
+    // The unified (v2) hierarchy is the entry with the id 0 and no controllers: 0::/system.slice/daemon.service
+    QString path;
+    foreach (const QByteArray & entry, membership.split('\n'))  {
+        QByteArray line = entry.trimmed();
+        if (line.startsWith("0::"))  {
+            path = QDir::cleanPath(root + QLatin1Char('/') + QString::fromLocal8Bit(line.mid(3)));
+            break;
+        }
+    }
+
+    if (!path.isEmpty() && QFile::exists(path + QStringLiteral("/cgroup.controllers")))
+        return path;
+
+    // A container without its own cgroup namespace sees the host's path, but has its group mounted as the root
+    if (QFile::exists(root + QStringLiteral("/cgroup.controllers")))
+        return root;
+
+    return QString();
+}
+
+QStringList QDaemonControlGroup::hierarchy()
+{
+    return hierarchy(controlGroupRoot, path());
+}
+
+QStringList QDaemonControlGroup::hierarchy(const QString & root, const QString & group)
+{
+    // The group of the process followed by its ancestors. The real root has no limit files, but
+    // in a cgroup namespace the root is the container's own group
+    QStringList groups;
+
+    QString ancestor = group;
+    while (ancestor.startsWith(root))  {
+        groups.append(ancestor);
+        if (ancestor.length() == root.length())
+            break;
+
+        ancestor.truncate(ancestor.lastIndexOf(QLatin1Char('/')));
+    }
+
+    return groups;
+}
+
+QList<int> QDaemonControlGroup::effectiveCpus()
+{
+    return effectiveCpus(hierarchy());
+}
+
+QList<int> QDaemonControlGroup::effectiveCpus(const QStringList & groups)
+{
+    QList<int> cpus;
+
+    // The effective set already accounts for the ancestors, the closest group with the cpuset controller has it
+    foreach (const QString & group, groups)  {
+        QByteArray value = readValue(group, QStringLiteral("cpuset.cpus.effective"));
+        if (!value.isEmpty())  {
+            QDaemonProcessTuning::parseCpuList(QString::fromLatin1(value), cpus);
+            break;
+        }
+    }
+
+    return cpus;
+}
+
+double QDaemonControlGroup::cpuQuota()
+{
+    return cpuQuota(hierarchy());
+}
+
+double QDaemonControlGroup::cpuQuota(const QStringList & groups)
+{
+    // cpu.max holds the quota and the period in microseconds, or "max" for no quota; the tightest group wins
+    double quota = -1;
+    foreach (const QString & group, groups)  {
+        QList<QByteArray> values = readValue(group, QStringLiteral("cpu.max")).split(' ');
+        if (values.size() != 2 || values.first() == "max")
+            continue;
+
+        bool quotaOk, periodOk;
+        qint64 groupQuota = values.first().toLongLong(&quotaOk), period = values.last().toLongLong(&periodOk);
+        if (!quotaOk || !periodOk || groupQuota <= 0 || period <= 0)
+            continue;
+
+        double cpus = double(groupQuota) / period;
+        if (quota < 0 || cpus < quota)
+            quota = cpus;
+    }
+
+    return quota;
+}
+
+qint64 QDaemonControlGroup::memoryLimit()
+{
+    return memoryLimit(hierarchy());
+}
+
+qint64 QDaemonControlGroup::memoryLimit(const QStringList & groups)
+{
+    // Past memory.high the group is throttled and reclaimed, past memory.max it's killed; honor the lower of the two
+    qint64 limit = -1;
+    foreach (const QString & group, groups)  {
+        const QString files[] = { QStringLiteral("memory.max"), QStringLiteral("memory.high") };
+        for (const QString & file : files)  {
+            QByteArray value = readValue(group, file);
+            if (value.isEmpty() || value == "max")
+                continue;
+
+            bool ok;
+            qint64 bytes = value.toLongLong(&ok);
+            if (ok && bytes >= 0 && (limit < 0 || bytes < limit))
+                limit = bytes;
+        }
+    }
+
+    return limit;
+}
+
+QByteArray QDaemonControlGroup::readValue(const QString & group, const QString & name)
+{
+    QFile file(group + QLatin1Char('/') + name);
+    if (!file.open(QFile::ReadOnly))
+        return QByteArray();
+
+    return file.readAll().trimmed();
+}
+
+QT_END_NAMESPACE
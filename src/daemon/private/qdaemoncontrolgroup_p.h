@@ -0,0 +1,76 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtDaemon API. It exists only
+// as an implementation detail. This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+
+#ifndef QDAEMONCONTROLGROUP_P_H
+#define QDAEMONCONTROLGROUP_P_H
+
+#include "QtDaemon/qdaemon-global.h"
+
+#include <QtCore/qbytearray.h>
+#include <QtCore/qlist.h>
+#include <QtCore/qstringlist.h>
+
+QT_BEGIN_NAMESPACE
+
+namespace QtDaemon
+{
+    class Q_DAEMON_LOCAL QDaemonControlGroup
+    {
+    public:
+        static QString path();
+        static QString path(const QString &, const QByteArray &);
+        static QStringList hierarchy();
+        static QStringList hierarchy(const QString &, const QString &);
+
+        static QList<int> effectiveCpus();
+        static QList<int> effectiveCpus(const QStringList &);
+        static double cpuQuota();
+        static double cpuQuota(const QStringList &);
+        static qint64 memoryLimit();
+        static qint64 memoryLimit(const QStringList &);
+
+    private:
+        static QByteArray readValue(const QString &, const QString &);
+    };
+}
+
+QT_END_NAMESPACE
+
+#endif // QDAEMONCONTROLGROUP_P_H
@@ -0,0 +1,402 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include "qdaemoneventdispatcher_p.h"
+
+#include <QtCore/qcoreapplication.h>
+#include <QtCore/qcoreevent.h>
+#include <QtCore/qsocketnotifier.h>
+#include <QtCore/qvarlengtharray.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+QT_BEGIN_NAMESPACE
+
+extern Q_CORE_EXPORT uint qGlobalPostedEventsCount();
+
+using namespace QtDaemon;
+
+static const int maximumEvents = 256;           // Events taken from the kernel per iteration
+static const qint64 nanosecondsPerMillisecond = Q_INT64_C(1000000);
+
+QDaemonEpollEventDispatcher::QDaemonEpollEventDispatcher(QObject * parent)
+    : QAbstractEventDispatcher(parent), wakeUpDescriptor(-1), timerDescriptor(-1), armedDeadline(0)
+{
+    epollDescriptor = ::epoll_create1(EPOLL_CLOEXEC);
+    if (epollDescriptor < 0)  {
+        qWarning("Couldn't create the epoll instance (%s).", ::strerror(errno));
+        return;
+    }
+
+    wakeUpDescriptor = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    timerDescriptor = ::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (wakeUpDescriptor < 0 || timerDescriptor < 0)  {
+        qWarning("Couldn't create the event dispatcher's wake up descriptors (%s).", ::strerror(errno));
+        return;
+    }
+
+    // Both are polled for the lifetime of the dispatcher, told apart from the sockets by the descriptor
+    for (int descriptor : { wakeUpDescriptor, timerDescriptor })  {
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = descriptor;
+        if (::epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, descriptor, &event) != 0)
+            qWarning("Couldn't register the event dispatcher's wake up descriptors (%s).", ::strerror(errno));
+    }
+}
+
+QDaemonEpollEventDispatcher::~QDaemonEpollEventDispatcher()
+{
+    for (int descriptor : { timerDescriptor, wakeUpDescriptor, epollDescriptor })  {
+        if (descriptor >= 0)
+            ::close(descriptor);
+    }
+}
+
+bool QDaemonEpollEventDispatcher::isValid() const
+{
+    return epollDescriptor >= 0 && wakeUpDescriptor >= 0 && timerDescriptor >= 0;
+}
+
+bool QDaemonEpollEventDispatcher::processEvents(QEventLoop::ProcessEventsFlags flags)
+{
+    interrupted.store(0);
+
+    emit awake();
+    QCoreApplication::sendPostedEvents();
+
+    // Events posted from now on write to the eventfd, so the wait below can't miss them
+    const bool canWait = (flags & QEventLoop::WaitForMoreEvents) && !interrupted.load();
+    const bool includeTimers = !(flags & QEventLoop::X11ExcludeTimers);
+    const bool includeNotifiers = !(flags & QEventLoop::ExcludeSocketNotifiers);
+
+    if (canWait)
+        emit aboutToBlock();
+
+    armTimer();
+
+    struct epoll_event events[maximumEvents];
+    int count = ::epoll_wait(epollDescriptor, events, maximumEvents, canWait ? -1 : 0);
+    if (count < 0)  {
+        if (errno != EINTR)
+            qWarning("Waiting for events failed (%s).", ::strerror(errno));
+        count = 0;
+    }
+
+    bool processed = false;
+    for (int i = 0; i < count; i++)  {
+        const int descriptor = events[i].data.fd;
+        if (descriptor == wakeUpDescriptor)  {
+            eventfd_t value;
+            ::eventfd_read(wakeUpDescriptor, &value);
+            wakeUps.store(0);
+        }
+        else if (descriptor == timerDescriptor)  {
+            quint64 expirations;
+            while (::read(timerDescriptor, &expirations, sizeof(expirations)) < 0 && errno == EINTR)
+                ;
+            armedDeadline = 0;      // A fired timerfd is disarmed
+        }
+        else if (includeNotifiers)
+            processed |= activateSocketNotifiers(descriptor, events[i].events);
+    }
+
+    // The schedule is checked even without the timerfd firing, a non-blocking pass may be late already
+    if (includeTimers)
+        processed |= activateTimers();
+
+    return processed;
+}
+
+bool QDaemonEpollEventDispatcher::hasPendingEvents()
+{
+    return qGlobalPostedEventsCount() > 0;
+}
+
+void QDaemonEpollEventDispatcher::registerSocketNotifier(QSocketNotifier * notifier)
+{
+    Q_ASSERT(notifier);
+
+    const int descriptor = int(notifier->socket());
+    const int type = notifier->type();
+
+    QHash<int, Descriptor>::Iterator i = descriptors.find(descriptor);
+    const bool registered = i != descriptors.end();
+    if (!registered)  {
+        Descriptor entry = { { Q_NULLPTR, Q_NULLPTR, Q_NULLPTR } };
+        i = descriptors.insert(descriptor, entry);
+    }
+
+    if (i->notifiers[type])
+        qWarning("QSocketNotifier: Multiple socket notifiers for the same socket %d and type %d.", descriptor, type);
+
+    i->notifiers[type] = notifier;
+    if (!updateDescriptor(descriptor, *i, registered))  {
+        i->notifiers[type] = Q_NULLPTR;
+        if (!registered)
+            descriptors.erase(i);
+    }
+}
+
+void QDaemonEpollEventDispatcher::unregisterSocketNotifier(QSocketNotifier * notifier)
+{
+    Q_ASSERT(notifier);
+
+    const int descriptor = int(notifier->socket());
+    QHash<int, Descriptor>::Iterator i = descriptors.find(descriptor);
+    if (i == descriptors.end() || i->notifiers[notifier->type()] != notifier)
+        return;
+
+    i->notifiers[notifier->type()] = Q_NULLPTR;
+    updateDescriptor(descriptor, *i, true);
+
+    if (!i->notifiers[QSocketNotifier::Read] && !i->notifiers[QSocketNotifier::Write] && !i->notifiers[QSocketNotifier::Exception])
+        descriptors.erase(i);
+}
+
+void QDaemonEpollEventDispatcher::registerTimer(int id, int interval, Qt::TimerType type, QObject * object)
+{
+    Q_ASSERT(id > 0 && interval >= 0 && object);
+
+    // Very coarse timers have a resolution of a second, the coarse ones are treated as precise
+    if (type == Qt::VeryCoarseTimer)
+        interval = (interval + 500) / 1000 * 1000;
+
+    Timer timer;
+    timer.object = object;
+    timer.interval = interval * nanosecondsPerMillisecond;
+    timer.deadline = monotonicTime() + timer.interval;
+    timer.type = type;
+    timer.active = false;
+
+    timers.insert(id, timer);
+    objectTimers.insert(object, id);
+    schedule.insert(std::make_pair(timer.deadline, id));
+}
+
+bool QDaemonEpollEventDispatcher::unregisterTimer(int id)
+{
+    QHash<int, Timer>::Iterator i = timers.find(id);
+    if (i == timers.end())
+        return false;
+
+    objectTimers.remove(i->object, id);
+    removeTimer(i);
+    return true;
+}
+
+bool QDaemonEpollEventDispatcher::unregisterTimers(QObject * object)
+{
+    QList<int> ids = objectTimers.values(object);
+    if (ids.isEmpty())
+        return false;
+
+    objectTimers.remove(object);
+    foreach (int id, ids)  {
+        QHash<int, Timer>::Iterator i = timers.find(id);
+        if (i != timers.end())
+            removeTimer(i);
+    }
+
+    return true;
+}
+
+QList<QAbstractEventDispatcher::TimerInfo> QDaemonEpollEventDispatcher::registeredTimers(QObject * object) const
+{
+    QList<TimerInfo> list;
+
+    QMultiHash<QObject *, int>::ConstIterator i = objectTimers.constFind(object);
+    for ( ; i != objectTimers.constEnd() && i.key() == object; ++i)  {
+        const Timer timer = timers.value(i.value());
+        list.append(TimerInfo(i.value(), int(timer.interval / nanosecondsPerMillisecond), timer.type));
+    }
+
+    return list;
+}
+
+int QDaemonEpollEventDispatcher::remainingTime(int id)
+{
+    QHash<int, Timer>::ConstIterator i = timers.constFind(id);
+    if (i == timers.constEnd())
+        return -1;
+
+    qint64 remaining = i->deadline - monotonicTime();
+    return remaining > 0 ? int((remaining + nanosecondsPerMillisecond - 1) / nanosecondsPerMillisecond) : 0;
+}
+
+void QDaemonEpollEventDispatcher::wakeUp()
+{
+    // Coalesce the wake ups until the dispatcher has picked the pending one
+    if (wakeUps.testAndSetAcquire(0, 1))
+        ::eventfd_write(wakeUpDescriptor, 1);
+}
+
+void QDaemonEpollEventDispatcher::interrupt()
+{
+    interrupted.store(1);
+    wakeUp();
+}
+
+void QDaemonEpollEventDispatcher::flush()
+{
+}
+
+qint64 QDaemonEpollEventDispatcher::monotonicTime()
+{
+    struct timespec now;
+    ::clock_gettime(CLOCK_MONOTONIC, &now);
+    return qint64(now.tv_sec) * 1000 * nanosecondsPerMillisecond + now.tv_nsec;
+}
+
+bool QDaemonEpollEventDispatcher::updateDescriptor(int descriptor, const Descriptor & entry, bool registered)
+{
+    // Level triggered, as the socket notifiers are expected to keep firing until the socket is drained
+    struct epoll_event event;
+    ::memset(&event, 0, sizeof(event));
+    event.data.fd = descriptor;
+    if (entry.notifiers[QSocketNotifier::Read])
+        event.events |= EPOLLIN;
+    if (entry.notifiers[QSocketNotifier::Write])
+        event.events |= EPOLLOUT;
+    if (entry.notifiers[QSocketNotifier::Exception])
+        event.events |= EPOLLPRI;
+
+    int operation = event.events ? (registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD) : EPOLL_CTL_DEL;
+    int status = ::epoll_ctl(epollDescriptor, operation, descriptor, &event);
+
+    // Closing a descriptor removes it from the epoll set, so it may be gone already (or reused)
+    if (status != 0 && errno == ENOENT && operation == EPOLL_CTL_MOD)
+        status = ::epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, descriptor, &event);
+    if (status != 0 && (errno == ENOENT || errno == EBADF) && operation == EPOLL_CTL_DEL)
+        return true;
+
+    if (status != 0)  {
+        // EPERM is returned for regular files, which can't be polled with epoll
+        qWarning("QSocketNotifier: Couldn't watch socket %d (%s).", descriptor, ::strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+void QDaemonEpollEventDispatcher::armTimer()
+{
+    qint64 deadline = schedule.empty() ? 0 : qMax<qint64>(schedule.begin()->first, 1);
+    if (deadline == armedDeadline)
+        return;
+
+    // An absolute deadline, so re-arming for the same timer doesn't drift. Zero disarms the timerfd
+    struct itimerspec spec;
+    ::memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = deadline / (1000 * nanosecondsPerMillisecond);
+    spec.it_value.tv_nsec = deadline % (1000 * nanosecondsPerMillisecond);
+
+    if (::timerfd_settime(timerDescriptor, TFD_TIMER_ABSTIME, &spec, Q_NULLPTR) == 0)
+        armedDeadline = deadline;
+}
+
+bool QDaemonEpollEventDispatcher::activateTimers()
+{
+    if (schedule.empty())
+        return false;
+
+    // Collect first, the timer events may register and unregister timers
+    const qint64 now = monotonicTime();
+    QVarLengthArray<int, 64> expired;
+    for (TimerSchedule::const_iterator i = schedule.begin(); i != schedule.end() && i->first <= now; ++i)
+        expired.append(i->second);
+
+    bool processed = false;
+    for (int id : expired)  {
+        QHash<int, Timer>::Iterator i = timers.find(id);
+        if (i == timers.end() || i->active || i->deadline > now)
+            continue;
+
+        // Reschedule before the delivery, so the receiver may kill or restart the timer
+        schedule.erase(std::make_pair(i->deadline, id));
+        i->deadline += i->interval;
+        if (i->deadline <= now)
+            i->deadline = now + i->interval;
+        schedule.insert(std::make_pair(i->deadline, id));
+
+        i->active = true;
+        QTimerEvent event(id);
+        QCoreApplication::sendEvent(i->object, &event);
+        processed = true;
+
+        i = timers.find(id);
+        if (i != timers.end())
+            i->active = false;
+    }
+
+    return processed;
+}
+
+bool QDaemonEpollEventDispatcher::activateSocketNotifiers(int descriptor, quint32 events)
+{
+    static const quint32 typeEvents[3] = {
+        EPOLLIN | EPOLLHUP | EPOLLERR,          // QSocketNotifier::Read
+        EPOLLOUT | EPOLLERR,                    // QSocketNotifier::Write
+        EPOLLPRI                                // QSocketNotifier::Exception
+    };
+
+    bool processed = false;
+    for (int type = QSocketNotifier::Read; type <= QSocketNotifier::Exception; type++)  {
+        if (!(events & typeEvents[type]))
+            continue;
+
+        // Looked up each time, a notifier may be unregistered by the previous one
+        QHash<int, Descriptor>::ConstIterator i = descriptors.constFind(descriptor);
+        if (i == descriptors.constEnd())
+            break;
+
+        QSocketNotifier * notifier = i->notifiers[type];
+        if (!notifier)
+            continue;
+
+        QEvent event(QEvent::SockAct);
+        QCoreApplication::sendEvent(notifier, &event);
+        processed = true;
+    }
+
+    return processed;
+}
+
+void QDaemonEpollEventDispatcher::removeTimer(QHash<int, Timer>::Iterator i)
+{
+    schedule.erase(std::make_pair(i->deadline, i.key()));
+    timers.erase(i);
+}
+
+QT_END_NAMESPACE
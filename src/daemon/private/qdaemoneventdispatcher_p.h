@@ -0,0 +1,128 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtDaemon API. It exists only
+// as an implementation detail. This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+
+#ifndef QDAEMONEVENTDISPATCHER_P_H
+#define QDAEMONEVENTDISPATCHER_P_H
+
+#include "QtDaemon/qdaemon-global.h"
+
+#include <QtCore/qabstracteventdispatcher.h>
+#include <QtCore/qhash.h>
+#include <QtCore/qatomic.h>
+
+#include <set>
+#include <utility>
+
+QT_BEGIN_NAMESPACE
+
+class QSocketNotifier;
+
+namespace QtDaemon
+{
+    class Q_DAEMON_LOCAL QDaemonEpollEventDispatcher : public QAbstractEventDispatcher
+    {
+        Q_OBJECT
+        Q_DISABLE_COPY(QDaemonEpollEventDispatcher)
+
+    public:
+        explicit QDaemonEpollEventDispatcher(QObject * = Q_NULLPTR);
+        ~QDaemonEpollEventDispatcher() Q_DECL_OVERRIDE;
+
+        bool isValid() const;
+
+        bool processEvents(QEventLoop::ProcessEventsFlags) Q_DECL_OVERRIDE;
+        bool hasPendingEvents() Q_DECL_OVERRIDE;
+
+        void registerSocketNotifier(QSocketNotifier *) Q_DECL_OVERRIDE;
+        void unregisterSocketNotifier(QSocketNotifier *) Q_DECL_OVERRIDE;
+
+        void registerTimer(int, int, Qt::TimerType, QObject *) Q_DECL_OVERRIDE;
+        bool unregisterTimer(int) Q_DECL_OVERRIDE;
+        bool unregisterTimers(QObject *) Q_DECL_OVERRIDE;
+        QList<TimerInfo> registeredTimers(QObject *) const Q_DECL_OVERRIDE;
+        int remainingTime(int) Q_DECL_OVERRIDE;
+
+        void wakeUp() Q_DECL_OVERRIDE;
+        void interrupt() Q_DECL_OVERRIDE;
+        void flush() Q_DECL_OVERRIDE;
+
+    private:
+        struct Descriptor
+        {
+            QSocketNotifier * notifiers[3];     // Indexed by QSocketNotifier::Type
+        };
+
+        struct Timer
+        {
+            QObject * object;
+            qint64 interval;                    // In nanoseconds
+            qint64 deadline;
+            Qt::TimerType type;
+            bool active;                        // Being delivered, don't fire it recursively
+        };
+
+        typedef std::set<std::pair<qint64, int>> TimerSchedule;
+
+        static qint64 monotonicTime();
+
+        bool updateDescriptor(int, const Descriptor &, bool);
+        void armTimer();
+        bool activateTimers();
+        bool activateSocketNotifiers(int, quint32);
+        void removeTimer(QHash<int, Timer>::Iterator);
+
+        int epollDescriptor;
+        int wakeUpDescriptor;
+        int timerDescriptor;
+        qint64 armedDeadline;
+
+        QHash<int, Descriptor> descriptors;
+        QHash<int, Timer> timers;
+        QMultiHash<QObject *, int> objectTimers;
+        TimerSchedule schedule;
+
+        QAtomicInt wakeUps;
+        QAtomicInt interrupted;
+    };
+}
+
+QT_END_NAMESPACE
+
+#endif // QDAEMONEVENTDISPATCHER_P_H
@@ -0,0 +1,274 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include "qdaemonexecutor_p.h"
+#include "qdaemonmetrics.h"
+#include "qdaemonapplication.h"
+
+#include <QtCore/qelapsedtimer.h>
+
+#include <atomic>
+
+QT_BEGIN_NAMESPACE
+
+QDaemonExecutor * QDaemonExecutorPrivate::instance = Q_NULLPTR;
+thread_local int QDaemonExecutorPrivate::currentWorker = -1;
+
+QDaemonExecutorWorker::QDaemonExecutorWorker(QDaemonExecutorPrivate * d, int workerIndex)
+    : executor(d), index(workerIndex)
+{
+    setObjectName(QStringLiteral("QDaemonExecutor %1").arg(workerIndex));
+}
+
+void QDaemonExecutorWorker::push(const std::function<void ()> & task)
+{
+    QMutexLocker lock(&queueMutex);
+    Q_UNUSED(lock);
+
+    queue.push_back(task);
+}
+
+bool QDaemonExecutorWorker::pop(std::function<void ()> & task)
+{
+    QMutexLocker lock(&queueMutex);
+    Q_UNUSED(lock);
+
+    if (queue.empty())
+        return false;
+
+    // The owner takes the newest task, it's the most likely to still be in the cache
+    task = std::move(queue.back());
+    queue.pop_back();
+    return true;
+}
+
+bool QDaemonExecutorWorker::steal(std::function<void ()> & task)
+{
+    QMutexLocker lock(&queueMutex);
+    Q_UNUSED(lock);
+
+    if (queue.empty())
+        return false;
+
+    // Thieves take the oldest task from the other end, away from the owner
+    task = std::move(queue.front());
+    queue.pop_front();
+    return true;
+}
+
+void QDaemonExecutorWorker::run()
+{
+    QDaemonExecutorPrivate::currentWorker = index;
+
+    std::function<void ()> task;
+    forever  {
+        if (executor->take(index, task))  {
+            executor->execute(task);
+            continue;
+        }
+
+        QMutexLocker lock(&executor->idleMutex);
+        Q_UNUSED(lock);
+
+        // Announce the thread is idle before looking at the count, while post() counts the task before it looks
+        // at the idle threads, so at least one of the two sides sees the other and no task is missed
+        executor->idleWorkers.ref();
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (executor->pending.load() > 0)  {
+            executor->idleWorkers.deref();
+            continue;
+        }
+        if (executor->draining)  {
+            executor->idleWorkers.deref();
+            break;      // Drained
+        }
+
+        executor->idleCondition.wait(&executor->idleMutex);
+        executor->idleWorkers.deref();
+    }
+
+    QDaemonExecutorPrivate::currentWorker = -1;
+}
+
+QDaemonExecutorPrivate::QDaemonExecutorPrivate()
+    : nextWorker(0), pending(0), accepting(0), posting(0), idleWorkers(0), running(false), stopping(false), draining(false)
+{
+}
+
+QDaemonExecutorPrivate::~QDaemonExecutorPrivate()
+{
+    stop();
+}
+
+void QDaemonExecutorPrivate::start(int threads)
+{
+    QMutexLocker lock(&idleMutex);
+    Q_UNUSED(lock);
+
+    if (running)
+        return;
+
+    if (threads <= 0)
+        threads = defaultThreadCount();
+
+    QDaemonMetrics & metrics = qDaemonMetrics();
+    tasksCounter = metrics.counter(QStringLiteral("qtdaemon_executor_tasks_total"), QStringLiteral("Tasks run by the executor"));
+    stealsCounter = metrics.counter(QStringLiteral("qtdaemon_executor_steals_total"), QStringLiteral("Tasks taken from the queue of another executor thread"));
+    busyCounter = metrics.counter(QStringLiteral("qtdaemon_executor_busy_microseconds_total"), QStringLiteral("Time spent running tasks, summed over the executor threads"));
+    threadsGauge = metrics.gauge(QStringLiteral("qtdaemon_executor_threads"), QStringLiteral("Threads of the executor"));
+    queuedGauge = metrics.gauge(QStringLiteral("qtdaemon_executor_queued_tasks"), QStringLiteral("Tasks waiting in the executor queues"));
+
+    workers.reserve(threads);
+    for (int i = 0; i < threads; i++)
+        workers.append(new QDaemonExecutorWorker(this, i));
+
+    running = true;
+    threadsGauge.set(threads);
+
+    foreach (QDaemonExecutorWorker * worker, workers)
+        worker->start();
+
+    accepting.storeRelease(1);
+}
+
+void QDaemonExecutorPrivate::stop()
+{
+    QVector<QDaemonExecutorWorker *> stoppedWorkers;
+    {
+        QMutexLocker lock(&idleMutex);
+        Q_UNUSED(lock);
+
+        if (!running || stopping)
+            return;
+
+        stopping = true;
+        accepting.store(0);
+    }
+
+    // Let the posts that got past the check finish, after that only the running tasks may post (follow-up) tasks
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (posting.load() > 0)
+        QThread::yieldCurrentThread();
+
+    {
+        QMutexLocker lock(&idleMutex);
+        Q_UNUSED(lock);
+
+        // The threads quit when there's nothing left to run
+        draining = true;
+        idleCondition.wakeAll();
+        stoppedWorkers = workers;
+    }
+
+    foreach (QDaemonExecutorWorker * worker, stoppedWorkers)
+        worker->wait();
+
+    QMutexLocker lock(&idleMutex);
+    Q_UNUSED(lock);
+
+    qDeleteAll(workers);
+    workers.clear();
+
+    running = stopping = draining = false;
+    threadsGauge.set(0);
+}
+
+bool QDaemonExecutorPrivate::post(const std::function<void ()> & task)
+{
+    // Tasks posted from an executor thread stay with it, the others are spread round-robin
+    int index = currentWorker;
+    const bool external = index < 0;
+    if (external)  {
+        // Registered before the check, so stop() either sees the post or the post sees the executor stopping
+        posting.ref();
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!accepting.loadAcquire())  {
+            posting.deref();
+            return false;
+        }
+
+        index = quint32(nextWorker.fetchAndAddRelaxed(1)) % quint32(workers.size());
+    }
+
+    // Counted before the push, so an idle thread looking at the count doesn't go to sleep on the task
+    queuedGauge.set(pending.fetchAndAddOrdered(1) + 1);
+    workers.at(index)->push(task);
+
+    if (external)
+        posting.deref();
+
+    // The idle threads are woken under the lock, which is taken only when there are any
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (idleWorkers.load() > 0)  {
+        QMutexLocker lock(&idleMutex);
+        Q_UNUSED(lock);
+
+        idleCondition.wakeOne();
+    }
+
+    return true;
+}
+
+bool QDaemonExecutorPrivate::take(int index, std::function<void ()> & task)
+{
+    bool stolen = false;
+    if (!workers.at(index)->pop(task))  {
+        // Nothing of our own, try the other threads starting from the next one
+        for (int i = 1, size = workers.size(); i < size && !stolen; i++)
+            stolen = workers.at((index + i) % size)->steal(task);
+
+        if (!stolen)
+            return false;
+
+        stealsCounter.add();
+    }
+
+    queuedGauge.set(pending.fetchAndSubRelaxed(1) - 1);
+    return true;
+}
+
+void QDaemonExecutorPrivate::execute(std::function<void ()> & task)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    task();
+    task = Q_NULLPTR;       // Release what the task holds as soon as it's done
+
+    busyCounter.add(quint64(timer.nsecsElapsed() / 1000));
+    tasksCounter.add();
+}
+
+int QDaemonExecutorPrivate::defaultThreadCount()
+{
+    // Respect the affinity mask and the cgroup limits rather than counting all the CPUs of the machine
+    return QDaemonApplication::effectiveCpuCount();
+}
+
+QT_END_NAMESPACE
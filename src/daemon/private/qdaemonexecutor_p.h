@@ -0,0 +1,120 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtDaemon API. It exists only
+// as an implementation detail. This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#ifndef QDAEMONEXECUTOR_P_H
+#define QDAEMONEXECUTOR_P_H
+
+#include "qdaemonexecutor.h"
+#include "qdaemonmetrics.h"
+
+#include <QtCore/qthread.h>
+#include <QtCore/qmutex.h>
+#include <QtCore/qwaitcondition.h>
+#include <QtCore/qatomic.h>
+#include <QtCore/qvector.h>
+
+#include <deque>
+
+QT_BEGIN_NAMESPACE
+
+class QDaemonExecutorWorker : public QThread
+{
+    Q_DISABLE_COPY(QDaemonExecutorWorker)
+
+public:
+    QDaemonExecutorWorker(QDaemonExecutorPrivate *, int);
+
+    void push(const std::function<void ()> &);
+    bool pop(std::function<void ()> &);
+    bool steal(std::function<void ()> &);
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    QDaemonExecutorPrivate * executor;
+    const int index;
+
+    QMutex queueMutex;
+    std::deque<std::function<void ()>> queue;
+};
+
+class QDaemonExecutorPrivate
+{
+    friend class QDaemonExecutorWorker;
+
+public:
+    QDaemonExecutorPrivate();
+    ~QDaemonExecutorPrivate();
+
+    void start(int);
+    void stop();
+    bool post(const std::function<void ()> &);
+
+    static int defaultThreadCount();
+
+    static QDaemonExecutor * instance;
+
+private:
+    bool take(int, std::function<void ()> &);
+    void execute(std::function<void ()> &);
+
+    QVector<QDaemonExecutorWorker *> workers;   // Fixed while the executor accepts tasks
+    QAtomicInt nextWorker;
+    QAtomicInt pending;
+    QAtomicInt accepting;                       // Set while the threads outside the executor may post
+    QAtomicInt posting;                         // Posts from outside the executor in progress
+    QAtomicInt idleWorkers;                     // Checked by post() without the lock
+
+    QMutex idleMutex;
+    QWaitCondition idleCondition;
+    bool running, stopping, draining;
+
+    QDaemonCounter tasksCounter;
+    QDaemonCounter stealsCounter;
+    QDaemonCounter busyCounter;
+    QDaemonGauge threadsGauge;
+    QDaemonGauge queuedGauge;
+
+    static thread_local int currentWorker;
+};
+
+QT_END_NAMESPACE
+
+#endif // QDAEMONEXECUTOR_P_H
@@ -0,0 +1,319 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include "qdaemonhandoff_p.h"
+#include "qdaemonlog.h"
+
+#include <QtCore/qsocketnotifier.h>
+#include <QtCore/qstringlist.h>
+#include <QtCore/qvector.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstddef>
+#include <cstring>
+
+QT_BEGIN_NAMESPACE
+
+using namespace QtDaemon;
+
+static const int handoffTimeout = 10;           // Seconds to wait for the running instance to pass the descriptors
+static const int maximumDescriptors = 253;      // SCM_MAX_FD
+static const int maximumPayload = 65536;
+static const char descriptorsHeader = 'H';      // Messages can't be empty, as a zero-length read means the peer went away
+
+const char QDaemonHandoff::readyMessage = 'R';
+const char QDaemonHandoff::releasedMessage = 'D';
+
+static socklen_t abstractAddress(const QString & name, struct sockaddr_un & address)
+{
+    QByteArray path = name.toUtf8();
+    path.truncate(sizeof(address.sun_path) - 1);
+
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path + 1, path.constData(), path.size());      // Leading null byte: the socket is in the abstract namespace
+
+    return socklen_t(offsetof(struct sockaddr_un, sun_path) + 1 + path.size());
+}
+
+QDaemonHandoff::QDaemonHandoff(QObject * parent)
+    : QObject(parent), listenDescriptor(-1), connectionDescriptor(-1), listenNotifier(Q_NULLPTR), connectionNotifier(Q_NULLPTR), handingOver(false)
+{
+}
+
+QDaemonHandoff::~QDaemonHandoff()
+{
+    close();
+}
+
+QString QDaemonHandoff::listen(const QString & service, const QHash<QString, int> & handoffDescriptors)
+{
+    close();
+
+    QString name = QStringLiteral("qtdaemon-handoff.%1.%2").arg(service).arg(::getpid());
+
+    struct sockaddr_un address;
+    socklen_t length = abstractAddress(name, address);
+
+    listenDescriptor = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (listenDescriptor < 0 || ::bind(listenDescriptor, reinterpret_cast<struct sockaddr *>(&address), length) != 0 || ::listen(listenDescriptor, 1) != 0)  {
+        int error = errno;
+        qDaemonLog(QStringLiteral("Couldn't open the descriptor handoff socket (%1).").arg(QString::fromLocal8Bit(std::strerror(error))), QDaemonLog::ErrorEntry);
+        close();
+        return QString();
+    }
+
+    handingOver = true;
+    descriptors = handoffDescriptors;
+
+    listenNotifier = new QSocketNotifier(listenDescriptor, QSocketNotifier::Read, this);
+    QObject::connect(listenNotifier, &QSocketNotifier::activated, this, &QDaemonHandoff::accept);
+
+    return name;
+}
+
+void QDaemonHandoff::notifyReleased()
+{
+    sendMessage(releasedMessage);
+    close();
+}
+
+bool QDaemonHandoff::connectToInstance(const QString & name, QHash<QString, int> & receivedDescriptors)
+{
+    close();
+
+    struct sockaddr_un address;
+    socklen_t length = abstractAddress(name, address);
+
+    connectionDescriptor = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (connectionDescriptor < 0 || ::connect(connectionDescriptor, reinterpret_cast<struct sockaddr *>(&address), length) != 0)  {
+        int error = errno;
+        qDaemonLog(QStringLiteral("Couldn't connect to the running instance for the descriptor handoff (%1).").arg(QString::fromLocal8Bit(std::strerror(error))), QDaemonLog::ErrorEntry);
+        close();
+        return false;
+    }
+
+    struct timeval timeout = { handoffTimeout, 0 };
+    ::setsockopt(connectionDescriptor, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    if (!receiveDescriptors(connectionDescriptor, receivedDescriptors))  {
+        qDaemonLog(QStringLiteral("Couldn't receive the descriptors from the running instance."), QDaemonLog::ErrorEntry);
+        close();
+        return false;
+    }
+
+    handingOver = false;
+    connectionNotifier = new QSocketNotifier(connectionDescriptor, QSocketNotifier::Read, this);
+    QObject::connect(connectionNotifier, &QSocketNotifier::activated, this, &QDaemonHandoff::readMessage);
+
+    return true;
+}
+
+void QDaemonHandoff::notifyReady()
+{
+    if (!sendMessage(readyMessage))
+        emit released();        // The running instance has gone away already
+}
+
+void QDaemonHandoff::accept()
+{
+    int connection = ::accept4(listenDescriptor, Q_NULLPTR, Q_NULLPTR, SOCK_CLOEXEC);
+    if (connection < 0)
+        return;
+
+    // Only a process run by the same user (or root) may take over the descriptors
+    struct ucred credentials;
+    socklen_t length = sizeof(credentials);
+    if (::getsockopt(connection, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0 || (credentials.uid != ::geteuid() && credentials.uid != 0))  {
+        qDaemonLog(QStringLiteral("Refused a descriptor handoff to a process run by a different user."), QDaemonLog::WarningEntry);
+        ::close(connection);
+        return;
+    }
+
+    // Only one upgrade can be in progress, stop listening
+    delete listenNotifier;
+    listenNotifier = Q_NULLPTR;
+    ::close(listenDescriptor);
+    listenDescriptor = -1;
+
+    if (!sendDescriptors(connection, descriptors))  {
+        int error = errno;
+        qDaemonLog(QStringLiteral("Couldn't pass the descriptors to the upgraded instance (%1).").arg(QString::fromLocal8Bit(std::strerror(error))), QDaemonLog::ErrorEntry);
+        ::close(connection);
+        return;
+    }
+
+    connectionDescriptor = connection;
+    connectionNotifier = new QSocketNotifier(connectionDescriptor, QSocketNotifier::Read, this);
+    QObject::connect(connectionNotifier, &QSocketNotifier::activated, this, &QDaemonHandoff::readMessage);
+}
+
+void QDaemonHandoff::readMessage()
+{
+    char message = 0;
+    ssize_t bytes = ::recv(connectionDescriptor, &message, 1, MSG_DONTWAIT);
+    if (bytes < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+        return;
+
+    if (handingOver)  {
+        if (bytes == 1 && message == readyMessage)  {
+            connectionNotifier->setEnabled(false);
+            emit ready();
+            return;
+        }
+
+        qDaemonLog(QStringLiteral("The upgraded instance went away before reporting it's ready."), QDaemonLog::WarningEntry);
+        close();
+        return;
+    }
+
+    // Either the service was released, or the running instance has gone away; both mean the service can be taken over
+    close();
+    emit released();
+}
+
+void QDaemonHandoff::close()
+{
+    delete listenNotifier;
+    delete connectionNotifier;
+    listenNotifier = connectionNotifier = Q_NULLPTR;
+
+    if (listenDescriptor >= 0)
+        ::close(listenDescriptor);
+    if (connectionDescriptor >= 0)
+        ::close(connectionDescriptor);
+    listenDescriptor = connectionDescriptor = -1;
+}
+
+bool QDaemonHandoff::sendMessage(char message)
+{
+    if (connectionDescriptor < 0)
+        return false;
+
+    ssize_t bytes;
+    while ((bytes = ::send(connectionDescriptor, &message, 1, MSG_NOSIGNAL)) < 0 && errno == EINTR)
+        ;
+
+    return bytes == 1;
+}
+
+bool QDaemonHandoff::sendDescriptors(int socket, const QHash<QString, int> & descriptors)
+{
+    QByteArray payload(1, descriptorsHeader);
+    QVector<int> handles;
+
+    for (QHash<QString, int>::ConstIterator i = descriptors.constBegin(), end = descriptors.constEnd(); i != end && handles.size() < maximumDescriptors; ++i)  {
+        if (::fcntl(i.value(), F_GETFD) < 0)
+            continue;       // The application has closed it meanwhile
+
+        if (handles.size())
+            payload.append('\n');
+        payload.append(i.key().toUtf8());
+        handles.append(i.value());
+    }
+
+    struct iovec data;
+    data.iov_base = payload.data();
+    data.iov_len = size_t(payload.size());
+
+    struct msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+
+    QByteArray control;
+    if (handles.size())  {
+        control.fill(0, int(CMSG_SPACE(sizeof(int) * handles.size())));
+        message.msg_control = control.data();
+        message.msg_controllen = size_t(control.size());
+
+        struct cmsghdr * header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int) * handles.size());
+        std::memcpy(CMSG_DATA(header), handles.constData(), sizeof(int) * handles.size());
+    }
+
+    ssize_t bytes;
+    while ((bytes = ::sendmsg(socket, &message, MSG_NOSIGNAL)) < 0 && errno == EINTR)
+        ;
+
+    return bytes == payload.size();
+}
+
+bool QDaemonHandoff::receiveDescriptors(int socket, QHash<QString, int> & descriptors)
+{
+    QByteArray payload(maximumPayload, Qt::Uninitialized), control(int(CMSG_SPACE(sizeof(int) * maximumDescriptors)), 0);
+
+    struct iovec data;
+    data.iov_base = payload.data();
+    data.iov_len = size_t(payload.size());
+
+    struct msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data();
+    message.msg_controllen = size_t(control.size());
+
+    ssize_t bytes;
+    while ((bytes = ::recvmsg(socket, &message, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR)
+        ;
+
+    QVector<int> handles;
+    for (struct cmsghdr * header = CMSG_FIRSTHDR(&message); bytes > 0 && header; header = CMSG_NXTHDR(&message, header))  {
+        if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        int count = int((header->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        handles.resize(count);
+        std::memcpy(handles.data(), CMSG_DATA(header), sizeof(int) * count);
+    }
+
+    QStringList names;
+    if (bytes > 0 && payload.at(0) == descriptorsHeader)
+        names = QString::fromUtf8(payload.constData() + 1, int(bytes) - 1).split(QLatin1Char('\n'), QString::SkipEmptyParts);
+
+    if (bytes <= 0 || payload.at(0) != descriptorsHeader || (message.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) || names.size() != handles.size())  {
+        for (int handle : handles)
+            ::close(handle);
+        return false;
+    }
+
+    for (int i = 0; i < names.size(); i++)
+        descriptors.insert(names.at(i), handles.at(i));
+
+    return true;
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,97 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtDaemon API. It exists only
+// as an implementation detail. This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#ifndef QDAEMONHANDOFF_P_H
+#define QDAEMONHANDOFF_P_H
+
+#include "QtDaemon/qdaemon-global.h"
+
+#include <QtCore/qobject.h>
+#include <QtCore/qhash.h>
+
+QT_BEGIN_NAMESPACE
+
+class QSocketNotifier;
+
+namespace QtDaemon
+{
+    class Q_DAEMON_LOCAL QDaemonHandoff : public QObject
+    {
+        Q_OBJECT
+        Q_DISABLE_COPY(QDaemonHandoff)
+
+    public:
+        QDaemonHandoff(QObject * = Q_NULLPTR);
+        ~QDaemonHandoff() Q_DECL_OVERRIDE;
+
+        // The running (old) instance
+        QString listen(const QString &, const QHash<QString, int> &);
+        void notifyReleased();
+
+        // The upgraded (new) instance
+        bool connectToInstance(const QString &, QHash<QString, int> &);
+        Q_INVOKABLE void notifyReady();
+
+    Q_SIGNALS:
+        void ready();
+        void released();
+
+    private:
+        void accept();
+        void readMessage();
+        void close();
+
+        bool sendMessage(char);
+        static bool sendDescriptors(int, const QHash<QString, int> &);
+        static bool receiveDescriptors(int, QHash<QString, int> &);
+
+        int listenDescriptor, connectionDescriptor;
+        QSocketNotifier * listenNotifier;
+        QSocketNotifier * connectionNotifier;
+        QHash<QString, int> descriptors;
+        bool handingOver;
+
+        static const char readyMessage;
+        static const char releasedMessage;
+    };
+}
+
+QT_END_NAMESPACE
+
+#endif // QDAEMONHANDOFF_P_H
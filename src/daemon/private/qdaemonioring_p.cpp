@@ -0,0 +1,554 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include "qdaemonioring_p.h"
+
+#include <QtCore/qsocketnotifier.h>
+#include <QtCore/qpointer.h>
+#include <QtCore/qscopedpointer.h>
+#include <QtCore/qpair.h>
+#include <QtCore/qtimer.h>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+
+#if QT_HAS_INCLUDE(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define QDAEMON_HAS_IO_URING
+#endif
+
+QT_BEGIN_NAMESPACE
+
+static const int submitRetryInterval = 1;       // Retry a submission the kernel couldn't take after 1 ms
+
+QDaemonIoRingOperation::QDaemonIoRingOperation(Type operationType, int operationDescriptor, qint64 operationOffset)
+    : type(operationType), descriptor(operationDescriptor), offset(operationOffset), dataOnly(false), notifier(Q_NULLPTR)
+{
+}
+
+QDaemonIoRingPrivate::QDaemonIoRingPrivate(QDaemonIoRing * q)
+    : q_ptr(q), ringDescriptor(-1), eventDescriptor(-1), eventNotifier(Q_NULLPTR),
+      submissionRing(Q_NULLPTR), submissionRingSize(0), completionRing(Q_NULLPTR), completionRingSize(0), entries(Q_NULLPTR), entriesSize(0),
+      submissionHead(Q_NULLPTR), submissionTail(Q_NULLPTR), submissionArray(Q_NULLPTR), submissionMask(0), submissionEntries(0), localTail(0),
+      completionHead(Q_NULLPTR), completionTail(Q_NULLPTR), completions(Q_NULLPTR), completionMask(0),
+      unsubmitted(0), submitPosted(false), retryPosted(false)
+{
+}
+
+QDaemonIoRingPrivate::~QDaemonIoRingPrivate()
+{
+    // The kernel may still access the buffers of the operations in flight, wait for them before letting go
+    if (ringDescriptor >= 0)
+        cancelAll();
+    release();
+
+    qDeleteAll(deferred);
+    qDeleteAll(blocked);
+    for (int i = 0, size = failed.size(); i < size; i++)
+        delete failed.at(i).first;
+}
+
+bool QDaemonIoRingPrivate::setup(unsigned size)
+{
+#ifdef QDAEMON_HAS_IO_URING
+    struct io_uring_params params;
+    ::memset(&params, 0, sizeof(params));
+
+    // ENOSYS on kernels without io_uring, EPERM when it's disabled by a seccomp filter or a sysctl
+    ringDescriptor = int(::syscall(__NR_io_uring_setup, size, &params));
+    if (ringDescriptor < 0 || !probe(ringDescriptor))  {
+        release();
+        return false;
+    }
+
+    submissionRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    completionRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    const bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMap)
+        submissionRingSize = completionRingSize = qMax(submissionRingSize, completionRingSize);
+
+    submissionRing = ::mmap(Q_NULLPTR, submissionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringDescriptor, IORING_OFF_SQ_RING);
+    if (submissionRing == MAP_FAILED)  {
+        submissionRing = Q_NULLPTR;
+        release();
+        return false;
+    }
+
+    completionRing = singleMap ? submissionRing : ::mmap(Q_NULLPTR, completionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringDescriptor, IORING_OFF_CQ_RING);
+    if (completionRing == MAP_FAILED)  {
+        completionRing = Q_NULLPTR;
+        release();
+        return false;
+    }
+
+    entriesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void * entriesMap = ::mmap(Q_NULLPTR, entriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringDescriptor, IORING_OFF_SQES);
+    if (entriesMap == MAP_FAILED)  {
+        release();
+        return false;
+    }
+    entries = static_cast<struct io_uring_sqe *>(entriesMap);
+
+    char * submission = static_cast<char *>(submissionRing);
+    submissionHead = reinterpret_cast<unsigned *>(submission + params.sq_off.head);
+    submissionTail = reinterpret_cast<unsigned *>(submission + params.sq_off.tail);
+    submissionArray = reinterpret_cast<unsigned *>(submission + params.sq_off.array);
+    submissionMask = *reinterpret_cast<unsigned *>(submission + params.sq_off.ring_mask);
+    submissionEntries = *reinterpret_cast<unsigned *>(submission + params.sq_off.ring_entries);
+    localTail = *submissionTail;
+
+    char * completion = static_cast<char *>(completionRing);
+    completionHead = reinterpret_cast<unsigned *>(completion + params.cq_off.head);
+    completionTail = reinterpret_cast<unsigned *>(completion + params.cq_off.tail);
+    completions = reinterpret_cast<struct io_uring_cqe *>(completion + params.cq_off.cqes);
+    completionMask = *reinterpret_cast<unsigned *>(completion + params.cq_off.ring_mask);
+
+    // The completions are signaled through an eventfd, so the ring is serviced by the event loop
+    eventDescriptor = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (eventDescriptor < 0 || ::syscall(__NR_io_uring_register, ringDescriptor, IORING_REGISTER_EVENTFD, &eventDescriptor, 1) != 0)  {
+        release();
+        return false;
+    }
+
+    eventNotifier = new QSocketNotifier(eventDescriptor, QSocketNotifier::Read, q_ptr);
+    QObject::connect(eventNotifier, &QSocketNotifier::activated, q_ptr, [this] () -> void  {
+        eventfd_t value;
+        ::eventfd_read(eventDescriptor, &value);
+        reap();
+    });
+
+    return true;
+#else
+    Q_UNUSED(size);
+    return false;
+#endif
+}
+
+void QDaemonIoRingPrivate::enqueue(QDaemonIoRingOperation * operation)
+{
+    if (ringDescriptor < 0 || !prepare(operation))
+        deferred.append(operation);
+
+    // Everything queued until control returns to the event loop goes to the kernel in a single call
+    if (!submitPosted)  {
+        submitPosted = true;
+        QMetaObject::invokeMethod(q_ptr, "submit", Qt::QueuedConnection);
+    }
+}
+
+void QDaemonIoRingPrivate::submit()
+{
+    submitPosted = false;
+    if (ringDescriptor >= 0)
+        flush();
+
+    QList<QPair<QDaemonIoRingOperation *, qint64> > rejected;
+    rejected.swap(failed);
+
+    QList<QDaemonIoRingOperation *> operations;
+    operations.swap(deferred);
+
+    QPointer<QDaemonIoRing> guard(q_ptr);
+    for (int i = 0, size = rejected.size(); i < size; i++)  {
+        if (!guard)  {
+            delete rejected.at(i).first;
+            continue;
+        }
+        complete(rejected.at(i).first, rejected.at(i).second);
+    }
+
+    for (int i = 0, size = operations.size(); i < size; i++)  {
+        if (!guard)  {
+            delete operations.at(i);        // Destroyed from a completion
+            continue;
+        }
+        run(operations.at(i));
+    }
+}
+
+bool QDaemonIoRingPrivate::prepare(QDaemonIoRingOperation * operation)
+{
+#ifdef QDAEMON_HAS_IO_URING
+    // No cap on the outstanding operations: the kernels that pass the probe (5.6+) don't drop completions
+    // when their queue is full, they keep them until there's room (IORING_FEAT_NODROP)
+    struct io_uring_sqe * entry = nextEntry();
+    if (!entry)
+        return false;
+
+    entry->fd = operation->descriptor;
+    entry->off = quint64(operation->offset);        // -1 is the current file position
+    entry->user_data = quint64(quintptr(operation));
+
+    switch (operation->type)
+    {
+    case QDaemonIoRingOperation::Read:
+        entry->opcode = IORING_OP_READ;
+        entry->addr = quint64(quintptr(operation->buffer.data()));
+        entry->len = quint32(operation->buffer.size());
+        break;
+    case QDaemonIoRingOperation::Write:
+        entry->opcode = IORING_OP_WRITE;
+        entry->addr = quint64(quintptr(operation->buffer.constData()));
+        entry->len = quint32(operation->buffer.size());
+        break;
+    case QDaemonIoRingOperation::WriteVector:
+        entry->opcode = IORING_OP_WRITEV;
+        entry->addr = quint64(quintptr(operation->vectors.constData()));
+        entry->len = quint32(operation->vectors.size());
+        break;
+    case QDaemonIoRingOperation::Sync:
+        entry->opcode = IORING_OP_FSYNC;
+        entry->off = 0;
+        entry->fsync_flags = operation->dataOnly ? IORING_FSYNC_DATASYNC : 0;
+        break;
+    case QDaemonIoRingOperation::Accept:
+        entry->opcode = IORING_OP_ACCEPT;
+        entry->off = 0;
+        entry->accept_flags = SOCK_CLOEXEC | SOCK_NONBLOCK;
+        break;
+    }
+
+    pending.insert(operation);
+    return true;
+#else
+    Q_UNUSED(operation);
+    return false;
+#endif
+}
+
+struct io_uring_sqe * QDaemonIoRingPrivate::nextEntry()
+{
+#ifdef QDAEMON_HAS_IO_URING
+    unsigned head = __atomic_load_n(submissionHead, __ATOMIC_ACQUIRE);
+    if (localTail - head >= submissionEntries)  {
+        // Full, hand the prepared entries over to make room
+        flush();
+
+        head = __atomic_load_n(submissionHead, __ATOMIC_ACQUIRE);
+        if (localTail - head >= submissionEntries)
+            return Q_NULLPTR;
+    }
+
+    unsigned index = localTail & submissionMask;
+    struct io_uring_sqe * entry = &entries[index];
+    ::memset(entry, 0, sizeof(struct io_uring_sqe));
+    submissionArray[index] = index;
+
+    localTail++;
+    unsubmitted++;
+    return entry;
+#else
+    return Q_NULLPTR;
+#endif
+}
+
+int QDaemonIoRingPrivate::enter(unsigned submit, unsigned wait, unsigned flags)
+{
+#ifdef QDAEMON_HAS_IO_URING
+    return int(::syscall(__NR_io_uring_enter, ringDescriptor, submit, wait, flags, Q_NULLPTR, 0));
+#else
+    Q_UNUSED(submit);
+    Q_UNUSED(wait);
+    Q_UNUSED(flags);
+
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+void QDaemonIoRingPrivate::flush()
+{
+#ifdef QDAEMON_HAS_IO_URING
+    if (!unsubmitted)
+        return;
+
+    __atomic_store_n(submissionTail, localTail, __ATOMIC_RELEASE);
+
+    int submitted;
+    do  {
+        submitted = enter(unsubmitted, 0, 0);
+    } while (submitted < 0 && errno == EINTR);
+
+    if (submitted >= 0)
+        unsubmitted -= unsigned(submitted);
+
+    // A partial submission, or a transient failure (out of memory or the completions overflowed), leaves entries
+    // in the ring. Nothing else may submit them (e.g. the log writer doesn't queue while its write is pending),
+    // so retry on our own
+    if (submitted >= 0 || errno == EAGAIN || errno == EBUSY)  {
+        if (unsubmitted && !retryPosted)  {
+            retryPosted = true;
+            QTimer::singleShot(submitRetryInterval, q_ptr, [this] () -> void  {
+                retry();
+            });
+        }
+        return;
+    }
+
+    // The kernel didn't take any of the entries, take them back and fail their operations
+    int error = errno;
+    qWarning("Couldn't submit the I/O requests (%s).", ::strerror(error));
+
+    unsigned head = __atomic_load_n(submissionHead, __ATOMIC_ACQUIRE);
+    for (unsigned index = head; index != localTail; index++)  {
+        QDaemonIoRingOperation * operation = reinterpret_cast<QDaemonIoRingOperation *>(quintptr(entries[submissionArray[index & submissionMask]].user_data));
+        if (operation && pending.remove(operation))       // Cancel requests have none
+            failed.append(qMakePair(operation, -qint64(error)));
+    }
+
+    localTail = head;
+    unsubmitted = 0;
+    __atomic_store_n(submissionTail, localTail, __ATOMIC_RELEASE);
+
+    // Completed from the event loop, not from within whatever call ran out of room in the ring
+    if (!failed.isEmpty() && !submitPosted)  {
+        submitPosted = true;
+        QMetaObject::invokeMethod(q_ptr, "submit", Qt::QueuedConnection);
+    }
+#endif
+}
+
+void QDaemonIoRingPrivate::retry()
+{
+#ifdef QDAEMON_HAS_IO_URING
+    retryPosted = false;
+
+    // Move the overflowed completions to the ring and deliver them, which frees room for the retried entries
+    int result;
+    do  {
+        result = enter(0, 0, IORING_ENTER_GETEVENTS);
+    } while (result < 0 && errno == EINTR);
+    reap();
+
+    submit();
+#endif
+}
+
+void QDaemonIoRingPrivate::reap(bool deliver)
+{
+#ifdef QDAEMON_HAS_IO_URING
+    // Collect first, the completions may queue new operations
+    QVarLengthArray<QPair<QDaemonIoRingOperation *, qint64>, 64> finished;
+
+    unsigned head = *completionHead;
+    const unsigned tail = __atomic_load_n(completionTail, __ATOMIC_ACQUIRE);
+    for ( ; head != tail; head++)  {
+        const struct io_uring_cqe & entry = completions[head & completionMask];
+        if (entry.user_data)        // Cancel requests have none
+            finished.append(qMakePair(reinterpret_cast<QDaemonIoRingOperation *>(quintptr(entry.user_data)), qint64(entry.res)));
+    }
+    __atomic_store_n(completionHead, head, __ATOMIC_RELEASE);
+
+    for (int i = 0; i < finished.size(); i++)
+        pending.remove(finished[i].first);
+
+    QPointer<QDaemonIoRing> guard(q_ptr);
+    for (int i = 0; i < finished.size(); i++)  {
+        if (deliver && guard)
+            complete(finished[i].first, finished[i].second);
+        else
+            delete finished[i].first;
+    }
+#else
+    Q_UNUSED(deliver);
+#endif
+}
+
+void QDaemonIoRingPrivate::cancelAll()
+{
+#ifdef QDAEMON_HAS_IO_URING
+    flush();
+
+    // Accepts and reads on sockets may never complete on their own
+    foreach (QDaemonIoRingOperation * operation, pending)  {
+        struct io_uring_sqe * entry = nextEntry();
+        if (!entry)
+            break;
+
+        entry->opcode = IORING_OP_ASYNC_CANCEL;
+        entry->fd = -1;
+        entry->addr = quint64(quintptr(operation));
+    }
+    flush();
+
+    while (!pending.isEmpty())  {
+        if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+            break;
+        reap(false);
+    }
+#endif
+}
+
+qint64 QDaemonIoRingPrivate::perform(QDaemonIoRingOperation * operation)
+{
+    qint64 result;
+    do  {
+        switch (operation->type)
+        {
+        case QDaemonIoRingOperation::Read:
+            result = operation->offset < 0 ? ::read(operation->descriptor, operation->buffer.data(), size_t(operation->buffer.size()))
+                                           : ::pread(operation->descriptor, operation->buffer.data(), size_t(operation->buffer.size()), operation->offset);
+            break;
+        case QDaemonIoRingOperation::Write:
+            result = operation->offset < 0 ? ::write(operation->descriptor, operation->buffer.constData(), size_t(operation->buffer.size()))
+                                           : ::pwrite(operation->descriptor, operation->buffer.constData(), size_t(operation->buffer.size()), operation->offset);
+            break;
+        case QDaemonIoRingOperation::WriteVector:
+            result = operation->offset < 0 ? ::writev(operation->descriptor, operation->vectors.constData(), operation->vectors.size())
+                                           : ::pwritev(operation->descriptor, operation->vectors.constData(), operation->vectors.size(), operation->offset);
+            break;
+        case QDaemonIoRingOperation::Sync:
+            result = operation->dataOnly ? ::fdatasync(operation->descriptor) : ::fsync(operation->descriptor);
+            break;
+        case QDaemonIoRingOperation::Accept:
+        default:
+            result = ::accept4(operation->descriptor, Q_NULLPTR, Q_NULLPTR, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        }
+    } while (result < 0 && errno == EINTR);
+
+    return result < 0 ? -qint64(errno) : result;
+}
+
+void QDaemonIoRingPrivate::run(QDaemonIoRingOperation * operation)
+{
+    qint64 result = perform(operation);
+    if (result == -EAGAIN || result == -EWOULDBLOCK)  {
+        // A non-blocking descriptor isn't ready, wait for it in the event loop instead of failing
+        if (!operation->notifier)  {
+            bool reading = operation->type == QDaemonIoRingOperation::Read || operation->type == QDaemonIoRingOperation::Accept;
+            operation->notifier = new QSocketNotifier(operation->descriptor, reading ? QSocketNotifier::Read : QSocketNotifier::Write, q_ptr);
+            QObject::connect(operation->notifier, &QSocketNotifier::activated, q_ptr, [this, operation] () -> void  {
+                run(operation);
+            });
+            blocked.append(operation);
+        }
+        return;
+    }
+
+    if (operation->notifier)  {
+        blocked.removeOne(operation);
+        operation->notifier->setEnabled(false);
+        operation->notifier->deleteLater();     // We may be in its activated() signal
+        operation->notifier = Q_NULLPTR;
+    }
+
+    complete(operation, result);
+}
+
+void QDaemonIoRingPrivate::complete(QDaemonIoRingOperation * operation, qint64 result)
+{
+    QScopedPointer<QDaemonIoRingOperation> cleanup(operation);
+
+    if (operation->type == QDaemonIoRingOperation::Read)  {
+        operation->buffer.resize(result > 0 ? int(result) : 0);
+        if (operation->readCompletion)
+            operation->readCompletion(result, operation->buffer);
+    }
+    else if (operation->completion)
+        operation->completion(result);
+}
+
+void QDaemonIoRingPrivate::release()
+{
+#ifdef QDAEMON_HAS_IO_URING
+    delete eventNotifier;
+    eventNotifier = Q_NULLPTR;
+
+    if (entries)
+        ::munmap(entries, entriesSize);
+    if (completionRing && completionRing != submissionRing)
+        ::munmap(completionRing, completionRingSize);
+    if (submissionRing)
+        ::munmap(submissionRing, submissionRingSize);
+
+    entries = Q_NULLPTR;
+    completionRing = submissionRing = Q_NULLPTR;
+#endif
+
+    if (eventDescriptor >= 0)
+        ::close(eventDescriptor);
+    if (ringDescriptor >= 0)
+        ::close(ringDescriptor);
+
+    eventDescriptor = ringDescriptor = -1;
+}
+
+bool QDaemonIoRingPrivate::detect()
+{
+#ifdef QDAEMON_HAS_IO_URING
+    struct io_uring_params params;
+    ::memset(&params, 0, sizeof(params));
+
+    int descriptor = int(::syscall(__NR_io_uring_setup, 2, &params));
+    if (descriptor < 0)
+        return false;
+
+    bool supported = probe(descriptor);
+    ::close(descriptor);
+    return supported;
+#else
+    return false;
+#endif
+}
+
+bool QDaemonIoRingPrivate::probe(int descriptor)
+{
+#ifdef QDAEMON_HAS_IO_URING
+    // The opcodes were added over several kernel releases (READ and WRITE in 5.6), so check each one
+    static const int requiredOperations[] = {
+        IORING_OP_READ, IORING_OP_WRITE, IORING_OP_WRITEV, IORING_OP_FSYNC, IORING_OP_ACCEPT, IORING_OP_ASYNC_CANCEL
+    };
+    static const int probedOperations = 256;
+
+    size_t size = sizeof(struct io_uring_probe) + probedOperations * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe * probe = static_cast<struct io_uring_probe *>(::calloc(1, size));
+    if (!probe)
+        return false;
+
+    bool supported = ::syscall(__NR_io_uring_register, descriptor, IORING_REGISTER_PROBE, probe, probedOperations) == 0;
+    for (int i = 0, count = int(sizeof(requiredOperations) / sizeof(int)); i < count && supported; i++)  {
+        const int operation = requiredOperations[i];
+        supported = operation <= probe->last_op && (probe->ops[operation].flags & IO_URING_OP_SUPPORTED);
+    }
+
+    ::free(probe);
+    return supported;
+#else
+    Q_UNUSED(descriptor);
+    return false;
+#endif
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,155 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtDaemon API. It exists only
+// as an implementation detail. This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+
+#ifndef QDAEMONIORING_P_H
+#define QDAEMONIORING_P_H
+
+#include "qdaemonioring.h"
+
+#include <QtCore/qvarlengtharray.h>
+#include <QtCore/qlist.h>
+#include <QtCore/qset.h>
+#include <QtCore/qpair.h>
+
+#include <sys/uio.h>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+QT_BEGIN_NAMESPACE
+
+class QSocketNotifier;
+
+struct QDaemonIoRingOperation
+{
+    enum Type  {
+        Read,
+        Write,
+        WriteVector,
+        Sync,
+        Accept
+    };
+
+    QDaemonIoRingOperation(Type, int, qint64);
+
+    Type type;
+    int descriptor;
+    qint64 offset;
+    bool dataOnly;
+
+    QByteArray buffer;                          // The destination of a read, the source of a write
+    QByteArrayList buffers;
+    QVarLengthArray<struct iovec, 8> vectors;
+
+    QDaemonIoRing::Completion completion;
+    QDaemonIoRing::ReadCompletion readCompletion;
+    QSocketNotifier * notifier;                 // Waits for readiness in the synchronous fallback
+};
+
+class QDaemonIoRingPrivate
+{
+    Q_DECLARE_PUBLIC(QDaemonIoRing)
+
+public:
+    QDaemonIoRingPrivate(QDaemonIoRing *);
+    ~QDaemonIoRingPrivate();
+
+    bool setup(unsigned);
+    void enqueue(QDaemonIoRingOperation *);
+    void submit();
+
+    static bool detect();
+
+private:
+    bool prepare(QDaemonIoRingOperation *);
+    struct io_uring_sqe * nextEntry();
+    int enter(unsigned, unsigned, unsigned);
+    void flush();
+    void retry();
+    void reap(bool = true);
+    void cancelAll();
+
+    qint64 perform(QDaemonIoRingOperation *);
+    void run(QDaemonIoRingOperation *);
+    void complete(QDaemonIoRingOperation *, qint64);
+
+    void release();
+
+    static bool probe(int);
+
+private:
+    QDaemonIoRing * q_ptr;
+
+    int ringDescriptor;
+    int eventDescriptor;
+    QSocketNotifier * eventNotifier;
+
+    void * submissionRing;
+    size_t submissionRingSize;
+    void * completionRing;
+    size_t completionRingSize;
+    struct io_uring_sqe * entries;
+    size_t entriesSize;
+
+    unsigned * submissionHead;
+    unsigned * submissionTail;
+    unsigned * submissionArray;
+    unsigned submissionMask;
+    unsigned submissionEntries;
+    unsigned localTail;                         // One past the last prepared entry, published on submit
+
+    unsigned * completionHead;
+    unsigned * completionTail;
+    struct io_uring_cqe * completions;
+    unsigned completionMask;
+
+    unsigned unsubmitted;
+    bool submitPosted;
+    bool retryPosted;
+    QSet<QDaemonIoRingOperation *> pending;     // Handed over to the kernel
+    QList<QPair<QDaemonIoRingOperation *, qint64> > failed;  // Rejected by the kernel, completed on submit
+
+    QList<QDaemonIoRingOperation *> deferred;   // Operations of the synchronous fallback, run on submit
+    QList<QDaemonIoRingOperation *> blocked;    // Waiting for a non-blocking descriptor to become ready
+};
+
+QT_END_NAMESPACE
+
+#endif // QDAEMONIORING_P_H
@@ -28,18 +28,26 @@
 
 #include "qdaemonlog_p.h"
 #include "qdaemonlog.h"
+#include "qdaemonapplication.h"
 
 #include <QtCore/qcoreapplication.h>
 #include <QtCore/qdatetime.h>
 #include <QtCore/qdir.h>
 #include <QtCore/qfileinfo.h>
 
+#ifdef Q_OS_LINUX
+#include "qdaemonlogwriter_p.h"
+#endif
+
 QT_BEGIN_NAMESPACE
 
 QDaemonLog * QDaemonLogPrivate::logger = NULL;
+const int QDaemonLogPrivate::minimumQueueLimit = 256;
+const int QDaemonLogPrivate::maximumQueueLimit = 8192;
+const int QDaemonLogPrivate::averageEntrySize = 256;
 
 QDaemonLogPrivate::QDaemonLogPrivate()
-    : logStream(&logFile), logType(QDaemonLog::LogToStdout)
+    : logStream(&logFile), logType(QDaemonLog::LogToStdout), writer(Q_NULLPTR)
 {
     // Get the log file path
     QFileInfo info(QCoreApplication::applicationFilePath());
@@ -52,10 +60,51 @@ QDaemonLogPrivate::QDaemonLogPrivate()
 
 QDaemonLogPrivate::~QDaemonLogPrivate()
 {
+#ifdef Q_OS_LINUX
+    delete writer;
+#endif
+
     logStream.flush();
     logFile.close();
 }
 
+void QDaemonLogPrivate::setInstanceId(const QString & id)
+{
+    QMutexLocker lock(&streamMutex);
+    Q_UNUSED(lock);
+
+    // Each instance logs to its own file
+    QFileInfo info(QCoreApplication::applicationFilePath());
+    logFilePath = info.absoluteDir().filePath(QStringLiteral("%1_%2.log").arg(info.completeBaseName(), id));
+}
+
+void QDaemonLogPrivate::drainWriter()
+{
+#ifdef Q_OS_LINUX
+    // The file is about to be closed, nothing may be in flight
+    if (writer)
+        writer->drain();
+#endif
+}
+
+void QDaemonLogPrivate::updateWriter()
+{
+#ifdef Q_OS_LINUX
+    if (writer)
+        writer->setDescriptor(logFile.handle());
+#endif
+}
+
+int QDaemonLogPrivate::queueLimit()
+{
+    // Let the queued entries take up to a thousandth of the memory the daemon may use
+    qint64 budget = QDaemonApplication::memoryBudget();
+    if (budget < 0)
+        return maximumQueueLimit;
+
+    return int(qBound<qint64>(minimumQueueLimit, budget / 1024 / averageEntrySize, maximumQueueLimit));
+}
+
 void QDaemonLogPrivate::write(const QString & message, QDaemonLog::EntrySeverity severity)
 {
     static const QString noticeEntry = QStringLiteral("%1 %2");
@@ -76,6 +125,14 @@ void QDaemonLogPrivate::write(const QString & message, QDaemonLog::EntrySeverity
         formattedMessage = noticeEntry.arg(date).arg(message);
     }
 
+#ifdef Q_OS_LINUX
+    if (writer)  {
+        formattedMessage.append(QLatin1Char('\n'));
+        writer->append(formattedMessage.toLocal8Bit());
+        return;
+    }
+#endif
+
     logStream << formattedMessage << endl;
 }
 
@@ -48,6 +48,11 @@
 
 QT_BEGIN_NAMESPACE
 
+namespace QtDaemon
+{
+    class QDaemonLogWriter;
+}
+
 class QDaemonLogPrivate
 {
     friend class QDaemonLog;
@@ -59,6 +64,10 @@ public:
     ~QDaemonLogPrivate();
 
     void write(const QString &, QDaemonLog::EntrySeverity);
+    void setInstanceId(const QString &);
+
+    void drainWriter();
+    void updateWriter();
 
 private:
     QString logFilePath;
@@ -67,8 +76,14 @@ private:
     QDaemonLog::LogType logType;
 
     QMutex streamMutex;
+    QtDaemon::QDaemonLogWriter * writer;
 
     static QDaemonLog * logger;
+    static int queueLimit();
+
+    static const int minimumQueueLimit;
+    static const int maximumQueueLimit;
+    static const int averageEntrySize;
 };
 
 QT_END_NAMESPACE
@@ -0,0 +1,158 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include "qdaemonlogwriter_p.h"
+#include "qdaemonioring.h"
+
+#include <QtCore/qcoreapplication.h>
+
+#include <string.h>
+
+QT_BEGIN_NAMESPACE
+
+using namespace QtDaemon;
+
+const QEvent::Type QDaemonLogWriter::flushEvent = static_cast<QEvent::Type>(QEvent::registerEventType());
+
+QDaemonLogWriter::QDaemonLogWriter(int fileDescriptor, int queueLimit)
+    : queued(0), limit(qMax(1, queueLimit)), descriptor(fileDescriptor), flushPosted(false), writing(false)
+{
+    QDaemonMetrics & metrics = qDaemonMetrics();
+    queuedEntries = metrics.gauge(QStringLiteral("qtdaemon_log_queued_entries"), QStringLiteral("Log entries waiting to be written"));
+    batches = metrics.counter(QStringLiteral("qtdaemon_log_batches_total"), QStringLiteral("Batches of log entries written"));
+    entries = metrics.counter(QStringLiteral("qtdaemon_log_entries_total"), QStringLiteral("Log entries queued for writing"));
+
+    thread.setObjectName(QStringLiteral("QDaemonLog writer"));
+    moveToThread(&thread);
+    thread.start();
+}
+
+QDaemonLogWriter::~QDaemonLogWriter()
+{
+    drain();
+
+    thread.quit();
+    thread.wait();
+}
+
+void QDaemonLogWriter::append(const QByteArray & entry)
+{
+    QMutexLocker lock(&mutex);
+    Q_UNUSED(lock);
+
+    // Apply back pressure rather than losing entries or growing without bounds
+    while (queued >= limit)
+        condition.wait(&mutex);
+
+    queue.append(entry);
+    queuedEntries.set(++queued);
+    entries.add();
+
+    if (!flushPosted)  {
+        flushPosted = true;
+        QCoreApplication::postEvent(this, new QEvent(flushEvent));
+    }
+}
+
+void QDaemonLogWriter::drain()
+{
+    QMutexLocker lock(&mutex);
+    Q_UNUSED(lock);
+
+    while (queued > 0 || writing)
+        condition.wait(&mutex);
+}
+
+void QDaemonLogWriter::setDescriptor(int fileDescriptor)
+{
+    QMutexLocker lock(&mutex);
+    Q_UNUSED(lock);
+
+    Q_ASSERT(queued == 0 && !writing);
+    descriptor = fileDescriptor;
+}
+
+bool QDaemonLogWriter::event(QEvent * e)
+{
+    if (e->type() != flushEvent)
+        return QObject::event(e);
+
+    flush();
+    return true;
+}
+
+void QDaemonLogWriter::flush()
+{
+    QByteArray batch;
+    int fileDescriptor;
+    {
+        QMutexLocker lock(&mutex);
+        Q_UNUSED(lock);
+
+        flushPosted = false;
+        if (writing || queued == 0)
+            return;     // The completion of the write in flight picks up the rest
+
+        // Everything queued so far goes out with a single write
+        batch.swap(queue);
+        queued = 0;
+        queuedEntries.set(0);
+
+        writing = true;
+        fileDescriptor = descriptor;
+        condition.wakeAll();
+    }
+
+    write(fileDescriptor, batch);
+}
+
+void QDaemonLogWriter::write(int fileDescriptor, const QByteArray & batch)
+{
+    QDaemonIoRing::instance()->write(fileDescriptor, batch, -1, [this, fileDescriptor, batch] (qint64 result) -> void  {
+        if (result > 0 && result < batch.size())  {
+            write(fileDescriptor, batch.mid(int(result)));      // Short write, the rest follows
+            return;
+        }
+
+        if (result <= 0)
+            qWarning("Couldn't write to the log (%s).", result < 0 ? ::strerror(int(-result)) : "nothing was written");
+
+        batches.add();
+        {
+            QMutexLocker lock(&mutex);
+            Q_UNUSED(lock);
+
+            writing = false;
+            condition.wakeAll();
+        }
+
+        flush();
+    });
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,98 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtDaemon API. It exists only
+// as an implementation detail. This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+
+#ifndef QDAEMONLOGWRITER_P_H
+#define QDAEMONLOGWRITER_P_H
+
+#include "QtDaemon/qdaemon-global.h"
+#include "qdaemonmetrics.h"
+
+#include <QtCore/qobject.h>
+#include <QtCore/qthread.h>
+#include <QtCore/qmutex.h>
+#include <QtCore/qwaitcondition.h>
+#include <QtCore/qbytearray.h>
+#include <QtCore/qcoreevent.h>
+
+QT_BEGIN_NAMESPACE
+
+namespace QtDaemon
+{
+    class Q_DAEMON_LOCAL QDaemonLogWriter : public QObject
+    {
+        Q_OBJECT
+        Q_DISABLE_COPY(QDaemonLogWriter)
+
+    public:
+        QDaemonLogWriter(int, int);
+        ~QDaemonLogWriter() Q_DECL_OVERRIDE;
+
+        void append(const QByteArray &);
+        void drain();
+        void setDescriptor(int);
+
+        bool event(QEvent *) Q_DECL_OVERRIDE;
+
+        static const QEvent::Type flushEvent;
+
+    private:
+        void flush();
+        void write(int, const QByteArray &);
+
+        QThread thread;
+
+        QMutex mutex;
+        QWaitCondition condition;
+        QByteArray queue;
+        int queued;
+        const int limit;
+        int descriptor;
+        bool flushPosted;
+        bool writing;
+
+        QDaemonGauge queuedEntries;
+        QDaemonCounter batches;
+        QDaemonCounter entries;
+    };
+}
+
+QT_END_NAMESPACE
+
+#endif // QDAEMONLOGWRITER_P_H
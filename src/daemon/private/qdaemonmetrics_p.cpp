@@ -0,0 +1,300 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include "qdaemonmetrics_p.h"
+
+#include <QtCore/qalgorithms.h>
+
+QT_BEGIN_NAMESPACE
+
+static QBasicAtomicInt nextShard = Q_BASIC_ATOMIC_INITIALIZER(0);
+
+QDaemonShardedCounter::QDaemonShardedCounter()
+{
+    for (int i = 0; i < ShardCount; i++)
+        shards[i].value.store(0);
+}
+
+quint64 QDaemonShardedCounter::value() const
+{
+    quint64 total = 0;
+    for (int i = 0; i < ShardCount; i++)
+        total += shards[i].value.loadAcquire();
+
+    return total;
+}
+
+int QDaemonShardedCounter::shardIndex()
+{
+    // Each thread gets its own shard (round-robin), so the hot path is an uncontended add
+    static thread_local int index = nextShard.fetchAndAddRelaxed(1) & (ShardCount - 1);
+    return index;
+}
+
+QDaemonMetricPrivate::QDaemonMetricPrivate(Type metricType, const QString & metricName, const QString & metricDescription)
+    : type(metricType), name(metricName), description(metricDescription)
+{
+}
+
+QDaemonMetricPrivate::~QDaemonMetricPrivate()
+{
+}
+
+QDaemonCounterPrivate::QDaemonCounterPrivate(const QString & name, const QString & description)
+    : QDaemonMetricPrivate(CounterType, name, description)
+{
+}
+
+QDaemonGaugePrivate::QDaemonGaugePrivate(const QString & name, const QString & description)
+    : QDaemonMetricPrivate(GaugeType, name, description), gauge(0)
+{
+}
+
+QDaemonHistogramPrivate::QDaemonHistogramPrivate(const QString & name, const QString & description)
+    : QDaemonMetricPrivate(HistogramType, name, description)
+{
+    for (int i = 0; i < BucketCount; i++)
+        buckets[i].store(0);
+}
+
+void QDaemonHistogramPrivate::record(quint64 value)
+{
+    buckets[bucketIndex(value)].fetchAndAddRelaxed(1);
+    sum.add(value);
+}
+
+quint64 QDaemonHistogramPrivate::count() const
+{
+    quint64 total = 0;
+    for (int i = 0; i < BucketCount; i++)
+        total += buckets[i].loadAcquire();
+
+    return total;
+}
+
+quint64 QDaemonHistogramPrivate::percentile(double percent) const
+{
+    quint64 counts[BucketCount], total = 0;
+    for (int i = 0; i < BucketCount; i++)
+        total += (counts[i] = buckets[i].loadAcquire());
+
+    if (!total)
+        return 0;
+
+    percent = qBound(0.0, percent, 100.0);
+    quint64 rank = qMax<quint64>(1, quint64(percent / 100.0 * total + 0.5)), accumulated = 0;
+    for (int i = 0; i < BucketCount; i++)  {
+        accumulated += counts[i];
+        if (accumulated >= rank)
+            return bucketUpperBound(i);
+    }
+
+    return bucketUpperBound(BucketCount - 1);
+}
+
+int QDaemonHistogramPrivate::bucketIndex(quint64 value)
+{
+    if (value < SubBucketCount)
+        return int(value);
+
+    int exponent = 63 - int(qCountLeadingZeroBits(value));
+    int shift = exponent - SubBucketBits;
+    return (shift + 1) * SubBucketCount + int((value >> shift) & (SubBucketCount - 1));
+}
+
+quint64 QDaemonHistogramPrivate::bucketLowerBound(int index)
+{
+    if (index < SubBucketCount)
+        return quint64(index);
+
+    int shift = index / SubBucketCount - 1;
+    return quint64(SubBucketCount + index % SubBucketCount) << shift;
+}
+
+quint64 QDaemonHistogramPrivate::bucketUpperBound(int index)
+{
+    if (index < SubBucketCount)
+        return quint64(index);
+
+    int shift = index / SubBucketCount - 1;
+    return bucketLowerBound(index) + ((quint64(1) << shift) - 1);
+}
+
+QDaemonMetrics * QDaemonMetricsPrivate::registry = Q_NULLPTR;
+
+QDaemonMetricsPrivate::QDaemonMetricsPrivate()
+{
+}
+
+QDaemonMetricsPrivate::~QDaemonMetricsPrivate()
+{
+    qDeleteAll(metrics);
+}
+
+QDaemonMetricPrivate * QDaemonMetricsPrivate::metric(QDaemonMetricPrivate::Type type, const QString & name, const QString & description)
+{
+    QMutexLocker lock(&mutex);
+    Q_UNUSED(lock);
+
+    QDaemonMetricPrivate * metric = index.value(name, Q_NULLPTR);
+    if (metric)  {
+        if (Q_UNLIKELY(metric->type != type))  {
+            qWarning("QDaemonMetrics: The metric %s is already registered with a different type.", qPrintable(name));
+            return Q_NULLPTR;
+        }
+        return metric;
+    }
+
+    switch (type)
+    {
+    case QDaemonMetricPrivate::CounterType:
+        metric = new QDaemonCounterPrivate(name, description);
+        break;
+    case QDaemonMetricPrivate::GaugeType:
+        metric = new QDaemonGaugePrivate(name, description);
+        break;
+    case QDaemonMetricPrivate::HistogramType:
+    default:
+        metric = new QDaemonHistogramPrivate(name, description);
+    }
+
+    metrics.append(metric);
+    index.insert(name, metric);
+
+    return metric;
+}
+
+QByteArray QDaemonMetricsPrivate::toPrometheus() const
+{
+    static const double quantiles[] = { 50, 90, 99 };
+
+    QMutexLocker lock(&mutex);
+    Q_UNUSED(lock);
+
+    QByteArray output;
+    for (const QDaemonMetricPrivate * metric : metrics)  {
+        QByteArray name = prometheusName(metric->name);
+        if (!metric->description.isEmpty())
+            output += "# HELP " + name + ' ' + metric->description.toUtf8().replace('\\', "\\\\").replace('\n', "\\n") + '\n';
+
+        switch (metric->type)
+        {
+        case QDaemonMetricPrivate::CounterType:
+            output += "# TYPE " + name + " counter\n";
+            output += name + ' ' + QByteArray::number(static_cast<const QDaemonCounterPrivate *>(metric)->counter.value()) + '\n';
+            break;
+        case QDaemonMetricPrivate::GaugeType:
+            output += "# TYPE " + name + " gauge\n";
+            output += name + ' ' + QByteArray::number(static_cast<const QDaemonGaugePrivate *>(metric)->gauge.loadAcquire()) + '\n';
+            break;
+        case QDaemonMetricPrivate::HistogramType:
+        default:
+            {
+                // The log-linear buckets are too many to be exported as is, so report a summary instead
+                const QDaemonHistogramPrivate * histogram = static_cast<const QDaemonHistogramPrivate *>(metric);
+                output += "# TYPE " + name + " summary\n";
+                for (double quantile : quantiles)
+                    output += name + "{quantile=\"" + QByteArray::number(quantile / 100) + "\"} " + QByteArray::number(histogram->percentile(quantile)) + '\n';
+                output += name + "_sum " + QByteArray::number(histogram->sum.value()) + '\n';
+                output += name + "_count " + QByteArray::number(histogram->count()) + '\n';
+            }
+        }
+    }
+
+    return output;
+}
+
+QDaemonMetricsPrivate * QDaemonMetricsPrivate::instance()
+{
+    return registry ? registry->d_ptr : Q_NULLPTR;
+}
+
+QByteArray QDaemonMetricsPrivate::prometheusName(const QString & name)
+{
+    // Metric names must match [a-zA-Z_:][a-zA-Z0-9_:]*
+    QByteArray result = name.toLatin1();
+    for (int i = 0, size = result.size(); i < size; i++)  {
+        char c = result.at(i);
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == ':' || (i > 0 && c >= '0' && c <= '9'))
+            continue;
+        result[i] = '_';
+    }
+
+    return result;
+}
+
+QVector<QPair<QString, qint64> > QDaemonMetricsPrivate::values() const
+{
+    QMutexLocker lock(&mutex);
+    Q_UNUSED(lock);
+
+    // A single number for each metric, the histograms are represented by their count
+    QVector<QPair<QString, qint64> > values;
+    values.reserve(metrics.size());
+    for (const QDaemonMetricPrivate * metric : metrics)  {
+        qint64 value;
+        switch (metric->type)
+        {
+        case QDaemonMetricPrivate::CounterType:
+            value = qint64(static_cast<const QDaemonCounterPrivate *>(metric)->counter.value());
+            break;
+        case QDaemonMetricPrivate::GaugeType:
+            value = static_cast<const QDaemonGaugePrivate *>(metric)->gauge.loadAcquire();
+            break;
+        case QDaemonMetricPrivate::HistogramType:
+        default:
+            value = qint64(static_cast<const QDaemonHistogramPrivate *>(metric)->count());
+        }
+
+        values.append(qMakePair(metric->name, value));
+    }
+
+    return values;
+}
+
+QString QDaemonMetricsPrivate::formatValue(const QDaemonMetricPrivate * metric)
+{
+    switch (metric->type)
+    {
+    case QDaemonMetricPrivate::CounterType:
+        return QString::number(static_cast<const QDaemonCounterPrivate *>(metric)->counter.value());
+    case QDaemonMetricPrivate::GaugeType:
+        return QString::number(static_cast<const QDaemonGaugePrivate *>(metric)->gauge.loadAcquire());
+    case QDaemonMetricPrivate::HistogramType:
+    default:
+        {
+            const QDaemonHistogramPrivate * histogram = static_cast<const QDaemonHistogramPrivate *>(metric);
+            return QStringLiteral("count=%1 sum=%2 p50=%3 p90=%4 p99=%5 max=%6")
+                    .arg(histogram->count()).arg(histogram->sum.value())
+                    .arg(histogram->percentile(50)).arg(histogram->percentile(90))
+                    .arg(histogram->percentile(99)).arg(histogram->percentile(100));
+        }
+    }
+}
+
+QT_END_NAMESPACE
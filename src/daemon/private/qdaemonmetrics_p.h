@@ -0,0 +1,159 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtDaemon API. It exists only
+// as an implementation detail. This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#ifndef QDAEMONMETRICS_P_H
+#define QDAEMONMETRICS_P_H
+
+#include "qdaemonmetrics.h"
+
+#include <QtCore/qatomic.h>
+#include <QtCore/qmutex.h>
+#include <QtCore/qvector.h>
+#include <QtCore/qhash.h>
+#include <QtCore/qpair.h>
+
+QT_BEGIN_NAMESPACE
+
+class QDaemonShardedCounter
+{
+    Q_DISABLE_COPY(QDaemonShardedCounter)
+
+public:
+    enum { ShardCount = 64, CacheLineSize = 64 };
+
+    QDaemonShardedCounter();
+
+    inline void add(quint64 value)
+    {
+        shards[shardIndex()].value.fetchAndAddRelaxed(value);
+    }
+
+    quint64 value() const;
+
+private:
+    static int shardIndex();
+
+    struct Shard
+    {
+        QAtomicInteger<quint64> value;
+        char padding[CacheLineSize - sizeof(QAtomicInteger<quint64>)];     // Keep each shard on its own cache line
+    };
+
+    Shard shards[ShardCount];
+};
+
+class QDaemonMetricPrivate
+{
+    Q_DISABLE_COPY(QDaemonMetricPrivate)
+
+public:
+    enum Type { CounterType, GaugeType, HistogramType };
+
+    QDaemonMetricPrivate(Type, const QString &, const QString &);
+    virtual ~QDaemonMetricPrivate();
+
+    const Type type;
+    const QString name;
+    const QString description;
+};
+
+class QDaemonCounterPrivate : public QDaemonMetricPrivate
+{
+public:
+    QDaemonCounterPrivate(const QString &, const QString &);
+
+    QDaemonShardedCounter counter;
+};
+
+class QDaemonGaugePrivate : public QDaemonMetricPrivate
+{
+public:
+    QDaemonGaugePrivate(const QString &, const QString &);
+
+    QAtomicInteger<qint64> gauge;
+};
+
+class QDaemonHistogramPrivate : public QDaemonMetricPrivate
+{
+public:
+    // Log-linear (HDR-style) buckets: each power of two is split in 2^SubBucketBits linear sub-buckets
+    enum { SubBucketBits = 4, SubBucketCount = 1 << SubBucketBits, BucketCount = (64 - SubBucketBits + 1) * SubBucketCount };
+
+    QDaemonHistogramPrivate(const QString &, const QString &);
+
+    void record(quint64);
+    quint64 count() const;
+    quint64 percentile(double) const;
+
+    static int bucketIndex(quint64);
+    static quint64 bucketLowerBound(int);
+    static quint64 bucketUpperBound(int);
+
+    QAtomicInteger<quint64> buckets[BucketCount];
+    QDaemonShardedCounter sum;
+};
+
+class QDaemonMetricsPrivate
+{
+    friend class QDaemonMetrics;
+    friend QDaemonMetrics & qDaemonMetrics();
+
+public:
+    QDaemonMetricsPrivate();
+    ~QDaemonMetricsPrivate();
+
+    QDaemonMetricPrivate * metric(QDaemonMetricPrivate::Type, const QString &, const QString &);
+    QByteArray toPrometheus() const;
+    QVector<QPair<QString, qint64> > values() const;
+
+    static QDaemonMetricsPrivate * instance();
+    static QString formatValue(const QDaemonMetricPrivate *);
+    static QByteArray prometheusName(const QString &);
+
+private:
+    mutable QMutex mutex;
+    QVector<QDaemonMetricPrivate *> metrics;        // Kept in the order of registration
+    QHash<QString, QDaemonMetricPrivate *> index;
+
+    static QDaemonMetrics * registry;
+};
+
+QT_END_NAMESPACE
+
+#endif // QDAEMONMETRICS_P_H
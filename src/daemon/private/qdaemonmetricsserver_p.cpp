@@ -0,0 +1,351 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include "qdaemonmetricsserver_p.h"
+#include "qdaemonmetrics_p.h"
+#include "qdaemonlog.h"
+
+#include <QtCore/qfile.h>
+#include <QtCore/qlist.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/resource.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <cstring>
+
+QT_BEGIN_NAMESPACE
+
+using namespace QtDaemon;
+
+static const int requestTimeout = 1000;          // Give the client up to a second to send the request
+static const int maximumRequestSize = 8192;
+
+static bool isStaleSocket(const struct sockaddr_un & address)
+{
+    // Only a socket nobody accepts on is stale, a live daemon's endpoint (or a file that isn't a socket at all) is left alone
+    struct stat status;
+    if (::lstat(address.sun_path, &status) != 0 || !S_ISSOCK(status.st_mode))
+        return false;
+
+    int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (probe < 0)
+        return false;
+
+    bool stale = ::connect(probe, reinterpret_cast<const struct sockaddr *>(&address), sizeof(address)) != 0 && errno == ECONNREFUSED;
+    ::close(probe);
+
+    errno = EADDRINUSE;         // What the failed bind reports, if the path isn't removed
+    return stale;
+}
+
+QDaemonMetricsServer::QDaemonMetricsServer(QObject * parent)
+    : QThread(parent), listenDescriptor(-1)
+{
+    wakeDescriptors[0] = wakeDescriptors[1] = -1;
+}
+
+QDaemonMetricsServer::~QDaemonMetricsServer()
+{
+    stop();
+}
+
+bool QDaemonMetricsServer::listen(const QString & endpoint)
+{
+    Q_ASSERT(listenDescriptor < 0);
+
+    if (endpoint.startsWith(QLatin1Char('/')) || endpoint.startsWith(QStringLiteral("unix:")))  {
+        QByteArray path = QFile::encodeName(endpoint.startsWith(QLatin1Char('/')) ? endpoint : endpoint.mid(5));
+
+        struct sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        if (path.isEmpty() || size_t(path.size()) >= sizeof(address.sun_path))  {
+            qDaemonLog(QStringLiteral("The metrics endpoint path is invalid (%1).").arg(endpoint), QDaemonLog::ErrorEntry);
+            return false;
+        }
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, path.constData(), path.size());
+
+        listenDescriptor = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listenDescriptor >= 0)  {
+            int status = ::bind(listenDescriptor, reinterpret_cast<struct sockaddr *>(&address), sizeof(address));
+            if (status != 0 && errno == EADDRINUSE && isStaleSocket(address))  {
+                ::unlink(path.constData());      // Left from a previous run, nothing listens on it anymore
+                status = ::bind(listenDescriptor, reinterpret_cast<struct sockaddr *>(&address), sizeof(address));
+            }
+
+            if (status == 0)
+                unixSocketPath = path;          // Ours now, removed when stopped
+            else  {
+                int error = errno;
+                ::close(listenDescriptor);
+                listenDescriptor = -1;
+                errno = error;
+            }
+        }
+    }
+    else  {
+        // Either "port" or "host:port", by default only the loopback interface is used
+        QString host = QStringLiteral("127.0.0.1"), port = endpoint;
+        int separator = endpoint.lastIndexOf(QLatin1Char(':'));
+        if (separator >= 0)  {
+            host = endpoint.left(separator);
+            port = endpoint.mid(separator + 1);
+            if (host.startsWith(QLatin1Char('[')) && host.endsWith(QLatin1Char(']')))
+                host = host.mid(1, host.size() - 2);
+        }
+
+        struct addrinfo hints, * addresses = Q_NULLPTR;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+
+        if (::getaddrinfo(host.isEmpty() ? Q_NULLPTR : host.toLatin1().constData(), port.toLatin1().constData(), &hints, &addresses) != 0)  {
+            qDaemonLog(QStringLiteral("The metrics endpoint address is invalid (%1).").arg(endpoint), QDaemonLog::ErrorEntry);
+            return false;
+        }
+
+        for (struct addrinfo * address = addresses; address; address = address->ai_next)  {
+            listenDescriptor = ::socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol);
+            if (listenDescriptor < 0)
+                continue;
+
+            int enable = 1;
+            ::setsockopt(listenDescriptor, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+            if (::bind(listenDescriptor, address->ai_addr, address->ai_addrlen) == 0)
+                break;
+
+            ::close(listenDescriptor);
+            listenDescriptor = -1;
+        }
+        ::freeaddrinfo(addresses);
+    }
+
+    if (listenDescriptor < 0 || ::listen(listenDescriptor, SOMAXCONN) != 0 || ::pipe2(wakeDescriptors, O_CLOEXEC) != 0)  {
+        int error = errno;
+        qDaemonLog(QStringLiteral("Couldn't open the metrics endpoint %1 (%2).").arg(endpoint, QString::fromLocal8Bit(std::strerror(error))), QDaemonLog::ErrorEntry);
+        stop();
+        return false;
+    }
+
+    start(QThread::LowPriority);
+    return true;
+}
+
+void QDaemonMetricsServer::stop()
+{
+    if (wakeDescriptors[1] >= 0 && isRunning())  {
+        char wake = 0;
+        while (::write(wakeDescriptors[1], &wake, 1) < 0 && errno == EINTR)
+            ;
+        wait();
+    }
+
+    for (int i = 0; i < 2; i++)  {
+        if (wakeDescriptors[i] >= 0)
+            ::close(wakeDescriptors[i]);
+        wakeDescriptors[i] = -1;
+    }
+
+    if (listenDescriptor >= 0)  {
+        ::close(listenDescriptor);
+        listenDescriptor = -1;
+    }
+
+    if (!unixSocketPath.isEmpty())  {
+        ::unlink(unixSocketPath.constData());
+        unixSocketPath.clear();
+    }
+}
+
+void QDaemonMetricsServer::run()
+{
+    struct pollfd descriptors[2];
+    descriptors[0].fd = listenDescriptor;
+    descriptors[0].events = POLLIN;
+    descriptors[1].fd = wakeDescriptors[0];
+    descriptors[1].events = POLLIN;
+
+    forever  {
+        if (::poll(descriptors, 2, -1) < 0)  {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (descriptors[1].revents)
+            break;      // Asked to stop
+
+        if (descriptors[0].revents & POLLIN)  {
+            int client = ::accept4(listenDescriptor, Q_NULLPTR, Q_NULLPTR, SOCK_CLOEXEC);
+            if (client < 0)
+                continue;
+
+            serve(client);
+            ::close(client);
+        }
+    }
+}
+
+void QDaemonMetricsServer::serve(int client)
+{
+    struct timeval timeout = { requestTimeout / 1000, (requestTimeout % 1000) * 1000 };
+    ::setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ::setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // Read the request header
+    QByteArray request;
+    char buffer[1024];
+    while (!request.contains("\r\n\r\n") && request.size() < maximumRequestSize)  {
+        ssize_t bytes = ::recv(client, buffer, sizeof(buffer), 0);
+        if (bytes < 0 && errno == EINTR)
+            continue;
+        if (bytes <= 0)
+            break;
+        request.append(buffer, int(bytes));
+    }
+
+    QList<QByteArray> requestLine = request.left(request.indexOf("\r\n")).split(' ');
+    QByteArray method = requestLine.value(0), path = requestLine.value(1);
+    path.truncate(path.indexOf('?') >= 0 ? path.indexOf('?') : path.size());
+
+    QByteArray status, body;
+    if (requestLine.size() < 3)
+        status = "400 Bad Request";
+    else if (method != "GET" && method != "HEAD")
+        status = "405 Method Not Allowed";
+    else if (path != "/metrics" && path != "/")
+        status = "404 Not Found";
+    else  {
+        status = "200 OK";
+
+        body = processMetrics();
+        QDaemonMetricsPrivate * metrics = QDaemonMetricsPrivate::instance();
+        if (metrics)
+            body += metrics->toPrometheus();
+    }
+
+    QByteArray response = "HTTP/1.1 " + status + "\r\n"
+            "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+            "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+            "Connection: close\r\n\r\n";
+    if (method != "HEAD")
+        response += body;
+
+    for (const char * data = response.constData(), * end = data + response.size(); data < end; )  {
+        ssize_t bytes = ::send(client, data, end - data, MSG_NOSIGNAL);
+        if (bytes < 0 && errno == EINTR)
+            continue;
+        if (bytes <= 0)
+            break;
+        data += bytes;
+    }
+}
+
+QByteArray QDaemonMetricsServer::processMetrics()
+{
+    QByteArray output;
+
+    static const long ticksPerSecond = ::sysconf(_SC_CLK_TCK);
+    static const long pageSize = ::sysconf(_SC_PAGESIZE);
+
+    // Process statistics, the fields following the executable name (the 2nd field) are space separated
+    QFile stat(QStringLiteral("/proc/self/stat"));
+    if (stat.open(QFile::ReadOnly))  {
+        QByteArray data = stat.readAll();
+        QList<QByteArray> fields = data.mid(data.lastIndexOf(')') + 2).split(' ');
+        if (fields.size() > 21)  {
+            double cpu = double(fields.at(11).toULongLong() + fields.at(12).toULongLong()) / ticksPerSecond;
+
+            output += "# HELP process_cpu_seconds_total Total user and system CPU time spent in seconds.\n"
+                      "# TYPE process_cpu_seconds_total counter\n"
+                      "process_cpu_seconds_total " + QByteArray::number(cpu) + '\n';
+            output += "# HELP process_threads Number of OS threads in the process.\n"
+                      "# TYPE process_threads gauge\n"
+                      "process_threads " + fields.at(17) + '\n';
+            output += "# HELP process_virtual_memory_bytes Virtual memory size in bytes.\n"
+                      "# TYPE process_virtual_memory_bytes gauge\n"
+                      "process_virtual_memory_bytes " + fields.at(20) + '\n';
+            output += "# HELP process_resident_memory_bytes Resident memory size in bytes.\n"
+                      "# TYPE process_resident_memory_bytes gauge\n"
+                      "process_resident_memory_bytes " + QByteArray::number(fields.at(21).toLongLong() * pageSize) + '\n';
+
+            // The start time is in clock ticks after the system boot
+            QFile systemStat(QStringLiteral("/proc/stat"));
+            if (systemStat.open(QFile::ReadOnly))  {
+                QByteArray bootTime;
+                while (!systemStat.atEnd() && bootTime.isEmpty())  {
+                    QByteArray line = systemStat.readLine();
+                    if (line.startsWith("btime "))
+                        bootTime = line.mid(6).trimmed();
+                }
+
+                if (!bootTime.isEmpty())  {
+                    double startTime = bootTime.toDouble() + double(fields.at(19).toULongLong()) / ticksPerSecond;
+                    output += "# HELP process_start_time_seconds Start time of the process since unix epoch in seconds.\n"
+                              "# TYPE process_start_time_seconds gauge\n"
+                              "process_start_time_seconds " + QByteArray::number(startTime, 'f', 2) + '\n';
+                }
+            }
+        }
+    }
+
+    // Open file descriptors (excluding the one used for the listing itself)
+    DIR * directory = ::opendir("/proc/self/fd");
+    if (directory)  {
+        int descriptors = -1;
+        while (struct dirent * entry = ::readdir(directory))  {
+            if (entry->d_name[0] != '.')
+                descriptors++;
+        }
+        ::closedir(directory);
+
+        output += "# HELP process_open_fds Number of open file descriptors.\n"
+                  "# TYPE process_open_fds gauge\n"
+                  "process_open_fds " + QByteArray::number(descriptors) + '\n';
+    }
+
+    struct rlimit limit;
+    if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)  {
+        output += "# HELP process_max_fds Maximum number of open file descriptors.\n"
+                  "# TYPE process_max_fds gauge\n"
+                  "process_max_fds " + QByteArray::number(quint64(limit.rlim_cur)) + '\n';
+    }
+
+    return output;
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,326 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include "qdaemonprocesstuning_p.h"
+
+#include <QtCore/qdir.h>
+#include <QtCore/qfile.h>
+#include <QtCore/qstringlist.h>
+
+#include <algorithm>
+#include <limits>
+
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <malloc.h>
+#include <alloca.h>
+#include <string.h>
+#include <stdlib.h>
+
+QT_BEGIN_NAMESPACE
+
+using namespace QtDaemon;
+
+// From linux/ioprio.h and linux/mempolicy.h, which aren't shipped with every toolchain
+static const int ioPriorityWhoProcess = 1;
+static const int ioPriorityClassShift = 13;
+static const int memoryPolicyBind = 2;
+
+static const int maximumNumaNodes = 1024;
+
+bool QDaemonProcessTuning::parseCpuList(const QString & text, QList<int> & cpus)
+{
+    // The format of taskset -c and of the kernel's cpulist files: 0-3,8,10-11
+    cpus.clear();
+
+    QStringList ranges = text.trimmed().split(QLatin1Char(','), QString::SkipEmptyParts);
+    foreach (const QString & range, ranges)  {
+        QStringList bounds = range.split(QLatin1Char('-'));
+
+        bool ok, lastOk = true;
+        int first = bounds.first().trimmed().toInt(&ok), last = bounds.size() > 1 ? bounds.last().trimmed().toInt(&lastOk) : first;
+        if (!ok || !lastOk || bounds.size() > 2 || first < 0 || last < first || last >= CPU_SETSIZE)
+            return false;
+
+        for (int cpu = first; cpu <= last; cpu++)  {
+            if (!cpus.contains(cpu))
+                cpus.append(cpu);
+        }
+    }
+
+    std::sort(cpus.begin(), cpus.end());
+    return !cpus.isEmpty();
+}
+
+QString QDaemonProcessTuning::cpuListString(const QList<int> & cpus)
+{
+    QStringList ranges;
+    for (int i = 0, size = cpus.size(); i < size; )  {
+        int first = cpus.at(i), last = first;
+        while (++i < size && cpus.at(i) == last + 1)
+            last++;
+
+        ranges.append(first == last ? QString::number(first) : QStringLiteral("%1-%2").arg(first).arg(last));
+    }
+
+    return ranges.join(QLatin1Char(','));
+}
+
+QList<int> QDaemonProcessTuning::allowedCpus()
+{
+    QList<int> cpus;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (::sched_getaffinity(0, sizeof(set), &set) != 0)
+        return cpus;
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)  {
+        if (CPU_ISSET(cpu, &set))
+            cpus.append(cpu);
+    }
+
+    return cpus;
+}
+
+QList<int> QDaemonProcessTuning::numaNodeCpus(int node)
+{
+    QList<int> cpus;
+
+    QFile file(QStringLiteral("/sys/devices/system/node/node%1/cpulist").arg(node));
+    if (node < 0 || !file.open(QFile::ReadOnly))
+        return cpus;
+
+    parseCpuList(QString::fromLatin1(file.readAll()), cpus);
+    return cpus;
+}
+
+bool QDaemonProcessTuning::setAffinity(const QList<int> & cpus)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    foreach (int cpu, cpus)
+        CPU_SET(cpu, &set);
+
+    // The affinity is per thread, so the threads started before the daemon was set up need it too
+    return forEachThread([&set] (pid_t thread) -> bool  {
+        return ::sched_setaffinity(thread, sizeof(set), &set) == 0;
+    });
+}
+
+bool QDaemonProcessTuning::setCurrentThreadAffinity(const QList<int> & cpus)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    foreach (int cpu, cpus)  {
+        if (cpu < 0 || cpu >= CPU_SETSIZE)  {
+            errno = EINVAL;
+            return false;
+        }
+        CPU_SET(cpu, &set);
+    }
+
+    return ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) == 0;
+}
+
+bool QDaemonProcessTuning::bindMemory(int node)
+{
+    if (node < 0 || node >= maximumNumaNodes)  {
+        errno = EINVAL;
+        return false;
+    }
+
+    static const int bitsPerWord = sizeof(unsigned long) * 8;
+
+    unsigned long mask[maximumNumaNodes / bitsPerWord] = { 0 };
+    mask[node / bitsPerWord] |= 1UL << (node % bitsPerWord);
+
+    // The policy is inherited by the threads and the processes started from now on (the kernel expects one bit more)
+    return ::syscall(SYS_set_mempolicy, memoryPolicyBind, mask, maximumNumaNodes + 1) == 0;
+}
+
+bool QDaemonProcessTuning::setNice(int value)
+{
+    // On Linux the nice value is per thread as well
+    return forEachThread([value] (pid_t thread) -> bool  {
+        return ::setpriority(PRIO_PROCESS, id_t(thread), value) == 0;
+    });
+}
+
+bool QDaemonProcessTuning::parseIoPriority(const QString & text, int & priority)
+{
+    // class[:level], as with ionice: realtime and best-effort take a level from 0 (highest) to 7
+    QStringList values = text.trimmed().split(QLatin1Char(':'));
+    QString ioClass = values.first().toLower();
+
+    bool ok = values.size() <= 2;
+    int level = values.size() > 1 ? values.last().toInt(&ok) : 4;
+    if (!ok || level < 0 || level > 7)
+        return false;
+
+    if (ioClass == QLatin1String("realtime") || ioClass == QLatin1String("rt"))
+        priority = (1 << ioPriorityClassShift) | level;
+    else if (ioClass == QLatin1String("best-effort") || ioClass == QLatin1String("be"))
+        priority = (2 << ioPriorityClassShift) | level;
+    else if (ioClass == QLatin1String("idle") && values.size() == 1)
+        priority = 3 << ioPriorityClassShift;
+    else
+        return false;
+
+    return true;
+}
+
+bool QDaemonProcessTuning::setIoPriority(int priority)
+{
+    return forEachThread([priority] (pid_t thread) -> bool  {
+        return ::syscall(SYS_ioprio_set, ioPriorityWhoProcess, thread, priority) == 0;
+    });
+}
+
+bool QDaemonProcessTuning::parseSize(const QString & text, qint64 & size)
+{
+    // A number of bytes with an optional binary suffix: 512M, 2G
+    QString value = text.trimmed().toUpper();
+    if (value.endsWith(QLatin1Char('B')))
+        value.chop(1);
+
+    qint64 multiplier = 1;
+    if (value.endsWith(QLatin1Char('K')))
+        multiplier = Q_INT64_C(1) << 10;
+    else if (value.endsWith(QLatin1Char('M')))
+        multiplier = Q_INT64_C(1) << 20;
+    else if (value.endsWith(QLatin1Char('G')))
+        multiplier = Q_INT64_C(1) << 30;
+
+    if (multiplier > 1)
+        value.chop(1);
+
+    bool ok;
+    size = value.toLongLong(&ok);
+    if (!ok || size < 0 || size > std::numeric_limits<qint64>::max() / multiplier)
+        return false;
+
+    size *= multiplier;
+    return true;
+}
+
+bool QDaemonProcessTuning::raiseDescriptorLimit(qint64 requested, qint64 & applied)
+{
+    applied = -1;
+
+    struct rlimit limit;
+    if (::getrlimit(RLIMIT_NOFILE, &limit) != 0)
+        return false;
+
+    // A negative request means as much as allowed. Raising the hard limit requires CAP_SYS_RESOURCE
+    rlim_t target = requested < 0 ? limit.rlim_max : rlim_t(requested);
+    if (target > limit.rlim_max)
+        limit.rlim_max = target;
+    limit.rlim_cur = target;
+
+    bool raised = ::setrlimit(RLIMIT_NOFILE, &limit) == 0;
+    int error = errno;
+
+    struct rlimit current;
+    applied = ::getrlimit(RLIMIT_NOFILE, &current) == 0 ? qint64(current.rlim_cur) : -1;
+
+    errno = error;
+    return raised;
+}
+
+bool QDaemonProcessTuning::lockMemory()
+{
+    // Lift the soft limit on the locked memory as far as the hard one goes, CAP_IPC_LOCK lifts it altogether
+    struct rlimit limit;
+    if (::getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur < limit.rlim_max)  {
+        limit.rlim_cur = limit.rlim_max;
+        ::setrlimit(RLIMIT_MEMLOCK, &limit);
+    }
+
+    // The mappings created later on (heap growth, thread stacks) are locked and populated as they're created
+    return ::mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+}
+
+bool QDaemonProcessTuning::prefaultHeap(qint64 size)
+{
+    // The padding that keeps the reserve is an int
+    if (size <= 0 || size > std::numeric_limits<int>::max())  {
+        errno = EINVAL;
+        return false;
+    }
+
+    // Served from the break, as a mapped block would be returned to the system when freed. Mapping is enabled again
+    // right after (glibc has no getter, 65536 is its default), the other allocations are served as usual
+    ::mallopt(M_MMAP_MAX, 0);
+    char * reserve = static_cast<char *>(::malloc(size_t(size)));
+    int error = errno;
+    ::mallopt(M_MMAP_MAX, 65536);
+
+    if (!reserve)  {
+        errno = error;
+        return false;
+    }
+
+    // Touch each page so it's backed by memory before the daemon starts serving
+    const long pageSize = ::sysconf(_SC_PAGESIZE);
+    for (qint64 offset = 0; offset < size; offset += pageSize)
+        reserve[offset] = 0;
+
+    // The heap is still trimmed, but never below the reserve, which stays at its top once freed
+    ::mallopt(M_TOP_PAD, int(size));
+    ::free(reserve);
+    return true;
+}
+
+void QDaemonProcessTuning::prefaultStack(qint64 size)
+{
+    // Touch the stack of the calling thread down to the given depth
+    volatile char * stack = static_cast<volatile char *>(::alloca(size_t(size)));
+    ::memset(const_cast<char *>(stack), 0, size_t(size));
+}
+
+bool QDaemonProcessTuning::forEachThread(const std::function<bool (pid_t)> & function)
+{
+    QStringList threads = QDir(QStringLiteral("/proc/self/task")).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    if (threads.isEmpty())
+        return function(0);     // No procfs, the calling thread is all we can do
+
+    foreach (const QString & thread, threads)  {
+        if (!function(pid_t(thread.toInt())) && errno != ESRCH)     // The thread may have exited meanwhile
+            return false;
+    }
+
+    return true;
+}
+
+QT_END_NAMESPACE
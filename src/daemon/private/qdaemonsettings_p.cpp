@@ -0,0 +1,155 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include "qdaemonsettings_p.h"
+#include "qdaemonlog.h"
+
+#include <QtCore/qsettings.h>
+#include <QtCore/qfileinfo.h>
+#include <QtCore/qstringlist.h>
+
+QT_BEGIN_NAMESPACE
+
+static QBasicAtomicInt nextHazardSlot = Q_BASIC_ATOMIC_INITIALIZER(0);
+
+QDaemonSettingsPrivate::QDaemonSettingsPrivate(QDaemonSettings * q, const QString & file)
+    : q_ptr(q), fileName(file), current(Q_NULLPTR), reloadRequests(0)
+{
+    for (int i = 0; i < HazardSlotCount; i++)
+        hazards[i].store(Q_NULLPTR);
+
+    loader.setMaxThreadCount(1);
+
+    // The initial snapshot is loaded synchronously, so the settings can be read right away
+    QDaemonSettingsSnapshot * snapshot = load(fileName);
+    publish(snapshot ? snapshot : new QDaemonSettingsSnapshot);
+}
+
+QDaemonSettingsPrivate::~QDaemonSettingsPrivate()
+{
+    loader.waitForDone();
+
+    qDeleteAll(retired);
+    delete current.load();
+}
+
+QVariantMap QDaemonSettingsPrivate::read() const
+{
+    // Spread the threads over the slots, so they don't compete for the same one
+    static thread_local int hint = nextHazardSlot.fetchAndAddRelaxed(1) % HazardSlotCount;
+
+    QDaemonSettingsSnapshot * snapshot = current.loadAcquire();
+
+    int slot = hint;
+    forever  {
+        // Announce the snapshot is being read, then make sure it wasn't replaced (and possibly reclaimed) meanwhile
+        while (!hazards[slot].testAndSetOrdered(Q_NULLPTR, snapshot))
+            slot = (slot + 1) % HazardSlotCount;
+
+        QDaemonSettingsSnapshot * latest = current.loadAcquire();
+        if (latest == snapshot)
+            break;
+
+        hazards[slot].storeRelease(Q_NULLPTR);
+        snapshot = latest;
+    }
+
+    QVariantMap values = snapshot->values;      // Implicitly shared, the copy only references the data
+    hazards[slot].storeRelease(Q_NULLPTR);
+
+    return values;
+}
+
+void QDaemonSettingsPrivate::publish(QDaemonSettingsSnapshot * snapshot)
+{
+    QMutexLocker lock(&publishMutex);
+    Q_UNUSED(lock);
+
+    QDaemonSettingsSnapshot * previous = current.fetchAndStoreOrdered(snapshot);
+    if (previous)
+        retired.append(previous);
+
+    reclaim();
+}
+
+void QDaemonSettingsPrivate::reclaim()
+{
+    // Free the retired snapshots that no reader holds anymore
+    for (int i = retired.size() - 1; i >= 0; i--)  {
+        QDaemonSettingsSnapshot * snapshot = retired.at(i);
+
+        bool inUse = false;
+        for (int slot = 0; slot < HazardSlotCount && !inUse; slot++)
+            inUse = hazards[slot].loadAcquire() == snapshot;
+
+        if (inUse)
+            continue;
+
+        delete snapshot;
+        retired.remove(i);
+    }
+}
+
+void QDaemonSettingsPrivate::reloadAll()
+{
+    // Coalesce the reload requests that arrived while loading
+    int requests;
+    do  {
+        requests = reloadRequests.loadAcquire();
+
+        QDaemonSettingsSnapshot * snapshot = load(fileName);
+        if (snapshot)  {
+            publish(snapshot);
+            QMetaObject::invokeMethod(q_ptr, "configurationChanged", Qt::QueuedConnection);
+        }
+    } while (!reloadRequests.testAndSetOrdered(requests, 0));
+}
+
+QDaemonSettingsSnapshot * QDaemonSettingsPrivate::load(const QString & fileName)
+{
+    QFileInfo info(fileName);
+    if (!info.isFile() || !info.isReadable())  {
+        qDaemonLog(QStringLiteral("The configuration file %1 doesn't exist or can't be read.").arg(fileName), QDaemonLog::WarningEntry);
+        return Q_NULLPTR;
+    }
+
+    QSettings settings(fileName, QSettings::IniFormat);
+    if (settings.status() != QSettings::NoError)  {
+        qDaemonLog(QStringLiteral("The configuration file %1 couldn't be parsed. Keeping the current configuration.").arg(fileName), QDaemonLog::WarningEntry);
+        return Q_NULLPTR;
+    }
+
+    QDaemonSettingsSnapshot * snapshot = new QDaemonSettingsSnapshot;
+    const QStringList keys = settings.allKeys();
+    for (const QString & key : keys)
+        snapshot->values.insert(key, settings.value(key));
+
+    return snapshot;
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,193 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include "qdaemonspawner_p.h"
+
+#include <QtCore/qbytearray.h>
+#include <QtCore/qfile.h>
+#include <QtCore/qvector.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+
+QT_BEGIN_NAMESPACE
+
+using namespace QtDaemon;
+
+static const int statusDescriptor = 3;      // Where the daemon keeps the status pipe until it's replaced by the exec
+
+// Starts the program as a daemon: in a session of its own, detached from the controller (double fork), with the standard
+// channels redirected to /dev/null and no other descriptors inherited. Returns the daemon's process id as soon as the
+// program is executed, or -1 with errno set if it couldn't be started
+qint64 QDaemonSpawner::spawn(const QString & program, const QStringList & arguments, const QString & workingDirectory, const QStringList & environment)
+{
+    // The controller runs threads (D-Bus), so the children may only make async-signal-safe calls; everything is prepared here
+    QByteArray path = QFile::encodeName(program), directory = QFile::encodeName(workingDirectory);
+
+    QList<QByteArray> argumentData, environmentData;
+    argumentData.append(path);
+    foreach (const QString & argument, arguments)
+        argumentData.append(argument.toLocal8Bit());
+    foreach (const QString & variable, environment)
+        environmentData.append(variable.toLocal8Bit());
+
+    QVector<char *> argv, envp;
+    for (QList<QByteArray>::Iterator i = argumentData.begin(), end = argumentData.end(); i != end; ++i)
+        argv.append(i->data());
+    for (QList<QByteArray>::Iterator i = environmentData.begin(), end = environmentData.end(); i != end; ++i)
+        envp.append(i->data());
+    argv.append(Q_NULLPTR);
+    envp.append(Q_NULLPTR);
+
+    // Only for kernels without close_range() (before 5.9)
+    struct rlimit limit;
+    int maximumDescriptor = ::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < 65536 ? int(limit.rlim_cur) : 65536;
+
+    // The children report the daemon's pid and their failures through the pipe, which is closed by a successful exec
+    int channel[2];
+    if (::pipe2(channel, O_CLOEXEC) != 0)
+        return -1;
+
+    pid_t intermediate = ::fork();
+    if (intermediate < 0)  {
+        int error = errno;
+        ::close(channel[0]);
+        ::close(channel[1]);
+        errno = error;
+        return -1;
+    }
+
+    if (intermediate == 0)  {
+        // The intermediate process leads a new session, and leaves the daemon orphaned for init to adopt
+        ::setsid();
+
+        pid_t daemon = ::fork();
+        if (daemon != 0)  {
+            Report report = { daemon > 0 ? qint32(daemon) : 0, daemon > 0 ? 0 : errno };
+            ssize_t written = ::write(channel[1], &report, sizeof(report));
+            ::_exit(written == ssize_t(sizeof(report)) ? 0 : 1);
+        }
+
+        // Not a session leader, so the daemon can never acquire a controlling terminal
+        int status = ::fcntl(channel[1], F_DUPFD_CLOEXEC, statusDescriptor);
+
+        int null = ::open("/dev/null", O_RDWR);
+        if (null >= 0)  {
+            ::dup2(null, STDIN_FILENO);
+            ::dup2(null, STDOUT_FILENO);
+            ::dup2(null, STDERR_FILENO);
+        }
+
+        if (status != statusDescriptor)  {
+            ::dup3(status, statusDescriptor, O_CLOEXEC);
+            status = statusDescriptor;
+        }
+
+        // Nothing the controller opened leaks into the daemon
+#ifdef SYS_close_range
+        if (::syscall(SYS_close_range, statusDescriptor + 1, ~0U, 0) != 0)
+#endif
+        {
+            for (int descriptor = statusDescriptor + 1; descriptor < maximumDescriptor; descriptor++)
+                ::close(descriptor);
+        }
+
+        // Start with the default signal handling, whatever the controller had set up
+        sigset_t signals;
+        ::sigemptyset(&signals);
+        ::sigprocmask(SIG_SETMASK, &signals, Q_NULLPTR);
+        for (int number = 1; number < NSIG; number++)
+            ::signal(number, SIG_DFL);
+
+        if (directory.isEmpty() || ::chdir(directory.constData()) == 0)
+            ::execve(path.constData(), argv.data(), envp.data());
+
+        Report report = { 0, errno };
+        ssize_t written = ::write(status, &report, sizeof(report));
+        Q_UNUSED(written);
+
+        ::_exit(127);
+    }
+
+    ::close(channel[1]);
+
+    // Each report is written at once and is smaller than PIPE_BUF, so it's read whole
+    qint64 pid = -1;
+    int error = 0;
+
+    Report report;
+    for (;;)  {
+        ssize_t size = ::read(channel[0], &report, sizeof(report));
+        if (size < 0 && errno == EINTR)
+            continue;
+        if (size != ssize_t(sizeof(report)))  {
+            if (size < 0)
+                error = errno;
+            break;
+        }
+
+        if (report.pid > 0)
+            pid = report.pid;
+        if (report.error != 0)
+            error = report.error;
+    }
+
+    ::close(channel[0]);
+    while (::waitpid(intermediate, Q_NULLPTR, 0) < 0 && errno == EINTR)
+        ;
+
+    if (error != 0 || pid <= 0)  {
+        errno = error != 0 ? error : ECHILD;
+        return -1;
+    }
+
+    return pid;
+}
+
+bool QDaemonSpawner::isAlive(qint64 pid)
+{
+    // The daemon isn't a child of the controller, so it can't be waited for
+    if (pid <= 0 || (::kill(pid_t(pid), 0) != 0 && errno != EPERM))
+        return false;
+
+    // An exited daemon lingers as a zombie until it's reaped by init
+    QFile stat(QStringLiteral("/proc/%1/stat").arg(pid));
+    if (!stat.open(QFile::ReadOnly))
+        return true;
+
+    QByteArray data = stat.readAll();
+    return data.mid(data.lastIndexOf(')') + 2, 1) != "Z";
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,157 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include "qdaemonstartupprofiler_p.h"
+#include "qdaemonlog.h"
+
+#include <QtCore/qfile.h>
+#include <QtCore/qstringlist.h>
+
+#ifdef Q_OS_UNIX
+#include <time.h>
+#include <unistd.h>
+#endif
+
+QT_BEGIN_NAMESPACE
+
+using namespace QtDaemon;
+
+static void markLibraryLoaded()
+{
+    // Runs when the library is loaded, i.e. before main() for an application linked against it
+    QDaemonStartupProfiler::mark(QStringLiteral("library loaded"));
+}
+Q_CONSTRUCTOR_FUNCTION(markLibraryLoaded)
+
+QDaemonStartupProfiler::QDaemonStartupProfiler()
+    : startOffset(processAge()), finished(false)
+{
+    clock.start();
+}
+
+QDaemonStartupProfiler & QDaemonStartupProfiler::instance()
+{
+    static QDaemonStartupProfiler profiler;
+    return profiler;
+}
+
+void QDaemonStartupProfiler::mark(const QString & name)
+{
+    QDaemonStartupProfiler & profiler = instance();
+
+    QMutexLocker lock(&profiler.mutex);
+    Q_UNUSED(lock);
+
+    Phase phase;
+    phase.name = name;
+    phase.elapsed = profiler.startOffset + profiler.clock.nsecsElapsed();
+    phase.cpuTime = cpuTime();
+
+    profiler.phases.append(phase);
+}
+
+void QDaemonStartupProfiler::finish()
+{
+    QDaemonStartupProfiler & profiler = instance();
+    {
+        QMutexLocker lock(&profiler.mutex);
+        Q_UNUSED(lock);
+
+        if (profiler.finished)
+            return;
+        profiler.finished = true;
+    }
+
+    mark(QStringLiteral("ready"));
+
+    foreach (const QString & line, report().split(QLatin1Char('\n')))
+        qDaemonLog(line, QDaemonLog::NoticeEntry);
+}
+
+QString QDaemonStartupProfiler::report()
+{
+    QDaemonStartupProfiler & profiler = instance();
+
+    QMutexLocker lock(&profiler.mutex);
+    Q_UNUSED(lock);
+
+    // Without the process' start time the phases are timed from loading the library
+    QString reference = profiler.startOffset > 0 ? QStringLiteral("the process started") : QStringLiteral("the library was loaded");
+    QStringList lines(QStringLiteral("Startup phases (milliseconds since %1):").arg(reference));
+
+    qint64 elapsed = 0, cpu = 0;
+    foreach (const Phase & phase, profiler.phases)  {
+        QString line = QStringLiteral("  %1: %2 ms (+%3 ms)").arg(phase.name).arg(phase.elapsed / 1e6, 0, 'f', 1).arg((phase.elapsed - elapsed) / 1e6, 0, 'f', 1);
+        if (phase.cpuTime >= 0)
+            line += QStringLiteral(", CPU %1 ms (+%2 ms)").arg(phase.cpuTime / 1e6, 0, 'f', 1).arg((phase.cpuTime - cpu) / 1e6, 0, 'f', 1);
+
+        elapsed = phase.elapsed;
+        cpu = qMax(phase.cpuTime, Q_INT64_C(0));
+        lines.append(line);
+    }
+
+    return lines.join(QLatin1Char('\n'));
+}
+
+qint64 QDaemonStartupProfiler::processAge()
+{
+#ifdef Q_OS_LINUX
+    // The 22nd field of the process' stat is its start time in clock ticks since boot, the name (2nd) may contain spaces
+    QFile file(QStringLiteral("/proc/self/stat"));
+    if (!file.open(QFile::ReadOnly))
+        return 0;
+
+    QByteArray stat = file.readAll();
+    QList<QByteArray> fields = stat.mid(stat.lastIndexOf(')') + 2).split(' ');
+
+    bool ok;
+    qint64 startTicks = fields.value(19).toLongLong(&ok), ticksPerSecond = ::sysconf(_SC_CLK_TCK);
+
+    struct timespec now;
+    if (!ok || ticksPerSecond <= 0 || ::clock_gettime(CLOCK_BOOTTIME, &now) != 0)
+        return 0;
+
+    qint64 age = now.tv_sec * Q_INT64_C(1000000000) + now.tv_nsec - startTicks * Q_INT64_C(1000000000) / ticksPerSecond;
+    return qMax(age, Q_INT64_C(0));
+#else
+    return 0;
+#endif
+}
+
+qint64 QDaemonStartupProfiler::cpuTime()
+{
+#ifdef Q_OS_UNIX
+    struct timespec time;
+    if (::clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time) == 0)
+        return time.tv_sec * Q_INT64_C(1000000000) + time.tv_nsec;
+#endif
+
+    return -1;
+}
+
+QT_END_NAMESPACE
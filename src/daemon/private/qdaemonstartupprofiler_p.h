@@ -0,0 +1,87 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtDaemon API. It exists only
+// as an implementation detail. This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+
+#ifndef QDAEMONSTARTUPPROFILER_P_H
+#define QDAEMONSTARTUPPROFILER_P_H
+
+#include "QtDaemon/qdaemon-global.h"
+
+#include <QtCore/qelapsedtimer.h>
+#include <QtCore/qmutex.h>
+#include <QtCore/qstring.h>
+#include <QtCore/qvector.h>
+
+QT_BEGIN_NAMESPACE
+
+namespace QtDaemon
+{
+    class Q_DAEMON_LOCAL QDaemonStartupProfiler
+    {
+    public:
+        static void mark(const QString &);
+        static void finish();
+        static QString report();
+
+        static qint64 processAge();
+
+    private:
+        QDaemonStartupProfiler();
+
+        static QDaemonStartupProfiler & instance();
+        static qint64 cpuTime();
+
+        struct Phase
+        {
+            QString name;
+            qint64 elapsed;     // Nanoseconds since the process started
+            qint64 cpuTime;     // Nanoseconds of CPU time, -1 if not available
+        };
+
+        QMutex mutex;
+        QElapsedTimer clock;
+        qint64 startOffset;
+        QVector<Phase> phases;
+        bool finished;
+    };
+}
+
+QT_END_NAMESPACE
+
+#endif // QDAEMONSTARTUPPROFILER_P_H
@@ -0,0 +1,315 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include "qdaemonstatsmonitor_p.h"
+#include "qdaemonspawner_p.h"
+#include "qdaemonapplication_p.h"
+
+#include <QtCore/qdatetime.h>
+#include <QtCore/qdir.h>
+#include <QtCore/qfile.h>
+#include <QtCore/qtextstream.h>
+
+#include <algorithm>
+
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+
+QT_BEGIN_NAMESPACE
+
+using namespace QtDaemon;
+
+const QString QDaemonStatsMonitor::logEntriesMetric = QStringLiteral("qtdaemon_log_entries_total");
+const QString QDaemonStatsMonitor::countersSuffix = QStringLiteral("_total");
+const int QDaemonStatsMonitor::staleThreshold = 3000;
+
+QDaemonStatsMonitor::Sample::Sample()
+    : time(-1), pid(-1), cpuTicks(-1)
+{
+}
+
+QDaemonStatsMonitor::QDaemonStatsMonitor(const QStringList & instanceList, int interval, QObject * parent)
+    : QObject(parent), selected(instanceList), terminal(::isatty(STDOUT_FILENO))
+{
+    timer.setInterval(interval);
+    QObject::connect(&timer, &QTimer::timeout, this, &QDaemonStatsMonitor::refresh);
+}
+
+QDaemonStatsMonitor::~QDaemonStatsMonitor()
+{
+    qDeleteAll(instances);
+}
+
+QDaemonStatsMonitor::Instance::~Instance()
+{
+    qDeleteAll(workers);
+}
+
+void QDaemonStatsMonitor::start()
+{
+    clock.start();
+
+    refresh();
+    timer.start();
+}
+
+void QDaemonStatsMonitor::refresh()
+{
+    QStringList names = watchedInstances();
+
+    // Forget the instances that are no longer around
+    foreach (const QString & name, instances.keys())  {
+        if (!names.contains(name))
+            delete instances.take(name);
+    }
+
+    QStringList reports;
+    foreach (const QString & name, names)  {
+        Instance *& instance = instances[name];
+        if (!instance)
+            instance = new Instance;
+
+        reports.append(instanceReport(name, *instance));
+    }
+
+    if (reports.isEmpty())
+        reports.append(QStringLiteral("No running instances publish their statistics."));
+
+    QTextStream output(stdout);
+    if (terminal)
+        output << QStringLiteral("\x1b[H\x1b[2J");     // Redraw the screen in place
+
+    output << QStringLiteral("%1, refreshed every %2 ms (Ctrl+C to quit)\n\n").arg(QDateTime::currentDateTime().toString(Qt::ISODate)).arg(timer.interval())
+           << reports.join(QStringLiteral("\n\n")) << endl;
+    if (!terminal)
+        output << endl;
+}
+
+QStringList QDaemonStatsMonitor::watchedInstances() const
+{
+    if (!selected.contains(QDaemonApplicationPrivate::allInstances))
+        return selected;
+
+    // Find the instances by the segments they publish, no need to ask the bus (it may be the thing that's stuck)
+    QString segment = QDaemonStatsReader::segmentName(QString()).mid(1), prefix = segment + QLatin1Char('_');
+
+    QStringList names;
+    foreach (const QString & file, QDir(QStringLiteral("/dev/shm")).entryList(QDir::Files | QDir::System))  {
+        if (file == segment)
+            names.append(QString());
+        else if (file.startsWith(prefix) && file.indexOf(QLatin1Char('.'), prefix.size()) < 0)     // Not a worker's segment
+            names.append(file.mid(prefix.size()));
+    }
+
+    names.sort();
+    return names;
+}
+
+QList<int> QDaemonStatsMonitor::workers(const QString & name)
+{
+    // A supervising daemon runs the application code in workers, which publish their statistics next to the daemon's
+    QString prefix = QDaemonStatsReader::segmentName(name, 0).mid(1);
+    prefix.chop(1);     // The names of the workers' segments differ only in the index at the end
+
+    QList<int> indices;
+    foreach (const QString & file, QDir(QStringLiteral("/dev/shm")).entryList(QDir::Files | QDir::System))  {
+        if (!file.startsWith(prefix))
+            continue;
+
+        bool ok;
+        int index = file.mid(prefix.size()).toInt(&ok);
+        if (ok && index >= 0)
+            indices.append(index);
+    }
+
+    std::sort(indices.begin(), indices.end());
+    return indices;
+}
+
+QString QDaemonStatsMonitor::instanceReport(const QString & name, Instance & instance)
+{
+    QString label = name.isEmpty() ? QStringLiteral("The daemon") : QStringLiteral("Instance %1").arg(name);
+    QString report = processReport(label, name, -1, instance.daemon);
+
+    // Forget the workers that are no longer around
+    QList<int> indices = workers(name);
+    foreach (int index, instance.workers.keys())  {
+        if (!indices.contains(index))
+            delete instance.workers.take(index);
+    }
+
+    foreach (int index, indices)  {
+        Process *& worker = instance.workers[index];
+        if (!worker)
+            worker = new Process;
+
+        QString workerReport = processReport(QStringLiteral("Worker %1").arg(index), name, index, *worker);
+        report += QStringLiteral("\n  ") + workerReport.replace(QLatin1Char('\n'), QStringLiteral("\n  "));
+    }
+
+    return report;
+}
+
+QString QDaemonStatsMonitor::processReport(const QString & label, const QString & name, int worker, Process & process)
+{
+    static const long ticksPerSecond = ::sysconf(_SC_CLK_TCK);
+    static const long pageSize = ::sysconf(_SC_PAGESIZE);
+    static const char * const states[] = { "starting", "running", "stopping" };
+
+    if (!process.reader.isOpen() && !(worker < 0 ? process.reader.open(name) : process.reader.open(name, worker)))
+        return QStringLiteral("%1 doesn't publish its statistics (it's not running).").arg(label);
+
+    QDaemonStatsBlock block;
+    if (!process.reader.read(block))  {
+        process.reader.close();     // Reopened on the next refresh, the daemon may have been replaced by another version
+        return QStringLiteral("%1 publishes statistics in an unknown format.").arg(label);
+    }
+
+    // The segment of a killed daemon outlives it, until a restarted daemon takes it over
+    if (!QDaemonSpawner::isAlive(block.pid))  {
+        process.reader.close();
+        process.previous = Sample();
+        return QStringLiteral("%1 is not running (process %2 is gone).").arg(label).arg(block.pid);
+    }
+
+    Sample current;
+    current.time = clock.elapsed();
+    current.pid = block.pid;
+    qint32 counterCount = qBound<qint32>(0, block.counterCount, QDaemonStatsBlock::MaximumCounters);
+    for (qint32 i = 0; i < counterCount; i++)
+        current.counters.insert(QString::fromLatin1(block.counters[i].name, int(::strnlen(block.counters[i].name, QDaemonStatsBlock::NameSize))), block.counters[i].value);
+
+    // The resource usage comes from the kernel, the fields following the executable name (the 2nd field) are space separated
+    QString threads = QStringLiteral("-"), residentSize = QStringLiteral("-");
+    QFile stat(QStringLiteral("/proc/%1/stat").arg(block.pid));
+    if (stat.open(QFile::ReadOnly))  {
+        QByteArray data = stat.readAll();
+        QList<QByteArray> fields = data.mid(data.lastIndexOf(')') + 2).split(' ');
+        if (fields.size() > 21)  {
+            current.cpuTicks = fields.at(11).toLongLong() + fields.at(12).toLongLong();
+            threads = QString::fromLatin1(fields.at(17));
+            residentSize = formatSize(fields.at(21).toLongLong() * pageSize);
+        }
+    }
+
+    // The deltas are taken against the previous refresh of the same process
+    Sample previous = process.previous.pid == current.pid ? process.previous : Sample();
+    qint64 elapsed = previous.time >= 0 ? current.time - previous.time : 0;
+
+    QString cpu = QStringLiteral("-");
+    if (elapsed > 0 && previous.cpuTicks >= 0 && current.cpuTicks >= 0)
+        cpu = QStringLiteral("%1%").arg(100.0 * (current.cpuTicks - previous.cpuTicks) * 1000 / ticksPerSecond / elapsed, 0, 'f', 1);
+
+    qint64 descriptors = openDescriptors(block.pid);
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    QStringList lines;
+
+    QString state = QString::fromLatin1(states[qBound<qint32>(QDaemonStatsBlock::StartingState, block.state, QDaemonStatsBlock::StoppingState)]);
+    QString summary = QStringLiteral("%1 is %2, process %3, up %4").arg(label, state).arg(block.pid).arg(formatDuration(now - block.startTime));
+    if (now - block.updateTime > staleThreshold)
+        summary += QStringLiteral(", not updated for %1 (is its event loop blocked?)").arg(formatDuration(now - block.updateTime));
+    lines.append(summary);
+
+    lines.append(QStringLiteral("  CPU %1  RSS %2  threads %3  descriptors %4").arg(cpu, residentSize, threads, descriptors >= 0 ? QString::number(descriptors) : QStringLiteral("-")));
+    lines.append(QStringLiteral("  event loop lag %1  log %2 entries/s  log queue %3")
+                 .arg(block.eventLoopLag >= 0 ? QStringLiteral("%1 ms").arg(block.eventLoopLag / 1000.0, 0, 'f', 2) : QStringLiteral("-"))
+                 .arg(formatRate(previous.counters.value(logEntriesMetric, -1), current.counters.value(logEntriesMetric, -1), elapsed))
+                 .arg(block.logQueueDepth));
+
+    // The metrics in the order they were registered, the counters with their rate
+    qint32 width = 0;
+    for (qint32 i = 0; i < counterCount; i++)
+        width = qMax(width, qint32(::strnlen(block.counters[i].name, QDaemonStatsBlock::NameSize)));
+
+    if (counterCount > 0)
+        lines.append(QStringLiteral("  metrics"));
+
+    for (qint32 i = 0; i < counterCount; i++)  {
+        QString metric = QString::fromLatin1(block.counters[i].name, int(::strnlen(block.counters[i].name, QDaemonStatsBlock::NameSize)));
+        qint64 value = block.counters[i].value;
+
+        QString line = QStringLiteral("    %1  %2").arg(metric.leftJustified(width)).arg(value);
+        if (metric.endsWith(countersSuffix))
+            line += QStringLiteral("  (%1/s)").arg(formatRate(previous.counters.value(metric, -1), value, elapsed));
+
+        lines.append(line);
+    }
+
+    process.previous = current;
+    return lines.join(QLatin1Char('\n'));
+}
+
+qint64 QDaemonStatsMonitor::openDescriptors(qint64 pid)
+{
+    // Only the owner of the process (or root) may list its descriptors
+    DIR * directory = ::opendir(QByteArray("/proc/" + QByteArray::number(pid) + "/fd").constData());
+    if (!directory)
+        return -1;
+
+    qint64 descriptors = 0;
+    while (struct dirent * entry = ::readdir(directory))  {
+        if (entry->d_name[0] != '.')
+            descriptors++;
+    }
+    ::closedir(directory);
+
+    return descriptors;
+}
+
+QString QDaemonStatsMonitor::formatDuration(qint64 milliseconds)
+{
+    qint64 seconds = qMax<qint64>(0, milliseconds / 1000);
+
+    QString time = QStringLiteral("%1:%2:%3").arg(seconds / 3600 % 24, 2, 10, QLatin1Char('0')).arg(seconds / 60 % 60, 2, 10, QLatin1Char('0')).arg(seconds % 60, 2, 10, QLatin1Char('0'));
+    return seconds < 86400 ? time : QStringLiteral("%1d %2").arg(seconds / 86400).arg(time);
+}
+
+QString QDaemonStatsMonitor::formatSize(qint64 bytes)
+{
+    static const char * const units[] = { "KiB", "MiB", "GiB", "TiB" };
+
+    double size = bytes / 1024.0;
+    int unit = 0;
+    for ( ; size >= 1024 && unit < 3; unit++)
+        size /= 1024;
+
+    return QStringLiteral("%1 %2").arg(size, 0, 'f', 1).arg(QLatin1String(units[unit]));
+}
+
+QString QDaemonStatsMonitor::formatRate(qint64 previous, qint64 current, qint64 elapsed)
+{
+    // Nothing to compare with on the first refresh (or after the daemon restarted)
+    if (elapsed <= 0 || previous < 0 || current < 0)
+        return QStringLiteral("-");
+
+    return QString::number((current - previous) * 1000.0 / elapsed, 'f', 1);
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,120 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtDaemon API. It exists only
+// as an implementation detail. This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+
+#ifndef QDAEMONSTATSMONITOR_P_H
+#define QDAEMONSTATSMONITOR_P_H
+
+#include "QtDaemon/qdaemon-global.h"
+#include "qdaemonstats.h"
+
+#include <QtCore/qobject.h>
+#include <QtCore/qtimer.h>
+#include <QtCore/qelapsedtimer.h>
+#include <QtCore/qstringlist.h>
+#include <QtCore/qhash.h>
+#include <QtCore/qmap.h>
+
+QT_BEGIN_NAMESPACE
+
+namespace QtDaemon
+{
+    class Q_DAEMON_LOCAL QDaemonStatsMonitor : public QObject
+    {
+        Q_OBJECT
+        Q_DISABLE_COPY(QDaemonStatsMonitor)
+
+    public:
+        QDaemonStatsMonitor(const QStringList &, int, QObject * = Q_NULLPTR);
+        ~QDaemonStatsMonitor() Q_DECL_OVERRIDE;
+
+        void start();
+        void refresh();
+
+    private:
+        struct Sample
+        {
+            Sample();
+
+            qint64 time;            // Milliseconds on the monotonic clock of the controller
+            qint64 pid;
+            qint64 cpuTicks;
+            QHash<QString, qint64> counters;
+        };
+
+        struct Process
+        {
+            QDaemonStatsReader reader;
+            Sample previous;
+        };
+
+        struct Instance
+        {
+            ~Instance();
+
+            Process daemon;
+            QMap<int, Process *> workers;
+        };
+
+        QStringList watchedInstances() const;
+        QString instanceReport(const QString &, Instance &);
+        QString processReport(const QString &, const QString &, int, Process &);
+
+        static QList<int> workers(const QString &);
+
+        static qint64 openDescriptors(qint64);
+        static QString formatDuration(qint64);
+        static QString formatSize(qint64);
+        static QString formatRate(qint64, qint64, qint64);
+
+        QStringList selected;
+        QMap<QString, Instance *> instances;
+        QTimer timer;
+        QElapsedTimer clock;
+        bool terminal;
+
+        static const QString logEntriesMetric;
+        static const QString countersSuffix;
+        static const int staleThreshold;
+    };
+}
+
+QT_END_NAMESPACE
+
+#endif // QDAEMONSTATSMONITOR_P_H
@@ -0,0 +1,206 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include "qdaemonstatspublisher_p.h"
+#include "qdaemonmetrics_p.h"
+#include "qdaemonstartupprofiler_p.h"
+
+#include <QtCore/qdatetime.h>
+#include <QtCore/qfile.h>
+#include <QtCore/qcoreapplication.h>
+
+#include <atomic>
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+QT_BEGIN_NAMESPACE
+
+using namespace QtDaemon;
+
+const int QDaemonStatsPublisher::updateInterval = 1000;
+
+static const QString logQueueDepthMetric = QStringLiteral("qtdaemon_log_queued_entries");
+static const QString eventLoopLagMetric = QStringLiteral("qtdaemon_event_loop_last_lag_microseconds");
+
+QDaemonStatsPublisher::QDaemonStatsPublisher(QObject * parent)
+    : QObject(parent), block(Q_NULLPTR), currentState(QDaemonStatsBlock::StartingState), lockDescriptor(-1)
+{
+    timer.setInterval(updateInterval);
+    QObject::connect(&timer, &QTimer::timeout, this, &QDaemonStatsPublisher::update);
+}
+
+QDaemonStatsPublisher::~QDaemonStatsPublisher()
+{
+    close();
+}
+
+bool QDaemonStatsPublisher::open(const QString & segmentName)
+{
+    close();
+
+    // The segment belongs to the process holding the lock on it. The lock goes away with a daemon that died, so its
+    // segment is taken over, while the segment of a daemon that's still running is never touched
+    QByteArray encodedName = QFile::encodeName(segmentName), path = "/dev/shm" + encodedName;
+
+    int descriptor;
+    forever  {
+        descriptor = ::shm_open(encodedName.constData(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (descriptor < 0)
+            return false;
+
+        if (::flock(descriptor, LOCK_EX | LOCK_NB) != 0)  {
+            int error = errno;
+            ::close(descriptor);
+            errno = error == EWOULDBLOCK ? EBUSY : error;
+            return false;
+        }
+
+        // The owner removes the segment before it lets go of the lock, start over if it was removed meanwhile
+        struct stat opened, named;
+        if (::fstat(descriptor, &opened) != 0)  {
+            int error = errno;
+            ::close(descriptor);
+            errno = error;
+            return false;
+        }
+
+        if (::stat(path.constData(), &named) == 0 && named.st_dev == opened.st_dev && named.st_ino == opened.st_ino)
+            break;
+
+        ::close(descriptor);
+    }
+
+    // Readable by the controller and the monitoring tools regardless of the umask
+    void * mapping = MAP_FAILED;
+    if (::fchmod(descriptor, 0644) == 0 && ::ftruncate(descriptor, sizeof(QDaemonStatsBlock)) == 0)
+        mapping = ::mmap(Q_NULLPTR, sizeof(QDaemonStatsBlock), PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+
+    if (mapping == MAP_FAILED)  {
+        int error = errno;
+        ::shm_unlink(encodedName.constData());
+        ::close(descriptor);
+        errno = error;
+        return false;
+    }
+
+    name = segmentName;
+    lockDescriptor = descriptor;
+
+    // A new segment is zero filled. One left behind is reset under the sequence lock, as the tools may still be
+    // reading it (the sequence is odd if its owner died in the middle of an update)
+    block = static_cast<QDaemonStatsBlock *>(mapping);
+
+    quint32 sequence = block->sequence + (block->sequence & 1);
+    __atomic_store_n(&block->sequence, sequence + 1, __ATOMIC_RELAXED);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    ::memset(block->counters, 0, sizeof(block->counters));
+    block->counterCount = 0;
+    block->magic = QDaemonStatsBlock::Magic;
+    block->version = QDaemonStatsBlock::Version;
+    block->size = sizeof(QDaemonStatsBlock);
+    block->pid = QCoreApplication::applicationPid();
+    block->startTime = QDateTime::currentMSecsSinceEpoch() - QDaemonStartupProfiler::processAge() / 1000000;
+    block->eventLoopLag = -1;
+
+    __atomic_store_n(&block->sequence, sequence + 2, __ATOMIC_RELEASE);
+
+    update();
+    timer.start();
+
+    return true;
+}
+
+void QDaemonStatsPublisher::close()
+{
+    if (!block)
+        return;
+
+    timer.stop();
+    ::munmap(block, sizeof(QDaemonStatsBlock));
+    block = Q_NULLPTR;
+
+    // Removed while the lock is still held, so it can't be another process' segment
+    ::shm_unlink(QFile::encodeName(name).constData());
+    ::close(lockDescriptor);
+    lockDescriptor = -1;
+}
+
+void QDaemonStatsPublisher::setState(QDaemonStatsBlock::State state)
+{
+    // Published right away (or when the segment is opened), the state changes are what the watchers are most interested in
+    currentState = state;
+    update();
+}
+
+void QDaemonStatsPublisher::update()
+{
+    if (!block)
+        return;
+
+    // Collected before the update starts, so the readers never wait on the metrics' lock
+    QDaemonMetricsPrivate * metrics = QDaemonMetricsPrivate::instance();
+    QVector<QPair<QString, qint64> > values = metrics ? metrics->values() : QVector<QPair<QString, qint64> >();
+
+    // Sequence lock: odd while the block is being written
+    quint32 sequence = block->sequence;
+    __atomic_store_n(&block->sequence, sequence + 1, __ATOMIC_RELAXED);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    block->updateTime = QDateTime::currentMSecsSinceEpoch();
+    block->state = currentState;
+    block->logQueueDepth = 0;
+    block->eventLoopLag = -1;
+
+    qint32 count = 0;
+    for (QVector<QPair<QString, qint64> >::ConstIterator i = values.constBegin(), end = values.constEnd(); i != end; ++i)  {
+        if (i->first == logQueueDepthMetric)
+            block->logQueueDepth = i->second;
+        else if (i->first == eventLoopLagMetric)
+            block->eventLoopLag = i->second;
+
+        if (count >= QDaemonStatsBlock::MaximumCounters)
+            continue;
+
+        QDaemonStatsBlock::Counter & counter = block->counters[count++];
+        ::strncpy(counter.name, i->first.toLatin1().constData(), QDaemonStatsBlock::NameSize - 1);
+        counter.name[QDaemonStatsBlock::NameSize - 1] = '\0';
+        counter.value = i->second;
+    }
+    block->counterCount = count;
+
+    __atomic_store_n(&block->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,269 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include "qdaemonsupervisor_p.h"
+#include "qdaemonlog.h"
+
+#include <QtCore/qtimer.h>
+#include <QtCore/qdatetime.h>
+
+#include <sys/types.h>
+#include <signal.h>
+
+QT_BEGIN_NAMESPACE
+
+using namespace QtDaemon;
+
+const qint64 QDaemonSupervisor::stableUptime = 10000;      // A child running that long (in milliseconds) is considered healthy again
+const int QDaemonSupervisor::stopTimeout = 10000;
+
+QDaemonSupervisor::Child::Child()
+    : process(Q_NULLPTR), restartTimer(Q_NULLPTR), pid(0), backoff(0), restarts(0), done(false)
+{
+}
+
+QDaemonSupervisor::QDaemonSupervisor(QObject * parent)
+    : QObject(parent), policy(RestartAlways), minimumBackoff(100), maximumBackoff(30000), crashLimit(5), crashWindow(60000), stopping(false)
+{
+}
+
+QDaemonSupervisor::~QDaemonSupervisor()
+{
+    stop();
+}
+
+void QDaemonSupervisor::setRestartPolicy(RestartPolicy restartPolicy)
+{
+    policy = restartPolicy;
+}
+
+void QDaemonSupervisor::setBackoff(qint64 minimum, qint64 maximum)
+{
+    minimumBackoff = qMax<qint64>(0, minimum);
+    maximumBackoff = qMax(minimumBackoff, maximum);
+}
+
+void QDaemonSupervisor::setCrashLimit(qint32 limit, qint64 window)
+{
+    crashLimit = qMax(0, limit);        // Zero disables the crash-loop breaker
+    crashWindow = window;
+}
+
+void QDaemonSupervisor::start(const QString & executable, const QList<QStringList> & arguments)
+{
+    program = executable;
+    stopping = false;
+    clock.start();
+
+    // The children are set up as a whole under the lock, status() may read them from the control thread meanwhile
+    QMutexLocker lock(&mutex);
+    children.resize(arguments.size());
+    for (qint32 i = 0, size = children.size(); i < size; i++)  {
+        Child & child = children[i];
+        child.arguments = arguments.at(i);
+        child.backoff = minimumBackoff;
+
+        child.restartTimer = new QTimer(this);
+        child.restartTimer->setSingleShot(true);
+        QObject::connect(child.restartTimer, &QTimer::timeout, this, [this, i] () -> void  {
+            spawn(i);
+        });
+    }
+    lock.unlock();
+
+    // Spawning takes the lock itself
+    for (qint32 i = 0, size = children.size(); i < size; i++)
+        spawn(i);
+}
+
+void QDaemonSupervisor::stop()
+{
+    if (stopping)
+        return;
+
+    stopping = true;
+
+    // Ask all the children to quit first, so they shut down in parallel
+    QList<QProcess *> running;
+    for (qint32 i = 0, size = children.size(); i < size; i++)  {
+        Child & child = children[i];
+        child.restartTimer->stop();
+        if (!child.process)
+            continue;
+
+        running.append(child.process);
+        child.process->terminate();
+    }
+
+    foreach (QProcess * process, running)  {
+        if (process->waitForFinished(stopTimeout))
+            continue;
+
+        qDaemonLog(QStringLiteral("The process %1 didn't quit in time and will be killed.").arg(process->processId()), QDaemonLog::WarningEntry);
+        process->kill();
+        process->waitForFinished();
+    }
+}
+
+void QDaemonSupervisor::signal(int signalNumber)
+{
+    for (qint32 i = 0, size = children.size(); i < size; i++)  {
+        if (children.at(i).process)
+            ::kill(pid_t(children.at(i).process->processId()), signalNumber);
+    }
+}
+
+QString QDaemonSupervisor::status() const
+{
+    QMutexLocker lock(&mutex);
+    Q_UNUSED(lock);
+
+    QStringList lines;
+    for (qint32 i = 0, size = children.size(); i < size; i++)  {
+        const Child & child = children.at(i);
+
+        QString line;
+        if (child.process)
+            line = QStringLiteral("Child process %1: running (pid %2, up %3 s)").arg(i).arg(child.pid).arg(child.uptime.elapsed() / 1000);
+        else if (child.done)
+            line = QStringLiteral("Child process %1: stopped").arg(i);
+        else
+            line = QStringLiteral("Child process %1: waiting for restart").arg(i);
+
+        line += QStringLiteral(", %1 restart(s)").arg(child.restarts);
+        if (!child.lastExit.isEmpty())
+            line += QStringLiteral(", last %1").arg(child.lastExit);
+
+        lines.append(line);
+    }
+
+    return lines.join(QLatin1Char('\n'));
+}
+
+void QDaemonSupervisor::spawn(qint32 index)
+{
+    Child & child = children[index];
+
+    QProcess * process = new QProcess(this);
+    process->setProcessChannelMode(QProcess::ForwardedChannels);
+    QObject::connect(process, static_cast<void (QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished), this, [this, index] (int code, QProcess::ExitStatus status) -> void  {
+        childFinished(index, code, status);
+    });
+
+    process->start(program, child.arguments);
+    if (!process->waitForStarted())  {
+        qDaemonLog(QStringLiteral("Couldn't start child process %1 (%2).").arg(index).arg(process->errorString()), QDaemonLog::ErrorEntry);
+        delete process;
+
+        QMutexLocker lock(&mutex);
+        child.lastExit = QStringLiteral("failed to start at %1").arg(QDateTime::currentDateTime().toString(Qt::ISODate));
+        lock.unlock();
+
+        scheduleRestart(index);
+        return;
+    }
+
+    QMutexLocker lock(&mutex);
+    Q_UNUSED(lock);
+
+    child.process = process;
+    child.pid = process->processId();
+    child.uptime.start();
+}
+
+void QDaemonSupervisor::childFinished(qint32 index, int code, QProcess::ExitStatus status)
+{
+    Child & child = children[index];
+
+    bool failed = status == QProcess::CrashExit || code != 0;
+    QString exit = status == QProcess::CrashExit ? QStringLiteral("crashed") : QStringLiteral("exited with code %1").arg(code);
+
+    QMutexLocker lock(&mutex);
+    child.process->deleteLater();
+    child.process = Q_NULLPTR;
+    child.lastExit = QStringLiteral("%1 at %2").arg(exit, QDateTime::currentDateTime().toString(Qt::ISODate));
+
+    // A clean exit is intentional, so don't restart; the supervisor is done when all the children are
+    bool done = !stopping && !failed && policy == RestartOnFailure;
+    if (done)
+        child.done = true;
+    lock.unlock();
+
+    if (stopping)
+        return;
+
+    if (done)  {
+        for (qint32 i = 0, size = children.size(); i < size; i++)  {
+            if (!children.at(i).done)
+                return;
+        }
+
+        emit finished();
+        return;
+    }
+
+    // A child that ran for a while starts from the beginning of the backoff
+    if (child.uptime.elapsed() >= stableUptime)
+        child.backoff = minimumBackoff;
+
+    qDaemonLog(QStringLiteral("Child process %1 %2, restarting in %3 ms.").arg(index).arg(exit).arg(child.backoff), QDaemonLog::WarningEntry);
+    scheduleRestart(index);
+}
+
+void QDaemonSupervisor::scheduleRestart(qint32 index)
+{
+    Child & child = children[index];
+
+    // Break crash loops: too many failures in the window mean restarting won't help
+    if (crashLimit > 0)  {
+        qint64 now = clock.elapsed();
+        child.failures.append(now);
+        while (!child.failures.isEmpty() && now - child.failures.first() > crashWindow)
+            child.failures.removeFirst();
+
+        if (child.failures.size() > crashLimit)  {
+            qDaemonLog(QStringLiteral("Child process %1 failed %2 times in %3 s, giving up.").arg(index).arg(child.failures.size()).arg(crashWindow / 1000), QDaemonLog::ErrorEntry);
+
+            QMutexLocker lock(&mutex);
+            child.done = true;
+            lock.unlock();
+
+            emit crashLoop();
+            return;
+        }
+    }
+
+    QMutexLocker lock(&mutex);
+    child.restarts++;
+    lock.unlock();
+
+    child.restartTimer->start(child.backoff);
+    child.backoff = qMin(child.backoff * 2, maximumBackoff);
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,125 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtDaemon API. It exists only
+// as an implementation detail. This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#ifndef QDAEMONSUPERVISOR_P_H
+#define QDAEMONSUPERVISOR_P_H
+
+#include "QtDaemon/qdaemon-global.h"
+
+#include <QtCore/qobject.h>
+#include <QtCore/qprocess.h>
+#include <QtCore/qvector.h>
+#include <QtCore/qstringlist.h>
+#include <QtCore/qelapsedtimer.h>
+#include <QtCore/qmutex.h>
+
+QT_BEGIN_NAMESPACE
+
+class QTimer;
+
+namespace QtDaemon
+{
+    class Q_DAEMON_LOCAL QDaemonSupervisor : public QObject
+    {
+        Q_OBJECT
+        Q_DISABLE_COPY(QDaemonSupervisor)
+
+    public:
+        enum RestartPolicy  {
+            RestartAlways,
+            RestartOnFailure
+        };
+
+        QDaemonSupervisor(QObject * = Q_NULLPTR);
+        ~QDaemonSupervisor() Q_DECL_OVERRIDE;
+
+        void setRestartPolicy(RestartPolicy);
+        void setBackoff(qint64, qint64);
+        void setCrashLimit(qint32, qint64);
+
+        void start(const QString &, const QList<QStringList> &);
+        void stop();
+        void signal(int);
+
+        QString status() const;
+
+    Q_SIGNALS:
+        void finished();
+        void crashLoop();
+
+    private:
+        struct Child
+        {
+            Child();
+
+            QProcess * process;
+            QTimer * restartTimer;
+            qint64 pid;
+            QStringList arguments;
+            QElapsedTimer uptime;
+            qint64 backoff;
+            qint32 restarts;
+            QString lastExit;
+            QList<qint64> failures;
+            bool done;
+        };
+
+        void spawn(qint32);
+        void childFinished(qint32, int, QProcess::ExitStatus);
+        void scheduleRestart(qint32);
+
+        QString program;
+        QVector<Child> children;
+        QElapsedTimer clock;
+        RestartPolicy policy;
+        qint64 minimumBackoff, maximumBackoff;
+        qint32 crashLimit;
+        qint64 crashWindow;
+        bool stopping;
+
+        mutable QMutex mutex;       // Guards the state of the children reported by status(), which is called from the control thread
+
+        static const qint64 stableUptime;
+        static const int stopTimeout;
+    };
+}
+
+QT_END_NAMESPACE
+
+#endif // QDAEMONSUPERVISOR_P_H
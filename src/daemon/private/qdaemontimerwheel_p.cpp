@@ -0,0 +1,254 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include "qdaemontimerwheel_p.h"
+
+#include <QtCore/qpointer.h>
+
+#include <algorithm>
+
+QT_BEGIN_NAMESPACE
+
+QDaemonTimerWheelPrivate::Node::Node()
+    : expiry(0), generation(0), previous(-1), next(-1), slot(-1)
+{
+}
+
+QDaemonTimerWheelPrivate::QDaemonTimerWheelPrivate(QDaemonTimerWheel * q, int msec)
+    : q_ptr(q), resolution(qMax(1, msec)), active(0), freeNodes(-1), currentTick(0)
+{
+    std::fill_n(slots, int(LevelCount * SlotCount), -1);
+
+    // A child, so it follows the wheel to another thread
+    timer.setParent(q);
+    timer.setTimerType(Qt::PreciseTimer);
+    timer.setInterval(resolution);
+    QObject::connect(&timer, &QTimer::timeout, q, [this] () -> void  {
+        tick();
+    });
+
+    clock.start();
+}
+
+QDaemonTimerWheel::TimerId QDaemonTimerWheelPrivate::start(int msec, const std::function<void ()> & callback)
+{
+    // The wheel doesn't tick while idle, so catch up with the clock before it's started again
+    if (!timer.isActive())  {
+        currentTick = elapsedTicks();
+        timer.start();
+    }
+
+    int index = allocate();
+    Node & node = nodes[index];
+    node.callback = callback;
+    node.expiry = expiryTick(msec);
+    schedule(index);
+
+    active++;
+    return (quint64(node.generation) << 32) | quint32(index + 1);
+}
+
+bool QDaemonTimerWheelPrivate::restart(QDaemonTimerWheel::TimerId id, int msec)
+{
+    int index = find(id);
+    if (index < 0)
+        return false;
+
+    unlink(index);
+    nodes[index].expiry = expiryTick(msec);
+    schedule(index);
+    return true;
+}
+
+bool QDaemonTimerWheelPrivate::cancel(QDaemonTimerWheel::TimerId id)
+{
+    int index = find(id);
+    if (index < 0)
+        return false;
+
+    // The timer is left to the next tick to stop, as this may be called from within a callback
+    unlink(index);
+    release(index);
+    active--;
+    return true;
+}
+
+bool QDaemonTimerWheelPrivate::isActive(QDaemonTimerWheel::TimerId id) const
+{
+    return find(id) >= 0;
+}
+
+void QDaemonTimerWheelPrivate::clear()
+{
+    for (int i = 0, size = nodes.size(); i < size; i++)  {
+        if (nodes.at(i).slot >= 0)
+            release(i);
+    }
+
+    std::fill_n(slots, int(LevelCount * SlotCount), -1);
+    active = 0;
+}
+
+int QDaemonTimerWheelPrivate::find(QDaemonTimerWheel::TimerId id) const
+{
+    int index = int(quint32(id)) - 1;
+    if (index < 0 || index >= nodes.size())
+        return -1;
+
+    const Node & node = nodes.at(index);
+    if (node.slot < 0 || node.generation != quint32(id >> 32))
+        return -1;      // Expired, canceled or reused
+
+    return index;
+}
+
+int QDaemonTimerWheelPrivate::allocate()
+{
+    if (freeNodes < 0)  {
+        nodes.append(Node());
+        return nodes.size() - 1;
+    }
+
+    int index = freeNodes;
+    freeNodes = nodes.at(index).next;
+    return index;
+}
+
+void QDaemonTimerWheelPrivate::release(int index)
+{
+    Node & node = nodes[index];
+    node.callback = Q_NULLPTR;
+    node.generation++;          // Invalidates the identifiers handed out for the node
+    node.slot = -1;
+    node.previous = -1;
+    node.next = freeNodes;
+    freeNodes = index;
+}
+
+void QDaemonTimerWheelPrivate::schedule(int index)
+{
+    // Pick the lowest level whose range covers the timeout, each level spans SlotCount times the previous
+    quint64 expiry = nodes.at(index).expiry, delta = expiry - currentTick;
+
+    int level = 0;
+    while (level < LevelCount - 1 && delta >= (Q_UINT64_C(1) << ((level + 1) * SlotBits)))
+        level++;
+
+    link(index, level * SlotCount + int((expiry >> (level * SlotBits)) & SlotMask));
+}
+
+void QDaemonTimerWheelPrivate::link(int index, int slot)
+{
+    Node & node = nodes[index];
+    node.slot = slot;
+    node.previous = -1;
+    node.next = slots[slot];
+
+    if (node.next >= 0)
+        nodes[node.next].previous = index;
+    slots[slot] = index;
+}
+
+void QDaemonTimerWheelPrivate::unlink(int index)
+{
+    Node & node = nodes[index];
+    if (node.previous >= 0)
+        nodes[node.previous].next = node.next;
+    else
+        slots[node.slot] = node.next;
+
+    if (node.next >= 0)
+        nodes[node.next].previous = node.previous;
+
+    node.previous = node.next = -1;
+}
+
+quint64 QDaemonTimerWheelPrivate::elapsedTicks() const
+{
+    return quint64(clock.elapsed()) / quint64(resolution);
+}
+
+quint64 QDaemonTimerWheelPrivate::expiryTick(int msec) const
+{
+    // Round up, a timeout never expires early. Neither can it be scheduled beyond the reach of the top level
+    static const quint64 maximumDelta = (Q_UINT64_C(1) << (LevelCount * SlotBits)) - 1;
+
+    // The current tick is already under way (the clock is floored), so the count starts from the next one
+    quint64 ticks = qBound<quint64>(1, (quint64(qMax(msec, 0)) + resolution - 1) / quint64(resolution), maximumDelta);
+    quint64 expiry = qMax(currentTick, elapsedTicks()) + 1 + ticks;
+    return qMin(expiry, currentTick + maximumDelta);
+}
+
+void QDaemonTimerWheelPrivate::tick()
+{
+    Q_Q(QDaemonTimerWheel);
+
+    QPointer<QDaemonTimerWheel> guard(q);
+    quint64 target = elapsedTicks();
+    while (currentTick < target && active > 0)  {
+        currentTick++;
+
+        // Spill the upper levels into the lower ones when the lower ones wrap around
+        for (int level = 1; level < LevelCount && (currentTick & ((Q_UINT64_C(1) << (level * SlotBits)) - 1)) == 0; level++)
+            cascade(level);
+
+        int slot = int(currentTick & SlotMask);
+        while (slots[slot] >= 0)  {
+            int index = slots[slot];
+            std::function<void ()> callback = std::move(nodes[index].callback);
+
+            unlink(index);
+            release(index);
+            active--;
+
+            callback();
+            if (!guard)
+                return;     // Destroyed from the callback
+        }
+    }
+
+    if (active == 0)
+        timer.stop();
+}
+
+void QDaemonTimerWheelPrivate::cascade(int level)
+{
+    int slot = level * SlotCount + int((currentTick >> (level * SlotBits)) & SlotMask);
+
+    // Detach the whole list first, the nodes are rescheduled relative to the current tick
+    int index = slots[slot];
+    slots[slot] = -1;
+
+    while (index >= 0)  {
+        int next = nodes.at(index).next;
+        schedule(index);
+        index = next;
+    }
+}
+
+QT_END_NAMESPACE
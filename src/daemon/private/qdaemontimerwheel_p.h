@@ -0,0 +1,108 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtDaemon API. It exists only
+// as an implementation detail. This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#ifndef QDAEMONTIMERWHEEL_P_H
+#define QDAEMONTIMERWHEEL_P_H
+
+#include "qdaemontimerwheel.h"
+
+#include <QtCore/qtimer.h>
+#include <QtCore/qelapsedtimer.h>
+#include <QtCore/qvector.h>
+
+QT_BEGIN_NAMESPACE
+
+class QDaemonTimerWheelPrivate
+{
+    Q_DECLARE_PUBLIC(QDaemonTimerWheel)
+
+public:
+    // 4 levels of 256 slots cover 2^32 ticks (~50 days at 1 ms resolution)
+    enum { SlotBits = 8, SlotCount = 1 << SlotBits, SlotMask = SlotCount - 1, LevelCount = 4 };
+
+    QDaemonTimerWheelPrivate(QDaemonTimerWheel *, int);
+
+    QDaemonTimerWheel::TimerId start(int, const std::function<void ()> &);
+    bool restart(QDaemonTimerWheel::TimerId, int);
+    bool cancel(QDaemonTimerWheel::TimerId);
+    bool isActive(QDaemonTimerWheel::TimerId) const;
+    void clear();
+
+private:
+    struct Node
+    {
+        Node();
+
+        std::function<void ()> callback;
+        quint64 expiry;
+        quint32 generation;
+        qint32 previous, next;
+        qint32 slot;            // Index in the slot table, -1 when the node is free
+    };
+
+    int find(QDaemonTimerWheel::TimerId) const;
+    int allocate();
+    void release(int);
+
+    void schedule(int);
+    void link(int, int);
+    void unlink(int);
+
+    quint64 elapsedTicks() const;
+    quint64 expiryTick(int) const;
+    void tick();
+    void cascade(int);
+
+private:
+    QDaemonTimerWheel * q_ptr;
+    const int resolution;
+    int active;
+
+    QVector<Node> nodes;
+    qint32 freeNodes;
+    qint32 slots[LevelCount * SlotCount];
+
+    quint64 currentTick;
+    QElapsedTimer clock;
+    QTimer timer;
+};
+
+QT_END_NAMESPACE
+
+#endif // QDAEMONTIMERWHEEL_P_H
@@ -0,0 +1,213 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include "qdaemonwatchdog_p.h"
+#include "qdaemonlog.h"
+
+#include <QtCore/qcoreapplication.h>
+#include <QtCore/qcoreevent.h>
+
+#include <cstdlib>
+#include <execinfo.h>
+#include <signal.h>
+#include <errno.h>
+
+QT_BEGIN_NAMESPACE
+
+using namespace QtDaemon;
+
+static const int maximumStackFrames = 64;
+static const int stackSampleTimeout = 100;      // Wait up to 100 ms for the main thread to take the sample
+
+// Each sample request is tagged with a generation, which the signal handler writes back when it's done.
+// A request is outstanding while the two differ, and no new signal is sent until the handler catches up.
+static void * stackFrames[maximumStackFrames];
+static int stackFrameCount = 0;
+static QBasicAtomicInt stackSampleRequested = Q_BASIC_ATOMIC_INITIALIZER(0);
+static QBasicAtomicInt stackSampleTaken = Q_BASIC_ATOMIC_INITIALIZER(0);
+
+static inline int stackSampleSignal()
+{
+    return SIGRTMIN + 4;
+}
+
+class QDaemonHeartbeatEvent : public QEvent
+{
+public:
+    QDaemonHeartbeatEvent(qint64 time)
+        : QEvent(QDaemonHeartbeatReceiver::heartbeatEvent), postedAt(time)
+    {
+    }
+
+    const qint64 postedAt;
+};
+
+const QEvent::Type QDaemonHeartbeatReceiver::heartbeatEvent = static_cast<QEvent::Type>(QEvent::registerEventType());
+
+QDaemonHeartbeatReceiver::QDaemonHeartbeatReceiver(QDaemonWatchdog * dog)
+    : watchdog(dog)
+{
+}
+
+bool QDaemonHeartbeatReceiver::event(QEvent * e)
+{
+    if (e->type() != heartbeatEvent)
+        return QObject::event(e);
+
+    watchdog->heartbeat(static_cast<QDaemonHeartbeatEvent *>(e)->postedAt);
+    return true;
+}
+
+QDaemonWatchdog::QDaemonWatchdog(int stallThreshold, QObject * parent)
+    : QThread(parent), threshold(stallThreshold), mainThread(::pthread_self()), receiver(this), pendingSince(-1), stopRequested(false),
+      latency(qDaemonMetrics().histogram(QStringLiteral("qtdaemon_event_loop_lag_microseconds"), QStringLiteral("Time it takes the main event loop to dispatch a posted event."))),
+      lastLatency(qDaemonMetrics().gauge(QStringLiteral("qtdaemon_event_loop_last_lag_microseconds"), QStringLiteral("The most recently measured main event loop dispatch latency."))),
+      stalls(qDaemonMetrics().counter(QStringLiteral("qtdaemon_event_loop_stalls_total"), QStringLiteral("Number of times the main event loop was blocked longer than the stall threshold.")))
+{
+    Q_ASSERT(threshold > 0);
+    clock.start();
+
+    struct sigaction action;
+    ::sigemptyset(&action.sa_mask);
+    action.sa_handler = QDaemonWatchdog::stackSampleHandler;
+    action.sa_flags = SA_RESTART;
+    ::sigaction(stackSampleSignal(), &action, Q_NULLPTR);
+
+    // The first call to backtrace() may allocate (it loads the unwinder), so don't let that happen in the signal handler
+    void * frame;
+    ::backtrace(&frame, 1);
+}
+
+QDaemonWatchdog::~QDaemonWatchdog()
+{
+    stop();
+    ::signal(stackSampleSignal(), SIG_DFL);
+}
+
+void QDaemonWatchdog::stop()
+{
+    QMutexLocker lock(&mutex);
+    stopRequested = true;
+    condition.wakeAll();
+    lock.unlock();
+
+    wait();
+}
+
+void QDaemonWatchdog::run()
+{
+    const int interval = qBound(10, threshold / 2, 1000);
+    qint64 reported = -1;
+
+    QMutexLocker lock(&mutex);
+    Q_UNUSED(lock);
+
+    while (!stopRequested)  {
+        condition.wait(&mutex, interval);
+        if (stopRequested)
+            break;
+
+        qint64 now = clock.nsecsElapsed(), since = pendingSince.loadAcquire();
+        if (since < 0)  {
+            // The previous heartbeat was dispatched, post a new one
+            pendingSince.storeRelease(now);
+            QCoreApplication::postEvent(&receiver, new QDaemonHeartbeatEvent(now), Qt::HighEventPriority);
+            continue;
+        }
+
+        qint64 blocked = (now - since) / 1000000;
+        if (blocked < threshold || reported == since)
+            continue;
+
+        // Report each stall only once
+        reported = since;
+        stalls.add();
+
+        QStringList stack = sampleMainThreadStack();
+        qDaemonLog(QStringLiteral("The main event loop has been blocked for %1 ms. Main thread stack:\n%2").arg(blocked).arg(stack.join(QLatin1Char('\n'))), QDaemonLog::WarningEntry);
+    }
+}
+
+void QDaemonWatchdog::heartbeat(qint64 postedAt)
+{
+    qint64 lag = (clock.nsecsElapsed() - postedAt) / 1000;
+
+    latency.record(quint64(lag));
+    lastLatency.set(lag);
+
+    pendingSince.storeRelease(-1);
+}
+
+QStringList QDaemonWatchdog::sampleMainThreadStack()
+{
+    QStringList stack;
+
+    // A signal sent for an earlier stall that timed out may still be pending, don't queue another one behind it
+    int generation = stackSampleRequested.loadAcquire();
+    if (stackSampleTaken.loadAcquire() != generation)
+        return stack << QStringLiteral("    <unavailable, the previous sample is still pending>");
+
+    generation++;
+    stackSampleRequested.storeRelease(generation);
+    if (::pthread_kill(mainThread, stackSampleSignal()) != 0)  {
+        stackSampleTaken.storeRelease(generation);      // Nothing is outstanding
+        return stack << QStringLiteral("    <unavailable>");
+    }
+
+    QElapsedTimer timeout;
+    timeout.start();
+    while (stackSampleTaken.loadAcquire() != generation && !timeout.hasExpired(stackSampleTimeout))
+        QThread::usleep(100);
+
+    // Discard the frames unless they were taken for this very request
+    if (stackSampleTaken.loadAcquire() != generation)
+        return stack << QStringLiteral("    <unavailable>");
+
+    int frames = stackFrameCount;
+    char ** symbols = frames > 0 ? ::backtrace_symbols(stackFrames, frames) : Q_NULLPTR;
+    if (!symbols)
+        return stack << QStringLiteral("    <unavailable>");
+
+    // Skip the signal handler and the signal trampoline frames
+    for (int i = qMin(2, frames - 1); i < frames; i++)
+        stack.append(QStringLiteral("    ") + QString::fromLocal8Bit(symbols[i]));
+
+    ::free(symbols);
+    return stack;
+}
+
+void QDaemonWatchdog::stackSampleHandler(int)
+{
+    int error = errno;
+    int generation = stackSampleRequested.loadAcquire();
+    stackFrameCount = ::backtrace(stackFrames, maximumStackFrames);
+    stackSampleTaken.storeRelease(generation);
+    errno = error;
+}
+
+QT_END_NAMESPACE
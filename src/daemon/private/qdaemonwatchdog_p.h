@@ -0,0 +1,116 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtDaemon API. It exists only
+// as an implementation detail. This header file may change from
+// version to version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#ifndef QDAEMONWATCHDOG_P_H
+#define QDAEMONWATCHDOG_P_H
+
+#include "QtDaemon/qdaemon-global.h"
+#include "qdaemonmetrics.h"
+
+#include <QtCore/qthread.h>
+#include <QtCore/qmutex.h>
+#include <QtCore/qwaitcondition.h>
+#include <QtCore/qelapsedtimer.h>
+#include <QtCore/qatomic.h>
+#include <QtCore/qstringlist.h>
+
+#include <pthread.h>
+
+QT_BEGIN_NAMESPACE
+
+namespace QtDaemon
+{
+    class QDaemonWatchdog;
+    class Q_DAEMON_LOCAL QDaemonHeartbeatReceiver : public QObject
+    {
+        Q_OBJECT
+        Q_DISABLE_COPY(QDaemonHeartbeatReceiver)
+
+    public:
+        QDaemonHeartbeatReceiver(QDaemonWatchdog *);
+
+        bool event(QEvent *) Q_DECL_OVERRIDE;
+
+        static const QEvent::Type heartbeatEvent;
+
+    private:
+        QDaemonWatchdog * watchdog;
+    };
+
+    class Q_DAEMON_LOCAL QDaemonWatchdog : public QThread
+    {
+        Q_OBJECT
+        Q_DISABLE_COPY(QDaemonWatchdog)
+
+        friend class QDaemonHeartbeatReceiver;
+
+    public:
+        QDaemonWatchdog(int, QObject * = Q_NULLPTR);
+        ~QDaemonWatchdog() Q_DECL_OVERRIDE;
+
+        void stop();
+
+    protected:
+        void run() Q_DECL_OVERRIDE;
+
+    private:
+        void heartbeat(qint64);
+        QStringList sampleMainThreadStack();
+
+        static void stackSampleHandler(int);
+
+        const int threshold;
+        const pthread_t mainThread;
+        QDaemonHeartbeatReceiver receiver;
+        QElapsedTimer clock;
+
+        QAtomicInteger<qint64> pendingSince;        // When the outstanding heartbeat was posted (-1 if none)
+        bool stopRequested;
+        QMutex mutex;
+        QWaitCondition condition;
+
+        QDaemonHistogram latency;
+        QDaemonGauge lastLatency;
+        QDaemonCounter stalls;
+    };
+}
+
+QT_END_NAMESPACE
+
+#endif // QDAEMONWATCHDOG_P_H
@@ -11,6 +11,7 @@ QT_BEGIN_NAMESPACE
         #define Q_DAEMON_LOCAL Q_DECL_HIDDEN
     #else
         #define Q_DAEMON_EXPORT Q_DECL_IMPORT
+        #define Q_DAEMON_LOCAL
     #endif
 #else
     #define Q_DAEMON_EXPORT
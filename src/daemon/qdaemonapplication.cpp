@@ -29,9 +29,26 @@
 #include "qdaemonapplication.h"
 #include "private/qdaemonapplication_p.h"
 #include "private/qabstractdaemonbackend.h"
+#include "private/qdaemonstartupprofiler_p.h"
 
 #include <QtCore/QScopedPointer>
 
+#if defined(Q_OS_LINUX)
+#include "private/qdaemoneventdispatcher_p.h"
+#include "private/qdaemonprocesstuning_p.h"
+#endif
+
+#ifdef Q_OS_UNIX
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <cstring>
+#endif
+
 QT_BEGIN_NAMESPACE
 
 using namespace QtDaemon;
@@ -59,6 +76,9 @@ using namespace QtDaemon;
     This signal is emitted when the process has been daemonized.
     The string list argument \a arguments is a proper command line that
     can be used with a \l{QCommandLineParser} instance.
+
+    When workerCount is set, the signal is emitted in each of the worker processes
+    and not in the supervising process. The worker can be identified with workerIndex().
 */
 /*!
     \fn void QDaemonApplication::started()
@@ -85,6 +105,56 @@ using namespace QtDaemon;
     and the daemon application has been uninstalled successfully.
 */
 
+/*!
+    \fn void QDaemonApplication::reloadRequested()
+
+    This signal is emitted when the process receives \c SIGHUP. Daemons should reload their
+    configuration in response.
+
+    \note The signal is dispatched through the event loop, so it's safe to do any work in the
+    connected slots. Supported on Unix only.
+*/
+/*!
+    \fn void QDaemonApplication::logReopenRequested()
+
+    This signal is emitted when the process receives \c SIGUSR1, after the daemon log has been
+    reopened (see QDaemonLog::reopen()). Daemons that keep files of their own should reopen
+    them in response, so they can be rotated externally.
+
+    \note Supported on Unix only.
+*/
+/*!
+    \fn void QDaemonApplication::dumpRequested()
+
+    This signal is emitted when the process receives \c SIGUSR2, after a snapshot of the
+    runtime statistics (see QDaemonMetrics) has been written to the log.
+
+    \note Supported on Unix only.
+*/
+
+/*!
+    \fn void QDaemonApplication::upgraded()
+
+    This signal is emitted in the running daemon when an upgraded instance, started with
+    the \c --upgrade switch, has taken over the registered descriptors and is ready. The
+    application quits right after the signal is emitted, so it should stop accepting new
+    work and drain the existing one (in response to this signal or to \l{QCoreApplication::}{aboutToQuit()}).
+
+    \note Supported on Linux only.
+    \sa registerDescriptor()
+*/
+/*!
+    \fn void QDaemonApplication::standby()
+
+    This signal is emitted when the daemon is started with the \c{--standby} switch while
+    another instance is running. The application should do its warm-up (load data, fill caches, etc.)
+    in response, but not start serving. When the running instance quits or dies, the standby instance
+    takes over its service within milliseconds and daemonized() is emitted.
+
+    \note Supported on Linux only.
+    \sa daemonized()
+*/
+
 /*!
     Constructs the daemon application object.
 
@@ -100,6 +170,7 @@ using namespace QtDaemon;
 QDaemonApplication::QDaemonApplication(int & argc, char ** argv)
     : QCoreApplication(argc, argv), d_ptr(new QDaemonApplicationPrivate(this))
 {
+    QDaemonStartupProfiler::mark(QStringLiteral("application constructed"));
 }
 
 /*!
@@ -130,16 +201,46 @@ int QDaemonApplication::exec()
     QCommandLineOption daemonOption(QStringLiteral("d"));
     daemonOption.setHidden(true);
 
+    QCommandLineOption instanceOption(QStringLiteral("instance"), QCoreApplication::translate("main", "Selects the daemon instance (can be repeated, or 'all' for all the running instances)"), QStringLiteral("id"));
+
     d->parser.addOption(daemonOption);
+    d->parser.addOption(instanceOption);
     d->parser.parse(arguments);
 
-    // Create the appropriate backend
+    // Select the instance, the controller may work with several of them at once
     bool isDaemon = d->parser.isSet(daemonOption);
+    QStringList instances = d->parser.values(instanceOption);
+    foreach (const QString & instance, instances)  {
+        if (!QDaemonApplicationPrivate::isValidInstanceId(instance) && (isDaemon || instance != QDaemonApplicationPrivate::allInstances))  {
+            qDaemonLog(QStringLiteral("The instance id may contain only letters, digits and underscores, and can't be '%1' (%2).").arg(QDaemonApplicationPrivate::allInstances, instance), QDaemonLog::ErrorEntry);
+            return QAbstractDaemonBackend::BackendFailed;
+        }
+    }
+
+    if (isDaemon && instances.size() > 1)  {
+        // The daemon runs as exactly one instance, don't silently fall back to the default one
+        qDaemonLog(QStringLiteral("The daemon can run as a single instance only (%1).").arg(instances.join(QStringLiteral(", "))), QDaemonLog::ErrorEntry);
+        return QAbstractDaemonBackend::BackendFailed;
+    }
+
+    if (instances.size() == 1 && instances.first() != QDaemonApplicationPrivate::allInstances)
+        QDaemonApplicationPrivate::instanceId = instances.first();
+
+    QDaemonStartupProfiler::mark(QStringLiteral("arguments parsed"));
+
+    // Create the appropriate backend
     QScopedPointer<QAbstractDaemonBackend> backend(d->createBackend(isDaemon));
 
     // Reparse with the options that the backends may have added in their constructors
     d->parser.parse(arguments);
 
+    QDaemonStartupProfiler::mark(QStringLiteral("backend created"));
+
+    // Connected last, so the executor drains after the application's own slots have run
+    QObject::connect(app, &QCoreApplication::aboutToQuit, app, [d] () -> void  {
+        d->stopExecutor();
+    });
+
     return backend->exec();
 }
 
@@ -198,4 +299,402 @@ void QDaemonApplication::setApplicationDescription(const QString & description)
     QDaemonApplicationPrivate::description = description;
 }
 
+/*!
+    \property QDaemonApplication::metricsEndpoint
+    \brief Holds the address of the daemon's built-in metrics endpoint.
+
+    When set, the daemon serves the metrics registered with QDaemonMetrics, together with
+    the process' own statistics (CPU time, memory, threads and file descriptors), in the
+    Prometheus text exposition format over HTTP. The endpoint is served from a dedicated
+    thread, so scraping it does not go through the application's event loop.
+
+    The address can be a port number (the loopback interface is used), a \c{host:port} pair,
+    or a path to a unix socket (either absolute or prefixed with \c{unix:}).
+
+    By default this property is empty and the endpoint is disabled.
+
+    \note The property has to be set before calling exec(). It's supported on Linux only.
+*/
+QString QDaemonApplication::metricsEndpoint()
+{
+    return QDaemonApplicationPrivate::metricsEndpoint;
+}
+
+void QDaemonApplication::setMetricsEndpoint(const QString & endpoint)
+{
+    QDaemonApplicationPrivate::metricsEndpoint = endpoint;
+}
+
+/*!
+    \property QDaemonApplication::stallThreshold
+    \brief Holds the time (in milliseconds) after which the main event loop is considered stalled.
+
+    When set to a positive value, the daemon starts a watchdog thread that periodically posts
+    heartbeat events to the main event loop. The time it takes the loop to dispatch them is recorded
+    in the \c qtdaemon_event_loop_lag_microseconds histogram of QDaemonMetrics. Whenever a heartbeat
+    stays pending longer than the threshold, a warning with a stack sample of the main thread
+    is written to the log.
+
+    By default this property is \c 0 and the watchdog is disabled.
+
+    \note The property has to be set before calling exec(). It's supported on Linux only.
+*/
+int QDaemonApplication::stallThreshold()
+{
+    return QDaemonApplicationPrivate::stallThreshold;
+}
+
+void QDaemonApplication::setStallThreshold(int threshold)
+{
+    QDaemonApplicationPrivate::stallThreshold = qMax(0, threshold);
+}
+
+/*!
+    Returns the id of the daemon instance selected with the \c{--instance} switch,
+    or an empty string if no instance was selected.
+
+    Several instances of the same daemon can run side by side when each is given a distinct id.
+    The id qualifies the name of the daemon's D-Bus service, its log file and the installed files
+    (e.g. \c{tcpserver_shard1.log}).
+
+    \note Supported on Linux only.
+*/
+QString QDaemonApplication::instanceId()
+{
+    return QDaemonApplicationPrivate::instanceId;
+}
+
+/*!
+    \property QDaemonApplication::workerCount
+    \brief Holds the number of worker processes the daemon runs.
+
+    When set to a positive value, the daemon process becomes a supervisor that starts
+    the given number of worker processes and restarts them (with an exponential backoff) when they quit.
+    Each worker is a separate instance of the application that receives the daemonized() signal
+    and serves independently of the others, so a crash takes down a single worker only.
+    The workers usually share the listening port through createReusePortListener().
+
+    The supervisor owns the daemon's D-Bus service, so \c --stop stops the whole group
+    and \c --status reports the state of each worker.
+
+    By default this property is \c 0 and the daemon runs in a single process.
+
+    \note The property has to be set before calling exec(). It's supported on Linux only.
+    \sa workerIndex()
+*/
+int QDaemonApplication::workerCount()
+{
+    return QDaemonApplicationPrivate::workerCount;
+}
+
+void QDaemonApplication::setWorkerCount(int count)
+{
+    QDaemonApplicationPrivate::workerCount = qMax(0, count);
+}
+
+/*!
+    Returns the index of the worker process, from \c 0 to \c{workerCount() - 1},
+    or \c -1 if the process isn't a worker.
+
+    \sa workerCount
+*/
+int QDaemonApplication::workerIndex()
+{
+    return QDaemonApplicationPrivate::workerIndex;
+}
+
+/*!
+    \property QDaemonApplication::executorThreadCount
+    \brief Holds the number of threads of the daemon's executor.
+
+    The executor (see qDaemonExecutor()) is started with the given number of threads
+    right before the daemonized() signal is emitted. When set to \c 0 (the default),
+    effectiveCpuCount() is used, so the executor isn't oversubscribed inside a container.
+
+    \note The property has to be set before the daemonized() signal is emitted.
+    \sa QDaemonExecutor
+*/
+int QDaemonApplication::executorThreadCount()
+{
+    return QDaemonApplicationPrivate::executorThreadCount;
+}
+
+void QDaemonApplication::setExecutorThreadCount(int count)
+{
+    QDaemonApplicationPrivate::executorThreadCount = qMax(0, count);
+}
+
+/*!
+    Creates a TCP socket listening on \a port of all the interfaces with \c SO_REUSEPORT set,
+    so multiple worker processes can listen on the same port and the kernel balances the incoming
+    connections between them. Returns the socket descriptor, which should be passed to
+    \l{QTcpServer::}{setSocketDescriptor()}, or \c -1 on failure.
+
+    \note Supported on Linux only.
+    \sa workerCount
+*/
+qintptr QDaemonApplication::createReusePortListener(quint16 port)
+{
+#if defined(Q_OS_UNIX) && defined(SO_REUSEPORT)
+    // Prefer a dual stack socket, fall back to IPv4 if IPv6 isn't available
+    int descriptor = ::socket(AF_INET6, SOCK_STREAM, 0);
+    bool ipv6 = descriptor >= 0;
+    if (!ipv6)
+        descriptor = ::socket(AF_INET, SOCK_STREAM, 0);
+
+    if (descriptor < 0)  {
+        int error = errno;
+        qDaemonLog(QStringLiteral("Couldn't create the listening socket (%1).").arg(QString::fromLocal8Bit(std::strerror(error))), QDaemonLog::ErrorEntry);
+        return -1;
+    }
+
+    ::fcntl(descriptor, F_SETFD, FD_CLOEXEC);
+
+    int enable = 1, disable = 0;
+    ::setsockopt(descriptor, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    int status = ::setsockopt(descriptor, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable));
+    if (status == 0 && ipv6)  {
+        ::setsockopt(descriptor, IPPROTO_IPV6, IPV6_V6ONLY, &disable, sizeof(disable));
+
+        struct sockaddr_in6 address = {};
+        address.sin6_family = AF_INET6;
+        address.sin6_addr = in6addr_any;
+        address.sin6_port = htons(port);
+        status = ::bind(descriptor, reinterpret_cast<struct sockaddr *>(&address), sizeof(address));
+    }
+    else if (status == 0)  {
+        struct sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(port);
+        status = ::bind(descriptor, reinterpret_cast<struct sockaddr *>(&address), sizeof(address));
+    }
+
+    if (status != 0 || ::listen(descriptor, SOMAXCONN) != 0)  {
+        int error = errno;
+        qDaemonLog(QStringLiteral("Couldn't listen on port %1 (%2).").arg(port).arg(QString::fromLocal8Bit(std::strerror(error))), QDaemonLog::ErrorEntry);
+        ::close(descriptor);
+        return -1;
+    }
+
+    return descriptor;
+#else
+    Q_UNUSED(port);
+
+    qDaemonLog(QStringLiteral("Listening with SO_REUSEPORT is not supported on this platform."), QDaemonLog::ErrorEntry);
+    return -1;
+#endif
+}
+
+/*!
+    Returns the CPUs the calling thread is allowed to run on. For the main thread of the daemon these are the CPUs
+    selected with the \c{--cpus} and \c{--numa-node} switches, or all the CPUs of the machine if none were selected.
+
+    \note Supported on Linux only. On the other platforms an empty list is returned.
+    \sa setCurrentThreadAffinity()
+*/
+QList<int> QDaemonApplication::allowedCpus()
+{
+#if defined(Q_OS_LINUX)
+    return QDaemonProcessTuning::allowedCpus();
+#else
+    return QList<int>();
+#endif
+}
+
+/*!
+    Pins the calling thread to \a cpus, which should be a subset of allowedCpus(). Returns \c true on success.
+
+    This allows the threads created by the application, e.g. the workers of a pool, to be spread over
+    the CPUs the daemon was given. The function is usually called at the start of QThread::run()
+    or from a slot connected to QThread::started() with a direct connection.
+
+    \note Supported on Linux only.
+    \sa allowedCpus()
+*/
+bool QDaemonApplication::setCurrentThreadAffinity(const QList<int> & cpus)
+{
+#if defined(Q_OS_LINUX)
+    if (!cpus.isEmpty() && QDaemonProcessTuning::setCurrentThreadAffinity(cpus))
+        return true;
+
+    int error = cpus.isEmpty() ? EINVAL : errno;
+    qDaemonLog(QStringLiteral("Couldn't pin the thread to the CPUs %1 (%2).").arg(QDaemonProcessTuning::cpuListString(cpus)).arg(QString::fromLocal8Bit(std::strerror(error))), QDaemonLog::WarningEntry);
+    return false;
+#else
+    Q_UNUSED(cpus);
+    return false;
+#endif
+}
+
+/*!
+    Returns the number of CPUs the daemon can actually keep busy. This is the number of allowedCpus(), narrowed
+    by the effective \c cpuset and the \c cpu.max quota of the daemon's cgroup (v2) and its ancestors, a quota
+    of 2.5 CPUs counting as 3. Unlike QThread::idealThreadCount(), which counts the CPUs of the host, this is
+    the number to size the thread pools with when the daemon runs in a container.
+
+    The limits are read once, the first time the function is called. QtDaemon sizes its own thread pools,
+    e.g. the executor, with it.
+
+    \note On the platforms other than Linux QThread::idealThreadCount() is returned.
+    \sa memoryBudget(), executorThreadCount()
+*/
+int QDaemonApplication::effectiveCpuCount()
+{
+    static const int count = QDaemonApplicationPrivate::detectCpuCount();
+    return count;
+}
+
+/*!
+    Returns the amount of memory, in bytes, the daemon may use: the lowest \c memory.max or \c memory.high
+    of the daemon's cgroup (v2) and its ancestors, or the physical memory of the machine if the daemon isn't
+    limited. Returns \c -1 if the amount can't be determined.
+
+    The limits are read once, the first time the function is called. QtDaemon bounds its own queues,
+    e.g. the one of the asynchronous log, with it.
+
+    \note The cgroup limits are read on Linux only.
+    \sa effectiveCpuCount()
+*/
+qint64 QDaemonApplication::memoryBudget()
+{
+    static const qint64 budget = QDaemonApplicationPrivate::detectMemoryBudget();
+    return budget;
+}
+
+/*!
+    Records the startup phase \a name, e.g. after the application has loaded its configuration
+    or opened its listening sockets, in the startup report.
+
+    The phases are timestamped with a monotonic clock, from the start of the process, along with the
+    CPU time the process has used so far. QtDaemon records its own phases: loading the library,
+    constructing the application object, parsing the arguments, creating the backend, registering
+    the D-Bus service and emitting daemonized(). The report is completed with the \c ready phase
+    when the slots connected to daemonized() have returned, and is written to the log then.
+
+    The function is thread-safe.
+
+    \note The start of the process is known on Linux only, elsewhere the phases are timed from loading the library.
+    \sa startupReport()
+*/
+void QDaemonApplication::markStartupPhase(const QString & name)
+{
+    QDaemonStartupProfiler::mark(name);
+}
+
+/*!
+    Returns the startup report: each phase recorded so far with the time elapsed since the process started
+    and since the previous phase, and the CPU time used. The report of a running daemon is also shown
+    by the \c --status switch.
+
+    \sa markStartupPhase()
+*/
+QString QDaemonApplication::startupReport()
+{
+    return QDaemonStartupProfiler::report();
+}
+
+/*!
+    Installs an \c epoll based event dispatcher for the main thread. Returns \c true on success.
+
+    The default event dispatcher polls all the registered socket notifiers on each iteration of the
+    event loop, so its cost grows with the number of sockets. The \c epoll dispatcher keeps the
+    descriptors registered in the kernel and is woken up through \c eventfd and \c timerfd, so
+    an iteration costs the same regardless of how many sockets are idle. It does not integrate
+    with the GLib main loop.
+
+    \note The function has to be called before the application object is constructed. It's supported on Linux only.
+    \sa createEpollEventDispatcher()
+*/
+bool QDaemonApplication::installEpollEventDispatcher()
+{
+    if (Q_UNLIKELY(QCoreApplication::instance()))  {
+        qWarning("The event dispatcher must be installed before constructing the QDaemonApplication.");
+        return false;
+    }
+
+    QAbstractEventDispatcher * dispatcher = createEpollEventDispatcher();
+    if (!dispatcher)
+        return false;
+
+    QCoreApplication::setEventDispatcher(dispatcher);
+    return true;
+}
+
+/*!
+    Creates an \c epoll based event dispatcher, which can be set on a QThread
+    with \l{QThread::}{setEventDispatcher()} before the thread is started.
+    Returns \c Q_NULLPTR if the dispatcher can't be created.
+
+    \note Supported on Linux only.
+    \sa installEpollEventDispatcher()
+*/
+QAbstractEventDispatcher * QDaemonApplication::createEpollEventDispatcher()
+{
+#if defined(Q_OS_LINUX)
+    QDaemonEpollEventDispatcher * dispatcher = new QDaemonEpollEventDispatcher;
+    if (dispatcher->isValid())
+        return dispatcher;
+
+    delete dispatcher;
+#endif
+    return Q_NULLPTR;
+}
+
+/*!
+    Registers the descriptor \a descriptor (usually a listening socket) under the name \a name,
+    so it's passed to the upgraded instance when the daemon is upgraded without downtime
+    with the \c --upgrade switch. The upgraded instance retrieves it with inheritedDescriptor().
+
+    \note Supported on Linux only.
+    \sa unregisterDescriptor(), inheritedDescriptor(), upgraded()
+*/
+void QDaemonApplication::registerDescriptor(const QString & name, qintptr descriptor)
+{
+    QDaemonApplicationPrivate::registeredDescriptors.insert(name, int(descriptor));
+}
+
+/*!
+    Removes the descriptor registered under the name \a name.
+
+    \sa registerDescriptor()
+*/
+void QDaemonApplication::unregisterDescriptor(const QString & name)
+{
+    QDaemonApplicationPrivate::registeredDescriptors.remove(name);
+}
+
+/*!
+    Returns the descriptor inherited under the name \a name, or \c -1 if there's no such descriptor.
+    The application should use the inherited descriptor (e.g. with \l{QTcpServer::}{setSocketDescriptor()})
+    instead of opening a new one.
+
+    Descriptors are inherited from the running instance when the daemon is upgraded, or from the
+    service manager when the daemon is socket activated (the \c LISTEN_FDS protocol). In the latter case
+    the name is the one set with \c FileDescriptorName in the socket unit, or \c unknown if none was set.
+
+    \sa inheritedDescriptorNames(), registerDescriptor()
+*/
+qintptr QDaemonApplication::inheritedDescriptor(const QString & name)
+{
+#if defined(Q_OS_LINUX)
+    QDaemonApplicationPrivate::inheritActivatedDescriptors();       // May be called before the daemon is started
+#endif
+    return QDaemonApplicationPrivate::inheritedDescriptors.value(name, -1);
+}
+
+/*!
+    Returns the names of all the inherited descriptors.
+
+    \sa inheritedDescriptor()
+*/
+QStringList QDaemonApplication::inheritedDescriptorNames()
+{
+#if defined(Q_OS_LINUX)
+    QDaemonApplicationPrivate::inheritActivatedDescriptors();
+#endif
+    return QDaemonApplicationPrivate::inheritedDescriptors.keys();
+}
+
 QT_END_NAMESPACE
@@ -35,6 +35,7 @@
 
 QT_BEGIN_NAMESPACE
 
+class QAbstractEventDispatcher;
 class QDaemonApplicationPrivate;
 class Q_DAEMON_EXPORT QDaemonApplication : public QCoreApplication
 {
@@ -44,6 +45,10 @@ class Q_DAEMON_EXPORT QDaemonApplication : public QCoreApplication
 
     Q_PROPERTY(bool autoQuit READ autoQuit WRITE setAutoQuit)
     Q_PROPERTY(QString applicationDescription READ applicationDescription WRITE setApplicationDescription)
+    Q_PROPERTY(QString metricsEndpoint READ metricsEndpoint WRITE setMetricsEndpoint)
+    Q_PROPERTY(int stallThreshold READ stallThreshold WRITE setStallThreshold)
+    Q_PROPERTY(int workerCount READ workerCount WRITE setWorkerCount)
+    Q_PROPERTY(int executorThreadCount READ executorThreadCount WRITE setExecutorThreadCount)
 
 public:
     QDaemonApplication(int & argc, char ** argv);
@@ -58,14 +63,53 @@ public:
     static QString applicationDescription();
     static void setApplicationDescription(const QString &);
 
+    static QString metricsEndpoint();
+    static void setMetricsEndpoint(const QString &);
+
+    static int stallThreshold();
+    static void setStallThreshold(int);
+
+    static QString instanceId();
+
+    static int workerCount();
+    static void setWorkerCount(int);
+    static int workerIndex();
+    static qintptr createReusePortListener(quint16);
+
+    static QList<int> allowedCpus();
+    static bool setCurrentThreadAffinity(const QList<int> &);
+
+    static int effectiveCpuCount();
+    static qint64 memoryBudget();
+
+    static void markStartupPhase(const QString &);
+    static QString startupReport();
+
+    static bool installEpollEventDispatcher();
+    static QAbstractEventDispatcher * createEpollEventDispatcher();
+
+    static int executorThreadCount();
+    static void setExecutorThreadCount(int);
+
+    static void registerDescriptor(const QString &, qintptr);
+    static void unregisterDescriptor(const QString &);
+    static qintptr inheritedDescriptor(const QString &);
+    static QStringList inheritedDescriptorNames();
+
 Q_SIGNALS:
     void daemonized(const QStringList &);
+    void standby();
 
     void started();
     void stopped();
     void installed();
     void uninstalled();
 
+    void reloadRequested();
+    void logReopenRequested();
+    void dumpRequested();
+    void upgraded();
+
 private:
     QDaemonApplicationPrivate * d_ptr;
 };
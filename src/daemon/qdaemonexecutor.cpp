@@ -0,0 +1,130 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include "qdaemonexecutor.h"
+#include "private/qdaemonexecutor_p.h"
+
+QT_BEGIN_NAMESPACE
+
+/*!
+    \class QDaemonExecutor
+    \inmodule QtDaemon
+
+    \brief The \l{QDaemonExecutor} class provides a work-stealing thread pool owned by the daemon application.
+
+    The executor is started right before the QDaemonApplication::daemonized() signal is delivered to the
+    application and stopped when the application quits, after the slots connected to
+    \l{QCoreApplication::}{aboutToQuit()} have run. Stopping drains the queued tasks, so all the tasks
+    posted before the application quit are run.
+
+    Each thread has its own task queue. Tasks posted from within a task go to the queue of the
+    running thread and are taken from it in reverse order, while idle threads steal the oldest tasks
+    from the queues of the busy ones. The number of threads is given by QDaemonApplication::executorThreadCount,
+    and by default matches QDaemonApplication::effectiveCpuCount().
+
+    The utilization is published through QDaemonMetrics as the \c qtdaemon_executor_busy_microseconds_total,
+    \c qtdaemon_executor_tasks_total and \c qtdaemon_executor_steals_total counters, and the
+    \c qtdaemon_executor_threads and \c qtdaemon_executor_queued_tasks gauges.
+
+    \threadsafe
+    \sa qDaemonExecutor()
+*/
+
+/*!
+    \fn template <typename Function> QFuture<typename std::result_of<Function()>::type> QDaemonExecutor::run(Function function)
+
+    Runs \a function in the executor and returns a QFuture for its result. If the executor isn't running
+    the function is not run and the returned future is canceled.
+
+    \sa post()
+*/
+
+/*!
+    \internal
+*/
+QDaemonExecutor::QDaemonExecutor(QDaemonExecutorPrivate & d)
+    : d_ptr(&d)
+{
+    Q_ASSERT(!QDaemonExecutorPrivate::instance);
+    QDaemonExecutorPrivate::instance = this;
+}
+
+/*!
+    \internal
+*/
+QDaemonExecutor::~QDaemonExecutor()
+{
+    QDaemonExecutorPrivate::instance = Q_NULLPTR;
+    delete d_ptr;
+}
+
+/*!
+    Returns \c true if the executor is accepting tasks.
+*/
+bool QDaemonExecutor::isRunning() const
+{
+    QMutexLocker lock(&d_ptr->idleMutex);
+    Q_UNUSED(lock);
+
+    return d_ptr->running && !d_ptr->stopping;
+}
+
+/*!
+    Returns the number of threads of the executor, or \c 0 if it isn't running.
+*/
+int QDaemonExecutor::threadCount() const
+{
+    QMutexLocker lock(&d_ptr->idleMutex);
+    Q_UNUSED(lock);
+
+    return d_ptr->workers.size();
+}
+
+/*!
+    Queues \a task to be run in the executor. Returns \c false if the executor isn't running, in which
+    case the task is discarded.
+
+    \sa run()
+*/
+bool QDaemonExecutor::post(const std::function<void ()> & task)
+{
+    return d_ptr->post(task);
+}
+
+/*!
+    \relates QDaemonExecutor
+
+    Returns the executor of the daemon application.
+*/
+QDaemonExecutor & qDaemonExecutor()
+{
+    Q_ASSERT(QDaemonExecutorPrivate::instance);
+    return *QDaemonExecutorPrivate::instance;
+}
+
+QT_END_NAMESPACE
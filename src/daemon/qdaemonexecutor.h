@@ -0,0 +1,117 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#ifndef QDAEMONEXECUTOR_H
+#define QDAEMONEXECUTOR_H
+
+#include "QtDaemon/qdaemon-global.h"
+
+#include <QtCore/qfuture.h>
+#include <QtCore/qfutureinterface.h>
+
+#include <functional>
+#include <type_traits>
+
+QT_BEGIN_NAMESPACE
+
+namespace QtDaemon
+{
+    template <typename Result>
+    struct QDaemonExecutorTask
+    {
+        template <typename Function>
+        static void run(QFutureInterface<Result> & future, Function & function)
+        {
+            future.reportResult(function());
+            future.reportFinished();
+        }
+    };
+
+    template <>
+    struct QDaemonExecutorTask<void>
+    {
+        template <typename Function>
+        static void run(QFutureInterface<void> & future, Function & function)
+        {
+            function();
+            future.reportFinished();
+        }
+    };
+}
+
+class QDaemonExecutorPrivate;
+class Q_DAEMON_EXPORT QDaemonExecutor
+{
+    Q_DISABLE_COPY(QDaemonExecutor)
+
+public:
+    QDaemonExecutor(QDaemonExecutorPrivate &);
+    ~QDaemonExecutor();
+
+    bool isRunning() const;
+    int threadCount() const;
+
+    bool post(const std::function<void ()> & task);
+
+    template <typename Function>
+    QFuture<typename std::result_of<Function()>::type> run(Function function);
+
+    friend Q_DAEMON_EXPORT QDaemonExecutor & qDaemonExecutor();
+
+private:
+    friend class QDaemonApplicationPrivate;
+    friend class QDaemonExecutorPrivate;
+    QDaemonExecutorPrivate * d_ptr;
+};
+
+template <typename Function>
+QFuture<typename std::result_of<Function()>::type> QDaemonExecutor::run(Function function)
+{
+    typedef typename std::result_of<Function()>::type Result;
+
+    QFutureInterface<Result> future;
+    future.reportStarted();
+
+    if (!post([future, function] () mutable -> void  {
+        QtDaemon::QDaemonExecutorTask<Result>::run(future, function);
+    }))  {
+        // The executor isn't running, don't leave the future hanging
+        future.reportCanceled();
+        future.reportFinished();
+    }
+
+    return future.future();
+}
+
+// --- Friend declarations ---------------------------------------------------------------------------------------------- //
+Q_DAEMON_EXPORT QDaemonExecutor & qDaemonExecutor();
+// ---------------------------------------------------------------------------------------------------------------------- //
+
+QT_END_NAMESPACE
+
+#endif // QDAEMONEXECUTOR_H
@@ -0,0 +1,230 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include "qdaemonioring.h"
+#include "private/qdaemonioring_p.h"
+
+#include <QtCore/qthreadstorage.h>
+#include <QtCore/qatomic.h>
+
+#include <limits.h>
+
+QT_BEGIN_NAMESPACE
+
+static const unsigned ringSize = 256;
+
+static QThreadStorage<QDaemonIoRing *> threadRings;
+static QBasicAtomicInt ringSupport = Q_BASIC_ATOMIC_INITIALIZER(-1);
+
+/*!
+    \class QDaemonIoRing
+    \inmodule QtDaemon
+
+    \brief The \l{QDaemonIoRing} class provides asynchronous file and socket I/O for daemon applications.
+
+    The operations are queued on the ring and submitted together once control returns to the event loop
+    (or when submit() is called), so a burst of reads and writes costs a single system call. On Linux
+    kernels that support it, the ring is backed by \c io_uring and the completions are delivered by the
+    event loop of the thread the ring lives in. Otherwise the ring falls back to performing the
+    operations with the regular system calls at submission time, waiting in the event loop for
+    non-blocking descriptors to become ready, and delivers the completions the same way.
+
+    The completion handlers receive the result of the operation: the number of bytes transferred,
+    the accepted descriptor or \c 0 for fsync(), and a negated \c errno value on failure.
+    The data passed to the ring is kept alive until the operation completes.
+
+    Each thread gets its own ring through instance(). A ring is not thread-safe and should be used
+    only from the thread it lives in.
+
+    \note Supported on Linux only.
+    \sa isAsynchronous()
+*/
+
+/*!
+    \typedef QDaemonIoRing::Completion
+
+    The handler invoked with the result of a write, vectored write, sync or accept operation.
+*/
+
+/*!
+    \typedef QDaemonIoRing::ReadCompletion
+
+    The handler invoked with the result of a read operation and the data that was read.
+*/
+
+/*!
+    Constructs a ring with the given \a parent, backed by \c io_uring when the kernel supports it.
+*/
+QDaemonIoRing::QDaemonIoRing(QObject * parent)
+    : QObject(parent), d_ptr(new QDaemonIoRingPrivate(this))
+{
+    d_ptr->setup(ringSize);
+}
+
+/*!
+    Destroys the ring. The pending operations are canceled without invoking their completion handlers.
+*/
+QDaemonIoRing::~QDaemonIoRing()
+{
+    delete d_ptr;
+}
+
+/*!
+    Returns the ring of the calling thread, creating it if needed. The ring is destroyed when the thread finishes.
+*/
+QDaemonIoRing * QDaemonIoRing::instance()
+{
+    if (!threadRings.hasLocalData())
+        threadRings.setLocalData(new QDaemonIoRing);
+
+    return threadRings.localData();
+}
+
+/*!
+    Returns \c true if the kernel supports all the \c io_uring operations the ring needs.
+*/
+bool QDaemonIoRing::isSupported()
+{
+    int supported = ringSupport.load();
+    if (supported < 0)  {
+        supported = QDaemonIoRingPrivate::detect() ? 1 : 0;
+        ringSupport.store(supported);
+    }
+
+    return supported;
+}
+
+/*!
+    Returns \c true if the ring is backed by \c io_uring, or \c false if it uses the synchronous fallback.
+*/
+bool QDaemonIoRing::isAsynchronous() const
+{
+    Q_D(const QDaemonIoRing);
+    return d->ringDescriptor >= 0;
+}
+
+/*!
+    Returns the number of operations that haven't completed yet.
+*/
+int QDaemonIoRing::pendingCount() const
+{
+    Q_D(const QDaemonIoRing);
+    return d->pending.size() + d->deferred.size() + d->blocked.size();
+}
+
+/*!
+    Reads up to \a size bytes from \a descriptor at \a offset, or at the current position if \a offset is \c -1,
+    and invokes \a completion with the result.
+*/
+void QDaemonIoRing::read(int descriptor, qint64 size, qint64 offset, const ReadCompletion & completion)
+{
+    Q_D(QDaemonIoRing);
+
+    QDaemonIoRingOperation * operation = new QDaemonIoRingOperation(QDaemonIoRingOperation::Read, descriptor, offset);
+    operation->buffer.resize(int(qBound<qint64>(0, size, INT_MAX)));
+    operation->readCompletion = completion;
+
+    d->enqueue(operation);
+}
+
+/*!
+    Writes \a data to \a descriptor at \a offset, or at the current position if \a offset is \c -1,
+    and invokes \a completion with the result. Fewer bytes than requested may be written.
+*/
+void QDaemonIoRing::write(int descriptor, const QByteArray & data, qint64 offset, const Completion & completion)
+{
+    Q_D(QDaemonIoRing);
+
+    QDaemonIoRingOperation * operation = new QDaemonIoRingOperation(QDaemonIoRingOperation::Write, descriptor, offset);
+    operation->buffer = data;
+    operation->completion = completion;
+
+    d->enqueue(operation);
+}
+
+/*!
+    Writes the buffers in \a data to \a descriptor with a single gathering write at \a offset,
+    or at the current position if \a offset is \c -1, and invokes \a completion with the result.
+*/
+void QDaemonIoRing::writev(int descriptor, const QByteArrayList & data, qint64 offset, const Completion & completion)
+{
+    Q_D(QDaemonIoRing);
+
+    QDaemonIoRingOperation * operation = new QDaemonIoRingOperation(QDaemonIoRingOperation::WriteVector, descriptor, offset);
+    operation->buffers = data;
+    operation->completion = completion;
+
+    operation->vectors.resize(data.size());
+    for (int i = 0, size = data.size(); i < size; i++)  {
+        const QByteArray & buffer = operation->buffers.at(i);
+        operation->vectors[i].iov_base = const_cast<char *>(buffer.constData());
+        operation->vectors[i].iov_len = size_t(buffer.size());
+    }
+
+    d->enqueue(operation);
+}
+
+/*!
+    Flushes the data of \a descriptor to the storage device and invokes \a completion with the result.
+    If \a dataOnly is \c true, the metadata not needed to read the data back isn't flushed (as with \c fdatasync()).
+*/
+void QDaemonIoRing::fsync(int descriptor, bool dataOnly, const Completion & completion)
+{
+    Q_D(QDaemonIoRing);
+
+    QDaemonIoRingOperation * operation = new QDaemonIoRingOperation(QDaemonIoRingOperation::Sync, descriptor, 0);
+    operation->dataOnly = dataOnly;
+    operation->completion = completion;
+
+    d->enqueue(operation);
+}
+
+/*!
+    Accepts a connection on the listening socket \a descriptor and invokes \a completion with the
+    descriptor of the connected socket, which is non-blocking and closed on \c exec().
+*/
+void QDaemonIoRing::accept(int descriptor, const Completion & completion)
+{
+    Q_D(QDaemonIoRing);
+
+    QDaemonIoRingOperation * operation = new QDaemonIoRingOperation(QDaemonIoRingOperation::Accept, descriptor, 0);
+    operation->completion = completion;
+
+    d->enqueue(operation);
+}
+
+/*!
+    Submits the queued operations immediately instead of waiting for control to return to the event loop.
+*/
+void QDaemonIoRing::submit()
+{
+    Q_D(QDaemonIoRing);
+    d->submit();
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,77 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#ifndef QDAEMONIORING_H
+#define QDAEMONIORING_H
+
+#include "QtDaemon/qdaemon-global.h"
+
+#include <QtCore/qobject.h>
+#include <QtCore/qbytearray.h>
+#include <QtCore/qbytearraylist.h>
+
+#include <functional>
+
+QT_BEGIN_NAMESPACE
+
+class QDaemonIoRingPrivate;
+class Q_DAEMON_EXPORT QDaemonIoRing : public QObject
+{
+    Q_OBJECT
+    Q_DECLARE_PRIVATE(QDaemonIoRing)
+    Q_DISABLE_COPY(QDaemonIoRing)
+
+public:
+    typedef std::function<void (qint64)> Completion;
+    typedef std::function<void (qint64, const QByteArray &)> ReadCompletion;
+
+    explicit QDaemonIoRing(QObject * parent = Q_NULLPTR);
+    ~QDaemonIoRing() Q_DECL_OVERRIDE;
+
+    static QDaemonIoRing * instance();
+    static bool isSupported();
+
+    bool isAsynchronous() const;
+    int pendingCount() const;
+
+    void read(int descriptor, qint64 size, qint64 offset, const ReadCompletion & completion);
+    void write(int descriptor, const QByteArray & data, qint64 offset, const Completion & completion);
+    void writev(int descriptor, const QByteArrayList & data, qint64 offset, const Completion & completion);
+    void fsync(int descriptor, bool dataOnly, const Completion & completion);
+    void accept(int descriptor, const Completion & completion);
+
+public Q_SLOTS:
+    void submit();
+
+private:
+    QDaemonIoRingPrivate * d_ptr;
+};
+
+QT_END_NAMESPACE
+
+#endif // QDAEMONIORING_H
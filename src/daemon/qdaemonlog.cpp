@@ -31,6 +31,12 @@
 
 #include <QtCore/QMutexLocker>
 
+#ifdef Q_OS_LINUX
+#include "private/qdaemonlogwriter_p.h"
+
+using namespace QtDaemon;
+#endif
+
 QT_BEGIN_NAMESPACE
 
 /*!
@@ -101,6 +107,8 @@ void QDaemonLog::setLogType(LogType type)
     if (type == d_ptr->logType)
         return;
 
+    d_ptr->drainWriter();
+
     bool failed = false;
     switch (type)
     {
@@ -110,6 +118,7 @@ void QDaemonLog::setLogType(LogType type)
         // Try opening the file
         if (d_ptr->logFile.open(QFile::WriteOnly | QFile::Text | QFile::Append))  {
             d_ptr->logType = LogToFile;
+            d_ptr->updateWriter();
             break;
         }
 
@@ -124,6 +133,7 @@ void QDaemonLog::setLogType(LogType type)
         }
 
         d_ptr->logType = LogToStdout;
+        d_ptr->updateWriter();
         if (failed)  // Report that a file couldn't be opened
             d_ptr->write(QStringLiteral("The log file %1 couldn't be opened for writing! Switched to stdout.").arg(d_ptr->logFilePath), WarningEntry);
     }
@@ -142,6 +152,90 @@ QDaemonLog::LogType QDaemonLog::logType() const
     return d_ptr->logType;
 }
 
+/*!
+    Reopens the log file. This allows the log to be rotated by external tools, which move the
+    file away and then ask the daemon to reopen it (by sending \c SIGUSR1 on Linux).
+
+    The function has no effect when the log type is QDaemonLog::LogToStdout.
+
+    \sa setLogType()
+*/
+void QDaemonLog::reopen()
+{
+    QMutexLocker lock(&d_ptr->streamMutex);	// The MS compiler doesn't get anonymous objects (error C2530: references must be initialized)
+    Q_UNUSED(lock);							// Suppress warning for unused variable
+
+    if (d_ptr->logType != LogToFile)
+        return;
+
+    d_ptr->drainWriter();
+    d_ptr->logStream.flush();
+    d_ptr->logFile.close();
+    if (d_ptr->logFile.open(QFile::WriteOnly | QFile::Text | QFile::Append))  {
+        d_ptr->updateWriter();
+        return;
+    }
+
+    // File couldn't be reopened. Try to fall back to the standard output
+    if (Q_UNLIKELY(!d_ptr->logFile.open(stdout, QFile::WriteOnly | QFile::Text)))  {
+        qWarning("Error while trying to open the standard output. Giving up!");
+        return;
+    }
+
+    d_ptr->logType = LogToStdout;
+    d_ptr->updateWriter();
+    d_ptr->write(QStringLiteral("The log file %1 couldn't be reopened for writing! Switched to stdout.").arg(d_ptr->logFilePath), WarningEntry);
+}
+
+/*!
+    Sets whether the entries are written asynchronously to \a enabled.
+
+    When enabled, the entries are queued and a background thread writes them in batches through
+    QDaemonIoRing (backed by \c io_uring when the kernel supports it), so logging doesn't block on
+    the file system. The queue holds up to 8192 entries, fewer when the daemon's memory is limited
+    (see QDaemonApplication::memoryBudget()), after which logging blocks until the writer catches up. Disabling asynchronous writing waits for the queued entries to be written.
+    The number of queued entries is published as the \c qtdaemon_log_queued_entries gauge.
+
+    By default the entries are written synchronously.
+
+    \note Supported on Linux only.
+    \sa isAsynchronous()
+*/
+void QDaemonLog::setAsynchronous(bool enabled)
+{
+    QMutexLocker lock(&d_ptr->streamMutex);	// The MS compiler doesn't get anonymous objects (error C2530: references must be initialized)
+    Q_UNUSED(lock);							// Suppress warning for unused variable
+
+#ifdef Q_OS_LINUX
+    if (enabled == (d_ptr->writer != Q_NULLPTR))
+        return;
+
+    if (enabled)  {
+        d_ptr->logStream.flush();
+        d_ptr->writer = new QDaemonLogWriter(d_ptr->logFile.handle(), QDaemonLogPrivate::queueLimit());
+    }
+    else  {
+        delete d_ptr->writer;
+        d_ptr->writer = Q_NULLPTR;
+    }
+#else
+    Q_UNUSED(enabled);
+#endif
+}
+
+/*!
+    Returns \c true if the entries are written asynchronously.
+
+    \sa setAsynchronous()
+*/
+bool QDaemonLog::isAsynchronous() const
+{
+    QMutexLocker lock(&d_ptr->streamMutex);	// The MS compiler doesn't get anonymous objects (error C2530: references must be initialized)
+    Q_UNUSED(lock);							// Suppress warning for unused variable
+
+    return d_ptr->writer != Q_NULLPTR;
+}
+
 /*!
     Writes the message specified by \a message to the log.
 
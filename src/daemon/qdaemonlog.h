@@ -48,10 +48,16 @@ public:
     void setLogType(LogType type);
     LogType logType() const;
 
+    void reopen();
+
+    void setAsynchronous(bool enabled);
+    bool isAsynchronous() const;
+
     QDaemonLog & operator << (const QString & message);
 
     friend Q_DAEMON_EXPORT QDaemonLog & qDaemonLog();
     friend Q_DAEMON_EXPORT void qDaemonLog(const QString & message, QDaemonLog::EntrySeverity severity);
+    friend class QDaemonApplicationPrivate;
 
 private:
     QDaemonLogPrivate * d_ptr;
@@ -0,0 +1,336 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include "qdaemonmetrics.h"
+#include "private/qdaemonmetrics_p.h"
+
+#include <QtCore/QMutexLocker>
+
+QT_BEGIN_NAMESPACE
+
+/*!
+    \class QDaemonMetrics
+    \inmodule QtDaemon
+
+    \brief The \l{QDaemonMetrics} class provides a registry of runtime statistics
+    for daemon applications.
+
+    Metrics are registered by name and are never removed for the lifetime of the
+    application object, so the returned handles can be stored and used freely.
+    Requesting a metric that is already registered returns a handle to the existing one.
+
+    The snapshot of all the registered metrics can be retrieved with the \c --stats switch of
+    the controlling application.
+
+    \threadsafe
+    \sa qDaemonMetrics()
+*/
+
+/*!
+    \class QDaemonCounter
+    \inmodule QtDaemon
+
+    \brief The \l{QDaemonCounter} class is a handle to a monotonically increasing counter.
+
+    The counter is sharded per thread, so incrementing it from multiple threads does not
+    contend for a single memory location.
+
+    \threadsafe
+    \sa QDaemonMetrics::counter()
+*/
+
+/*!
+    \class QDaemonGauge
+    \inmodule QtDaemon
+
+    \brief The \l{QDaemonGauge} class is a handle to a value that can go up and down.
+
+    \threadsafe
+    \sa QDaemonMetrics::gauge()
+*/
+
+/*!
+    \class QDaemonHistogram
+    \inmodule QtDaemon
+
+    \brief The \l{QDaemonHistogram} class is a handle to a log-linear histogram,
+    suitable for recording latencies.
+
+    Each power of two is split into 16 linear buckets, which bounds the relative error
+    of the reported percentiles to about 6%.
+
+    \threadsafe
+    \sa QDaemonMetrics::histogram()
+*/
+
+/*!
+    \internal
+*/
+QDaemonMetrics::QDaemonMetrics(QDaemonMetricsPrivate & d)
+    : d_ptr(&d)
+{
+    Q_ASSERT(!QDaemonMetricsPrivate::registry);
+    QDaemonMetricsPrivate::registry = this;
+}
+
+/*!
+    \internal
+*/
+QDaemonMetrics::~QDaemonMetrics()
+{
+    QDaemonMetricsPrivate::registry = Q_NULLPTR;
+    delete d_ptr;
+}
+
+/*!
+    Registers (if needed) and returns the counter named \a name. The \a description is
+    used only when the counter is registered for the first time.
+
+    A null handle is returned if a metric of a different type is already registered with that name.
+*/
+QDaemonCounter QDaemonMetrics::counter(const QString & name, const QString & description)
+{
+    return QDaemonCounter(static_cast<QDaemonCounterPrivate *>(d_ptr->metric(QDaemonMetricPrivate::CounterType, name, description)));
+}
+
+/*!
+    Registers (if needed) and returns the gauge named \a name. The \a description is
+    used only when the gauge is registered for the first time.
+
+    A null handle is returned if a metric of a different type is already registered with that name.
+*/
+QDaemonGauge QDaemonMetrics::gauge(const QString & name, const QString & description)
+{
+    return QDaemonGauge(static_cast<QDaemonGaugePrivate *>(d_ptr->metric(QDaemonMetricPrivate::GaugeType, name, description)));
+}
+
+/*!
+    Registers (if needed) and returns the histogram named \a name. The \a description is
+    used only when the histogram is registered for the first time.
+
+    A null handle is returned if a metric of a different type is already registered with that name.
+*/
+QDaemonHistogram QDaemonMetrics::histogram(const QString & name, const QString & description)
+{
+    return QDaemonHistogram(static_cast<QDaemonHistogramPrivate *>(d_ptr->metric(QDaemonMetricPrivate::HistogramType, name, description)));
+}
+
+/*!
+    Returns the names of the registered metrics in the order of their registration.
+*/
+QStringList QDaemonMetrics::names() const
+{
+    QMutexLocker lock(&d_ptr->mutex);
+    Q_UNUSED(lock);
+
+    QStringList names;
+    names.reserve(d_ptr->metrics.size());
+    for (const QDaemonMetricPrivate * metric : d_ptr->metrics)
+        names.append(metric->name);
+
+    return names;
+}
+
+/*!
+    Returns a human-readable snapshot of all the registered metrics, one metric per line.
+*/
+QString QDaemonMetrics::toString() const
+{
+    QMutexLocker lock(&d_ptr->mutex);
+    Q_UNUSED(lock);
+
+    QStringList lines;
+    lines.reserve(d_ptr->metrics.size());
+    for (const QDaemonMetricPrivate * metric : d_ptr->metrics)
+        lines.append(QStringLiteral("%1 %2").arg(metric->name, QDaemonMetricsPrivate::formatValue(metric)));
+
+    return lines.join(QLatin1Char('\n'));
+}
+
+/*!
+    \relates QDaemonMetrics
+
+    Retrieves the metrics registry instance.
+
+    \warning The registry can be retrieved only after the QDaemonApplication instance has been created.
+*/
+QDaemonMetrics & qDaemonMetrics()
+{
+    Q_ASSERT(QDaemonMetricsPrivate::registry);
+    return *QDaemonMetricsPrivate::registry;
+}
+
+/*!
+    Constructs a null counter handle.
+*/
+QDaemonCounter::QDaemonCounter()
+    : d(Q_NULLPTR)
+{
+}
+
+/*!
+    \internal
+*/
+QDaemonCounter::QDaemonCounter(QDaemonCounterPrivate * counter)
+    : d(counter)
+{
+}
+
+/*!
+    Returns \c true if the handle doesn't refer to a registered counter.
+*/
+bool QDaemonCounter::isNull() const
+{
+    return !d;
+}
+
+/*!
+    Increments the counter by \a value.
+*/
+void QDaemonCounter::add(quint64 value)
+{
+    if (Q_LIKELY(d))
+        d->counter.add(value);
+}
+
+/*!
+    Returns the current value of the counter.
+*/
+quint64 QDaemonCounter::value() const
+{
+    return d ? d->counter.value() : 0;
+}
+
+/*!
+    Constructs a null gauge handle.
+*/
+QDaemonGauge::QDaemonGauge()
+    : d(Q_NULLPTR)
+{
+}
+
+/*!
+    \internal
+*/
+QDaemonGauge::QDaemonGauge(QDaemonGaugePrivate * gauge)
+    : d(gauge)
+{
+}
+
+/*!
+    Returns \c true if the handle doesn't refer to a registered gauge.
+*/
+bool QDaemonGauge::isNull() const
+{
+    return !d;
+}
+
+/*!
+    Sets the gauge to \a value.
+*/
+void QDaemonGauge::set(qint64 value)
+{
+    if (Q_LIKELY(d))
+        d->gauge.storeRelease(value);
+}
+
+/*!
+    Adds \a value (which may be negative) to the gauge.
+*/
+void QDaemonGauge::add(qint64 value)
+{
+    if (Q_LIKELY(d))
+        d->gauge.fetchAndAddRelaxed(value);
+}
+
+/*!
+    Returns the current value of the gauge.
+*/
+qint64 QDaemonGauge::value() const
+{
+    return d ? d->gauge.loadAcquire() : 0;
+}
+
+/*!
+    Constructs a null histogram handle.
+*/
+QDaemonHistogram::QDaemonHistogram()
+    : d(Q_NULLPTR)
+{
+}
+
+/*!
+    \internal
+*/
+QDaemonHistogram::QDaemonHistogram(QDaemonHistogramPrivate * histogram)
+    : d(histogram)
+{
+}
+
+/*!
+    Returns \c true if the handle doesn't refer to a registered histogram.
+*/
+bool QDaemonHistogram::isNull() const
+{
+    return !d;
+}
+
+/*!
+    Records a sample with the given \a value.
+*/
+void QDaemonHistogram::record(quint64 value)
+{
+    if (Q_LIKELY(d))
+        d->record(value);
+}
+
+/*!
+    Returns the number of recorded samples.
+*/
+quint64 QDaemonHistogram::count() const
+{
+    return d ? d->count() : 0;
+}
+
+/*!
+    Returns the sum of the recorded samples.
+*/
+quint64 QDaemonHistogram::sum() const
+{
+    return d ? d->sum.value() : 0;
+}
+
+/*!
+    Returns the (upper bound of the) value below which \a percent percent of the samples fall.
+*/
+quint64 QDaemonHistogram::percentile(double percent) const
+{
+    return d ? d->percentile(percent) : 0;
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,126 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#ifndef QDAEMONMETRICS_H
+#define QDAEMONMETRICS_H
+
+#include "QtDaemon/qdaemon-global.h"
+
+#include <QtCore/qstring.h>
+#include <QtCore/qstringlist.h>
+
+QT_BEGIN_NAMESPACE
+
+class QDaemonCounterPrivate;
+class Q_DAEMON_EXPORT QDaemonCounter
+{
+public:
+    QDaemonCounter();
+
+    bool isNull() const;
+
+    void add(quint64 value = 1);
+    quint64 value() const;
+
+private:
+    friend class QDaemonMetrics;
+    explicit QDaemonCounter(QDaemonCounterPrivate *);
+
+    QDaemonCounterPrivate * d;
+};
+
+class QDaemonGaugePrivate;
+class Q_DAEMON_EXPORT QDaemonGauge
+{
+public:
+    QDaemonGauge();
+
+    bool isNull() const;
+
+    void set(qint64 value);
+    void add(qint64 value);
+    qint64 value() const;
+
+private:
+    friend class QDaemonMetrics;
+    explicit QDaemonGauge(QDaemonGaugePrivate *);
+
+    QDaemonGaugePrivate * d;
+};
+
+class QDaemonHistogramPrivate;
+class Q_DAEMON_EXPORT QDaemonHistogram
+{
+public:
+    QDaemonHistogram();
+
+    bool isNull() const;
+
+    void record(quint64 value);
+
+    quint64 count() const;
+    quint64 sum() const;
+    quint64 percentile(double percent) const;
+
+private:
+    friend class QDaemonMetrics;
+    explicit QDaemonHistogram(QDaemonHistogramPrivate *);
+
+    QDaemonHistogramPrivate * d;
+};
+
+class QDaemonMetricsPrivate;
+class Q_DAEMON_EXPORT QDaemonMetrics
+{
+    Q_DISABLE_COPY(QDaemonMetrics)
+
+public:
+    QDaemonMetrics(QDaemonMetricsPrivate &);
+    ~QDaemonMetrics();
+
+    QDaemonCounter counter(const QString & name, const QString & description = QString());
+    QDaemonGauge gauge(const QString & name, const QString & description = QString());
+    QDaemonHistogram histogram(const QString & name, const QString & description = QString());
+
+    QStringList names() const;
+    QString toString() const;
+
+    friend Q_DAEMON_EXPORT QDaemonMetrics & qDaemonMetrics();
+
+private:
+    friend class QDaemonMetricsPrivate;
+    QDaemonMetricsPrivate * d_ptr;
+};
+
+// --- Friend declarations ---------------------------------------------------------------------------------------------- //
+Q_DAEMON_EXPORT QDaemonMetrics & qDaemonMetrics();
+// ---------------------------------------------------------------------------------------------------------------------- //
+
+QT_END_NAMESPACE
+
+#endif // QDAEMONMETRICS_H
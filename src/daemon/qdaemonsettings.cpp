@@ -0,0 +1,133 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include "qdaemonsettings.h"
+#include "qdaemonapplication.h"
+#include "private/qdaemonsettings_p.h"
+
+QT_BEGIN_NAMESPACE
+
+/*!
+    \class QDaemonSettings
+    \inmodule QtDaemon
+
+    \brief The \l{QDaemonSettings} class provides a configuration that can be reloaded
+    while the daemon is running.
+
+    The configuration file (in the INI format) is loaded into an immutable snapshot.
+    Reading the configuration from any thread only picks up the current snapshot, without
+    taking locks. When a reload is requested, a new snapshot is parsed in a background
+    thread and then atomically published. Readers that are still using the previous
+    snapshot are not affected, and the old snapshot is reclaimed once they're done with it.
+
+    The configuration is reloaded when the daemon receives \c SIGHUP or when the controlling
+    application is run with the \c --reload switch. If the new configuration can't be loaded
+    the current one is kept.
+
+    \threadsafe
+    \sa QDaemonApplication::reloadRequested()
+*/
+
+/*!
+    \fn void QDaemonSettings::configurationChanged()
+
+    This signal is emitted after a reloaded configuration has been published.
+*/
+
+/*!
+    Constructs the settings object and loads the configuration file \a fileName.
+    The \a parent is passed to the QObject constructor.
+
+    If the QDaemonApplication instance exists, the configuration is reloaded
+    whenever it emits \l{QDaemonApplication::}{reloadRequested()}.
+
+    \warning The settings object can be created only after the QDaemonApplication instance has been created.
+*/
+QDaemonSettings::QDaemonSettings(const QString & fileName, QObject * parent)
+    : QObject(parent), d_ptr(new QDaemonSettingsPrivate(this, fileName))
+{
+    QDaemonApplication * app = QDaemonApplication::instance();
+    if (app)
+        QObject::connect(app, &QDaemonApplication::reloadRequested, this, &QDaemonSettings::reload);
+}
+
+/*!
+    Destroys the settings object. Waits for a pending reload to finish.
+*/
+QDaemonSettings::~QDaemonSettings()
+{
+    delete d_ptr;
+}
+
+/*!
+    Returns the path to the configuration file.
+*/
+QString QDaemonSettings::fileName() const
+{
+    Q_D(const QDaemonSettings);
+    return d->fileName;
+}
+
+/*!
+    Returns all the configuration values of the current snapshot.
+
+    The returned map is not affected by subsequent reloads.
+*/
+QVariantMap QDaemonSettings::snapshot() const
+{
+    Q_D(const QDaemonSettings);
+    return d->read();
+}
+
+/*!
+    Returns the value of the configuration key \a key from the current snapshot,
+    or \a defaultValue if there's no such key.
+
+    \note Reading multiple related keys should be done through snapshot(), as a reload
+    may be published between two calls to this function.
+*/
+QVariant QDaemonSettings::value(const QString & key, const QVariant & defaultValue) const
+{
+    Q_D(const QDaemonSettings);
+    return d->read().value(key, defaultValue);
+}
+
+/*!
+    Reloads the configuration file in a background thread. The configurationChanged() signal
+    is emitted when the new configuration has been published.
+
+    Requests made while a reload is in progress are coalesced.
+*/
+void QDaemonSettings::reload()
+{
+    Q_D(QDaemonSettings);
+    if (d->reloadRequests.fetchAndAddOrdered(1) == 0)
+        d->loader.start(new QDaemonSettingsLoader(d));
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,262 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include "qdaemonstats.h"
+#include "private/qdaemonstats_p.h"
+
+#if defined(Q_OS_LINUX)
+#include "private/daemonbackend_linux.h"
+
+#include <QtCore/qfile.h>
+
+#include <atomic>
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+QT_BEGIN_NAMESPACE
+
+/*!
+    \class QDaemonStatsBlock
+    \inmodule QtDaemon
+
+    \brief The \l{QDaemonStatsBlock} structure is the layout of the statistics a daemon publishes in shared memory.
+
+    Each running daemon (the process that owns the daemon's D-Bus service) publishes its state in a shared memory
+    segment, \c{/dev/shm/qtdaemon.<service name>}, and updates it once a second. The segment is published once the
+    service is registered, so \c RunningState means the daemon can be controlled, and only one process publishes
+    it at a time: the owner holds an exclusive \c flock() on it, which a daemon that dies releases. Reading the block doesn't involve
+    the daemon at all: once the segment is mapped, a snapshot is a plain memory copy, so a dashboard can poll dozens
+    of daemons without a single system call. Use QDaemonStatsReader, or map the segment directly; the structure
+    consists of plain integers and characters only, so it can be mirrored in any language.
+
+    The block is protected by a sequence lock. The daemon increments \c sequence before and after each update, so
+    it's odd while an update is in progress. A consistent snapshot is taken by reading \c sequence (with acquire
+    semantics), copying the block, and reading \c sequence again; the copy is valid if both values are equal and even.
+
+    \list
+        \li \c magic and \c version identify the layout: \c Magic and \c Version. The layout only grows at its end,
+            with the version incremented, and \c size holds the size of the whole block.
+        \li \c pid is the process id of the daemon, \c startTime the time it was started and \c updateTime the time
+            of the latest update, in milliseconds since the epoch. An \c updateTime lagging behind indicates the
+            daemon's event loop is blocked.
+        \li \c state is one of \c StartingState, \c RunningState and \c StoppingState.
+        \li \c logQueueDepth is the number of log entries waiting to be written (see QDaemonLog::setAsynchronous())
+            and \c eventLoopLag the latest measured lag of the main event loop in microseconds (see
+            QDaemonApplication::stallThreshold), or \c -1 if it isn't measured.
+        \li \c counters holds the first \c counterCount metrics registered with QDaemonMetrics, with their names
+            truncated to \c{NameSize - 1} characters. Histograms are represented by their count.
+    \endlist
+
+    \note Supported on Linux only.
+    \sa QDaemonStatsReader
+*/
+
+/*!
+    \class QDaemonStatsReader
+    \inmodule QtDaemon
+
+    \brief The \l{QDaemonStatsReader} class reads the statistics a running daemon publishes in shared memory.
+
+    The reader maps the segment of a daemon instance read-only, after which read() takes consistent snapshots
+    of the daemon's QDaemonStatsBlock without any system calls and without disturbing the daemon.
+
+    \note Supported on Linux only.
+*/
+
+const int QDaemonStatsReaderPrivate::maximumReadAttempts = 1000;
+
+QDaemonStatsReaderPrivate::QDaemonStatsReaderPrivate()
+    : descriptor(-1), block(Q_NULLPTR)
+{
+}
+
+bool QDaemonStatsReaderPrivate::open(QDaemonStatsReader * q, const QString & name)
+{
+    q->close();
+
+#if defined(Q_OS_LINUX)
+    int segment = ::shm_open(QFile::encodeName(name).constData(), O_RDONLY | O_CLOEXEC, 0);
+    if (segment < 0)
+        return false;
+
+    // An older daemon may publish a shorter block, it's rejected by read()
+    struct stat status;
+    void * mapping = MAP_FAILED;
+    if (::fstat(segment, &status) == 0 && status.st_size >= qint64(sizeof(QDaemonStatsBlock)))
+        mapping = ::mmap(Q_NULLPTR, sizeof(QDaemonStatsBlock), PROT_READ, MAP_SHARED, segment, 0);
+
+    if (mapping == MAP_FAILED)  {
+        ::close(segment);
+        return false;
+    }
+
+    descriptor = segment;
+    block = static_cast<const QDaemonStatsBlock *>(mapping);
+    return true;
+#else
+    Q_UNUSED(q);
+    Q_UNUSED(name);
+    return false;
+#endif
+}
+
+/*!
+    Constructs a reader that isn't attached to any daemon.
+*/
+QDaemonStatsReader::QDaemonStatsReader()
+    : d_ptr(new QDaemonStatsReaderPrivate)
+{
+}
+
+/*!
+    Destroys the reader and unmaps the segment.
+*/
+QDaemonStatsReader::~QDaemonStatsReader()
+{
+    close();
+    delete d_ptr;
+}
+
+/*!
+    Maps the statistics segment of the daemon instance \a instance (or of the daemon itself if \a instance is empty)
+    of the running application. Returns \c true on success, or \c false if the daemon isn't publishing its statistics.
+
+    \sa segmentName()
+*/
+bool QDaemonStatsReader::open(const QString & instance)
+{
+    return d_ptr->open(this, segmentName(instance));
+}
+
+/*!
+    \overload
+
+    Maps the statistics segment of the worker \a worker of the daemon instance \a instance. When the daemon runs
+    worker processes (or a supervised process, which is worker \c 0), the segment of the daemon belongs to the
+    supervising process and each worker publishes the statistics of the application code in a segment of its own.
+
+    \sa QDaemonApplication::workerIndex()
+*/
+bool QDaemonStatsReader::open(const QString & instance, int worker)
+{
+    return d_ptr->open(this, segmentName(instance, worker));
+}
+
+/*!
+    Returns \c true if the reader has a daemon's segment mapped.
+*/
+bool QDaemonStatsReader::isOpen() const
+{
+    return d_ptr->block;
+}
+
+/*!
+    Unmaps the segment.
+*/
+void QDaemonStatsReader::close()
+{
+#if defined(Q_OS_LINUX)
+    if (d_ptr->block)
+        ::munmap(const_cast<QDaemonStatsBlock *>(d_ptr->block), sizeof(QDaemonStatsBlock));
+    if (d_ptr->descriptor >= 0)
+        ::close(d_ptr->descriptor);
+#endif
+
+    d_ptr->block = Q_NULLPTR;
+    d_ptr->descriptor = -1;
+}
+
+/*!
+    Copies a consistent snapshot of the daemon's statistics to \a block. Returns \c false if no segment is mapped,
+    the segment has an unknown layout, or the daemon kept updating it for the whole time.
+
+    The daemon's pid should be checked if the snapshot is used to tell whether the daemon is running, since
+    the segment of a daemon that was killed outlives it.
+*/
+bool QDaemonStatsReader::read(QDaemonStatsBlock & block) const
+{
+#if defined(Q_OS_LINUX)
+    const QDaemonStatsBlock * shared = d_ptr->block;
+    if (!shared)
+        return false;
+
+    for (int i = 0; i < QDaemonStatsReaderPrivate::maximumReadAttempts; i++)  {
+        quint32 before = __atomic_load_n(&shared->sequence, __ATOMIC_ACQUIRE);
+        if (before & 1)
+            continue;       // An update is in progress
+
+        ::memcpy(&block, shared, sizeof(QDaemonStatsBlock));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (__atomic_load_n(&shared->sequence, __ATOMIC_RELAXED) == before)
+            return block.magic == QDaemonStatsBlock::Magic && block.version == QDaemonStatsBlock::Version && block.size == sizeof(QDaemonStatsBlock);
+    }
+#else
+    Q_UNUSED(block);
+#endif
+
+    return false;
+}
+
+/*!
+    Returns the name of the shared memory segment of the daemon instance \a instance (or of the daemon itself
+    if \a instance is empty), as passed to \c shm_open(). The segment is found in \c{/dev/shm} under the same name.
+*/
+QString QDaemonStatsReader::segmentName(const QString & instance)
+{
+#if defined(Q_OS_LINUX)
+    return QStringLiteral("/qtdaemon.%1").arg(QtDaemon::DaemonBackendLinux::serviceName(instance));
+#else
+    Q_UNUSED(instance);
+    return QString();
+#endif
+}
+
+/*!
+    \overload
+
+    Returns the name of the shared memory segment of the worker \a worker of the daemon instance \a instance:
+    the name of the instance's segment followed by \c{.worker<index>}.
+*/
+QString QDaemonStatsReader::segmentName(const QString & instance, int worker)
+{
+#if defined(Q_OS_LINUX)
+    return segmentName(instance) + QStringLiteral(".worker%1").arg(worker);
+#else
+    Q_UNUSED(instance);
+    Q_UNUSED(worker);
+    return QString();
+#endif
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,88 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#ifndef QDAEMONSTATS_H
+#define QDAEMONSTATS_H
+
+#include "QtDaemon/qdaemon-global.h"
+
+#include <QtCore/qstring.h>
+
+QT_BEGIN_NAMESPACE
+
+struct QDaemonStatsBlock
+{
+    enum { Magic = 0x54534451, Version = 1, MaximumCounters = 64, NameSize = 64 };
+    enum State { StartingState, RunningState, StoppingState };
+
+    struct Counter
+    {
+        char name[NameSize];
+        qint64 value;
+    };
+
+    quint32 magic;
+    quint32 version;
+    quint32 size;
+    quint32 sequence;
+    qint64 pid;
+    qint64 startTime;
+    qint64 updateTime;
+    qint32 state;
+    qint32 counterCount;
+    qint64 logQueueDepth;
+    qint64 eventLoopLag;
+    Counter counters[MaximumCounters];
+};
+
+class QDaemonStatsReaderPrivate;
+class Q_DAEMON_EXPORT QDaemonStatsReader
+{
+    Q_DISABLE_COPY(QDaemonStatsReader)
+
+public:
+    QDaemonStatsReader();
+    ~QDaemonStatsReader();
+
+    bool open(const QString & instance = QString());
+    bool open(const QString & instance, int worker);
+    bool isOpen() const;
+    void close();
+
+    bool read(QDaemonStatsBlock & block) const;
+
+    static QString segmentName(const QString & instance = QString());
+    static QString segmentName(const QString & instance, int worker);
+
+private:
+    QDaemonStatsReaderPrivate * d_ptr;
+};
+
+QT_END_NAMESPACE
+
+#endif // QDAEMONSTATS_H
@@ -0,0 +1,161 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include "qdaemontimerwheel.h"
+#include "private/qdaemontimerwheel_p.h"
+
+QT_BEGIN_NAMESPACE
+
+/*!
+    \class QDaemonTimerWheel
+    \inmodule QtDaemon
+
+    \brief The \l{QDaemonTimerWheel} class provides a hierarchical timer wheel for large numbers of timeouts.
+
+    Daemons tracking per-connection idle timeouts or retry schedules often need tens of thousands of timers
+    that are mostly restarted or canceled before they expire. Instead of a QTimer per object, the timer wheel
+    keeps all of its timeouts in buckets of a single tick, so starting, restarting and canceling a timeout
+    take constant time and the event dispatcher only sees one timer.
+
+    The timeouts are rounded up to the resolution of the wheel (10 milliseconds by default), so a timeout
+    never expires early but may expire up to a tick late, and the callbacks are invoked from the event loop of the thread the wheel lives in, in no particular order
+    for timeouts expiring in the same tick. The wheel ticks only while it has active timeouts.
+
+    \code
+    QDaemonTimerWheel wheel(100);
+    QDaemonTimerWheel::TimerId id = wheel.start(30000, [socket] () -> void  {
+        socket->disconnectFromHost();
+    });
+
+    // On activity
+    wheel.restart(id, 30000);
+    \endcode
+
+    \note The wheel is not thread-safe, it should be used only from the thread it lives in.
+    \sa QTimer
+*/
+
+/*!
+    \typedef QDaemonTimerWheel::TimerId
+
+    The identifier of a timeout started in the wheel. Identifiers are not reused, so a stale one
+    is safe to cancel. The value \c 0 is never a valid identifier.
+*/
+
+/*!
+    Constructs a timer wheel with the default resolution of 10 milliseconds and the given \a parent.
+*/
+QDaemonTimerWheel::QDaemonTimerWheel(QObject * parent)
+    : QObject(parent), d_ptr(new QDaemonTimerWheelPrivate(this, 10))
+{
+}
+
+/*!
+    Constructs a timer wheel ticking each \a resolution milliseconds with the given \a parent.
+*/
+QDaemonTimerWheel::QDaemonTimerWheel(int resolution, QObject * parent)
+    : QObject(parent), d_ptr(new QDaemonTimerWheelPrivate(this, resolution))
+{
+}
+
+/*!
+    Destroys the timer wheel. The pending timeouts are discarded.
+*/
+QDaemonTimerWheel::~QDaemonTimerWheel()
+{
+    delete d_ptr;
+}
+
+/*!
+    Returns the resolution of the wheel in milliseconds.
+*/
+int QDaemonTimerWheel::resolution() const
+{
+    Q_D(const QDaemonTimerWheel);
+    return d->resolution;
+}
+
+/*!
+    Returns the number of active timeouts.
+*/
+int QDaemonTimerWheel::count() const
+{
+    Q_D(const QDaemonTimerWheel);
+    return d->active;
+}
+
+/*!
+    Returns \c true if the timeout \a id is still pending.
+*/
+bool QDaemonTimerWheel::isActive(TimerId id) const
+{
+    Q_D(const QDaemonTimerWheel);
+    return d->isActive(id);
+}
+
+/*!
+    Starts a timeout of \a msec milliseconds that invokes \a callback once it expires.
+    Returns the identifier of the timeout.
+
+    \sa restart(), cancel()
+*/
+QDaemonTimerWheel::TimerId QDaemonTimerWheel::start(int msec, const std::function<void ()> & callback)
+{
+    Q_D(QDaemonTimerWheel);
+    return d->start(msec, callback);
+}
+
+/*!
+    Restarts the timeout \a id so that it expires after \a msec milliseconds from now.
+    Returns \c false if the timeout has already expired or was canceled.
+*/
+bool QDaemonTimerWheel::restart(TimerId id, int msec)
+{
+    Q_D(QDaemonTimerWheel);
+    return d->restart(id, msec);
+}
+
+/*!
+    Cancels the timeout \a id. Returns \c false if the timeout has already expired or was canceled.
+*/
+bool QDaemonTimerWheel::cancel(TimerId id)
+{
+    Q_D(QDaemonTimerWheel);
+    return d->cancel(id);
+}
+
+/*!
+    Cancels all the pending timeouts.
+*/
+void QDaemonTimerWheel::clear()
+{
+    Q_D(QDaemonTimerWheel);
+    d->clear();
+}
+
+QT_END_NAMESPACE
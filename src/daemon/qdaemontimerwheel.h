@@ -0,0 +1,69 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#ifndef QDAEMONTIMERWHEEL_H
+#define QDAEMONTIMERWHEEL_H
+
+#include "QtDaemon/qdaemon-global.h"
+
+#include <QtCore/qobject.h>
+
+#include <functional>
+
+QT_BEGIN_NAMESPACE
+
+class QDaemonTimerWheelPrivate;
+class Q_DAEMON_EXPORT QDaemonTimerWheel : public QObject
+{
+    Q_OBJECT
+    Q_DECLARE_PRIVATE(QDaemonTimerWheel)
+    Q_DISABLE_COPY(QDaemonTimerWheel)
+
+public:
+    typedef quint64 TimerId;
+
+    explicit QDaemonTimerWheel(QObject * parent = Q_NULLPTR);
+    explicit QDaemonTimerWheel(int resolution, QObject * parent = Q_NULLPTR);
+    ~QDaemonTimerWheel() Q_DECL_OVERRIDE;
+
+    int resolution() const;
+    int count() const;
+    bool isActive(TimerId) const;
+
+    TimerId start(int msec, const std::function<void ()> & callback);
+    bool restart(TimerId, int msec);
+    bool cancel(TimerId);
+    void clear();
+
+private:
+    QDaemonTimerWheelPrivate * d_ptr;
+};
+
+QT_END_NAMESPACE
+
+#endif // QDAEMONTIMERWHEEL_H
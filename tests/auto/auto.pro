@@ -1,3 +1,24 @@
 TEMPLATE = subdirs
 SUBDIRS = \
-   cmake 
+   cmake \
+   qdaemonexecutor \
+   qdaemonmetrics \
+   qdaemonsettings \
+   qdaemontimerwheel
+
+linux: SUBDIRS += \
+   qdaemonapplication \
+   qdaemonbusregistration \
+   qdaemoncontrol \
+   qdaemoncontrolgroup \
+   qdaemoneventdispatcher \
+   qdaemonhandoff \
+   qdaemoninstances \
+   qdaemonioring \
+   qdaemonmetricsserver \
+   qdaemonprocesstuning \
+   qdaemonspawner \
+   qdaemonstats \
+   qdaemonstatsmonitor \
+   qdaemonsupervisor \
+   qdaemonwatchdog
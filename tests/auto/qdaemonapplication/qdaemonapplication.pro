@@ -0,0 +1,4 @@
+CONFIG += testcase
+TARGET = tst_qdaemonapplication
+QT = core daemon testlib
+SOURCES = tst_qdaemonapplication.cpp
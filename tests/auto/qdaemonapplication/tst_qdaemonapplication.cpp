@@ -0,0 +1,340 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+#include <QtDaemon/qdaemonapplication.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+
+class tst_QDaemonApplication : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void cleanup();
+
+    void socketActivationForAnotherProcess();
+    void socketActivation();
+    void signalDispatch();
+    void quitOnSignal();
+    void workerDefaults();
+    void reusePortListener();
+    void startupPhases();
+    void invalidInstance_data();
+    void invalidInstance();
+};
+
+static int argc = 1;
+static char applicationName[] = "tst_qdaemonapplication";
+static char * argv[] = { applicationName, Q_NULLPTR };
+
+static const int firstDescriptor = 3;           // Where the service manager puts the passed sockets
+
+void tst_QDaemonApplication::cleanup()
+{
+    qunsetenv("LISTEN_PID");
+    qunsetenv("LISTEN_FDS");
+    qunsetenv("LISTEN_FDNAMES");
+}
+
+void tst_QDaemonApplication::socketActivationForAnotherProcess()
+{
+    QDaemonApplication app(argc, argv);
+
+    // Not activated
+    QVERIFY(QDaemonApplication::inheritedDescriptorNames().isEmpty());
+
+    // The variables were inherited from a parent that was activated, they aren't meant for this process
+    qputenv("LISTEN_PID", QByteArray::number(qint64(::getppid())));
+    qputenv("LISTEN_FDS", "1");
+    qputenv("LISTEN_FDNAMES", "http");
+
+    QVERIFY(QDaemonApplication::inheritedDescriptorNames().isEmpty());
+    QCOMPARE(QDaemonApplication::inheritedDescriptor(QStringLiteral("http")), qintptr(-1));
+
+    // And they're left alone
+    QCOMPARE(qgetenv("LISTEN_PID"), QByteArray::number(qint64(::getppid())));
+    QCOMPARE(qgetenv("LISTEN_FDS"), QByteArray("1"));
+    QCOMPARE(qgetenv("LISTEN_FDNAMES"), QByteArray("http"));
+}
+
+void tst_QDaemonApplication::socketActivation()
+{
+    const int count = 4;
+
+    // Both ends are kept out of the way of the descriptors the service manager passes
+    int passed[count], peers[count];
+    for (int i = 0; i < count; i++)  {
+        int pair[2];
+        QCOMPARE(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair), 0);
+
+        passed[i] = ::fcntl(pair[0], F_DUPFD_CLOEXEC, 100);
+        peers[i] = ::fcntl(pair[1], F_DUPFD_CLOEXEC, 100);
+        ::close(pair[0]);
+        ::close(pair[1]);
+
+        QVERIFY(passed[i] >= 0 && peers[i] >= 0);
+    }
+
+    for (int i = 0; i < count; i++)  {
+        if (::fcntl(firstDescriptor + i, F_GETFD) != -1)
+            QSKIP("The descriptors the service manager passes are in use.");
+    }
+
+    // Passed as the service manager does it: from the third descriptor on, inheritable, one of them twice
+    for (int i = 0; i < count; i++)
+        QCOMPARE(::dup2(passed[i], firstDescriptor + i), firstDescriptor + i);
+
+    qputenv("LISTEN_PID", QByteArray::number(qint64(::getpid())));
+    qputenv("LISTEN_FDS", QByteArray::number(count));
+    qputenv("LISTEN_FDNAMES", "http:admin::http");
+
+    {
+        QDaemonApplication app(argc, argv);
+
+        // The unnamed one gets the default name, the second socket with the same name is ignored
+        QStringList names = QDaemonApplication::inheritedDescriptorNames();
+        names.sort();
+        QCOMPARE(names, QStringList() << QStringLiteral("admin") << QStringLiteral("http") << QStringLiteral("unknown"));
+
+        QCOMPARE(QDaemonApplication::inheritedDescriptor(QStringLiteral("http")), qintptr(firstDescriptor));
+        QCOMPARE(QDaemonApplication::inheritedDescriptor(QStringLiteral("admin")), qintptr(firstDescriptor + 1));
+        QCOMPARE(QDaemonApplication::inheritedDescriptor(QStringLiteral("unknown")), qintptr(firstDescriptor + 2));
+        QCOMPARE(QDaemonApplication::inheritedDescriptor(QStringLiteral("missing")), qintptr(-1));
+
+        // The variables are consumed, so the children don't take them for their own
+        QVERIFY(!qEnvironmentVariableIsSet("LISTEN_PID"));
+        QVERIFY(!qEnvironmentVariableIsSet("LISTEN_FDS"));
+        QVERIFY(!qEnvironmentVariableIsSet("LISTEN_FDNAMES"));
+
+        // Neither do the descriptors leak to them
+        for (int i = 0; i < count; i++)
+            QVERIFY(::fcntl(firstDescriptor + i, F_GETFD) & FD_CLOEXEC);
+
+        // The names lead to the right sockets
+        QCOMPARE(::write(peers[1], "a", 1), ssize_t(1));
+        char data = 0;
+        QCOMPARE(::read(int(QDaemonApplication::inheritedDescriptor(QStringLiteral("admin"))), &data, 1), ssize_t(1));
+        QCOMPARE(data, 'a');
+
+        // Asking again doesn't change anything
+        QCOMPARE(QDaemonApplication::inheritedDescriptorNames().size(), 3);
+    }
+
+    for (int i = 0; i < count; i++)  {
+        ::close(firstDescriptor + i);
+        ::close(passed[i]);
+        ::close(peers[i]);
+    }
+}
+
+void tst_QDaemonApplication::signalDispatch()
+{
+    {
+        QDaemonApplication app(argc, argv);
+
+        QSignalSpy reload(&app, &QDaemonApplication::reloadRequested);
+        QSignalSpy reopen(&app, &QDaemonApplication::logReopenRequested);
+        QSignalSpy dump(&app, &QDaemonApplication::dumpRequested);
+
+        // Nothing is emitted from the handler itself, only once the event loop gets to it
+        QCOMPARE(::raise(SIGHUP), 0);
+        QCOMPARE(::raise(SIGHUP), 0);
+        QCOMPARE(reload.count(), 0);
+
+        QTRY_COMPARE(reload.count(), 2);
+
+        QCOMPARE(::raise(SIGUSR1), 0);
+        QTRY_COMPARE(reopen.count(), 1);
+
+        QCOMPARE(::raise(SIGUSR2), 0);
+        QTRY_COMPARE(dump.count(), 1);
+
+        QCOMPARE(reload.count(), 2);
+        QCOMPARE(reopen.count(), 1);
+    }
+
+    // The default dispositions are restored with the application gone
+    struct sigaction action;
+    QCOMPARE(::sigaction(SIGHUP, Q_NULLPTR, &action), 0);
+    QVERIFY(action.sa_handler == SIG_DFL);
+}
+
+void tst_QDaemonApplication::quitOnSignal()
+{
+    QDaemonApplication app(argc, argv);
+
+    // Quitting the application ends the loop with 0, the timeout with 1
+    QEventLoop loop;
+    QTimer::singleShot(0, [] () -> void  {
+        ::raise(SIGTERM);
+    });
+    QTimer::singleShot(5000, &loop, [&loop] () -> void  {
+        loop.exit(1);
+    });
+
+    QCOMPARE(loop.exec(), 0);
+}
+
+void tst_QDaemonApplication::workerDefaults()
+{
+    // A single process by default, which isn't a worker
+    QCOMPARE(QDaemonApplication::workerCount(), 0);
+    QCOMPARE(QDaemonApplication::workerIndex(), -1);
+
+    QDaemonApplication::setWorkerCount(4);
+    QCOMPARE(QDaemonApplication::workerCount(), 4);
+
+    QDaemonApplication::setWorkerCount(-3);
+    QCOMPARE(QDaemonApplication::workerCount(), 0);
+    QCOMPARE(QDaemonApplication::workerIndex(), -1);
+}
+
+void tst_QDaemonApplication::reusePortListener()
+{
+    QDaemonApplication app(argc, argv);
+
+    int first = int(QDaemonApplication::createReusePortListener(0));
+    QVERIFY(first >= 0);
+
+    // The listener isn't inherited by the children
+    QVERIFY(::fcntl(first, F_GETFD) & FD_CLOEXEC);
+
+    struct sockaddr_storage address = {};
+    socklen_t length = sizeof(address);
+    QCOMPARE(::getsockname(first, reinterpret_cast<struct sockaddr *>(&address), &length), 0);
+
+    quint16 port = ntohs(address.ss_family == AF_INET6 ? reinterpret_cast<struct sockaddr_in6 *>(&address)->sin6_port : reinterpret_cast<struct sockaddr_in *>(&address)->sin_port);
+    QVERIFY(port != 0);
+
+    // Another worker binds the same port
+    int second = int(QDaemonApplication::createReusePortListener(port));
+    QVERIFY(second >= 0);
+
+    // An IPv4 client reaches one of them, the socket is dual stack
+    int client = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    QVERIFY(client >= 0);
+
+    struct sockaddr_in loopback = {};
+    loopback.sin_family = AF_INET;
+    loopback.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    loopback.sin_port = htons(port);
+    QCOMPARE(::connect(client, reinterpret_cast<struct sockaddr *>(&loopback), sizeof(loopback)), 0);
+
+    ::fcntl(first, F_SETFL, ::fcntl(first, F_GETFL) | O_NONBLOCK);
+    ::fcntl(second, F_SETFL, ::fcntl(second, F_GETFL) | O_NONBLOCK);
+
+    int accepted = ::accept(first, Q_NULLPTR, Q_NULLPTR);
+    if (accepted < 0)
+        accepted = ::accept(second, Q_NULLPTR, Q_NULLPTR);
+    QVERIFY(accepted >= 0);
+
+    ::close(accepted);
+    ::close(client);
+    ::close(second);
+    ::close(first);
+}
+
+void tst_QDaemonApplication::startupPhases()
+{
+    QDaemonApplication app(argc, argv);
+
+    QDaemonApplication::markStartupPhase(QStringLiteral("configuration loaded"));
+    QDaemonApplication::markStartupPhase(QStringLiteral("cache warmed"));
+
+    QStringList lines = QDaemonApplication::startupReport().split(QLatin1Char('\n'));
+    QVERIFY(lines.size() > 4);
+
+    QVERIFY(lines.takeFirst().startsWith(QStringLiteral("Startup phases (milliseconds since ")));
+
+    // Each phase with the time since the start and since the previous one, and possibly the CPU time
+    QRegularExpression phase(QStringLiteral("^  (.+): (\\d+\\.\\d) ms \\(\\+(\\d+\\.\\d) ms\\)(, CPU \\d+\\.\\d ms \\(\\+\\d+\\.\\d ms\\))?$"));
+
+    QStringList names;
+    double previous = 0;
+    foreach (const QString & line, lines)  {
+        QRegularExpressionMatch match = phase.match(line);
+        QVERIFY2(match.hasMatch(), qPrintable(line));
+
+        double elapsed = match.captured(2).toDouble();
+        QVERIFY(elapsed >= previous);
+        QVERIFY(match.captured(3).toDouble() >= 0);
+
+        previous = elapsed;
+        names.append(match.captured(1));
+    }
+
+    // The library marks its own phases, the application's come after them in the order they were marked
+    QCOMPARE(names.first(), QStringLiteral("library loaded"));
+    QVERIFY(names.contains(QStringLiteral("application constructed")));
+    QCOMPARE(names.mid(names.size() - 2), QStringList() << QStringLiteral("configuration loaded") << QStringLiteral("cache warmed"));
+}
+
+void tst_QDaemonApplication::invalidInstance_data()
+{
+    QTest::addColumn<QStringList>("arguments");
+
+    QTest::newRow("dash") << (QStringList() << QStringLiteral("-d") << QStringLiteral("--instance=shard-1"));
+    QTest::newRow("dot") << (QStringList() << QStringLiteral("-d") << QStringLiteral("--instance=shard.1"));
+    QTest::newRow("empty") << (QStringList() << QStringLiteral("-d") << QStringLiteral("--instance="));
+    QTest::newRow("non-ASCII") << (QStringList() << QStringLiteral("-d") << QString::fromUtf8("--instance=sh\xc3\xa4rd"));
+    QTest::newRow("all instances") << (QStringList() << QStringLiteral("-d") << QStringLiteral("--instance=all"));
+    QTest::newRow("repeated") << (QStringList() << QStringLiteral("-d") << QStringLiteral("--instance=a") << QStringLiteral("--instance=b"));
+    QTest::newRow("controller") << (QStringList() << QStringLiteral("--status") << QStringLiteral("--instance=a b"));
+}
+
+void tst_QDaemonApplication::invalidInstance()
+{
+    QFETCH(QStringList, arguments);
+
+    QList<QByteArray> data = QList<QByteArray>() << QByteArray(applicationName);
+    foreach (const QString & argument, arguments)
+        data.append(argument.toLocal8Bit());
+
+    QVector<char *> pointers;
+    for (int i = 0; i < data.size(); i++)
+        pointers.append(data[i].data());
+    pointers.append(Q_NULLPTR);
+
+    int count = data.size();
+    QDaemonApplication app(count, pointers.data());
+
+    // Refused before a backend is created, so nothing is started or contacted
+    QCOMPARE(QDaemonApplication::exec(), -1);
+    QVERIFY(QDaemonApplication::instanceId().isEmpty());
+}
+
+QTEST_APPLESS_MAIN(tst_QDaemonApplication)
+
+#include "tst_qdaemonapplication.moc"
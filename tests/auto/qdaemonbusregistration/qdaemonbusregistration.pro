@@ -0,0 +1,10 @@
+CONFIG += testcase
+TARGET = tst_qdaemonbusregistration
+QT = core dbus daemon testlib
+
+# The registration is internal to the module, so it's built into the test
+INCLUDEPATH += ../../../src/daemon/private
+
+HEADERS = ../../../src/daemon/private/qdaemonbusregistration_p.h
+SOURCES = tst_qdaemonbusregistration.cpp \
+    ../../../src/daemon/private/qdaemonbusregistration_p.cpp
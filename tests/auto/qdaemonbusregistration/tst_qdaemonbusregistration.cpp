@@ -0,0 +1,208 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+
+#include "qdaemonbusregistration_p.h"
+
+#include <QtCore/qtemporarydir.h>
+#include <QtCore/qstandardpaths.h>
+#include <QtCore/qprocess.h>
+
+#include <QtDBus/qdbusconnection.h>
+#include <QtDBus/qdbusconnectioninterface.h>
+
+using namespace QtDaemon;
+
+class tst_QDaemonBusRegistration : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void retryUntilStopped();
+    void registerWhenBusAppears();
+    void serviceOwnedElsewhere();
+
+private:
+    bool startBus();
+
+    QTemporaryDir directory;
+    QString busAddress;
+    QProcess bus;
+};
+
+static const QString serviceName = QStringLiteral("io.qt.QtDaemon.tst_qdaemonbusregistration");
+
+// Collects what the registration thread reports, delivered in the test's thread
+class RegistrationResult : public QObject
+{
+public:
+    RegistrationResult(QDaemonBusRegistration * registration)
+        : attempts(0), retries(0), failures(0)
+    {
+        QObject::connect(registration, &QDaemonBusRegistration::registered, this, [this] (const QString & name, int count, qint64) -> void  {
+            connectionName = name;
+            attempts = count;
+        });
+        QObject::connect(registration, &QDaemonBusRegistration::retrying, this, [this] (const QString & message) -> void  {
+            retries++;
+            error = message;
+        });
+        QObject::connect(registration, &QDaemonBusRegistration::failed, this, [this] (const QString & message) -> void  {
+            failures++;
+            error = message;
+        });
+    }
+
+    QString connectionName;
+    QString error;
+    int attempts, retries, failures;
+};
+
+void tst_QDaemonBusRegistration::initTestCase()
+{
+    QVERIFY(directory.isValid());
+
+    // The system bus of the test is a private one that isn't running yet; the address is read once per process
+    busAddress = QStringLiteral("unix:path=%1").arg(directory.filePath(QStringLiteral("system_bus_socket")));
+    qputenv("DBUS_SYSTEM_BUS_ADDRESS", busAddress.toLocal8Bit());
+}
+
+void tst_QDaemonBusRegistration::cleanupTestCase()
+{
+    if (bus.state() != QProcess::NotRunning)  {
+        bus.terminate();
+        if (!bus.waitForFinished())
+            bus.kill();
+    }
+}
+
+bool tst_QDaemonBusRegistration::startBus()
+{
+    QString program = QStandardPaths::findExecutable(QStringLiteral("dbus-daemon"));
+    if (program.isEmpty())
+        return false;
+
+    // The session configuration lets anyone own any name
+    bus.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    bus.start(program, QStringList() << QStringLiteral("--session") << QStringLiteral("--nofork") << QStringLiteral("--address=%1").arg(busAddress));
+    return bus.waitForStarted();
+}
+
+void tst_QDaemonBusRegistration::retryUntilStopped()
+{
+    QObject exported;
+    QDaemonBusRegistration registration(serviceName, &exported);
+    RegistrationResult result(&registration);
+
+    registration.start();
+
+    // The bus isn't there, reported once while it keeps trying
+    QTRY_COMPARE(result.retries, 1);
+    QVERIFY(!result.error.isEmpty());
+
+    QTest::qWait(500);
+    QVERIFY(registration.isRunning());
+    QCOMPARE(result.retries, 1);
+    QCOMPARE(result.failures, 0);
+    QVERIFY(result.connectionName.isEmpty());
+
+    // Stopping interrupts the wait between the attempts
+    QElapsedTimer timer;
+    timer.start();
+    registration.stop();
+    QVERIFY2(timer.elapsed() < 1000, qPrintable(QStringLiteral("Stopped after %1 ms").arg(timer.elapsed())));
+    QVERIFY(registration.isFinished());
+}
+
+void tst_QDaemonBusRegistration::registerWhenBusAppears()
+{
+    QObject exported;
+    QDaemonBusRegistration registration(serviceName, &exported);
+    RegistrationResult result(&registration);
+
+    registration.start();
+    QTRY_COMPARE(result.retries, 1);
+
+    // The startup went on without the bus; once it's up the service is registered on one of the next attempts
+    if (!startBus())
+        QSKIP("There's no dbus-daemon to run a bus for the test.");
+
+    QTRY_VERIFY_WITH_TIMEOUT(!result.connectionName.isEmpty(), 15000);
+    QVERIFY(result.attempts > 1);
+    QCOMPARE(result.failures, 0);
+    QVERIFY(registration.wait(1000));
+
+    // The connection is handed over with the object exported and the name owned
+    QDBusConnection connection(result.connectionName);
+    QVERIFY(connection.isConnected());
+    QCOMPARE(connection.objectRegisteredAt(QStringLiteral("/")), &exported);
+    QVERIFY(connection.interface()->isServiceRegistered(serviceName));
+
+    QDBusConnection::disconnectFromBus(result.connectionName);
+}
+
+void tst_QDaemonBusRegistration::serviceOwnedElsewhere()
+{
+    if (bus.state() != QProcess::Running && !startBus())
+        QSKIP("There's no dbus-daemon to run a bus for the test.");
+
+    // The bus may still be starting, the connection isn't retried on its own
+    const QString ownerName = QStringLiteral("owner"), ownedService = serviceName + QStringLiteral(".owned");
+    QElapsedTimer timer;
+    timer.start();
+    while (!QDBusConnection::connectToBus(QDBusConnection::SystemBus, ownerName).isConnected() && timer.elapsed() < 5000)  {
+        QDBusConnection::disconnectFromBus(ownerName);
+        QTest::qWait(50);
+    }
+
+    QDBusConnection owner(ownerName);
+    QVERIFY(owner.isConnected());
+    QVERIFY(owner.registerService(ownedService));
+
+    QObject exported;
+    QDaemonBusRegistration registration(ownedService, &exported);
+    RegistrationResult result(&registration);
+
+    registration.start();
+
+    // Another instance owns the name, retrying won't help
+    QTRY_COMPARE(result.failures, 1);
+    QVERIFY(result.error.contains(ownedService));
+    QVERIFY(result.connectionName.isEmpty());
+    QVERIFY(registration.wait(1000));
+
+    QDBusConnection::disconnectFromBus(ownerName);
+}
+
+QTEST_GUILESS_MAIN(tst_QDaemonBusRegistration)
+
+#include "tst_qdaemonbusregistration.moc"
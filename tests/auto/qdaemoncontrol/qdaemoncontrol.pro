@@ -0,0 +1,13 @@
+CONFIG += testcase
+TARGET = tst_qdaemoncontrol
+QT = core dbus daemon testlib
+
+# The control object is internal to the module, so it's built into the test
+INCLUDEPATH += ../../../src/daemon/private
+
+HEADERS = ../../../src/daemon/private/qdaemoncontrol_p.h \
+    ../../../src/daemon/private/qdaemonsupervisor_p.h
+SOURCES = tst_qdaemoncontrol.cpp \
+    ../../../src/daemon/private/qdaemoncontrol_p.cpp \
+    ../../../src/daemon/private/qdaemonsupervisor_p.cpp \
+    ../../../src/daemon/private/qdaemonstartupprofiler_p.cpp
@@ -0,0 +1,240 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+
+#include "qdaemoncontrol_p.h"
+#include "qdaemonsupervisor_p.h"
+#include "qdaemonstartupprofiler_p.h"
+
+#include <QtDaemon/qdaemonapplication.h>
+
+#include <QtCore/qtemporarydir.h>
+#include <QtCore/qstandardpaths.h>
+#include <QtCore/qprocess.h>
+#include <QtCore/qthread.h>
+
+#include <QtDBus/qdbusconnection.h>
+#include <QtDBus/qdbusmessage.h>
+#include <QtDBus/qdbuspendingcall.h>
+#include <QtDBus/qdbuspendingreply.h>
+#include <QtDBus/qdbusreply.h>
+
+using namespace QtDaemon;
+
+class tst_QDaemonControl : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void answeredWhileBusy();
+    void statusDetails();
+    void delayedReply();
+
+private:
+    QDBusMessage methodCall(const QString &);
+
+    QScopedPointer<QDaemonApplication> app;
+    QTemporaryDir directory;
+    QString busAddress;
+    QProcess bus;
+
+    QDaemonSupervisor supervisor;
+    QScopedPointer<QDaemonControl> control;
+    QThread controlThread;
+};
+
+static int argc = 1;
+static char applicationName[] = "tst_qdaemoncontrol";
+static char * argv[] = { applicationName, Q_NULLPTR };
+
+static const QString serviceName = QStringLiteral("io.qt.QtDaemon.tst_qdaemoncontrol");
+static const QString serverName = QStringLiteral("server");
+static const QString clientName = QStringLiteral("client");
+
+// Makes a blocking call from a thread of its own
+class Caller : public QThread
+{
+public:
+    Caller(const QString & address, const QDBusMessage & call)
+        : address(address), call(call), elapsed(-1)
+    {
+    }
+
+    QDBusMessage reply;
+    qint64 elapsed;
+
+protected:
+    void run() Q_DECL_OVERRIDE
+    {
+        const QString name = QStringLiteral("caller");
+        {
+            QDBusConnection connection = QDBusConnection::connectToBus(address, name);
+
+            QElapsedTimer timer;
+            timer.start();
+            reply = connection.call(call, QDBus::Block, 5000);
+            elapsed = timer.elapsed();
+        }
+        QDBusConnection::disconnectFromBus(name);
+    }
+
+private:
+    QString address;
+    QDBusMessage call;
+};
+
+void tst_QDaemonControl::initTestCase()
+{
+    // The statistics come from the registry of the application
+    app.reset(new QDaemonApplication(argc, argv));
+
+    QString program = QStandardPaths::findExecutable(QStringLiteral("dbus-daemon"));
+    if (program.isEmpty())
+        QSKIP("There's no dbus-daemon to run a bus for the test.");
+
+    // A private bus, the session configuration lets anyone own any name
+    QVERIFY(directory.isValid());
+    busAddress = QStringLiteral("unix:path=%1").arg(directory.filePath(QStringLiteral("bus_socket")));
+
+    bus.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    bus.start(program, QStringList() << QStringLiteral("--session") << QStringLiteral("--nofork") << QStringLiteral("--address=%1").arg(busAddress));
+    QVERIFY(bus.waitForStarted());
+
+    // The bus may take a moment to listen, the connection isn't retried on its own
+    QElapsedTimer timer;
+    timer.start();
+    while (!QDBusConnection::connectToBus(busAddress, serverName).isConnected() && timer.elapsed() < 5000)  {
+        QDBusConnection::disconnectFromBus(serverName);
+        QTest::qWait(50);
+    }
+
+    // Set up as the daemon does: the object lives in the control thread and is exported on a connection of its own
+    control.reset(new QDaemonControl(&supervisor));
+    controlThread.start();
+    control->moveToThread(&controlThread);
+
+    QDBusConnection server(serverName);
+    QVERIFY(server.isConnected());
+    QVERIFY(server.registerObject(QStringLiteral("/"), control.data(), QDBusConnection::ExportAllInvokables));
+    QVERIFY(server.registerService(serviceName));
+
+    QVERIFY(QDBusConnection::connectToBus(busAddress, clientName).isConnected());
+}
+
+void tst_QDaemonControl::cleanupTestCase()
+{
+    QDBusConnection::disconnectFromBus(clientName);
+    QDBusConnection::disconnectFromBus(serverName);
+
+    controlThread.quit();
+    controlThread.wait();
+    control.reset();
+
+    if (bus.state() != QProcess::NotRunning)  {
+        bus.terminate();
+        if (!bus.waitForFinished())
+            bus.kill();
+    }
+
+    app.reset();
+}
+
+QDBusMessage tst_QDaemonControl::methodCall(const QString & method)
+{
+    return QDBusMessage::createMethodCall(serviceName, QStringLiteral("/"), QStringLiteral(Q_DAEMON_DBUS_CONTROL_INTERFACE), method);
+}
+
+void tst_QDaemonControl::answeredWhileBusy()
+{
+    Caller isRunning(busAddress, methodCall(QStringLiteral("isRunning")));
+    Caller statistics(busAddress, methodCall(QStringLiteral("statistics")));
+
+    isRunning.start();
+    statistics.start();
+
+    // The main thread doesn't get to its event loop meanwhile
+    QThread::msleep(2000);
+
+    QVERIFY(isRunning.wait(5000));
+    QVERIFY(statistics.wait(5000));
+
+    QCOMPARE(isRunning.reply.type(), QDBusMessage::ReplyMessage);
+    QCOMPARE(isRunning.reply.arguments().value(0).toBool(), true);
+    QVERIFY2(isRunning.elapsed < 1000, qPrintable(QStringLiteral("Answered after %1 ms").arg(isRunning.elapsed)));
+
+    QCOMPARE(statistics.reply.type(), QDBusMessage::ReplyMessage);
+    QCOMPARE(statistics.reply.arguments().value(0).userType(), int(QMetaType::QString));
+    QVERIFY2(statistics.elapsed < 1000, qPrintable(QStringLiteral("Answered after %1 ms").arg(statistics.elapsed)));
+}
+
+void tst_QDaemonControl::statusDetails()
+{
+    QDaemonStartupProfiler::mark(QStringLiteral("tst_qdaemoncontrol phase"));
+
+    QDBusConnection client(clientName);
+    QDBusReply<QString> reply = client.call(methodCall(QStringLiteral("statusDetails")));
+    QVERIFY2(reply.isValid(), qPrintable(reply.error().message()));
+    QVERIFY(reply.value().contains(QStringLiteral("tst_qdaemoncontrol phase")));
+    QVERIFY(!reply.value().contains(QStringLiteral("Child process")));
+
+    // The children of the supervisor are read from the control thread while the main thread manages them
+    QList<QStringList> arguments;
+    arguments << (QStringList() << QStringLiteral("60")) << (QStringList() << QStringLiteral("60"));
+    supervisor.start(QStringLiteral("/bin/sleep"), arguments);
+
+    reply = client.call(methodCall(QStringLiteral("statusDetails")));
+    QVERIFY2(reply.isValid(), qPrintable(reply.error().message()));
+    QVERIFY(reply.value().contains(QStringLiteral("Child process 0: running")));
+    QVERIFY(reply.value().contains(QStringLiteral("Child process 1: running")));
+
+    supervisor.stop();
+}
+
+void tst_QDaemonControl::delayedReply()
+{
+    // The main thread answers in the daemon's place
+    QObject context;
+    QObject::connect(control.data(), &QDaemonControl::upgradeRequested, &context, [] (const QDBusMessage & message) -> void  {
+        QDBusConnection(serverName).send(message.createReply(QStringLiteral("handoff socket")));
+    });
+
+    QDBusConnection client(clientName);
+    QDBusPendingReply<QString> reply = client.asyncCall(methodCall(QStringLiteral("prepareUpgrade")));
+
+    QTRY_VERIFY(reply.isFinished());
+    QVERIFY2(reply.isValid(), qPrintable(reply.error().message()));
+    QCOMPARE(reply.value(), QStringLiteral("handoff socket"));
+}
+
+QTEST_APPLESS_MAIN(tst_QDaemonControl)
+
+#include "tst_qdaemoncontrol.moc"
@@ -0,0 +1,10 @@
+CONFIG += testcase
+TARGET = tst_qdaemoncontrolgroup
+QT = core daemon testlib
+
+# The control group reader is internal to the module, so it's built into the test
+INCLUDEPATH += ../../../src/daemon/private
+
+SOURCES = tst_qdaemoncontrolgroup.cpp \
+    ../../../src/daemon/private/qdaemoncontrolgroup_p.cpp \
+    ../../../src/daemon/private/qdaemonprocesstuning_p.cpp
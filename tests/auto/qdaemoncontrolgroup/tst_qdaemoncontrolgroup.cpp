@@ -0,0 +1,194 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+
+#include "qdaemoncontrolgroup_p.h"
+
+#include <QtCore/qtemporarydir.h>
+
+using namespace QtDaemon;
+
+class tst_QDaemonControlGroup : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+
+    void path();
+    void pathOutsideNamespace();
+    void hierarchy();
+    void effectiveCpus();
+    void cpuQuota();
+    void memoryLimit();
+    void noLimits();
+
+private:
+    QString group(const QString &);
+    void writeValue(const QString &, const QString &, const QByteArray &);
+
+    QScopedPointer<QTemporaryDir> root;
+};
+
+// A fake unified hierarchy: the root, system.slice and the daemon's own group below it
+void tst_QDaemonControlGroup::init()
+{
+    root.reset(new QTemporaryDir);
+    QVERIFY(root->isValid());
+
+    QVERIFY(QDir(root->path()).mkpath(QStringLiteral("system.slice/daemon.service")));
+    writeValue(QString(), QStringLiteral("cgroup.controllers"), "cpuset cpu io memory pids");
+    writeValue(QStringLiteral("system.slice"), QStringLiteral("cgroup.controllers"), "cpuset cpu memory");
+    writeValue(QStringLiteral("system.slice/daemon.service"), QStringLiteral("cgroup.controllers"), "cpu memory");
+}
+
+QString tst_QDaemonControlGroup::group(const QString & name)
+{
+    return name.isEmpty() ? root->path() : root->path() + QLatin1Char('/') + name;
+}
+
+void tst_QDaemonControlGroup::writeValue(const QString & name, const QString & file, const QByteArray & value)
+{
+    QFile out(group(name) + QLatin1Char('/') + file);
+    QVERIFY(out.open(QFile::WriteOnly | QFile::Truncate));
+    QCOMPARE(out.write(value + '\n'), qint64(value.size() + 1));
+}
+
+void tst_QDaemonControlGroup::path()
+{
+    // Only the unified hierarchy counts, the v1 controllers of a hybrid setup are skipped
+    const QByteArray membership = "12:pids:/system.slice/daemon.service\n"
+                                  "1:name=systemd:/system.slice/daemon.service\n"
+                                  "0::/system.slice/daemon.service\n";
+
+    QCOMPARE(QDaemonControlGroup::path(root->path(), membership), group(QStringLiteral("system.slice/daemon.service")));
+    QCOMPARE(QDaemonControlGroup::path(root->path(), "0::/\n"), root->path());
+
+    // Not a v2 system at all
+    QVERIFY(QDaemonControlGroup::path(root->path() + QStringLiteral("/missing"), membership).isEmpty());
+}
+
+void tst_QDaemonControlGroup::pathOutsideNamespace()
+{
+    // Without a cgroup namespace a container sees the host's path, which doesn't exist in its own mount
+    QCOMPARE(QDaemonControlGroup::path(root->path(), "0::/docker/0123456789abcdef\n"), root->path());
+    QCOMPARE(QDaemonControlGroup::path(root->path(), QByteArray()), root->path());
+}
+
+void tst_QDaemonControlGroup::hierarchy()
+{
+    QStringList expected;
+    expected << group(QStringLiteral("system.slice/daemon.service")) << group(QStringLiteral("system.slice")) << root->path();
+
+    QCOMPARE(QDaemonControlGroup::hierarchy(root->path(), expected.first()), expected);
+    QCOMPARE(QDaemonControlGroup::hierarchy(root->path(), root->path()), QStringList(root->path()));
+
+    // Outside of the hierarchy, or none at all
+    QVERIFY(QDaemonControlGroup::hierarchy(root->path(), QStringLiteral("/elsewhere")).isEmpty());
+    QVERIFY(QDaemonControlGroup::hierarchy(root->path(), QString()).isEmpty());
+}
+
+void tst_QDaemonControlGroup::effectiveCpus()
+{
+    const QStringList groups = QDaemonControlGroup::hierarchy(root->path(), group(QStringLiteral("system.slice/daemon.service")));
+
+    // The closest group with the cpuset controller decides, the ancestors' sets are already accounted for
+    writeValue(QString(), QStringLiteral("cpuset.cpus.effective"), "0-15");
+    writeValue(QStringLiteral("system.slice"), QStringLiteral("cpuset.cpus.effective"), "0-3,8,10-11");
+
+    QList<int> expected;
+    expected << 0 << 1 << 2 << 3 << 8 << 10 << 11;
+    QCOMPARE(QDaemonControlGroup::effectiveCpus(groups), expected);
+
+    writeValue(QStringLiteral("system.slice/daemon.service"), QStringLiteral("cpuset.cpus.effective"), "2");
+    QCOMPARE(QDaemonControlGroup::effectiveCpus(groups), QList<int>() << 2);
+}
+
+void tst_QDaemonControlGroup::cpuQuota()
+{
+    const QStringList groups = QDaemonControlGroup::hierarchy(root->path(), group(QStringLiteral("system.slice/daemon.service")));
+
+    writeValue(QStringLiteral("system.slice/daemon.service"), QStringLiteral("cpu.max"), "max 100000");
+    QCOMPARE(QDaemonControlGroup::cpuQuota(groups), -1.0);
+
+    // The tightest group wins, wherever it is
+    writeValue(QStringLiteral("system.slice/daemon.service"), QStringLiteral("cpu.max"), "250000 100000");
+    QCOMPARE(QDaemonControlGroup::cpuQuota(groups), 2.5);
+
+    writeValue(QStringLiteral("system.slice"), QStringLiteral("cpu.max"), "150000 100000");
+    QCOMPARE(QDaemonControlGroup::cpuQuota(groups), 1.5);
+
+    // Malformed values are ignored
+    writeValue(QStringLiteral("system.slice"), QStringLiteral("cpu.max"), "150000");
+    writeValue(QString(), QStringLiteral("cpu.max"), "-1 100000");
+    QCOMPARE(QDaemonControlGroup::cpuQuota(groups), 2.5);
+
+    writeValue(QString(), QStringLiteral("cpu.max"), "50000 0");
+    QCOMPARE(QDaemonControlGroup::cpuQuota(groups), 2.5);
+}
+
+void tst_QDaemonControlGroup::memoryLimit()
+{
+    const QStringList groups = QDaemonControlGroup::hierarchy(root->path(), group(QStringLiteral("system.slice/daemon.service")));
+
+    writeValue(QStringLiteral("system.slice/daemon.service"), QStringLiteral("memory.max"), "max");
+    writeValue(QStringLiteral("system.slice/daemon.service"), QStringLiteral("memory.high"), "max");
+    QCOMPARE(QDaemonControlGroup::memoryLimit(groups), qint64(-1));
+
+    writeValue(QStringLiteral("system.slice/daemon.service"), QStringLiteral("memory.max"), "1073741824");
+    QCOMPARE(QDaemonControlGroup::memoryLimit(groups), Q_INT64_C(1073741824));
+
+    // The throttling limit is lower than the hard one
+    writeValue(QStringLiteral("system.slice/daemon.service"), QStringLiteral("memory.high"), "805306368");
+    QCOMPARE(QDaemonControlGroup::memoryLimit(groups), Q_INT64_C(805306368));
+
+    // An ancestor may be tighter still
+    writeValue(QStringLiteral("system.slice"), QStringLiteral("memory.max"), "536870912");
+    QCOMPARE(QDaemonControlGroup::memoryLimit(groups), Q_INT64_C(536870912));
+
+    writeValue(QString(), QStringLiteral("memory.max"), "garbage");
+    QCOMPARE(QDaemonControlGroup::memoryLimit(groups), Q_INT64_C(536870912));
+}
+
+void tst_QDaemonControlGroup::noLimits()
+{
+    const QStringList groups = QDaemonControlGroup::hierarchy(root->path(), group(QStringLiteral("system.slice/daemon.service")));
+
+    QVERIFY(QDaemonControlGroup::effectiveCpus(groups).isEmpty());
+    QCOMPARE(QDaemonControlGroup::cpuQuota(groups), -1.0);
+    QCOMPARE(QDaemonControlGroup::memoryLimit(groups), qint64(-1));
+
+    QVERIFY(QDaemonControlGroup::effectiveCpus(QStringList()).isEmpty());
+    QCOMPARE(QDaemonControlGroup::cpuQuota(QStringList()), -1.0);
+    QCOMPARE(QDaemonControlGroup::memoryLimit(QStringList()), qint64(-1));
+}
+
+QTEST_APPLESS_MAIN(tst_QDaemonControlGroup)
+
+#include "tst_qdaemoncontrolgroup.moc"
@@ -0,0 +1,4 @@
+CONFIG += testcase
+TARGET = tst_qdaemoneventdispatcher
+QT = core daemon testlib
+SOURCES = tst_qdaemoneventdispatcher.cpp
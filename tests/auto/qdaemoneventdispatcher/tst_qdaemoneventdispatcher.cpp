@@ -0,0 +1,373 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+#include <QtDaemon/qdaemonapplication.h>
+
+#include <QtCore/qabstracteventdispatcher.h>
+#include <QtCore/qsocketnotifier.h>
+
+#include <functional>
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdlib.h>
+
+static const char epollDispatcherClass[] = "QtDaemon::QDaemonEpollEventDispatcher";
+
+class TestThread : public QThread
+{
+public:
+    explicit TestThread(const std::function<void ()> & function)
+        : body(function)
+    {
+    }
+
+protected:
+    void run() Q_DECL_OVERRIDE
+    {
+        body();
+    }
+
+private:
+    std::function<void ()> body;
+};
+
+class tst_QDaemonEventDispatcher : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void socketNotifiers_data();
+    void socketNotifiers();
+    void timers_data();
+    void timers();
+    void interrupt_data();
+    void interrupt();
+    void wakeUp_data();
+    void wakeUp();
+
+private:
+    void dispatchers();
+    bool runInThread(const std::function<void ()> &);
+};
+
+void tst_QDaemonEventDispatcher::dispatchers()
+{
+    QTest::addColumn<bool>("epoll");
+
+    QTest::newRow("default") << false;
+    QTest::newRow("epoll") << true;
+}
+
+// Runs a test case in a thread with the epoll dispatcher or with the default one, so the two can be compared
+bool tst_QDaemonEventDispatcher::runInThread(const std::function<void ()> & body)
+{
+    QFETCH(bool, epoll);
+
+    QString dispatcherClass;
+    TestThread thread([&dispatcherClass, &body] () -> void  {
+        dispatcherClass = QString::fromLatin1(QAbstractEventDispatcher::instance()->metaObject()->className());
+        body();
+    });
+
+    if (epoll)  {
+        QAbstractEventDispatcher * dispatcher = QDaemonApplication::createEpollEventDispatcher();
+        if (!dispatcher)  {
+            qWarning("Couldn't create the epoll event dispatcher.");
+            return false;
+        }
+        thread.setEventDispatcher(dispatcher);
+    }
+
+    thread.start();
+    if (!thread.wait(30000))  {
+        qWarning("The test thread is stuck.");
+        ::_exit(EXIT_FAILURE);      // Can't be recovered from, the thread references the test function's locals
+    }
+
+    // Make sure the intended dispatcher was exercised
+    return (dispatcherClass == QLatin1String(epollDispatcherClass)) == epoll;
+}
+
+void tst_QDaemonEventDispatcher::socketNotifiers_data()
+{
+    dispatchers();
+}
+
+void tst_QDaemonEventDispatcher::socketNotifiers()
+{
+    int descriptors[2];
+    QCOMPARE(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, descriptors), 0);
+
+    int writes = 0, reads = 0, readsWhileDisabled = -1, readsAfterEnabling = -1, readsAfterClosing = -1;
+    bool written = true;
+    QByteArray received;
+
+    QVERIFY(runInThread([&] () -> void  {
+        QEventLoop loop;
+
+        // Every wait is cut short if the notifier doesn't fire
+        QTimer failsafe;
+        failsafe.setSingleShot(true);
+        failsafe.setInterval(5000);
+        QObject::connect(&failsafe, &QTimer::timeout, &loop, &QEventLoop::quit);
+
+        QSocketNotifier writer(descriptors[1], QSocketNotifier::Write);
+        QObject::connect(&writer, &QSocketNotifier::activated, &loop, [&] () -> void  {
+            // A connected socket is writable right away
+            writes++;
+            writer.setEnabled(false);
+            written &= ::write(descriptors[1], "x", 1) == 1;
+        });
+
+        QSocketNotifier reader(descriptors[0], QSocketNotifier::Read);
+        QObject::connect(&reader, &QSocketNotifier::activated, &loop, [&] () -> void  {
+            reads++;
+
+            char data[16];
+            ssize_t size = ::read(descriptors[0], data, sizeof(data));
+            if (size > 0)
+                received.append(data, int(size));
+            else
+                reader.setEnabled(false);       // End of file
+            loop.quit();
+        });
+
+        failsafe.start();
+        loop.exec();
+
+        // A disabled notifier doesn't fire
+        reader.setEnabled(false);
+        written &= ::write(descriptors[1], "y", 1) == 1;
+        QTimer::singleShot(100, &loop, &QEventLoop::quit);
+        loop.exec();
+        readsWhileDisabled = reads;
+
+        // The notifiers are level triggered, so the data that arrived meanwhile is reported once enabled
+        reader.setEnabled(true);
+        failsafe.start();
+        loop.exec();
+        readsAfterEnabling = reads;
+
+        // The peer closing the connection is reported as readable
+        ::close(descriptors[1]);
+        failsafe.start();
+        loop.exec();
+        readsAfterClosing = reads;
+    }));
+
+    ::close(descriptors[0]);
+
+    QVERIFY(written);
+    QCOMPARE(writes, 1);
+    QCOMPARE(readsWhileDisabled, 1);
+    QCOMPARE(readsAfterEnabling, 2);
+    QCOMPARE(readsAfterClosing, 3);
+    QCOMPARE(received, QByteArray("xy"));
+}
+
+void tst_QDaemonEventDispatcher::timers_data()
+{
+    QTest::addColumn<bool>("epoll");
+    QTest::addColumn<int>("type");
+    QTest::addColumn<int>("interval");
+    QTest::addColumn<int>("tolerance");         // How early a timeout may be, in milliseconds
+
+    // The coarse timers may be adjusted by 5% of the interval, the very coarse ones are rounded to whole seconds
+    QTest::newRow("default precise") << false << int(Qt::PreciseTimer) << 50 << 1;
+    QTest::newRow("default coarse") << false << int(Qt::CoarseTimer) << 50 << 4;
+    QTest::newRow("default very coarse") << false << int(Qt::VeryCoarseTimer) << 1000 << 500;
+    QTest::newRow("epoll precise") << true << int(Qt::PreciseTimer) << 50 << 1;
+    QTest::newRow("epoll coarse") << true << int(Qt::CoarseTimer) << 50 << 4;
+    QTest::newRow("epoll very coarse") << true << int(Qt::VeryCoarseTimer) << 1000 << 500;
+}
+
+void tst_QDaemonEventDispatcher::timers()
+{
+    QFETCH(int, type);
+    QFETCH(int, interval);
+    QFETCH(int, tolerance);
+
+    const int expected = 3;
+    QList<qint64> timeouts;
+    QList<QAbstractEventDispatcher::TimerInfo> registered;
+    int remaining = -1, remainingAfterStop = 0, registeredAfterStop = -1;
+
+    QVERIFY(runInThread([&] () -> void  {
+        QEventLoop loop;
+        QElapsedTimer clock;
+
+        QTimer timer;
+        timer.setTimerType(Qt::TimerType(type));
+        timer.setInterval(interval);
+        QObject::connect(&timer, &QTimer::timeout, &loop, [&] () -> void  {
+            timeouts.append(clock.elapsed());
+            if (timeouts.size() == 1)  {
+                QAbstractEventDispatcher * dispatcher = QAbstractEventDispatcher::instance();
+                registered = dispatcher->registeredTimers(&timer);
+                remaining = dispatcher->remainingTime(timer.timerId());
+            }
+
+            if (timeouts.size() < expected)
+                return;
+
+            int id = timer.timerId();
+            timer.stop();
+
+            QAbstractEventDispatcher * dispatcher = QAbstractEventDispatcher::instance();
+            remainingAfterStop = dispatcher->remainingTime(id);
+            registeredAfterStop = dispatcher->registeredTimers(&timer).size();
+
+            // Make sure a stopped timer stays quiet
+            QTimer::singleShot(interval + 100, &loop, &QEventLoop::quit);
+        });
+
+        QTimer failsafe;
+        failsafe.setSingleShot(true);
+        QObject::connect(&failsafe, &QTimer::timeout, &loop, &QEventLoop::quit);
+        failsafe.start(interval * (expected + 5));
+
+        clock.start();
+        timer.start();
+        loop.exec();
+    }));
+
+    QCOMPARE(timeouts.size(), expected);
+    for (int i = 0; i < expected; i++)  {
+        qint64 due = qint64(interval) * (i + 1);
+        QVERIFY2(timeouts.at(i) >= due - tolerance, qPrintable(QStringLiteral("Timeout %1 after %2 ms, due at %3 ms").arg(i + 1).arg(timeouts.at(i)).arg(due)));
+    }
+
+    QCOMPARE(registered.size(), 1);
+    QCOMPARE(int(registered.first().timerType), type);
+    QCOMPARE(registered.first().interval, interval);
+    QVERIFY(remaining >= 0 && remaining <= interval);
+
+    QCOMPARE(remainingAfterStop, -1);
+    QCOMPARE(registeredAfterStop, 0);
+}
+
+void tst_QDaemonEventDispatcher::interrupt_data()
+{
+    dispatchers();
+}
+
+void tst_QDaemonEventDispatcher::interrupt()
+{
+    qint64 elapsed = -1;
+
+    QVERIFY(runInThread([&elapsed] () -> void  {
+        QAbstractEventDispatcher * dispatcher = QAbstractEventDispatcher::instance();
+
+        QTimer failsafe;
+        failsafe.setSingleShot(true);
+        failsafe.start(5000);
+
+        // Nothing is pending after this, so the blocking pass below waits until it's interrupted
+        dispatcher->processEvents(QEventLoop::AllEvents);
+
+        TestThread interrupter([dispatcher] () -> void  {
+            QThread::msleep(100);
+            dispatcher->interrupt();
+        });
+
+        QElapsedTimer clock;
+        clock.start();
+        interrupter.start();
+
+        dispatcher->processEvents(QEventLoop::WaitForMoreEvents);
+        elapsed = clock.elapsed();
+
+        interrupter.wait();
+    }));
+
+    QVERIFY2(elapsed >= 0 && elapsed < 5000, qPrintable(QStringLiteral("Interrupted after %1 ms").arg(elapsed)));
+}
+
+void tst_QDaemonEventDispatcher::wakeUp_data()
+{
+    dispatchers();
+}
+
+void tst_QDaemonEventDispatcher::wakeUp()
+{
+    qint64 wokenUp = -1, quit = -1;
+    bool failsafeFired = false;
+
+    QVERIFY(runInThread([&] () -> void  {
+        QAbstractEventDispatcher * dispatcher = QAbstractEventDispatcher::instance();
+
+        QTimer failsafe;
+        failsafe.setSingleShot(true);
+        failsafe.start(5000);
+
+        dispatcher->processEvents(QEventLoop::AllEvents);
+
+        // A wake up from another thread ends the blocking pass
+        TestThread waker([dispatcher] () -> void  {
+            QThread::msleep(100);
+            dispatcher->wakeUp();
+        });
+
+        QElapsedTimer clock;
+        clock.start();
+        waker.start();
+
+        dispatcher->processEvents(QEventLoop::WaitForMoreEvents);
+        wokenUp = clock.elapsed();
+        waker.wait();
+
+        // So does an event posted from another thread, which is then delivered
+        QEventLoop loop;
+        QObject::connect(&failsafe, &QTimer::timeout, &loop, [&loop, &failsafeFired] () -> void  {
+            failsafeFired = true;
+            loop.quit();
+        });
+
+        TestThread poster([&loop] () -> void  {
+            QThread::msleep(100);
+            QMetaObject::invokeMethod(&loop, "quit", Qt::QueuedConnection);
+        });
+
+        clock.restart();
+        poster.start();
+
+        loop.exec();
+        quit = clock.elapsed();
+        poster.wait();
+    }));
+
+    QVERIFY2(wokenUp >= 0 && wokenUp < 5000, qPrintable(QStringLiteral("Woken up after %1 ms").arg(wokenUp)));
+    QVERIFY(!failsafeFired);
+    QVERIFY2(quit >= 0 && quit < 5000, qPrintable(QStringLiteral("Quit after %1 ms").arg(quit)));
+}
+
+QTEST_GUILESS_MAIN(tst_QDaemonEventDispatcher)
+
+#include "tst_qdaemoneventdispatcher.moc"
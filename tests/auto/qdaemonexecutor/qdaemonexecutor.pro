@@ -0,0 +1,4 @@
+CONFIG += testcase
+TARGET = tst_qdaemonexecutor
+QT = core daemon testlib
+SOURCES = tst_qdaemonexecutor.cpp
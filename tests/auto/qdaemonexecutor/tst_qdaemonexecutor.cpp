@@ -0,0 +1,182 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+#include <QtDaemon/qdaemonapplication.h>
+#include <QtDaemon/qdaemonexecutor.h>
+
+#include <functional>
+
+class tst_QDaemonExecutor : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void notRunning();
+    void run();
+    void drainOnStop();
+    void drainFollowUps();
+    void concurrentPosts();
+};
+
+static int argc = 1;
+static char applicationName[] = "tst_qdaemonexecutor";
+static char * argv[] = { applicationName, Q_NULLPTR };
+
+void tst_QDaemonExecutor::initTestCase()
+{
+    QDaemonApplication::setExecutorThreadCount(4);
+}
+
+void tst_QDaemonExecutor::notRunning()
+{
+    QDaemonApplication app(argc, argv);
+
+    // The executor is started with the daemon
+    QVERIFY(!qDaemonExecutor().isRunning());
+    QCOMPARE(qDaemonExecutor().threadCount(), 0);
+    QVERIFY(!qDaemonExecutor().post([] () -> void  { }));
+
+    QFuture<int> future = qDaemonExecutor().run([] () -> int  { return 1; });
+    QVERIFY(future.isCanceled());
+}
+
+void tst_QDaemonExecutor::run()
+{
+    QDaemonApplication app(argc, argv);
+    emit app.daemonized(QStringList());
+
+    QVERIFY(qDaemonExecutor().isRunning());
+    QCOMPARE(qDaemonExecutor().threadCount(), 4);
+
+    QFuture<int> future = qDaemonExecutor().run([] () -> int  { return 42; });
+    future.waitForFinished();
+    QCOMPARE(future.result(), 42);
+}
+
+void tst_QDaemonExecutor::drainOnStop()
+{
+    const int tasks = 2000;
+    QAtomicInt done(0);
+
+    {
+        QDaemonApplication app(argc, argv);
+        emit app.daemonized(QStringList());
+
+        // Slow enough for most of the tasks to be still queued when the application goes away
+        for (int i = 0; i < tasks; i++)  {
+            QVERIFY(qDaemonExecutor().post([&done, i] () -> void  {
+                if (i % 100 == 0)
+                    QThread::msleep(5);
+                done.ref();
+            }));
+        }
+    }
+
+    // All the tasks posted before the stop have run
+    QCOMPARE(done.load(), tasks);
+}
+
+void tst_QDaemonExecutor::drainFollowUps()
+{
+    const int chains = 100, length = 20;
+    QAtomicInt done(0), rejected(0);
+
+    // Each task posts the next one of its chain, including the tasks run while draining
+    std::function<void (int)> step = [&done, &rejected, &step] (int remaining) -> void  {
+        done.ref();
+        if (remaining > 1 && !qDaemonExecutor().post(std::bind(step, remaining - 1)))
+            rejected.ref();
+    };
+
+    {
+        QDaemonApplication app(argc, argv);
+        emit app.daemonized(QStringList());
+
+        for (int i = 0; i < chains; i++)
+            QVERIFY(qDaemonExecutor().post(std::bind(step, length)));
+    }
+
+    QCOMPARE(rejected.load(), 0);
+    QCOMPARE(done.load(), chains * length);
+}
+
+class Poster : public QThread
+{
+public:
+    Poster(QAtomicInt & counter, int count)
+        : done(counter), tasks(count), posted(0)
+    {
+    }
+
+    void run() Q_DECL_OVERRIDE
+    {
+        for (int i = 0; i < tasks; i++)  {
+            if (qDaemonExecutor().post([this] () -> void  { done.ref(); }))
+                posted++;
+        }
+    }
+
+    QAtomicInt & done;
+    const int tasks;
+    int posted;
+};
+
+void tst_QDaemonExecutor::concurrentPosts()
+{
+    const int threads = 8, tasks = 20000;
+    QAtomicInt done(0);
+
+    {
+        QDaemonApplication app(argc, argv);
+        emit app.daemonized(QStringList());
+
+        QList<Poster *> posters;
+        for (int i = 0; i < threads; i++)
+            posters.append(new Poster(done, tasks));
+
+        foreach (Poster * poster, posters)
+            poster->start();
+        foreach (Poster * poster, posters)
+            poster->wait();
+
+        foreach (Poster * poster, posters)
+            QCOMPARE(poster->posted, tasks);
+
+        qDeleteAll(posters);
+    }
+
+    // Nothing was lost between the queues, and no task was run twice
+    QCOMPARE(done.load(), threads * tasks);
+}
+
+QTEST_APPLESS_MAIN(tst_QDaemonExecutor)
+
+#include "tst_qdaemonexecutor.moc"
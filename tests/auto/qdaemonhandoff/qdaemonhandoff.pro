@@ -0,0 +1,10 @@
+CONFIG += testcase
+TARGET = tst_qdaemonhandoff
+QT = core daemon testlib
+
+# The handoff is internal to the module, so it's built into the test
+INCLUDEPATH += ../../../src/daemon/private
+
+HEADERS = ../../../src/daemon/private/qdaemonhandoff_p.h
+SOURCES = tst_qdaemonhandoff.cpp \
+    ../../../src/daemon/private/qdaemonhandoff_p.cpp
@@ -0,0 +1,202 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+#include <QtDaemon/qdaemonapplication.h>
+
+#include "qdaemonhandoff_p.h"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace QtDaemon;
+
+class tst_QDaemonHandoff : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void handOver();
+    void runningInstanceGone();
+    void noRunningInstance();
+
+private:
+    QDaemonApplication * app;
+    int sockets[2][2];
+};
+
+static int argc = 1;
+static char applicationName[] = "tst_qdaemonhandoff";
+static char * argv[] = { applicationName, Q_NULLPTR };
+
+// The upgraded instance, which blocks while it receives the descriptors, so it's run in a thread of its own
+class UpgradedInstance : public QThread
+{
+public:
+    UpgradedInstance(const QString & name)
+        : name(name), handoff(Q_NULLPTR)
+    {
+    }
+
+    QAtomicInt connected, released;
+    QHash<QString, int> descriptors;
+    QDaemonHandoff * handoff;
+
+protected:
+    void run() Q_DECL_OVERRIDE
+    {
+        QDaemonHandoff upgraded;
+        QObject::connect(&upgraded, &QDaemonHandoff::released, [this] () -> void  {
+            released.storeRelease(1);
+        });
+
+        bool succeeded = upgraded.connectToInstance(name, descriptors);
+        handoff = &upgraded;
+        connected.storeRelease(succeeded ? 1 : -1);
+
+        exec();
+        handoff = Q_NULLPTR;
+    }
+
+private:
+    QString name;
+};
+
+static bool sameSocket(int first, int second)
+{
+    struct stat firstStatus, secondStatus;
+    return ::fstat(first, &firstStatus) == 0 && ::fstat(second, &secondStatus) == 0 && firstStatus.st_dev == secondStatus.st_dev && firstStatus.st_ino == secondStatus.st_ino;
+}
+
+void tst_QDaemonHandoff::init()
+{
+    app = new QDaemonApplication(argc, argv);
+
+    // Stand-ins for the listening sockets of the running instance
+    for (int i = 0; i < 2; i++)
+        QCOMPARE(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets[i]), 0);
+}
+
+void tst_QDaemonHandoff::cleanup()
+{
+    for (int i = 0; i < 2; i++)  {
+        ::close(sockets[i][0]);
+        ::close(sockets[i][1]);
+    }
+
+    delete app;
+}
+
+void tst_QDaemonHandoff::handOver()
+{
+    QHash<QString, int> passed;
+    passed.insert(QStringLiteral("http"), sockets[0][0]);
+    passed.insert(QStringLiteral("admin"), sockets[1][0]);
+
+    QDaemonHandoff running;
+    QSignalSpy ready(&running, &QDaemonHandoff::ready);
+
+    QString name = running.listen(QStringLiteral("io.qt.QtDaemon.tst_qdaemonhandoff"), passed);
+    QVERIFY(!name.isEmpty());
+
+    UpgradedInstance upgraded(name);
+    upgraded.start();
+
+    // The descriptors are passed once the running instance's event loop accepts the connection
+    QTRY_COMPARE(upgraded.connected.loadAcquire(), 1);
+    QCOMPARE(upgraded.descriptors.size(), 2);
+    QVERIFY(upgraded.descriptors.value(QStringLiteral("http"), -1) >= 0);
+    QVERIFY(upgraded.descriptors.value(QStringLiteral("admin"), -1) >= 0);
+
+    // The same sockets under new numbers, which don't leak to the processes the new instance starts
+    QVERIFY(sameSocket(upgraded.descriptors.value(QStringLiteral("http")), sockets[0][0]));
+    QVERIFY(sameSocket(upgraded.descriptors.value(QStringLiteral("admin")), sockets[1][0]));
+    QVERIFY(upgraded.descriptors.value(QStringLiteral("http")) != sockets[0][0]);
+    QVERIFY(::fcntl(upgraded.descriptors.value(QStringLiteral("http")), F_GETFD) & FD_CLOEXEC);
+
+    QCOMPARE(::write(sockets[1][1], "a", 1), ssize_t(1));
+    char data = 0;
+    QCOMPARE(::read(upgraded.descriptors.value(QStringLiteral("admin")), &data, 1), ssize_t(1));
+    QCOMPARE(data, 'a');
+
+    // The new instance is set up, the running one releases the service
+    QCOMPARE(ready.count(), 0);
+    QVERIFY(QMetaObject::invokeMethod(upgraded.handoff, "notifyReady", Qt::QueuedConnection));
+    QTRY_COMPARE(ready.count(), 1);
+
+    QCOMPARE(upgraded.released.loadAcquire(), 0);
+    running.notifyReleased();
+    QTRY_COMPARE(upgraded.released.loadAcquire(), 1);
+
+    upgraded.quit();
+    QVERIFY(upgraded.wait(5000));
+
+    foreach (int descriptor, upgraded.descriptors)
+        ::close(descriptor);
+}
+
+void tst_QDaemonHandoff::runningInstanceGone()
+{
+    QHash<QString, int> passed;
+    passed.insert(QStringLiteral("http"), sockets[0][0]);
+
+    QScopedPointer<QDaemonHandoff> running(new QDaemonHandoff);
+    QString name = running->listen(QStringLiteral("io.qt.QtDaemon.tst_qdaemonhandoff"), passed);
+    QVERIFY(!name.isEmpty());
+
+    UpgradedInstance upgraded(name);
+    upgraded.start();
+    QTRY_COMPARE(upgraded.connected.loadAcquire(), 1);
+
+    // The running instance quits (or crashes) instead of releasing the service, which can be taken over all the same
+    running.reset();
+    QTRY_COMPARE(upgraded.released.loadAcquire(), 1);
+
+    upgraded.quit();
+    QVERIFY(upgraded.wait(5000));
+
+    foreach (int descriptor, upgraded.descriptors)
+        ::close(descriptor);
+}
+
+void tst_QDaemonHandoff::noRunningInstance()
+{
+    QDaemonHandoff upgraded;
+    QHash<QString, int> descriptors;
+    QVERIFY(!upgraded.connectToInstance(QStringLiteral("qtdaemon-handoff.io.qt.QtDaemon.tst_qdaemonhandoff.0"), descriptors));
+    QVERIFY(descriptors.isEmpty());
+}
+
+QTEST_APPLESS_MAIN(tst_QDaemonHandoff)
+
+#include "tst_qdaemonhandoff.moc"
@@ -0,0 +1,6 @@
+TEMPLATE = subdirs
+SUBDIRS = \
+   testdaemon \
+   test
+
+test.depends = testdaemon
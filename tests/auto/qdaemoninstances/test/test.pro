@@ -0,0 +1,4 @@
+CONFIG += testcase
+TARGET = ../tst_qdaemoninstances
+QT = core dbus testlib
+SOURCES = ../tst_qdaemoninstances.cpp
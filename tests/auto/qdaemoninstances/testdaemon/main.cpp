@@ -0,0 +1,55 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include <QtDaemon/qdaemonapplication.h>
+
+#include <stdio.h>
+
+// A daemon that does nothing, but tells the test (on the standard output) what it was told to do
+static void report(const char * event)
+{
+    ::puts(event);
+    ::fflush(stdout);
+}
+
+int main(int argc, char ** argv)
+{
+    QDaemonApplication app(argc, argv);
+
+    QDaemonApplication::setApplicationName("QtDaemon test daemon");
+    QDaemonApplication::setOrganizationDomain("qtdaemon.tests");
+
+    QObject::connect(&app, &QDaemonApplication::standby, [] () -> void  {
+        report("standby");
+    });
+    QObject::connect(&app, &QDaemonApplication::daemonized, [] (const QStringList &) -> void  {
+        report("daemonized");
+    });
+
+    return QDaemonApplication::exec();
+}
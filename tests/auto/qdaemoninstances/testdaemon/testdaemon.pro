@@ -0,0 +1,9 @@
+TARGET = testdaemon
+QT = core daemon
+CONFIG += console
+CONFIG -= app_bundle
+
+# Next to the test, which runs it as the daemon (and as its controller)
+DESTDIR = ../
+
+SOURCES = main.cpp
@@ -0,0 +1,239 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+
+#include <QtCore/qtemporarydir.h>
+#include <QtCore/qstandardpaths.h>
+#include <QtCore/qprocess.h>
+
+#include <QtDBus/qdbusconnection.h>
+#include <QtDBus/qdbusconnectioninterface.h>
+#include <QtDBus/qdbusreply.h>
+
+#include <sys/types.h>
+#include <signal.h>
+
+class tst_QDaemonInstances : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void cleanup();
+
+    void standbyTakeOver();
+    void controlInstances();
+
+private:
+    qint64 owner(const QString &);
+    int control(const QStringList &, QString &);
+
+    QString daemon;
+    QTemporaryDir directory;
+    QString busAddress;
+    QProcess bus;
+};
+
+static const QString clientName = QStringLiteral("client");
+static const QString serviceName = QStringLiteral("tests.qtdaemon.testdaemon");
+
+// Waits for the daemon to report the event on its standard output
+static bool waitForOutput(QProcess & process, const QByteArray & event, int timeout = 5000)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    while (!process.peek(process.bytesAvailable()).contains(event + '\n'))  {
+        if (timer.hasExpired(timeout) || process.state() == QProcess::NotRunning)
+            return false;
+
+        process.waitForReadyRead(50);
+    }
+
+    return true;
+}
+
+void tst_QDaemonInstances::initTestCase()
+{
+    daemon = QDir(QCoreApplication::applicationDirPath()).filePath(QStringLiteral("testdaemon"));
+    QVERIFY2(QFile::exists(daemon), qPrintable(daemon));
+
+    QString program = QStandardPaths::findExecutable(QStringLiteral("dbus-daemon"));
+    if (program.isEmpty())
+        QSKIP("There's no dbus-daemon to run a bus for the test.");
+
+    // The daemons and their controller use the system bus, which is a private one for the test (inherited by the children)
+    QVERIFY(directory.isValid());
+    busAddress = QStringLiteral("unix:path=%1").arg(directory.filePath(QStringLiteral("system_bus_socket")));
+    qputenv("DBUS_SYSTEM_BUS_ADDRESS", busAddress.toLocal8Bit());
+
+    // The session configuration lets anyone own any name
+    bus.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    bus.start(program, QStringList() << QStringLiteral("--session") << QStringLiteral("--nofork") << QStringLiteral("--address=%1").arg(busAddress));
+    QVERIFY(bus.waitForStarted());
+
+    // The bus may take a moment to listen, the connection isn't retried on its own
+    QElapsedTimer timer;
+    timer.start();
+    while (!QDBusConnection::connectToBus(busAddress, clientName).isConnected() && timer.elapsed() < 5000)  {
+        QDBusConnection::disconnectFromBus(clientName);
+        QTest::qWait(50);
+    }
+
+    QVERIFY(QDBusConnection(clientName).isConnected());
+}
+
+void tst_QDaemonInstances::cleanupTestCase()
+{
+    QDBusConnection::disconnectFromBus(clientName);
+
+    if (bus.state() != QProcess::NotRunning)  {
+        bus.terminate();
+        if (!bus.waitForFinished())
+            bus.kill();
+    }
+}
+
+void tst_QDaemonInstances::cleanup()
+{
+    // Don't leave daemons behind, whatever the test did to them
+    QDBusConnection client(clientName);
+    if (!client.isConnected())
+        return;
+
+    foreach (const QString & service, client.interface()->registeredServiceNames().value())  {
+        if (!service.startsWith(serviceName))
+            continue;
+
+        qint64 pid = owner(service);
+        if (pid > 0)
+            ::kill(pid_t(pid), SIGKILL);
+    }
+}
+
+qint64 tst_QDaemonInstances::owner(const QString & service)
+{
+    QDBusReply<uint> pid = QDBusConnection(clientName).interface()->servicePid(service);
+    return pid.isValid() ? qint64(pid.value()) : -1;
+}
+
+// Runs the daemon's controller, which reports on the standard output
+int tst_QDaemonInstances::control(const QStringList & arguments, QString & output)
+{
+    QProcess controller;
+    controller.setProcessChannelMode(QProcess::MergedChannels);
+    controller.start(daemon, arguments);
+    if (!controller.waitForFinished(30000))  {
+        controller.kill();
+        controller.waitForFinished();
+    }
+
+    output = QString::fromLocal8Bit(controller.readAll());
+    return controller.exitStatus() == QProcess::NormalExit ? controller.exitCode() : -1;
+}
+
+void tst_QDaemonInstances::standbyTakeOver()
+{
+    QProcess primary;
+    primary.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    primary.start(daemon, QStringList() << QStringLiteral("-d"));
+    QVERIFY(waitForOutput(primary, "daemonized"));
+    QTRY_COMPARE(owner(serviceName), primary.processId());
+
+    // Fully started, but not serving
+    QProcess standby;
+    standby.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    standby.start(daemon, QStringList() << QStringLiteral("-d") << QStringLiteral("--standby"));
+    QVERIFY(waitForOutput(standby, "standby"));
+
+    QTest::qWait(200);
+    QVERIFY(!standby.peek(standby.bytesAvailable()).contains("daemonized"));
+    QCOMPARE(owner(serviceName), primary.processId());
+
+    // The bus hands the service over as soon as the primary instance dies, no polling involved
+    QElapsedTimer timer;
+    timer.start();
+    QCOMPARE(::kill(pid_t(primary.processId()), SIGKILL), 0);
+
+    QVERIFY(waitForOutput(standby, "daemonized"));
+    QVERIFY2(timer.elapsed() < 2000, qPrintable(QStringLiteral("Took over after %1 ms").arg(timer.elapsed())));
+    QCOMPARE(owner(serviceName), standby.processId());
+    QVERIFY(primary.waitForFinished());
+
+    // And serves until told to quit
+    standby.terminate();
+    QVERIFY(standby.waitForFinished());
+    QCOMPARE(standby.exitStatus(), QProcess::NormalExit);
+    QTRY_VERIFY(!QDBusConnection(clientName).interface()->isServiceRegistered(serviceName).value());
+}
+
+void tst_QDaemonInstances::controlInstances()
+{
+    const QStringList instances = QStringList() << QStringLiteral("a") << QStringLiteral("b") << QStringLiteral("c");
+
+    QStringList selected;
+    foreach (const QString & instance, instances)
+        selected << QStringLiteral("--instance=%1").arg(instance);
+
+    // All started together, each reported in a row of its own
+    QString output;
+    QCOMPARE(control(QStringList() << QStringLiteral("--start") << selected, output), 0);
+    foreach (const QString & instance, instances)  {
+        QVERIFY2(output.contains(QRegularExpression(QStringLiteral("\n%1\\s+started \\(process \\d+\\)").arg(instance))), qPrintable(output));
+        QVERIFY(QDBusConnection(clientName).interface()->isServiceRegistered(serviceName + QLatin1Char('_') + instance).value());
+    }
+
+    // Starting again doesn't start another copy of any of them
+    QVERIFY(control(QStringList() << QStringLiteral("--start") << selected, output) != 0);
+    foreach (const QString & instance, instances)
+        QVERIFY2(output.contains(QRegularExpression(QStringLiteral("\n%1\\s+is already running").arg(instance))), qPrintable(output));
+
+    // The running instances are found on the bus
+    QCOMPARE(control(QStringList() << QStringLiteral("--status") << QStringLiteral("--instance=all"), output), 0);
+    QVERIFY2(output.contains(QStringLiteral("Daemon is running.")), qPrintable(output));
+    foreach (const QString & instance, instances)
+        QVERIFY2(output.contains(QRegularExpression(QStringLiteral("\n%1\\s+is running").arg(instance))), qPrintable(output));
+
+    // An instance that isn't running is reported as such, next to the running ones
+    QVERIFY(control(QStringList() << QStringLiteral("--stop") << QStringLiteral("--instance=a") << QStringLiteral("--instance=missing"), output) != 0);
+    QVERIFY2(output.contains(QRegularExpression(QStringLiteral("\na\\s+stopped"))), qPrintable(output));
+    QVERIFY2(output.contains(QRegularExpression(QStringLiteral("\nmissing\\s+is not running"))), qPrintable(output));
+
+    QCOMPARE(control(QStringList() << QStringLiteral("--stop") << QStringLiteral("--instance=all"), output), 0);
+    foreach (const QString & instance, instances.mid(1))
+        QVERIFY2(output.contains(QRegularExpression(QStringLiteral("\n%1\\s+stopped").arg(instance))), qPrintable(output));
+
+    foreach (const QString & instance, instances)
+        QTRY_VERIFY(!QDBusConnection(clientName).interface()->isServiceRegistered(serviceName + QLatin1Char('_') + instance).value());
+}
+
+QTEST_GUILESS_MAIN(tst_QDaemonInstances)
+
+#include "tst_qdaemoninstances.moc"
@@ -0,0 +1,4 @@
+CONFIG += testcase
+TARGET = tst_qdaemonioring
+QT = core daemon testlib
+SOURCES = tst_qdaemonioring.cpp
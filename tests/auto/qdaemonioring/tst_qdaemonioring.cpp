@@ -0,0 +1,281 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+#include <QtDaemon/qdaemonioring.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <cstring>
+
+class tst_QDaemonIoRing : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void instance();
+    void readWrite();
+    void vectoredWrite();
+    void failures();
+    void burst();
+    void waitForData();
+    void accept();
+    void destroyPending();
+
+private:
+    int descriptorFlags() const;
+
+    QDaemonIoRing * ring;
+};
+
+void tst_QDaemonIoRing::initTestCase()
+{
+    ring = QDaemonIoRing::instance();
+    QVERIFY(ring);
+    QCOMPARE(ring->isAsynchronous(), QDaemonIoRing::isSupported());
+
+    qDebug("Testing the %s ring.", ring->isAsynchronous() ? "io_uring" : "synchronous fallback");
+}
+
+int tst_QDaemonIoRing::descriptorFlags() const
+{
+    // The kernel waits for blocking descriptors, while the fallback waits for non-blocking ones in the event loop
+    return ring->isAsynchronous() ? 0 : O_NONBLOCK;
+}
+
+void tst_QDaemonIoRing::instance()
+{
+    QCOMPARE(QDaemonIoRing::instance(), ring);
+    QCOMPARE(ring->pendingCount(), 0);
+}
+
+void tst_QDaemonIoRing::readWrite()
+{
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    const int descriptor = file.handle();
+
+    qint64 first = 0, second = 0;
+    ring->write(descriptor, QByteArrayLiteral("hello "), 0, [&first] (qint64 result) -> void  { first = result; });
+    ring->write(descriptor, QByteArrayLiteral("world"), 6, [&second] (qint64 result) -> void  { second = result; });
+
+    // Nothing runs before the submission
+    QCOMPARE(ring->pendingCount(), 2);
+    QCOMPARE(first, qint64(0));
+
+    QTRY_COMPARE(first, qint64(6));
+    QTRY_COMPARE(second, qint64(5));
+
+    qint64 synced = -1;
+    ring->fsync(descriptor, true, [&synced] (qint64 result) -> void  { synced = result; });
+    QTRY_COMPARE(synced, qint64(0));
+
+    qint64 read = -1;
+    QByteArray data;
+    ring->read(descriptor, 64, 0, [&read, &data] (qint64 result, const QByteArray & buffer) -> void  {
+        read = result;
+        data = buffer;
+    });
+    QTRY_COMPARE(read, qint64(11));
+    QCOMPARE(data, QByteArrayLiteral("hello world"));
+
+    // Reading at the end gives nothing
+    read = -1;
+    ring->read(descriptor, 64, 11, [&read, &data] (qint64 result, const QByteArray & buffer) -> void  {
+        read = result;
+        data = buffer;
+    });
+    QTRY_COMPARE(read, qint64(0));
+    QVERIFY(data.isEmpty());
+
+    QCOMPARE(ring->pendingCount(), 0);
+}
+
+void tst_QDaemonIoRing::vectoredWrite()
+{
+    QTemporaryFile file;
+    QVERIFY(file.open());
+
+    QByteArrayList buffers;
+    buffers << QByteArrayLiteral("one ") << QByteArray() << QByteArrayLiteral("two ") << QByteArrayLiteral("three");
+
+    qint64 written = -1;
+    ring->writev(file.handle(), buffers, 0, [&written] (qint64 result) -> void  { written = result; });
+    QTRY_COMPARE(written, qint64(13));
+
+    QCOMPARE(file.readAll(), QByteArrayLiteral("one two three"));
+}
+
+void tst_QDaemonIoRing::failures()
+{
+    int descriptors[2];
+    QCOMPARE(::pipe2(descriptors, O_CLOEXEC), 0);
+    ::close(descriptors[1]);
+
+    // The errors are reported as negated errno values, each operation on its own
+    qint64 badRead = 0, badSync = 0, badWrite = 0, closedRead = -1;
+    QByteArray data("untouched");
+    ring->read(-1, 16, -1, [&badRead, &data] (qint64 result, const QByteArray & buffer) -> void  {
+        badRead = result;
+        data = buffer;
+    });
+    ring->fsync(descriptors[0], false, [&badSync] (qint64 result) -> void  { badSync = result; });
+    ring->write(descriptors[0], QByteArrayLiteral("data"), -1, [&badWrite] (qint64 result) -> void  { badWrite = result; });
+    ring->read(descriptors[0], 16, -1, [&closedRead] (qint64 result, const QByteArray &) -> void  { closedRead = result; });
+    ring->submit();
+
+    QTRY_COMPARE(badRead, qint64(-EBADF));
+    QVERIFY(data.isEmpty());
+    QTRY_COMPARE(badSync, qint64(-EINVAL));        // Pipes can't be synced
+    QTRY_COMPARE(badWrite, qint64(-EBADF));        // The read end isn't writable
+    QTRY_COMPARE(closedRead, qint64(0));           // End of file, the write end is gone
+
+    ::close(descriptors[0]);
+}
+
+void tst_QDaemonIoRing::burst()
+{
+    QTemporaryFile file;
+    QVERIFY(file.open());
+
+    // Several times the size of the ring, so the submission queue fills up while queueing
+    const int count = 2000;
+    int completed = 0, failed = 0;
+    for (int i = 0; i < count; i++)  {
+        ring->write(file.handle(), QByteArray::number(i % 10), i, [&completed, &failed] (qint64 result) -> void  {
+            completed++;
+            if (result != 1)
+                failed++;
+        });
+    }
+
+    QTRY_COMPARE_WITH_TIMEOUT(completed, count, 10000);
+    QCOMPARE(failed, 0);
+    QCOMPARE(ring->pendingCount(), 0);
+
+    const QByteArray contents = file.readAll();
+    QCOMPARE(contents.size(), count);
+    for (int i = 0; i < count; i++)
+        QCOMPARE(contents.at(i), char('0' + i % 10));
+}
+
+void tst_QDaemonIoRing::waitForData()
+{
+    int descriptors[2];
+    QCOMPARE(::pipe2(descriptors, O_CLOEXEC | descriptorFlags()), 0);
+
+    qint64 read = -1;
+    QByteArray data;
+    ring->read(descriptors[0], 16, -1, [&read, &data] (qint64 result, const QByteArray & buffer) -> void  {
+        read = result;
+        data = buffer;
+    });
+
+    // Stays pending until there's something to read, without blocking the event loop
+    QTest::qWait(50);
+    QCOMPARE(read, qint64(-1));
+    QCOMPARE(ring->pendingCount(), 1);
+
+    QCOMPARE(::write(descriptors[1], "ready", 5), ssize_t(5));
+    QTRY_COMPARE(read, qint64(5));
+    QCOMPARE(data, QByteArrayLiteral("ready"));
+    QCOMPARE(ring->pendingCount(), 0);
+
+    ::close(descriptors[0]);
+    ::close(descriptors[1]);
+}
+
+void tst_QDaemonIoRing::accept()
+{
+    int server = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | descriptorFlags(), 0);
+    QVERIFY(server >= 0);
+
+    struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    QCOMPARE(::bind(server, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)), 0);
+    QCOMPARE(::listen(server, 1), 0);
+    QCOMPARE(::getsockname(server, reinterpret_cast<struct sockaddr *>(&address), &length), 0);
+
+    qint64 accepted = -1;
+    ring->accept(server, [&accepted] (qint64 result) -> void  { accepted = result; });
+
+    QTest::qWait(50);
+    QCOMPARE(accepted, qint64(-1));
+
+    int client = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    QVERIFY(client >= 0);
+    QCOMPARE(::connect(client, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)), 0);
+
+    QTRY_VERIFY(accepted >= 0);
+
+    // The connected socket is non-blocking and closed on exec()
+    const int connection = int(accepted);
+    QVERIFY(::fcntl(connection, F_GETFL) & O_NONBLOCK);
+    QVERIFY(::fcntl(connection, F_GETFD) & FD_CLOEXEC);
+
+    ::close(connection);
+    ::close(client);
+    ::close(server);
+}
+
+void tst_QDaemonIoRing::destroyPending()
+{
+    int descriptors[2];
+    QCOMPARE(::pipe2(descriptors, O_CLOEXEC | descriptorFlags()), 0);
+
+    QDaemonIoRing * pendingRing = new QDaemonIoRing;
+    QCOMPARE(pendingRing->isAsynchronous(), ring->isAsynchronous());
+
+    bool called = false;
+    pendingRing->read(descriptors[0], 16, -1, [&called] (qint64, const QByteArray &) -> void  { called = true; });
+    pendingRing->submit();
+    QCOMPARE(pendingRing->pendingCount(), 1);
+
+    // Canceled without invoking the handler
+    delete pendingRing;
+
+    QCOMPARE(::write(descriptors[1], "late", 4), ssize_t(4));
+    QTest::qWait(50);
+    QVERIFY(!called);
+
+    ::close(descriptors[0]);
+    ::close(descriptors[1]);
+}
+
+QTEST_GUILESS_MAIN(tst_QDaemonIoRing)
+
+#include "tst_qdaemonioring.moc"
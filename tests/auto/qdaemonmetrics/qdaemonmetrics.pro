@@ -0,0 +1,4 @@
+CONFIG += testcase
+TARGET = tst_qdaemonmetrics
+QT = core daemon testlib
+SOURCES = tst_qdaemonmetrics.cpp
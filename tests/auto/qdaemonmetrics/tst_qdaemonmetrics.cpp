@@ -0,0 +1,210 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+#include <QtDaemon/qdaemonapplication.h>
+#include <QtDaemon/qdaemonmetrics.h>
+
+#include <QtCore/qthread.h>
+
+#include <limits>
+
+class tst_QDaemonMetrics : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void counterShards();
+    void gauge();
+    void typeMismatch();
+    void histogramSmallValues();
+    void histogramBounds_data();
+    void histogramBounds();
+    void histogramPercentiles();
+};
+
+static int argc = 1;
+static char applicationName[] = "tst_qdaemonmetrics";
+static char * argv[] = { applicationName, Q_NULLPTR };
+
+class Adder : public QThread
+{
+public:
+    Adder(QDaemonCounter counter, int additions)
+        : counter(counter), additions(additions)
+    {
+    }
+
+protected:
+    void run() Q_DECL_OVERRIDE
+    {
+        for (int i = 0; i < additions; i++)
+            counter.add(i % 2 ? 1 : 2);
+    }
+
+private:
+    QDaemonCounter counter;
+    const int additions;
+};
+
+void tst_QDaemonMetrics::counterShards()
+{
+    QDaemonApplication app(argc, argv);
+
+    QDaemonCounter counter = qDaemonMetrics().counter(QStringLiteral("test_total"));
+    QVERIFY(!counter.isNull());
+    QCOMPARE(counter.value(), quint64(0));
+
+    // More threads than shards, so some of them share a shard
+    const int threads = 80, additions = 10000;
+
+    QList<Adder *> adders;
+    for (int i = 0; i < threads; i++)
+        adders.append(new Adder(counter, additions));
+
+    foreach (Adder * adder, adders)
+        adder->start();
+    foreach (Adder * adder, adders)
+        adder->wait();
+
+    qDeleteAll(adders);
+
+    // The shards are merged, nothing is lost
+    QCOMPARE(counter.value(), quint64(threads) * additions / 2 * 3);
+
+    // The same counter is returned for the same name
+    QCOMPARE(qDaemonMetrics().counter(QStringLiteral("test_total")).value(), counter.value());
+}
+
+void tst_QDaemonMetrics::gauge()
+{
+    QDaemonApplication app(argc, argv);
+
+    QDaemonGauge gauge = qDaemonMetrics().gauge(QStringLiteral("test_gauge"));
+    QVERIFY(!gauge.isNull());
+    QCOMPARE(gauge.value(), qint64(0));
+
+    gauge.set(10);
+    gauge.add(-15);
+    QCOMPARE(gauge.value(), qint64(-5));
+}
+
+void tst_QDaemonMetrics::typeMismatch()
+{
+    QDaemonApplication app(argc, argv);
+
+    QVERIFY(!qDaemonMetrics().counter(QStringLiteral("test_metric")).isNull());
+
+    QTest::ignoreMessage(QtWarningMsg, "QDaemonMetrics: The metric test_metric is already registered with a different type.");
+    QVERIFY(qDaemonMetrics().gauge(QStringLiteral("test_metric")).isNull());
+
+    QCOMPARE(qDaemonMetrics().names().count(QStringLiteral("test_metric")), 1);
+}
+
+void tst_QDaemonMetrics::histogramSmallValues()
+{
+    QDaemonApplication app(argc, argv);
+
+    QDaemonHistogram histogram = qDaemonMetrics().histogram(QStringLiteral("test_histogram"));
+    QVERIFY(!histogram.isNull());
+    QCOMPARE(histogram.count(), quint64(0));
+    QCOMPARE(histogram.percentile(50), quint64(0));
+
+    // Each of the small values has a bucket of its own
+    for (quint64 value = 0; value < 16; value++)
+        histogram.record(value);
+
+    QCOMPARE(histogram.count(), quint64(16));
+    QCOMPARE(histogram.sum(), quint64(120));
+
+    for (int rank = 1; rank <= 16; rank++)
+        QCOMPARE(histogram.percentile(rank * 100.0 / 16), quint64(rank - 1));
+}
+
+void tst_QDaemonMetrics::histogramBounds_data()
+{
+    QTest::addColumn<quint64>("value");
+
+    QTest::newRow("first linear") << quint64(16);
+    QTest::newRow("odd") << quint64(17);
+    QTest::newRow("before power") << quint64(31);
+    QTest::newRow("power") << quint64(32);
+    QTest::newRow("thousand") << quint64(1000);
+    QTest::newRow("million") << quint64(1000003);
+    QTest::newRow("large") << quint64(Q_UINT64_C(1000000000007));
+    QTest::newRow("maximum") << std::numeric_limits<quint64>::max();
+}
+
+void tst_QDaemonMetrics::histogramBounds()
+{
+    QFETCH(quint64, value);
+
+    QDaemonApplication app(argc, argv);
+
+    QDaemonHistogram histogram = qDaemonMetrics().histogram(QStringLiteral("test_histogram"));
+    histogram.record(value);
+
+    // The upper bound of the value's bucket is reported, which is at most 1/16th above it
+    quint64 reported = histogram.percentile(100);
+    QVERIFY2(reported >= value, qPrintable(QString::number(reported)));
+    QVERIFY2(reported - value <= value / 16, qPrintable(QString::number(reported)));
+    QCOMPARE(histogram.percentile(0), reported);
+
+    // The values just outside of the bucket end up in the neighbouring ones
+    if (reported < std::numeric_limits<quint64>::max())  {
+        histogram.record(reported + 1);
+        QCOMPARE(histogram.percentile(50), reported);
+        QVERIFY(histogram.percentile(100) > reported);
+    }
+}
+
+void tst_QDaemonMetrics::histogramPercentiles()
+{
+    QDaemonApplication app(argc, argv);
+
+    QDaemonHistogram histogram = qDaemonMetrics().histogram(QStringLiteral("test_histogram"));
+    for (quint64 value = 1000; value > 0; value--)
+        histogram.record(value);
+
+    QCOMPARE(histogram.count(), quint64(1000));
+    QCOMPARE(histogram.sum(), quint64(500500));
+
+    const double percents[] = { 1, 50, 90, 99, 100 };
+    for (double percent : percents)  {
+        quint64 exact = quint64(percent * 10), reported = histogram.percentile(percent);
+        QVERIFY2(reported >= exact && reported - exact <= exact / 16, qPrintable(QStringLiteral("p%1: %2").arg(percent).arg(reported)));
+    }
+
+    // Out of range requests are clamped
+    QCOMPARE(histogram.percentile(-1), histogram.percentile(0));
+    QCOMPARE(histogram.percentile(200), histogram.percentile(100));
+}
+
+QTEST_APPLESS_MAIN(tst_QDaemonMetrics)
+
+#include "tst_qdaemonmetrics.moc"
@@ -0,0 +1,11 @@
+CONFIG += testcase
+TARGET = tst_qdaemonmetricsserver
+QT = core daemon testlib
+
+# The endpoint is internal to the module, so it's built into the test
+INCLUDEPATH += ../../../src/daemon/private
+
+HEADERS = ../../../src/daemon/private/qdaemonmetricsserver_p.h
+SOURCES = tst_qdaemonmetricsserver.cpp \
+    ../../../src/daemon/private/qdaemonmetricsserver_p.cpp \
+    ../../../src/daemon/private/qdaemonmetrics_p.cpp
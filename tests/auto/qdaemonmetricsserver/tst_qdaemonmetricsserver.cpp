@@ -0,0 +1,270 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+#include <QtDaemon/qdaemonapplication.h>
+
+#include "qdaemonmetricsserver_p.h"
+
+#include <QtCore/qtemporarydir.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <cstring>
+
+using namespace QtDaemon;
+
+class tst_QDaemonMetricsServer : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void requests_data();
+    void requests();
+    void tcpEndpoint();
+    void invalidEndpoint();
+    void staleSocket();
+    void liveSocket();
+};
+
+static int argc = 1;
+static char applicationName[] = "tst_qdaemonmetricsserver";
+static char * argv[] = { applicationName, Q_NULLPTR };
+
+static struct sockaddr_un unixAddress(const QString & path)
+{
+    struct sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    QByteArray name = QFile::encodeName(path);
+    std::memcpy(address.sun_path, name.constData(), qMin(size_t(name.size()), sizeof(address.sun_path) - 1));
+    return address;
+}
+
+// A socket bound to the path, listening or not
+static int bindSocket(const QString & path, bool listening)
+{
+    int descriptor = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_un address = unixAddress(path);
+    if (descriptor < 0 || ::bind(descriptor, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0 || (listening && ::listen(descriptor, 1) != 0))  {
+        ::close(descriptor);
+        return -1;
+    }
+
+    return descriptor;
+}
+
+// Sends the request and reads the response until the server closes the connection
+static QByteArray exchange(int descriptor, const QByteArray & request)
+{
+    QByteArray response;
+    if (::send(descriptor, request.constData(), size_t(request.size()), MSG_NOSIGNAL) != request.size())
+        return response;
+
+    char buffer[4096];
+    ssize_t bytes;
+    while ((bytes = ::recv(descriptor, buffer, sizeof(buffer), 0)) > 0 || (bytes < 0 && errno == EINTR))  {
+        if (bytes > 0)
+            response.append(buffer, int(bytes));
+    }
+
+    return response;
+}
+
+static QByteArray unixRequest(const QString & path, const QByteArray & request)
+{
+    int descriptor = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_un address = unixAddress(path);
+    if (descriptor < 0 || ::connect(descriptor, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0)  {
+        ::close(descriptor);
+        return QByteArray();
+    }
+
+    QByteArray response = exchange(descriptor, request);
+    ::close(descriptor);
+    return response;
+}
+
+void tst_QDaemonMetricsServer::requests_data()
+{
+    QTest::addColumn<QByteArray>("request");
+    QTest::addColumn<QByteArray>("status");
+    QTest::addColumn<bool>("hasBody");
+
+    QTest::newRow("metrics") << QByteArray("GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n") << QByteArray("200 OK") << true;
+    QTest::newRow("root") << QByteArray("GET / HTTP/1.0\r\n\r\n") << QByteArray("200 OK") << true;
+    QTest::newRow("query") << QByteArray("GET /metrics?name=process_threads HTTP/1.1\r\n\r\n") << QByteArray("200 OK") << true;
+    QTest::newRow("head") << QByteArray("HEAD /metrics HTTP/1.1\r\n\r\n") << QByteArray("200 OK") << false;
+    QTest::newRow("post") << QByteArray("POST /metrics HTTP/1.1\r\nContent-Length: 0\r\n\r\n") << QByteArray("405 Method Not Allowed") << false;
+    QTest::newRow("unknown path") << QByteArray("GET /status HTTP/1.1\r\n\r\n") << QByteArray("404 Not Found") << false;
+    QTest::newRow("malformed") << QByteArray("hello\r\n\r\n") << QByteArray("400 Bad Request") << false;
+}
+
+void tst_QDaemonMetricsServer::requests()
+{
+    QFETCH(QByteArray, request);
+    QFETCH(QByteArray, status);
+    QFETCH(bool, hasBody);
+
+    QDaemonApplication app(argc, argv);
+
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    const QString path = directory.filePath(QStringLiteral("metrics.sock"));
+
+    QDaemonMetricsServer server;
+    QVERIFY(server.listen(QStringLiteral("unix:") + path));
+
+    QByteArray response = unixRequest(path, request);
+    QVERIFY(response.startsWith("HTTP/1.1 " + status + "\r\n"));
+    QVERIFY(response.contains("Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"));
+
+    int separator = response.indexOf("\r\n\r\n");
+    QVERIFY(separator > 0);
+    QByteArray body = response.mid(separator + 4);
+    QCOMPARE(body.isEmpty(), !hasBody);
+
+    if (hasBody)  {
+        QVERIFY(response.contains("Content-Length: " + QByteArray::number(body.size()) + "\r\n"));
+
+        // The process metrics, in the text exposition format
+        QVERIFY(body.contains("# TYPE process_cpu_seconds_total counter\nprocess_cpu_seconds_total "));
+        QVERIFY(body.contains("# TYPE process_resident_memory_bytes gauge\nprocess_resident_memory_bytes "));
+        QVERIFY(body.contains("\nprocess_open_fds "));
+        QVERIFY(body.endsWith('\n'));
+    }
+
+    // Removed once stopped
+    server.stop();
+    QVERIFY(!QFile::exists(path));
+}
+
+void tst_QDaemonMetricsServer::tcpEndpoint()
+{
+    QDaemonApplication app(argc, argv);
+
+    // Find a free port on the loopback interface
+    int probe = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    QVERIFY(probe >= 0);
+
+    struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    QCOMPARE(::bind(probe, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)), 0);
+    QCOMPARE(::getsockname(probe, reinterpret_cast<struct sockaddr *>(&address), &length), 0);
+    ::close(probe);
+
+    QDaemonMetricsServer server;
+    QVERIFY(server.listen(QStringLiteral("127.0.0.1:%1").arg(ntohs(address.sin_port))));
+
+    int client = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    QVERIFY(client >= 0);
+    QCOMPARE(::connect(client, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)), 0);
+
+    QByteArray response = exchange(client, "GET /metrics HTTP/1.1\r\n\r\n");
+    ::close(client);
+
+    QVERIFY(response.startsWith("HTTP/1.1 200 OK\r\n"));
+    QVERIFY(response.contains("\nprocess_threads "));
+}
+
+void tst_QDaemonMetricsServer::invalidEndpoint()
+{
+    QDaemonApplication app(argc, argv);
+
+    QDaemonMetricsServer server;
+    QVERIFY(!server.listen(QStringLiteral("unix:")));
+    QVERIFY(!server.listen(QStringLiteral("unix:/") + QString(200, QLatin1Char('x'))));
+    QVERIFY(!server.listen(QStringLiteral("127.0.0.1:port")));
+    QVERIFY(!server.listen(QStringLiteral("/nonexistent/directory/metrics.sock")));
+    QVERIFY(!server.isRunning());
+}
+
+void tst_QDaemonMetricsServer::staleSocket()
+{
+    QDaemonApplication app(argc, argv);
+
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    const QString path = directory.filePath(QStringLiteral("metrics.sock"));
+
+    // Left behind by a previous run that didn't get to clean up
+    int stale = bindSocket(path, false);
+    QVERIFY(stale >= 0);
+    ::close(stale);
+    QVERIFY(QFile::exists(path));
+
+    QDaemonMetricsServer server;
+    QVERIFY(server.listen(path));
+    QVERIFY(unixRequest(path, "GET /metrics HTTP/1.1\r\n\r\n").startsWith("HTTP/1.1 200 OK\r\n"));
+}
+
+void tst_QDaemonMetricsServer::liveSocket()
+{
+    QDaemonApplication app(argc, argv);
+
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    const QString path = directory.filePath(QStringLiteral("metrics.sock"));
+
+    // Another daemon serves on the path, it's not taken over
+    int live = bindSocket(path, true);
+    QVERIFY(live >= 0);
+
+    QDaemonMetricsServer server;
+    QVERIFY(!server.listen(path));
+    server.stop();
+
+    QVERIFY(QFile::exists(path));
+    int client = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_un address = unixAddress(path);
+    QCOMPARE(::connect(client, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)), 0);
+    ::close(client);
+    ::close(live);
+
+    // Neither is a file that isn't a socket
+    QVERIFY(QFile::remove(path));
+    QFile file(path);
+    QVERIFY(file.open(QFile::WriteOnly));
+    file.close();
+
+    QVERIFY(!server.listen(path));
+    QVERIFY(QFile::exists(path));
+}
+
+QTEST_APPLESS_MAIN(tst_QDaemonMetricsServer)
+
+#include "tst_qdaemonmetricsserver.moc"
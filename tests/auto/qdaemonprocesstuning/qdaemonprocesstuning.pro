@@ -0,0 +1,9 @@
+CONFIG += testcase
+TARGET = tst_qdaemonprocesstuning
+QT = core daemon testlib
+
+# The process tuning is internal to the module, so it's built into the test
+INCLUDEPATH += ../../../src/daemon/private
+
+SOURCES = tst_qdaemonprocesstuning.cpp \
+    ../../../src/daemon/private/qdaemonprocesstuning_p.cpp
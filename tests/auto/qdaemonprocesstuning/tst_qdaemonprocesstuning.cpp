@@ -0,0 +1,245 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+
+#include "qdaemonprocesstuning_p.h"
+
+#include <sched.h>
+#include <sys/resource.h>
+#include <errno.h>
+
+#include <limits>
+
+using namespace QtDaemon;
+
+class tst_QDaemonProcessTuning : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void parseCpuList_data();
+    void parseCpuList();
+    void cpuListString();
+    void parseIoPriority_data();
+    void parseIoPriority();
+    void affinity();
+    void nice();
+    void parseSize_data();
+    void parseSize();
+    void descriptorLimit();
+    void heapReserve();
+};
+
+void tst_QDaemonProcessTuning::parseCpuList_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<bool>("valid");
+    QTest::addColumn<QList<int> >("cpus");
+
+    QTest::newRow("single") << QStringLiteral("3") << true << (QList<int>() << 3);
+    QTest::newRow("range") << QStringLiteral("0-3") << true << (QList<int>() << 0 << 1 << 2 << 3);
+    QTest::newRow("mixed") << QStringLiteral("0-1,8,10-11") << true << (QList<int>() << 0 << 1 << 8 << 10 << 11);
+    QTest::newRow("sorted") << QStringLiteral("8,2-3,0") << true << (QList<int>() << 0 << 2 << 3 << 8);
+    QTest::newRow("overlapping") << QStringLiteral("0-2,1-3,2") << true << (QList<int>() << 0 << 1 << 2 << 3);
+    QTest::newRow("spaces") << QStringLiteral(" 1 - 2 , 4\n") << true << (QList<int>() << 1 << 2 << 4);
+    QTest::newRow("trailing comma") << QStringLiteral("1,2,") << true << (QList<int>() << 1 << 2);
+
+    QTest::newRow("empty") << QString() << false << QList<int>();
+    QTest::newRow("negative") << QStringLiteral("-1") << false << QList<int>();
+    QTest::newRow("reversed") << QStringLiteral("3-1") << false << QList<int>();
+    QTest::newRow("open range") << QStringLiteral("2-") << false << QList<int>();
+    QTest::newRow("two dashes") << QStringLiteral("1-2-3") << false << QList<int>();
+    QTest::newRow("not a number") << QStringLiteral("one") << false << QList<int>();
+    QTest::newRow("too large") << QString::number(CPU_SETSIZE) << false << QList<int>();
+}
+
+void tst_QDaemonProcessTuning::parseCpuList()
+{
+    QFETCH(QString, text);
+    QFETCH(bool, valid);
+    QFETCH(QList<int>, cpus);
+
+    QList<int> parsed;
+    QCOMPARE(QDaemonProcessTuning::parseCpuList(text, parsed), valid);
+    if (valid)
+        QCOMPARE(parsed, cpus);
+}
+
+void tst_QDaemonProcessTuning::cpuListString()
+{
+    QCOMPARE(QDaemonProcessTuning::cpuListString(QList<int>()), QString());
+    QCOMPARE(QDaemonProcessTuning::cpuListString(QList<int>() << 5), QStringLiteral("5"));
+    QCOMPARE(QDaemonProcessTuning::cpuListString(QList<int>() << 0 << 1 << 2 << 3 << 8 << 10 << 11), QStringLiteral("0-3,8,10-11"));
+
+    // Round trips through the parser
+    QList<int> cpus;
+    QVERIFY(QDaemonProcessTuning::parseCpuList(QStringLiteral("1,3-5,7,9-10"), cpus));
+    QCOMPARE(QDaemonProcessTuning::cpuListString(cpus), QStringLiteral("1,3-5,7,9-10"));
+}
+
+void tst_QDaemonProcessTuning::parseIoPriority_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<bool>("valid");
+    QTest::addColumn<int>("priority");
+
+    // The class is in the bits above 13, the level in the ones below
+    QTest::newRow("realtime") << QStringLiteral("realtime:0") << true << ((1 << 13) | 0);
+    QTest::newRow("rt") << QStringLiteral("rt:7") << true << ((1 << 13) | 7);
+    QTest::newRow("best-effort") << QStringLiteral("best-effort:2") << true << ((2 << 13) | 2);
+    QTest::newRow("default level") << QStringLiteral("be") << true << ((2 << 13) | 4);
+    QTest::newRow("case") << QStringLiteral("BE:1") << true << ((2 << 13) | 1);
+    QTest::newRow("idle") << QStringLiteral("idle") << true << (3 << 13);
+
+    QTest::newRow("idle with a level") << QStringLiteral("idle:3") << false << 0;
+    QTest::newRow("level too high") << QStringLiteral("be:8") << false << 0;
+    QTest::newRow("negative level") << QStringLiteral("rt:-1") << false << 0;
+    QTest::newRow("bad level") << QStringLiteral("rt:high") << false << 0;
+    QTest::newRow("extra field") << QStringLiteral("rt:1:2") << false << 0;
+    QTest::newRow("unknown class") << QStringLiteral("urgent:1") << false << 0;
+    QTest::newRow("empty") << QString() << false << 0;
+}
+
+void tst_QDaemonProcessTuning::parseIoPriority()
+{
+    QFETCH(QString, text);
+    QFETCH(bool, valid);
+    QFETCH(int, priority);
+
+    int parsed = -1;
+    QCOMPARE(QDaemonProcessTuning::parseIoPriority(text, parsed), valid);
+    if (valid)
+        QCOMPARE(parsed, priority);
+}
+
+void tst_QDaemonProcessTuning::affinity()
+{
+    QList<int> allowed = QDaemonProcessTuning::allowedCpus();
+    QVERIFY(!allowed.isEmpty());
+
+    // Applying the current set changes nothing, but goes through all the threads of the process
+    QVERIFY(QDaemonProcessTuning::setAffinity(allowed));
+    QCOMPARE(QDaemonProcessTuning::allowedCpus(), allowed);
+
+    // Pinning the calling thread to a single CPU, then back
+    QVERIFY(QDaemonProcessTuning::setCurrentThreadAffinity(QList<int>() << allowed.first()));
+    QCOMPARE(QDaemonProcessTuning::allowedCpus(), QList<int>() << allowed.first());
+    QVERIFY(QDaemonProcessTuning::setCurrentThreadAffinity(allowed));
+    QCOMPARE(QDaemonProcessTuning::allowedCpus(), allowed);
+
+    errno = 0;
+    QVERIFY(!QDaemonProcessTuning::setCurrentThreadAffinity(QList<int>() << CPU_SETSIZE));
+    QCOMPARE(errno, EINVAL);
+}
+
+void tst_QDaemonProcessTuning::nice()
+{
+    // Lowering the priority doesn't need privileges, raising it back does, so this is done last
+    errno = 0;
+    int current = ::getpriority(PRIO_PROCESS, 0);
+    QCOMPARE(errno, 0);
+
+    int lower = qMin(current + 1, 19);
+    QVERIFY(QDaemonProcessTuning::setNice(lower));
+    QCOMPARE(::getpriority(PRIO_PROCESS, 0), lower);
+}
+
+void tst_QDaemonProcessTuning::parseSize_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<bool>("valid");
+    QTest::addColumn<qint64>("size");
+
+    QTest::newRow("bytes") << QStringLiteral("4096") << true << Q_INT64_C(4096);
+    QTest::newRow("zero") << QStringLiteral("0") << true << Q_INT64_C(0);
+    QTest::newRow("kilobytes") << QStringLiteral("64K") << true << Q_INT64_C(65536);
+    QTest::newRow("megabytes") << QStringLiteral("512M") << true << Q_INT64_C(536870912);
+    QTest::newRow("gigabytes") << QStringLiteral("2G") << true << Q_INT64_C(2147483648);
+    QTest::newRow("suffix case") << QStringLiteral("16mb") << true << Q_INT64_C(16777216);
+    QTest::newRow("bytes suffix") << QStringLiteral("100B") << true << Q_INT64_C(100);
+    QTest::newRow("spaces") << QStringLiteral(" 1k ") << true << Q_INT64_C(1024);
+
+    QTest::newRow("empty") << QString() << false << Q_INT64_C(0);
+    QTest::newRow("suffix only") << QStringLiteral("M") << false << Q_INT64_C(0);
+    QTest::newRow("negative") << QStringLiteral("-1") << false << Q_INT64_C(0);
+    QTest::newRow("fraction") << QStringLiteral("1.5G") << false << Q_INT64_C(0);
+    QTest::newRow("unknown suffix") << QStringLiteral("1T") << false << Q_INT64_C(0);
+    QTest::newRow("overflow") << QStringLiteral("9223372036854775807K") << false << Q_INT64_C(0);
+}
+
+void tst_QDaemonProcessTuning::parseSize()
+{
+    QFETCH(QString, text);
+    QFETCH(bool, valid);
+    QFETCH(qint64, size);
+
+    qint64 parsed = -1;
+    QCOMPARE(QDaemonProcessTuning::parseSize(text, parsed), valid);
+    if (valid)
+        QCOMPARE(parsed, size);
+}
+
+void tst_QDaemonProcessTuning::descriptorLimit()
+{
+    struct rlimit limit;
+    QCOMPARE(::getrlimit(RLIMIT_NOFILE, &limit), 0);
+    if (limit.rlim_max == RLIM_INFINITY)
+        QSKIP("The descriptor limit isn't bounded, the kernel's maximum applies instead.");
+
+    // As much as allowed is the hard limit, which doesn't need privileges
+    qint64 applied = 0;
+    QVERIFY(QDaemonProcessTuning::raiseDescriptorLimit(-1, applied));
+    QCOMPARE(applied, qint64(limit.rlim_max));
+
+    // Lowering the soft limit is allowed as well
+    const qint64 requested = qMin(qint64(limit.rlim_max), qint64(1024));
+    QVERIFY(QDaemonProcessTuning::raiseDescriptorLimit(requested, applied));
+    QCOMPARE(applied, requested);
+}
+
+void tst_QDaemonProcessTuning::heapReserve()
+{
+    errno = 0;
+    QVERIFY(!QDaemonProcessTuning::prefaultHeap(0));
+    QCOMPARE(errno, EINVAL);
+
+    errno = 0;
+    QVERIFY(!QDaemonProcessTuning::prefaultHeap(qint64(std::numeric_limits<int>::max()) + 1));
+    QCOMPARE(errno, EINVAL);
+
+    // The reserve is freed back to malloc, so later allocations don't fail
+    QVERIFY(QDaemonProcessTuning::prefaultHeap(4 * 1024 * 1024));
+
+    QByteArray data(1024 * 1024, 'x');
+    QCOMPARE(data.size(), 1024 * 1024);
+}
+
+QTEST_APPLESS_MAIN(tst_QDaemonProcessTuning)
+
+#include "tst_qdaemonprocesstuning.moc"
@@ -0,0 +1,4 @@
+CONFIG += testcase
+TARGET = tst_qdaemonsettings
+QT = core daemon testlib
+SOURCES = tst_qdaemonsettings.cpp
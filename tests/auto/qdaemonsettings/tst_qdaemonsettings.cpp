@@ -0,0 +1,224 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+#include <QtDaemon/qdaemonapplication.h>
+#include <QtDaemon/qdaemonsettings.h>
+
+#include <QtCore/qsavefile.h>
+#include <QtCore/qtemporarydir.h>
+#include <QtCore/qthread.h>
+
+class tst_QDaemonSettings : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+
+    void initialLoad();
+    void missingFile();
+    void reload();
+    void concurrentReaders();
+
+private:
+    bool write(int version);
+
+    QTemporaryDir directory;
+    QString fileName;
+};
+
+static int argc = 1;
+static char applicationName[] = "tst_qdaemonsettings";
+static char * argv[] = { applicationName, Q_NULLPTR };
+
+// Reads snapshots until stopped, checking that each of them comes from a single version of the file
+class SettingsReader : public QThread
+{
+public:
+    explicit SettingsReader(const QDaemonSettings & settings)
+        : consistent(true), ordered(true), reads(0), settings(settings)
+    {
+    }
+
+    QAtomicInt stopped;
+    bool consistent, ordered;
+    int reads;
+
+protected:
+    void run() Q_DECL_OVERRIDE
+    {
+        int last = 0;
+        while (!stopped.loadAcquire() && consistent && ordered)  {
+            QVariantMap snapshot = settings.snapshot();
+
+            int version = snapshot.value(QStringLiteral("a")).toInt();
+            consistent = snapshot.value(QStringLiteral("b")).toInt() == version && snapshot.value(QStringLiteral("group/c")).toInt() == version
+                            && snapshot.value(QStringLiteral("padding")).toString().size() == version;
+            ordered = version >= last;
+
+            last = version;
+            reads++;
+        }
+    }
+
+private:
+    const QDaemonSettings & settings;
+};
+
+void tst_QDaemonSettings::init()
+{
+    QVERIFY(directory.isValid());
+    fileName = directory.filePath(QStringLiteral("settings.conf"));
+    QFile::remove(fileName);
+}
+
+bool tst_QDaemonSettings::write(int version)
+{
+    // Replaced atomically, as a configuration management tool would. The padding changes the size with each version,
+    // as QSettings rereads a file it has cached only when its size or time stamp differ
+    QByteArray value = QByteArray::number(version);
+
+    QSaveFile file(fileName);
+    if (!file.open(QFile::WriteOnly))
+        return false;
+
+    file.write("a=" + value + "\nb=" + value + "\npadding=" + QByteArray(version, 'x') + "\n\n[group]\nc=" + value + '\n');
+    return file.commit();
+}
+
+void tst_QDaemonSettings::initialLoad()
+{
+    QDaemonApplication app(argc, argv);
+
+    QVERIFY(write(1));
+
+    // Loaded right away
+    QDaemonSettings settings(fileName);
+    QCOMPARE(settings.fileName(), fileName);
+    QCOMPARE(settings.value(QStringLiteral("a")).toInt(), 1);
+    QCOMPARE(settings.value(QStringLiteral("group/c")).toInt(), 1);
+    QCOMPARE(settings.value(QStringLiteral("missing"), 5).toInt(), 5);
+
+    QVariantMap snapshot = settings.snapshot();
+    QCOMPARE(snapshot.size(), 4);
+    QCOMPARE(snapshot.value(QStringLiteral("b")).toInt(), 1);
+}
+
+void tst_QDaemonSettings::missingFile()
+{
+    QDaemonApplication app(argc, argv);
+
+    QDaemonSettings settings(fileName);
+    QVERIFY(settings.snapshot().isEmpty());
+    QVERIFY(!settings.value(QStringLiteral("a")).isValid());
+}
+
+void tst_QDaemonSettings::reload()
+{
+    QDaemonApplication app(argc, argv);
+
+    QVERIFY(write(1));
+
+    QDaemonSettings settings(fileName);
+    QSignalSpy spy(&settings, SIGNAL(configurationChanged()));
+
+    // A snapshot taken before the reload is left alone
+    QVariantMap snapshot = settings.snapshot();
+
+    QVERIFY(write(2));
+    settings.reload();
+
+    QVERIFY(spy.wait());
+    QCOMPARE(settings.value(QStringLiteral("a")).toInt(), 2);
+    QCOMPARE(snapshot.value(QStringLiteral("a")).toInt(), 1);
+
+    // The current configuration is kept if the file goes away
+    spy.clear();
+    QVERIFY(QFile::remove(fileName));
+    settings.reload();
+
+    QVERIFY(!spy.wait(200));
+    QCOMPARE(settings.value(QStringLiteral("a")).toInt(), 2);
+}
+
+void tst_QDaemonSettings::concurrentReaders()
+{
+    const int readers = 4, versions = 200;
+
+    QDaemonApplication app(argc, argv);
+
+    QVERIFY(write(1));
+
+    QDaemonSettings settings(fileName);
+    QSignalSpy spy(&settings, SIGNAL(configurationChanged()));
+
+    QList<SettingsReader *> threads;
+    for (int i = 0; i < readers; i++)
+        threads.append(new SettingsReader(settings));
+    foreach (SettingsReader * thread, threads)
+        thread->start();
+
+    // The reloads pile up faster than they're loaded, so many of them are coalesced
+    bool written = true;
+    for (int version = 2; version <= versions && written; version++)  {
+        written = write(version);
+        settings.reload();
+
+        if (version % 20 == 0)
+            QCoreApplication::processEvents();
+    }
+
+    // The last version is published in the end
+    QElapsedTimer timer;
+    timer.start();
+    while (settings.value(QStringLiteral("a")).toInt() != versions && timer.elapsed() < 5000)
+        QTest::qWait(10);
+
+    // The readers are stopped before anything is checked, they must not outlive the settings
+    foreach (SettingsReader * thread, threads)
+        thread->stopped.storeRelease(1);
+    foreach (SettingsReader * thread, threads)
+        thread->wait();
+
+    QVERIFY(written);
+    QCOMPARE(settings.value(QStringLiteral("a")).toInt(), versions);
+    QVERIFY(spy.count() > 0);
+
+    foreach (SettingsReader * thread, threads)  {
+        QVERIFY(thread->consistent);
+        QVERIFY(thread->ordered);
+        QVERIFY(thread->reads > 0);
+    }
+
+    qDeleteAll(threads);
+}
+
+QTEST_APPLESS_MAIN(tst_QDaemonSettings)
+
+#include "tst_qdaemonsettings.moc"
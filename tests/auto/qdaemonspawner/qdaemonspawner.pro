@@ -0,0 +1,9 @@
+CONFIG += testcase
+TARGET = tst_qdaemonspawner
+QT = core daemon testlib
+
+# The spawner is internal to the module, so it's built into the test
+INCLUDEPATH += ../../../src/daemon/private
+
+SOURCES = tst_qdaemonspawner.cpp \
+    ../../../src/daemon/private/qdaemonspawner_p.cpp
@@ -0,0 +1,100 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+
+#include "qdaemonspawner_p.h"
+
+#include <QtCore/qtemporarydir.h>
+
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+
+using namespace QtDaemon;
+
+class tst_QDaemonSpawner : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void missingProgram();
+    void missingWorkingDirectory();
+    void spawn();
+};
+
+static QByteArray readFile(const QString & fileName)
+{
+    QFile file(fileName);
+    return file.open(QFile::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+void tst_QDaemonSpawner::missingProgram()
+{
+    // The failure of the exec is reported back, not only the fork
+    errno = 0;
+    QCOMPARE(QDaemonSpawner::spawn(QStringLiteral("/nonexistent/program"), QStringList(), QString(), QStringList()), qint64(-1));
+    QCOMPARE(errno, ENOENT);
+}
+
+void tst_QDaemonSpawner::missingWorkingDirectory()
+{
+    errno = 0;
+    QCOMPARE(QDaemonSpawner::spawn(QStringLiteral("/bin/sh"), QStringList(), QStringLiteral("/nonexistent/directory"), QStringList()), qint64(-1));
+    QCOMPARE(errno, ENOENT);
+}
+
+void tst_QDaemonSpawner::spawn()
+{
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+
+    // The daemon writes where it runs, its pid, and the environment it got, then waits to be stopped
+    QStringList arguments = QStringList() << QStringLiteral("-c") << QStringLiteral("pwd > output; echo $$ >> output; echo $VARIABLE >> output; exec /bin/sleep 60");
+    qint64 pid = QDaemonSpawner::spawn(QStringLiteral("/bin/sh"), arguments, directory.path(), QStringList() << QStringLiteral("VARIABLE=value"));
+    QVERIFY(pid > 0);
+    QVERIFY(QDaemonSpawner::isAlive(pid));
+
+    QByteArray output;
+    QTRY_COMPARE((output = readFile(directory.filePath(QStringLiteral("output")))).count('\n'), 3);
+
+    QList<QByteArray> lines = output.trimmed().split('\n');
+    QCOMPARE(QFileInfo(QFile::decodeName(lines.at(0))).canonicalFilePath(), QFileInfo(directory.path()).canonicalFilePath());
+    QCOMPARE(lines.at(1).toLongLong(), pid);
+    QCOMPARE(lines.at(2), QByteArray("value"));
+
+    // The daemon is detached from the session of the controller
+    QVERIFY(::getsid(pid_t(pid)) != ::getsid(0));
+
+    QCOMPARE(::kill(pid_t(pid), SIGTERM), 0);
+    QTRY_VERIFY(!QDaemonSpawner::isAlive(pid));
+}
+
+QTEST_GUILESS_MAIN(tst_QDaemonSpawner)
+
+#include "tst_qdaemonspawner.moc"
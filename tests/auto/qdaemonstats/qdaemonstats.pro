@@ -0,0 +1,4 @@
+CONFIG += testcase
+TARGET = tst_qdaemonstats
+QT = core daemon testlib
+SOURCES = tst_qdaemonstats.cpp
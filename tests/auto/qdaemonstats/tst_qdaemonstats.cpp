@@ -0,0 +1,246 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+#include <QtDaemon/qdaemonstats.h>
+
+#include <QtCore/qthread.h>
+
+#include <atomic>
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+class tst_QDaemonStats : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void missingSegment();
+    void shortSegment();
+    void unknownLayout();
+    void concurrentWriter();
+
+private:
+    bool createSegment(size_t size = sizeof(QDaemonStatsBlock));
+
+    QString instance;
+    QByteArray name;
+    QDaemonStatsBlock * block;
+};
+
+// Updates the block the way the daemon's publisher does, with the same value in all the fields
+class StatsWriter : public QThread
+{
+public:
+    StatsWriter(QDaemonStatsBlock * block)
+        : block(block), updates(0)
+    {
+    }
+
+    QAtomicInt stopped;
+
+protected:
+    void run() Q_DECL_OVERRIDE
+    {
+        while (!stopped.loadAcquire())  {
+            qint64 value = ++updates;
+
+            quint32 sequence = block->sequence;
+            __atomic_store_n(&block->sequence, sequence + 1, __ATOMIC_RELAXED);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            block->pid = value;
+            block->updateTime = value;
+            block->logQueueDepth = value;
+            block->eventLoopLag = value;
+            for (int i = 0; i < QDaemonStatsBlock::MaximumCounters; i++)
+                block->counters[i].value = value;
+
+            __atomic_store_n(&block->sequence, sequence + 2, __ATOMIC_RELEASE);
+
+            // A varying pause, so the reader gets its chance, but also keeps running into updates
+            for (volatile int pause = int(value % 2048); pause > 0; pause--)
+                ;
+        }
+    }
+
+private:
+    QDaemonStatsBlock * block;
+    qint64 updates;
+};
+
+void tst_QDaemonStats::init()
+{
+    instance = QStringLiteral("test%1").arg(QCoreApplication::applicationPid());
+    name = QFile::encodeName(QDaemonStatsReader::segmentName(instance));
+    block = Q_NULLPTR;
+}
+
+void tst_QDaemonStats::cleanup()
+{
+    if (block)
+        ::munmap(block, sizeof(QDaemonStatsBlock));
+    ::shm_unlink(name.constData());
+}
+
+bool tst_QDaemonStats::createSegment(size_t size)
+{
+    int descriptor = ::shm_open(name.constData(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (descriptor < 0)
+        return false;
+
+    void * mapping = MAP_FAILED;
+    bool resized = ::ftruncate(descriptor, off_t(size)) == 0;
+    if (resized && size >= sizeof(QDaemonStatsBlock))
+        mapping = ::mmap(Q_NULLPTR, sizeof(QDaemonStatsBlock), PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    ::close(descriptor);
+
+    if (size < sizeof(QDaemonStatsBlock))
+        return resized;     // Left empty, the reader must not map it anyway
+    if (mapping == MAP_FAILED)
+        return false;
+
+    block = static_cast<QDaemonStatsBlock *>(mapping);
+    block->magic = QDaemonStatsBlock::Magic;
+    block->version = QDaemonStatsBlock::Version;
+    block->size = sizeof(QDaemonStatsBlock);
+    block->state = QDaemonStatsBlock::RunningState;
+    block->counterCount = QDaemonStatsBlock::MaximumCounters;
+    return true;
+}
+
+void tst_QDaemonStats::missingSegment()
+{
+    QDaemonStatsReader reader;
+    QVERIFY(!reader.open(instance));
+    QVERIFY(!reader.isOpen());
+
+    QDaemonStatsBlock snapshot;
+    QVERIFY(!reader.read(snapshot));
+}
+
+void tst_QDaemonStats::shortSegment()
+{
+    // Published by an older daemon
+    QVERIFY(createSegment(sizeof(QDaemonStatsBlock) / 2));
+
+    QDaemonStatsReader reader;
+    QVERIFY(!reader.open(instance));
+}
+
+void tst_QDaemonStats::unknownLayout()
+{
+    QVERIFY(createSegment());
+
+    QDaemonStatsReader reader;
+    QVERIFY(reader.open(instance));
+    QVERIFY(reader.isOpen());
+
+    QDaemonStatsBlock snapshot;
+    QVERIFY(reader.read(snapshot));
+    QCOMPARE(snapshot.state, qint32(QDaemonStatsBlock::RunningState));
+
+    block->magic = 0;
+    QVERIFY(!reader.read(snapshot));
+    block->magic = QDaemonStatsBlock::Magic;
+
+    block->version = QDaemonStatsBlock::Version + 1;
+    QVERIFY(!reader.read(snapshot));
+    block->version = QDaemonStatsBlock::Version;
+
+    block->size = sizeof(QDaemonStatsBlock) - 1;
+    QVERIFY(!reader.read(snapshot));
+    block->size = sizeof(QDaemonStatsBlock);
+
+    // A writer that never finishes its update
+    block->sequence = 1;
+    QVERIFY(!reader.read(snapshot));
+    block->sequence = 2;
+
+    QVERIFY(reader.read(snapshot));
+
+    reader.close();
+    QVERIFY(!reader.isOpen());
+    QVERIFY(!reader.read(snapshot));
+}
+
+void tst_QDaemonStats::concurrentWriter()
+{
+    QVERIFY(createSegment());
+
+    QDaemonStatsReader reader;
+    QVERIFY(reader.open(instance));
+
+    StatsWriter writer(block);
+    writer.start();
+
+    // Every snapshot must come from a single update, and the updates must never be seen out of order
+    int snapshots = 0, failures = 0;
+    qint64 last = 0;
+    bool consistent = true, ordered = true;
+
+    QDaemonStatsBlock snapshot;
+    QElapsedTimer timer;
+    timer.start();
+    while (timer.elapsed() < 500 && consistent && ordered)  {
+        if (!reader.read(snapshot))  {
+            failures++;
+            continue;
+        }
+
+        snapshots++;
+
+        qint64 value = snapshot.pid;
+        consistent = snapshot.updateTime == value && snapshot.logQueueDepth == value && snapshot.eventLoopLag == value;
+        for (int i = 0; i < QDaemonStatsBlock::MaximumCounters && consistent; i++)
+            consistent = snapshot.counters[i].value == value;
+
+        ordered = value >= last;
+        last = value;
+    }
+
+    writer.stopped.storeRelease(1);
+    QVERIFY(writer.wait());
+
+    QVERIFY(consistent);
+    QVERIFY(ordered);
+    QVERIFY2(snapshots > 0, qPrintable(QStringLiteral("The writer starved the reader (%1 failed reads)").arg(failures)));
+
+    // Once the writer is done the last update is read
+    QVERIFY(reader.read(snapshot));
+    QCOMPARE(snapshot.pid, block->pid);
+}
+
+QTEST_GUILESS_MAIN(tst_QDaemonStats)
+
+#include "tst_qdaemonstats.moc"
@@ -0,0 +1,11 @@
+CONFIG += testcase
+TARGET = tst_qdaemonstatsmonitor
+QT = core daemon testlib
+
+# The monitor is internal to the module, so it's built into the test
+INCLUDEPATH += ../../../src/daemon/private
+
+HEADERS = ../../../src/daemon/private/qdaemonstatsmonitor_p.h
+SOURCES = tst_qdaemonstatsmonitor.cpp \
+    ../../../src/daemon/private/qdaemonstatsmonitor_p.cpp \
+    ../../../src/daemon/private/qdaemonspawner_p.cpp
@@ -0,0 +1,279 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+
+#include "qdaemonstatsmonitor_p.h"
+
+#include <QtDaemon/qdaemonstats.h>
+
+#include <QtCore/qtemporaryfile.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace QtDaemon;
+
+class tst_QDaemonStatsMonitor : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void notPublished();
+    void report();
+    void counterRates();
+    void stale();
+    void processGone();
+    void workers();
+    void allInstances();
+
+private:
+    QDaemonStatsBlock * createSegment(const QString &);
+    QString refresh(QDaemonStatsMonitor &, void (QDaemonStatsMonitor::*)() = &QDaemonStatsMonitor::refresh);
+
+    QString instance;
+    QList<QByteArray> segments;
+    QList<QDaemonStatsBlock *> blocks;
+};
+
+void tst_QDaemonStatsMonitor::init()
+{
+    instance = QStringLiteral("test%1").arg(QCoreApplication::applicationPid());
+}
+
+void tst_QDaemonStatsMonitor::cleanup()
+{
+    foreach (QDaemonStatsBlock * block, blocks)
+        ::munmap(block, sizeof(QDaemonStatsBlock));
+    blocks.clear();
+
+    foreach (const QByteArray & segment, segments)
+        ::shm_unlink(segment.constData());
+    segments.clear();
+}
+
+// Publishes a segment the way the daemon does, for this process
+QDaemonStatsBlock * tst_QDaemonStatsMonitor::createSegment(const QString & name)
+{
+    QByteArray segment = QFile::encodeName(name);
+    int descriptor = ::shm_open(segment.constData(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (descriptor < 0)
+        return Q_NULLPTR;
+    segments.append(segment);
+
+    void * mapping = MAP_FAILED;
+    if (::ftruncate(descriptor, off_t(sizeof(QDaemonStatsBlock))) == 0)
+        mapping = ::mmap(Q_NULLPTR, sizeof(QDaemonStatsBlock), PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    ::close(descriptor);
+
+    if (mapping == MAP_FAILED)
+        return Q_NULLPTR;
+
+    QDaemonStatsBlock * block = static_cast<QDaemonStatsBlock *>(mapping);
+    blocks.append(block);
+
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    block->magic = QDaemonStatsBlock::Magic;
+    block->version = QDaemonStatsBlock::Version;
+    block->size = sizeof(QDaemonStatsBlock);
+    block->pid = QCoreApplication::applicationPid();
+    block->startTime = now;
+    block->updateTime = now;
+    block->state = QDaemonStatsBlock::RunningState;
+    block->eventLoopLag = -1;
+    return block;
+}
+
+static void setCounter(QDaemonStatsBlock * block, int index, const char * name, qint64 value)
+{
+    ::strncpy(block->counters[index].name, name, QDaemonStatsBlock::NameSize);
+    block->counters[index].value = value;
+    block->counterCount = qMax(block->counterCount, index + 1);
+}
+
+// The monitor draws on the standard output, so that's captured while it refreshes
+QString tst_QDaemonStatsMonitor::refresh(QDaemonStatsMonitor & monitor, void (QDaemonStatsMonitor::*method)())
+{
+    QTemporaryFile file;
+    if (!file.open())
+        return QString();
+
+    ::fflush(stdout);
+    int output = ::dup(STDOUT_FILENO);
+    ::dup2(file.handle(), STDOUT_FILENO);
+
+    (monitor.*method)();
+
+    ::fflush(stdout);
+    ::dup2(output, STDOUT_FILENO);
+    ::close(output);
+
+    file.seek(0);
+    return QString::fromLocal8Bit(file.readAll());
+}
+
+void tst_QDaemonStatsMonitor::notPublished()
+{
+    QDaemonStatsMonitor monitor(QStringList() << instance, 1000);
+
+    QString output = refresh(monitor, &QDaemonStatsMonitor::start);
+    QVERIFY2(output.contains(QStringLiteral("Instance %1 doesn't publish its statistics (it's not running).").arg(instance)), qPrintable(output));
+}
+
+void tst_QDaemonStatsMonitor::report()
+{
+    QDaemonStatsBlock * block = createSegment(QDaemonStatsReader::segmentName(instance));
+    QVERIFY(block);
+
+    block->startTime -= 3723000;
+    block->eventLoopLag = 1500;
+    block->logQueueDepth = 7;
+    setCounter(block, 0, "connections", 5);
+    setCounter(block, 1, "requests_total", 100);
+
+    QDaemonStatsMonitor monitor(QStringList() << instance, 1000);
+
+    QString output = refresh(monitor, &QDaemonStatsMonitor::start);
+    QVERIFY2(output.contains(QStringLiteral("refreshed every 1000 ms")), qPrintable(output));
+    QVERIFY2(output.contains(QStringLiteral("Instance %1 is running, process %2, up 01:02:03\n").arg(instance).arg(QCoreApplication::applicationPid())), qPrintable(output));
+    QVERIFY2(output.contains(QStringLiteral("event loop lag 1.50 ms  log - entries/s  log queue 7")), qPrintable(output));
+    QVERIFY2(output.contains(QRegularExpression(QStringLiteral("CPU -  RSS \\d+\\.\\d [KMG]iB  threads \\d+  descriptors \\d+"))), qPrintable(output));
+
+    // In the order they were registered, aligned, only the counters have a rate (nothing to compare with yet)
+    QVERIFY2(output.contains(QStringLiteral("  metrics\n    connections     5\n    requests_total  100  (-/s)")), qPrintable(output));
+}
+
+void tst_QDaemonStatsMonitor::counterRates()
+{
+    QDaemonStatsBlock * block = createSegment(QDaemonStatsReader::segmentName(instance));
+    QVERIFY(block);
+
+    setCounter(block, 0, "qtdaemon_log_entries_total", 0);
+    setCounter(block, 1, "requests_total", 0);
+
+    QDaemonStatsMonitor monitor(QStringList() << instance, 1000);
+    refresh(monitor, &QDaemonStatsMonitor::start);
+
+    QTest::qWait(500);
+    block->counters[0].value = 1000;
+    block->counters[1].value = 1000;
+
+    // The rates are taken between the refreshes, so they're somewhat below 2000/s
+    QString output = refresh(monitor);
+    QRegularExpressionMatch match = QRegularExpression(QStringLiteral("requests_total\\s+1000  \\((\\d+\\.\\d)/s\\)")).match(output);
+    QVERIFY2(match.hasMatch(), qPrintable(output));
+    double rate = match.captured(1).toDouble();
+    QVERIFY2(rate > 0 && rate <= 2000, qPrintable(output));
+
+    QVERIFY2(output.contains(QRegularExpression(QStringLiteral("log \\d+\\.\\d entries/s"))), qPrintable(output));
+    QVERIFY2(output.contains(QRegularExpression(QStringLiteral("CPU \\d+\\.\\d%"))), qPrintable(output));
+}
+
+void tst_QDaemonStatsMonitor::stale()
+{
+    QDaemonStatsBlock * block = createSegment(QDaemonStatsReader::segmentName(instance));
+    QVERIFY(block);
+
+    block->updateTime -= 10000;
+
+    QDaemonStatsMonitor monitor(QStringList() << instance, 1000);
+
+    QString output = refresh(monitor, &QDaemonStatsMonitor::start);
+    QVERIFY2(output.contains(QStringLiteral(", not updated for 00:00:1")), qPrintable(output));
+}
+
+void tst_QDaemonStatsMonitor::processGone()
+{
+    // A process that's certainly gone, it was reaped already
+    pid_t pid = ::fork();
+    QVERIFY(pid >= 0);
+    if (pid == 0)
+        ::_exit(0);
+    QCOMPARE(::waitpid(pid, Q_NULLPTR, 0), pid);
+
+    QDaemonStatsBlock * block = createSegment(QDaemonStatsReader::segmentName(instance));
+    QVERIFY(block);
+    block->pid = pid;
+
+    QDaemonStatsMonitor monitor(QStringList() << instance, 1000);
+
+    QString output = refresh(monitor, &QDaemonStatsMonitor::start);
+    QVERIFY2(output.contains(QStringLiteral("Instance %1 is not running (process %2 is gone).").arg(instance).arg(pid)), qPrintable(output));
+}
+
+void tst_QDaemonStatsMonitor::workers()
+{
+    QVERIFY(createSegment(QDaemonStatsReader::segmentName(instance)));
+    QVERIFY(createSegment(QDaemonStatsReader::segmentName(instance, 1)));
+
+    QDaemonStatsBlock * worker = createSegment(QDaemonStatsReader::segmentName(instance, 0));
+    QVERIFY(worker);
+    setCounter(worker, 0, "requests_total", 42);
+
+    QDaemonStatsMonitor monitor(QStringList() << instance, 1000);
+
+    // Below the supervising process, indented, by index
+    QString output = refresh(monitor, &QDaemonStatsMonitor::start);
+    int daemon = output.indexOf(QStringLiteral("Instance %1 is running").arg(instance));
+    int first = output.indexOf(QStringLiteral("\n  Worker 0 is running"));
+    int second = output.indexOf(QStringLiteral("\n  Worker 1 is running"));
+    QVERIFY2(daemon >= 0 && first > daemon && second > first, qPrintable(output));
+    QVERIFY2(output.contains(QStringLiteral("\n      requests_total  42  (-/s)")), qPrintable(output));
+
+    // A worker that's gone is dropped
+    ::shm_unlink(segments.takeLast().constData());
+    output = refresh(monitor);
+    QVERIFY2(output.contains(QStringLiteral("Worker 1")), qPrintable(output));
+    QVERIFY2(!output.contains(QStringLiteral("Worker 0")), qPrintable(output));
+}
+
+void tst_QDaemonStatsMonitor::allInstances()
+{
+    QVERIFY(createSegment(QDaemonStatsReader::segmentName(instance)));
+    QVERIFY(createSegment(QDaemonStatsReader::segmentName(instance, 0)));
+
+    // Found by their segments, the worker's segment isn't taken for an instance
+    QDaemonStatsMonitor monitor(QStringList() << QStringLiteral("all"), 1000);
+
+    QString output = refresh(monitor, &QDaemonStatsMonitor::start);
+    QCOMPARE(output.count(QStringLiteral("Instance %1 ").arg(instance)), 1);
+    QVERIFY2(output.contains(QStringLiteral("\n  Worker 0 is running")), qPrintable(output));
+}
+
+QTEST_GUILESS_MAIN(tst_QDaemonStatsMonitor)
+
+#include "tst_qdaemonstatsmonitor.moc"
@@ -0,0 +1,10 @@
+CONFIG += testcase
+TARGET = tst_qdaemonsupervisor
+QT = core daemon testlib
+
+# The supervisor is internal to the module, so it's built into the test
+INCLUDEPATH += ../../../src/daemon/private
+
+HEADERS = ../../../src/daemon/private/qdaemonsupervisor_p.h
+SOURCES = tst_qdaemonsupervisor.cpp \
+    ../../../src/daemon/private/qdaemonsupervisor_p.cpp
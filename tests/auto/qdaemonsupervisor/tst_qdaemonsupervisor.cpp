@@ -0,0 +1,194 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+
+#include "qdaemonsupervisor_p.h"
+
+#include <QtDaemon/qdaemonapplication.h>
+
+#include <QtCore/qtemporarydir.h>
+#include <QtCore/qfile.h>
+
+#include <signal.h>
+
+using namespace QtDaemon;
+
+class tst_QDaemonSupervisor : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void restartBackoff();
+    void cleanExit();
+    void crashLoop();
+    void stop();
+
+private:
+    QList<qint64> startTimes(const QString &);
+
+    QScopedPointer<QDaemonApplication> app;
+    QTemporaryDir directory;
+};
+
+static int argc = 1;
+static char applicationName[] = "tst_qdaemonsupervisor";
+static char * argv[] = { applicationName, Q_NULLPTR };
+
+static const QString shell = QStringLiteral("/bin/sh");
+
+// A child that appends the time it was started (in milliseconds) to the given file and exits
+static QStringList child(const QString & file, int code)
+{
+    return QStringList() << QStringLiteral("-c") << QStringLiteral("echo $(($(date +%s%N) / 1000000)) >> '%1'; exit %2").arg(file).arg(code);
+}
+
+void tst_QDaemonSupervisor::initTestCase()
+{
+    // The supervisor logs through the application
+    app.reset(new QDaemonApplication(argc, argv));
+
+    if (!QFile::exists(shell))
+        QSKIP("There's no shell to run the children with.");
+
+    QVERIFY(directory.isValid());
+}
+
+void tst_QDaemonSupervisor::cleanupTestCase()
+{
+    app.reset();
+}
+
+QList<qint64> tst_QDaemonSupervisor::startTimes(const QString & fileName)
+{
+    QList<qint64> times;
+
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly | QFile::Text))
+        return times;
+
+    foreach (const QByteArray & line, file.readAll().split('\n'))  {
+        if (!line.isEmpty())
+            times.append(line.toLongLong());
+    }
+
+    return times;
+}
+
+void tst_QDaemonSupervisor::restartBackoff()
+{
+    QString file = directory.filePath(QStringLiteral("backoff"));
+
+    QDaemonSupervisor supervisor;
+    supervisor.setBackoff(100, 400);
+    supervisor.setCrashLimit(0, 0);
+    supervisor.start(shell, QList<QStringList>() << child(file, 1));
+
+    QTRY_VERIFY_WITH_TIMEOUT(startTimes(file).size() >= 5, 10000);
+    supervisor.stop();
+
+    // The delay doubles with each failure, up to the maximum (a coarse timer may fire up to 5% early)
+    QList<qint64> times = startTimes(file);
+    const qint64 delays[] = { 100, 200, 400, 400 };
+    for (int i = 0; i < 4; i++)
+        QVERIFY2(times.at(i + 1) - times.at(i) >= delays[i] * 95 / 100, qPrintable(QStringLiteral("Restart %1 after %2 ms").arg(i + 1).arg(times.at(i + 1) - times.at(i))));
+
+    QString status = supervisor.status();
+    QVERIFY2(status.startsWith(QStringLiteral("Child process 0: ")), qPrintable(status));
+    QVERIFY2(status.contains(QStringLiteral("last exited with code 1")), qPrintable(status));
+}
+
+void tst_QDaemonSupervisor::cleanExit()
+{
+    QString file = directory.filePath(QStringLiteral("clean"));
+
+    QDaemonSupervisor supervisor;
+    supervisor.setRestartPolicy(QDaemonSupervisor::RestartOnFailure);
+    supervisor.setBackoff(10, 10);
+
+    QSignalSpy finished(&supervisor, &QDaemonSupervisor::finished);
+    supervisor.start(shell, QList<QStringList>() << child(file, 0) << child(file, 0));
+
+    // Exiting cleanly is intentional, the supervisor is done once both children are
+    QTRY_COMPARE(finished.count(), 1);
+    QTest::qWait(100);
+
+    QCOMPARE(startTimes(file).size(), 2);
+
+    QStringList status = supervisor.status().split(QLatin1Char('\n'));
+    QCOMPARE(status.size(), 2);
+    for (int i = 0; i < status.size(); i++)
+        QVERIFY2(status.at(i).startsWith(QStringLiteral("Child process %1: stopped, 0 restart(s), last exited with code 0 at ").arg(i)), qPrintable(status.at(i)));
+}
+
+void tst_QDaemonSupervisor::crashLoop()
+{
+    QString file = directory.filePath(QStringLiteral("crash"));
+
+    QDaemonSupervisor supervisor;
+    supervisor.setBackoff(10, 10);
+    supervisor.setCrashLimit(2, 60000);
+
+    QSignalSpy crashLoop(&supervisor, &QDaemonSupervisor::crashLoop);
+    supervisor.start(shell, QList<QStringList>() << child(file, 1));
+
+    // The third failure within the window breaks the loop
+    QTRY_COMPARE(crashLoop.count(), 1);
+    QTest::qWait(100);
+
+    QCOMPARE(startTimes(file).size(), 3);
+
+    QString status = supervisor.status();
+    QVERIFY2(status.startsWith(QStringLiteral("Child process 0: stopped, 2 restart(s)")), qPrintable(status));
+}
+
+void tst_QDaemonSupervisor::stop()
+{
+    QDaemonSupervisor supervisor;
+    supervisor.setBackoff(10, 10);
+    supervisor.start(shell, QList<QStringList>() << (QStringList() << QStringLiteral("-c") << QStringLiteral("exec sleep 30")));
+
+    QVERIFY2(supervisor.status().contains(QStringLiteral("running")), qPrintable(supervisor.status()));
+
+    // The children are asked to quit and aren't restarted after
+    QElapsedTimer timer;
+    timer.start();
+    supervisor.stop();
+    QVERIFY(timer.elapsed() < 5000);
+
+    QTest::qWait(200);
+    QVERIFY2(!supervisor.status().contains(QStringLiteral("running")), qPrintable(supervisor.status()));
+    QVERIFY2(supervisor.status().contains(QStringLiteral("0 restart(s)")), qPrintable(supervisor.status()));
+}
+
+QTEST_APPLESS_MAIN(tst_QDaemonSupervisor)
+
+#include "tst_qdaemonsupervisor.moc"
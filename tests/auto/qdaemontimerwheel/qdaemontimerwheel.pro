@@ -0,0 +1,4 @@
+CONFIG += testcase
+TARGET = tst_qdaemontimerwheel
+QT = core daemon testlib
+SOURCES = tst_qdaemontimerwheel.cpp
@@ -0,0 +1,260 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+#include <QtDaemon/qdaemontimerwheel.h>
+
+class tst_QDaemonTimerWheel : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void start();
+    void restart();
+    void cancel();
+    void clear();
+    void cascade();
+    void cancelFromCallback();
+    void startFromCallback();
+    void staleIdentifiers();
+};
+
+void tst_QDaemonTimerWheel::start()
+{
+    QDaemonTimerWheel wheel(1);
+    QCOMPARE(wheel.resolution(), 1);
+    QCOMPARE(wheel.count(), 0);
+
+    QElapsedTimer clock;
+    clock.start();
+
+    qint64 elapsed = -1;
+    QDaemonTimerWheel::TimerId id = wheel.start(50, [&elapsed, &clock] () -> void  {
+        elapsed = clock.elapsed();
+    });
+
+    QVERIFY(id != 0);
+    QVERIFY(wheel.isActive(id));
+    QCOMPARE(wheel.count(), 1);
+
+    // Never early
+    QTRY_VERIFY(elapsed >= 0);
+    QVERIFY2(elapsed >= 50, qPrintable(QStringLiteral("Expired after %1 ms").arg(elapsed)));
+
+    // Expired timers are gone
+    QVERIFY(!wheel.isActive(id));
+    QCOMPARE(wheel.count(), 0);
+    QVERIFY(!wheel.cancel(id));
+}
+
+void tst_QDaemonTimerWheel::restart()
+{
+    QDaemonTimerWheel wheel(1);
+
+    QElapsedTimer clock;
+    clock.start();
+
+    int fired = 0;
+    qint64 elapsed = -1;
+    QDaemonTimerWheel::TimerId id = wheel.start(30, [&] () -> void  {
+        fired++;
+        elapsed = clock.elapsed();
+    });
+
+    // Pushed back before it expires, possibly several times
+    QTest::qWait(10);
+    const qint64 restarted = clock.elapsed();
+    QVERIFY(wheel.restart(id, 100));
+    QVERIFY(wheel.restart(id, 100));
+
+    QVERIFY(wheel.isActive(id));
+    QCOMPARE(wheel.count(), 1);
+
+    QTRY_COMPARE(fired, 1);
+    QVERIFY2(elapsed >= restarted + 100, qPrintable(QStringLiteral("Expired after %1 ms, restarted at %2 ms").arg(elapsed).arg(restarted)));
+
+    // Once expired it can't be restarted
+    QVERIFY(!wheel.restart(id, 10));
+    QTest::qWait(30);
+    QCOMPARE(fired, 1);
+}
+
+void tst_QDaemonTimerWheel::cancel()
+{
+    QDaemonTimerWheel wheel(1);
+
+    int fired = 0;
+    QDaemonTimerWheel::TimerId canceled = wheel.start(20, [&fired] () -> void  { fired++; });
+    QDaemonTimerWheel::TimerId kept = wheel.start(20, [&fired] () -> void  { fired += 10; });
+    QCOMPARE(wheel.count(), 2);
+
+    QVERIFY(wheel.cancel(canceled));
+    QVERIFY(!wheel.isActive(canceled));
+    QVERIFY(wheel.isActive(kept));
+    QCOMPARE(wheel.count(), 1);
+
+    // Canceling twice or an invalid identifier does nothing
+    QVERIFY(!wheel.cancel(canceled));
+    QVERIFY(!wheel.cancel(0));
+
+    QTRY_COMPARE(fired, 10);
+    QTest::qWait(30);
+    QCOMPARE(fired, 10);
+}
+
+void tst_QDaemonTimerWheel::clear()
+{
+    QDaemonTimerWheel wheel(1);
+
+    int fired = 0;
+    QList<QDaemonTimerWheel::TimerId> ids;
+    for (int i = 0; i < 100; i++)
+        ids.append(wheel.start(10 + i, [&fired] () -> void  { fired++; }));
+    QCOMPARE(wheel.count(), 100);
+
+    wheel.clear();
+    QCOMPARE(wheel.count(), 0);
+    foreach (QDaemonTimerWheel::TimerId id, ids)
+        QVERIFY(!wheel.isActive(id));
+
+    QTest::qWait(150);
+    QCOMPARE(fired, 0);
+}
+
+void tst_QDaemonTimerWheel::cascade()
+{
+    // With a resolution of 1 ms the first level spans 256 ms, so the longer timeouts are kept in the second level
+    // and spill into the first one when it wraps around
+    QDaemonTimerWheel wheel(1);
+
+    QElapsedTimer clock;
+    clock.start();
+
+    const int timeouts[] = { 700, 5, 255, 256, 257, 300, 511, 512, 600 };
+    const int count = int(sizeof(timeouts) / sizeof(timeouts[0]));
+
+    QVector<qint64> elapsed(count, -1);
+    QList<int> order;
+    for (int i = 0; i < count; i++)  {
+        wheel.start(timeouts[i], [&elapsed, &order, &clock, i] () -> void  {
+            elapsed[i] = clock.elapsed();
+            order.append(i);
+        });
+    }
+    QCOMPARE(wheel.count(), count);
+
+    QTRY_COMPARE_WITH_TIMEOUT(order.size(), count, 5000);
+    QCOMPARE(wheel.count(), 0);
+
+    // None expired early, and they expired in the order of their timeouts
+    for (int i = 0; i < count; i++)
+        QVERIFY2(elapsed.at(i) >= timeouts[i], qPrintable(QStringLiteral("%1 ms timeout expired after %2 ms").arg(timeouts[i]).arg(elapsed.at(i))));
+    for (int i = 1; i < count; i++)
+        QVERIFY(timeouts[order.at(i - 1)] <= timeouts[order.at(i)]);
+}
+
+void tst_QDaemonTimerWheel::cancelFromCallback()
+{
+    QDaemonTimerWheel wheel(1);
+
+    // Expiring in the same tick, whichever goes first cancels the other
+    int fired = 0;
+    QDaemonTimerWheel::TimerId first = 0, second = 0;
+    first = wheel.start(10, [&] () -> void  {
+        fired++;
+        QVERIFY(!wheel.cancel(first));      // Already expired
+        QVERIFY(wheel.cancel(second));
+    });
+    second = wheel.start(10, [&] () -> void  {
+        fired++;
+        QVERIFY(!wheel.cancel(second));
+        QVERIFY(wheel.cancel(first));
+    });
+
+    // One in a later slot, canceled from a callback as well
+    int laterFired = 0;
+    QDaemonTimerWheel::TimerId later = wheel.start(300, [&laterFired] () -> void  { laterFired++; });
+    wheel.start(20, [&wheel, later] () -> void  {
+        QVERIFY(wheel.cancel(later));
+    });
+
+    QTRY_COMPARE(wheel.count(), 0);
+    QCOMPARE(fired, 1);
+
+    QTest::qWait(350);
+    QCOMPARE(fired, 1);
+    QCOMPARE(laterFired, 0);
+}
+
+void tst_QDaemonTimerWheel::startFromCallback()
+{
+    QDaemonTimerWheel wheel(1);
+
+    // A periodic timeout, rearmed from its own callback
+    int fired = 0;
+    std::function<void ()> callback = [&] () -> void  {
+        if (++fired < 5)
+            wheel.start(5, callback);
+    };
+    wheel.start(5, callback);
+
+    QTRY_COMPARE(fired, 5);
+    QCOMPARE(wheel.count(), 0);
+}
+
+void tst_QDaemonTimerWheel::staleIdentifiers()
+{
+    QDaemonTimerWheel wheel(1);
+
+    int staleFired = 0, freshFired = 0;
+    QDaemonTimerWheel::TimerId stale = wheel.start(20, [&staleFired] () -> void  { staleFired++; });
+    QVERIFY(wheel.cancel(stale));
+
+    // The node of the canceled timer is reused, but the identifier isn't
+    QDaemonTimerWheel::TimerId fresh = wheel.start(20, [&freshFired] () -> void  { freshFired++; });
+    QVERIFY(fresh != stale);
+    QCOMPARE(quint32(fresh), quint32(stale));       // The same node
+
+    QVERIFY(!wheel.isActive(stale));
+    QVERIFY(!wheel.restart(stale, 1000));
+    QVERIFY(!wheel.cancel(stale));
+    QVERIFY(wheel.isActive(fresh));
+
+    QTRY_COMPARE(freshFired, 1);
+    QCOMPARE(staleFired, 0);
+
+    // Reused after expiring too
+    QDaemonTimerWheel::TimerId reused = wheel.start(1000, [] () -> void  { });
+    QCOMPARE(quint32(reused), quint32(fresh));
+    QVERIFY(!wheel.cancel(fresh));
+    QVERIFY(wheel.isActive(reused));
+}
+
+QTEST_GUILESS_MAIN(tst_QDaemonTimerWheel)
+
+#include "tst_qdaemontimerwheel.moc"
@@ -0,0 +1,10 @@
+CONFIG += testcase
+TARGET = tst_qdaemonwatchdog
+QT = core daemon testlib
+
+# The watchdog is internal to the module, so it's built into the test
+INCLUDEPATH += ../../../src/daemon/private
+
+HEADERS = ../../../src/daemon/private/qdaemonwatchdog_p.h
+SOURCES = tst_qdaemonwatchdog.cpp \
+    ../../../src/daemon/private/qdaemonwatchdog_p.cpp
@@ -0,0 +1,97 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+#include <QtDaemon/qdaemonapplication.h>
+#include <QtDaemon/qdaemonmetrics.h>
+
+#include "qdaemonwatchdog_p.h"
+
+using namespace QtDaemon;
+
+class tst_QDaemonWatchdog : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void latency();
+    void stalls();
+};
+
+static int argc = 1;
+static char applicationName[] = "tst_qdaemonwatchdog";
+static char * argv[] = { applicationName, Q_NULLPTR };
+
+void tst_QDaemonWatchdog::latency()
+{
+    QDaemonApplication app(argc, argv);
+
+    QDaemonWatchdog watchdog(100);
+    watchdog.start();
+
+    // The heartbeats go through the event loop, which is free
+    QDaemonHistogram lag = qDaemonMetrics().histogram(QStringLiteral("qtdaemon_event_loop_lag_microseconds"));
+    QDaemonCounter stalls = qDaemonMetrics().counter(QStringLiteral("qtdaemon_event_loop_stalls_total"));
+    QTRY_VERIFY(lag.count() >= 3);
+    QCOMPARE(stalls.value(), quint64(0));
+
+    watchdog.stop();
+    QVERIFY(watchdog.isFinished());
+
+    // Nothing is posted once stopped
+    const quint64 count = lag.count();
+    QTest::qWait(200);
+    QCOMPARE(lag.count(), count);
+}
+
+void tst_QDaemonWatchdog::stalls()
+{
+    QDaemonApplication app(argc, argv);
+
+    QDaemonWatchdog watchdog(100);
+    watchdog.start();
+
+    QDaemonHistogram lag = qDaemonMetrics().histogram(QStringLiteral("qtdaemon_event_loop_lag_microseconds"));
+    QDaemonGauge lastLag = qDaemonMetrics().gauge(QStringLiteral("qtdaemon_event_loop_last_lag_microseconds"));
+    QDaemonCounter stalls = qDaemonMetrics().counter(QStringLiteral("qtdaemon_event_loop_stalls_total"));
+    QTRY_VERIFY(lag.count() > 0);
+
+    // Blocked well past the threshold, reported once however long it lasts
+    QThread::msleep(500);
+    QCOMPARE(stalls.value(), quint64(1));
+
+    // The heartbeat that was kept waiting is dispatched late
+    QTRY_VERIFY(lastLag.value() >= 100000);
+
+    QThread::msleep(300);
+    QCOMPARE(stalls.value(), quint64(2));
+}
+
+QTEST_APPLESS_MAIN(tst_QDaemonWatchdog)
+
+#include "tst_qdaemonwatchdog.moc"
@@ -0,0 +1,6 @@
+TEMPLATE = subdirs
+SUBDIRS = \
+   qdaemontimerwheel
+
+linux: SUBDIRS += \
+   qdaemoneventdispatcher
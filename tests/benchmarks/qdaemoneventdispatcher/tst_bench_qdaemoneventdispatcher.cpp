@@ -0,0 +1,147 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+#include <QtDaemon/qdaemonapplication.h>
+
+#include <QtCore/qabstracteventdispatcher.h>
+#include <QtCore/qsocketnotifier.h>
+
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+// Runs an event loop watching idle sockets, the benchmark measures a single pass of it
+class IdleThread : public QThread
+{
+public:
+    explicit IdleThread(const QVector<int> & watched)
+        : descriptors(watched)
+    {
+    }
+
+    QSemaphore blocking;
+
+protected:
+    void run() Q_DECL_OVERRIDE
+    {
+        QList<QSocketNotifier *> notifiers;
+        foreach (int descriptor, descriptors)
+            notifiers.append(new QSocketNotifier(descriptor, QSocketNotifier::Read));
+
+        // Released each time the dispatcher is about to wait again, i.e. when it's done with a pass
+        QObject::connect(QAbstractEventDispatcher::instance(), &QAbstractEventDispatcher::aboutToBlock, [this] () -> void  {
+            blocking.release();
+        });
+
+        exec();
+        qDeleteAll(notifiers);
+    }
+
+private:
+    const QVector<int> descriptors;
+};
+
+class tst_QDaemonEventDispatcher : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void idleWakeUp_data();
+    void idleWakeUp();
+};
+
+void tst_QDaemonEventDispatcher::initTestCase()
+{
+    // Two descriptors per socket pair, so the default limit of 1024 isn't nearly enough
+    struct rlimit limit;
+    if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)  {
+        limit.rlim_cur = limit.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+void tst_QDaemonEventDispatcher::idleWakeUp_data()
+{
+    QTest::addColumn<bool>("epoll");
+    QTest::addColumn<int>("sockets");
+
+    const int counts[] = { 0, 1000, 10000, 20000 };
+    for (int count : counts)  {
+        QTest::newRow(qPrintable(QStringLiteral("default %1").arg(count))) << false << count;
+        QTest::newRow(qPrintable(QStringLiteral("epoll %1").arg(count))) << true << count;
+    }
+}
+
+void tst_QDaemonEventDispatcher::idleWakeUp()
+{
+    QFETCH(bool, epoll);
+    QFETCH(int, sockets);
+
+    struct rlimit limit;
+    if (::getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur < rlim_t(2 * sockets + 64))
+        QSKIP("The limit of open files is too low.");
+
+    // Registered, but none of them ever becomes ready
+    QVector<int> watched, peers;
+    for (int i = 0; i < sockets; i++)  {
+        int pair[2];
+        QCOMPARE(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, pair), 0);
+        watched.append(pair[0]);
+        peers.append(pair[1]);
+    }
+
+    IdleThread thread(watched);
+    if (epoll)  {
+        QAbstractEventDispatcher * dispatcher = QDaemonApplication::createEpollEventDispatcher();
+        QVERIFY(dispatcher);
+        thread.setEventDispatcher(dispatcher);
+    }
+
+    thread.start();
+    thread.blocking.acquire();
+
+    // From the wake up to the dispatcher waiting again, with all the sockets still registered
+    QAbstractEventDispatcher * dispatcher = thread.eventDispatcher();
+    QBENCHMARK  {
+        dispatcher->wakeUp();
+        thread.blocking.acquire();
+    }
+
+    thread.quit();
+    thread.wait();
+
+    foreach (int descriptor, watched + peers)
+        ::close(descriptor);
+}
+
+QTEST_GUILESS_MAIN(tst_QDaemonEventDispatcher)
+
+#include "tst_bench_qdaemoneventdispatcher.moc"
@@ -0,0 +1,4 @@
+TARGET = tst_bench_qdaemontimerwheel
+QT = core daemon testlib
+CONFIG += release
+SOURCES = tst_bench_qdaemontimerwheel.cpp
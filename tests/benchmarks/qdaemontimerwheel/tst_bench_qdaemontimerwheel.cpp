@@ -0,0 +1,159 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Konstantin Shegunov <kshegunov@gmail.com>
+**
+** This file is part of the QtDaemon library.
+**
+** The MIT License (MIT)
+**
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files (the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions:
+**
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+**
+****************************************************************************/
+
+#include <QtTest/QtTest>
+#include <QtDaemon/qdaemontimerwheel.h>
+
+// Compares the wheel with a QTimer per timeout, for the operations idle timeouts are made of
+class tst_QDaemonTimerWheel : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void startCancelWheel_data();
+    void startCancelWheel();
+    void startCancelQTimer_data();
+    void startCancelQTimer();
+
+    void restartWheel_data();
+    void restartWheel();
+    void restartQTimer_data();
+    void restartQTimer();
+
+private:
+    void timerCounts();
+};
+
+// Spread over a minute, like connection idle timeouts
+static inline int timeout(int i)
+{
+    return 1000 + (i * 7919) % 60000;
+}
+
+void tst_QDaemonTimerWheel::timerCounts()
+{
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("10k") << 10000;
+    QTest::newRow("100k") << 100000;
+    QTest::newRow("1M") << 1000000;
+}
+
+void tst_QDaemonTimerWheel::startCancelWheel_data()
+{
+    timerCounts();
+}
+
+void tst_QDaemonTimerWheel::startCancelWheel()
+{
+    QFETCH(int, count);
+
+    QDaemonTimerWheel wheel;
+    QVector<QDaemonTimerWheel::TimerId> ids(count);
+
+    QBENCHMARK  {
+        for (int i = 0; i < count; i++)
+            ids[i] = wheel.start(timeout(i), [] () -> void  { });
+        for (int i = 0; i < count; i++)
+            wheel.cancel(ids.at(i));
+    }
+}
+
+void tst_QDaemonTimerWheel::startCancelQTimer_data()
+{
+    timerCounts();
+}
+
+void tst_QDaemonTimerWheel::startCancelQTimer()
+{
+    QFETCH(int, count);
+
+    // Created beforehand, the benchmark measures the registration with the event dispatcher only
+    QVector<QTimer *> timers(count);
+    for (int i = 0; i < count; i++)
+        timers[i] = new QTimer;
+
+    QBENCHMARK  {
+        for (int i = 0; i < count; i++)
+            timers.at(i)->start(timeout(i));
+        for (int i = 0; i < count; i++)
+            timers.at(i)->stop();
+    }
+
+    qDeleteAll(timers);
+}
+
+void tst_QDaemonTimerWheel::restartWheel_data()
+{
+    timerCounts();
+}
+
+void tst_QDaemonTimerWheel::restartWheel()
+{
+    QFETCH(int, count);
+
+    QDaemonTimerWheel wheel;
+    QVector<QDaemonTimerWheel::TimerId> ids(count);
+    for (int i = 0; i < count; i++)
+        ids[i] = wheel.start(timeout(i), [] () -> void  { });
+
+    // Activity on each connection pushes its timeout back
+    QBENCHMARK  {
+        for (int i = 0; i < count; i++)
+            wheel.restart(ids.at(i), timeout(i + 1));
+    }
+
+    wheel.clear();
+}
+
+void tst_QDaemonTimerWheel::restartQTimer_data()
+{
+    timerCounts();
+}
+
+void tst_QDaemonTimerWheel::restartQTimer()
+{
+    QFETCH(int, count);
+
+    QVector<QTimer *> timers(count);
+    for (int i = 0; i < count; i++)  {
+        timers[i] = new QTimer;
+        timers.at(i)->start(timeout(i));
+    }
+
+    QBENCHMARK  {
+        for (int i = 0; i < count; i++)
+            timers.at(i)->start(timeout(i + 1));
+    }
+
+    qDeleteAll(timers);
+}
+
+QTEST_GUILESS_MAIN(tst_QDaemonTimerWheel)
+
+#include "tst_bench_qdaemontimerwheel.moc"